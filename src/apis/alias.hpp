@@ -1,15 +1,23 @@
 #pragma once
 #include <Windows.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <future>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <process.h>
 #include <sdkddkver.h>
 #include <sstream>
 #include <stdexcept>
+#include <stop_token>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -84,17 +92,128 @@ namespace Alias {
     void Cancel_IO_On_StdOut();
     void Reset_StdHandles_To_Real();
     auto Get_Terminal_Size() -> std::pair<short, short>;
+    /**
+     * Writes to the debugger's output. The console belongs to the panes, so errors can't be printed there.
+     */
+    void Debug_Log(const std::string& message);
+    /**
+     * An anonymous style pipe where the read end is opened for overlapped I/O, so it can be read through a CompletionPort.
+     * The write end is an ordinary synchronous handle.
+     */
+    void CreateOverlappedPipe(HANDLE* read_handle, HANDLE* write_handle, DWORD buffer_size);
+
+    /**
+     * An I/O completion port. Overlapped operations on associated handles complete here, and anything
+     * can be posted to wake whoever is waiting.
+     */
+    class CompletionPort {
+        public:
+        struct Completion {
+            ULONG_PTR key;
+            OVERLAPPED* overlapped;
+            DWORD bytes;
+            // 0 when the operation succeeded
+            DWORD error;
+        };
+        CompletionPort();
+        ~CompletionPort();
+        CompletionPort(const CompletionPort&) = delete;
+        auto operator=(const CompletionPort&) -> CompletionPort& = delete;
+        /**
+         * A handle can only ever be associated with one port, associating it again is ignored.
+         */
+        void associate(HANDLE handle, ULONG_PTR key);
+        void post(ULONG_PTR key, OVERLAPPED* overlapped = nullptr);
+        /**
+         * Blocks until the next completion or posted packet.
+         */
+        auto wait() -> Completion;
+
+        private:
+        HANDLE port;
+    };
+    /**
+     * Calls callback once from a thread pool thread after delay.
+     */
+    class OneShotTimer {
+        public:
+        OneShotTimer(std::chrono::milliseconds delay, std::function<void()> callback);
+        /**
+         * Cancels the timer, waiting for the callback if it is already running.
+         */
+        ~OneShotTimer();
+        OneShotTimer(const OneShotTimer&) = delete;
+        auto operator=(const OneShotTimer&) -> OneShotTimer& = delete;
+
+        private:
+        HANDLE timer = nullptr;
+        std::function<void()> callback;
+    };
+
+    /**
+     * Reads a handle on a thread of its own and queues what it reads, so nobody else ever blocks in ReadFile.
+     * Waiting for a chunk takes a stop token, requesting a stop wakes the waiter straight away.
+     */
+    class PipeReader {
+        public:
+        /**
+         * @param overlapped the handle was opened for overlapped I/O
+         */
+        explicit PipeReader(HANDLE handle, bool overlapped = false);
+        ~PipeReader();
+        PipeReader(const PipeReader&) = delete;
+        auto operator=(const PipeReader&) -> PipeReader& = delete;
+        /**
+         * Everything read since the last call, waiting up to timeout for something to arrive.
+         * @return nothing on timeout, once stop is requested or once the handle has closed
+         */
+        auto next(std::stop_token stop, std::chrono::milliseconds timeout) -> std::optional<std::string>;
+        auto next(std::stop_token stop) -> std::optional<std::string>;
+        /**
+         * The handle has closed or reading was stopped, and everything read has been taken.
+         */
+        [[nodiscard]] auto finished() -> bool;
+        /**
+         * Cancels the read in progress and waits for the thread to exit.
+         */
+        void stop();
+
+        private:
+        HANDLE handle;
+        const bool overlapped;
+        std::mutex lock;
+        std::condition_variable_any ready;
+        std::deque<std::string> chunks;
+        bool closed = false;
+        // Declared last so it starts after, and is joined before, everything it uses
+        std::jthread reader;
 
+        void run(std::stop_token stop);
+        // The caller must hold lock
+        auto take_chunks() -> std::optional<std::string>;
+    };
     class MainConsole {
         private:
         std::atomic<HANDLE> std_in;
         std::atomic<HANDLE> std_out;
+        std::mutex input_lock;
+        std::shared_ptr<PipeReader> input_reader;
+
+        auto get_input_reader() -> std::shared_ptr<PipeReader>;
 
         public: 
         MainConsole();
         ~MainConsole();
         void cancel_io();
-        auto read_input_from_console() -> std::future<std::string>;
+        /**
+         * Waits for input until timeout passes or stop is requested.
+         */
+        auto next_input(std::stop_token stop, std::chrono::milliseconds timeout) -> std::optional<std::string>;
+        auto next_input(std::stop_token stop) -> std::optional<std::string>;
+        /**
+         * Stdin has closed or reading from it has been cancelled.
+         */
+        [[nodiscard]] auto input_finished() -> bool;
         auto number_of_input_events() -> size_t;
         auto write_to_stdout(std::string_view) -> size_t;
         auto write_to_stdout(std::stringstream&) -> size_t;
@@ -105,6 +224,9 @@ namespace Alias {
         private:
         std::atomic<HANDLE> pipe_in;
         std::atomic<HANDLE> pipe_out;
+        std::mutex reader_lock;
+        // Started by the first read, so a pseudo console that is never read doesn't get a thread
+        std::shared_ptr<PipeReader> output_reader;
         public:
         using ptr = std::unique_ptr<PseudoConsole>;
         using Sptr = std::shared_ptr<PseudoConsole>;
@@ -124,8 +246,11 @@ namespace Alias {
         }
 
         ~PseudoConsole() {
-
+            // Closing the pseudo console breaks the output pipe, which is what lets the reader finish
             ClosePseudoConsole(pseudo_console_handle);
+            if(output_reader) {
+                output_reader->stop();
+            }
             if(pipe_in != 0) {
                 CloseHandle(pipe_in);
             }
@@ -133,7 +258,12 @@ namespace Alias {
                 CloseHandle(pipe_out);
             }            
         }
-        auto read_output() -> std::future<std::string>;
+        /**
+         * Output read since the last call, waiting up to timeout for some to arrive.
+         * @return nothing on timeout, once stop is requested or once the pipes are closed
+         */
+        auto next_output(std::stop_token stop, std::chrono::milliseconds timeout) -> std::optional<std::string>;
+        [[nodiscard]] auto output_finished() -> bool;
         auto read_unbuffered_output() -> std::string;
         void write_input(std::string_view input) const;
         void write_to_pty_stdout(std::string_view input) const;
@@ -145,11 +275,69 @@ namespace Alias {
         static auto get_cursor_position_as_movement() -> std::string;
         static auto get_cursor_position_as_pair() -> std::pair<unsigned int, unsigned int>;
         void process_attached(Process* process);
+        /**
+         * Stops the output reader then closes both pipes.
+         */
         void close_pipes();
+        /**
+         * The read end of the output pipe, opened for overlapped I/O. Read it either through
+         * next_output or through a CompletionPort, not both.
+         */
+        [[nodiscard]] auto output_pipe() const -> HANDLE {
+            return pipe_out;
+        }
+        /**
+         * Cancels any overlapped read in progress on the output pipe, the reader sees it as aborted.
+         */
+        void interrupt_read();
         void resize(short, short);
     };
+    /**
+     * Size of each view a MappedFile maps, anything bigger gets a view of its own.
+     */
+    constexpr size_t MAPPED_FILE_SEGMENT_SIZE = 64 * 1024 * 1024;
+    /**
+     * Views for a file that stays small, like a spill's index. Views can't be smaller than the allocation granularity.
+     */
+    constexpr size_t MAPPED_FILE_SMALL_SEGMENT_SIZE = 64 * 1024;
+    /**
+     * A temporary file that is appended to and read back through memory mapped views, so the OS decides
+     * how much of it stays in memory. The file is deleted when it is closed.
+     */
+    class MappedFile {
+        public:
+        explicit MappedFile(const std::wstring& path, size_t segment_size = MAPPED_FILE_SEGMENT_SIZE);
+        ~MappedFile();
+        MappedFile(const MappedFile&) = delete;
+        auto operator=(const MappedFile&) -> MappedFile& = delete;
+        /**
+         * Data that won't fit in what is left of the last view starts a new one.
+         * @return where the data starts
+         */
+        auto append(std::string_view data) -> size_t;
+        void write(size_t offset, std::string_view data);
+        auto read(size_t offset, size_t length) -> std::string_view;
+        [[nodiscard]] auto size() const -> size_t;
+
+        private:
+        struct Segment {
+            size_t start;
+            size_t size;
+            HANDLE mapping;
+            char* view;
+        };
+        HANDLE file;
+        const size_t segment_size;
+        std::vector<Segment> segments;
+        size_t length = 0;
+
+        auto segment_at(size_t offset, size_t count) -> Segment&;
+        void add_segment(size_t minimum_size);
+    };
     enum WAIT_RESULT { SUCCESS, TIMEOUT, R_ERROR };
     class Process {
+        HANDLE exit_wait = nullptr;
+        std::function<void()> exit_callback;
 
         public:    
         using ptr = std::unique_ptr<Process>;
@@ -167,6 +355,10 @@ namespace Alias {
             WaitForSingleObject(process_info.hProcess, timeout);
         }
         [[nodiscard]] bool stopped() const;
+        /**
+         * Calls callback from a thread pool thread once the process exits, at most once per process.
+         */
+        void on_exit(std::function<void()> callback);
         auto wait_for_idle(int timeout) const -> WAIT_RESULT {
             unsigned long actual_timeout = 0;
             if(timeout < 0) {
@@ -207,6 +399,10 @@ namespace Alias {
             }
         }
         ~Process() {
+            if(exit_wait != nullptr) {
+                // Waits for a callback that is already running
+                UnregisterWaitEx(exit_wait, INVALID_HANDLE_VALUE);
+            }
             this->kill(INFINITE);
             CloseHandle(process_info.hThread);
             CloseHandle(process_info.hProcess);
@@ -0,0 +1,72 @@
+#include "apis/alias.hpp"
+#include <atomic>
+
+void Alias::CreateOverlappedPipe(HANDLE* read_handle, HANDLE* write_handle, DWORD buffer_size) {
+    // Anonymous pipes can't do overlapped I/O, a named pipe that only we know the name of is the same thing otherwise
+    static std::atomic<unsigned long> next_pipe{0};
+    auto name = L"\\\\.\\pipe\\omux-" + std::to_wstring(GetCurrentProcessId()) + L"-" + std::to_wstring(next_pipe++);
+    SetLastError(0);
+    *read_handle = CreateNamedPipeW(name.c_str(), PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                                    PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1,
+                                    buffer_size, buffer_size, 0, nullptr);
+    if(*read_handle == INVALID_HANDLE_VALUE) {
+        check_and_throw_error("Couldn't create the read end of a pipe");
+    }
+    *write_handle = CreateFileW(name.c_str(), GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(*write_handle == INVALID_HANDLE_VALUE) {
+        CloseHandle(*read_handle);
+        check_and_throw_error("Couldn't open the write end of a pipe");
+    }
+}
+
+Alias::CompletionPort::CompletionPort() {
+    SetLastError(0);
+    port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, nullptr, 0, 0);
+    if(port == nullptr) {
+        check_and_throw_error("Couldn't create a completion port");
+    }
+}
+
+Alias::CompletionPort::~CompletionPort() {
+    CloseHandle(port);
+    SetLastError(0);
+}
+
+void Alias::CompletionPort::associate(HANDLE handle, ULONG_PTR key) {
+    if(CreateIoCompletionPort(handle, port, key, 0) == nullptr) {
+        // Already associated, there is nothing else this can fail for on a valid overlapped handle
+        SetLastError(0);
+    }
+}
+
+void Alias::CompletionPort::post(ULONG_PTR key, OVERLAPPED* overlapped) {
+    if(PostQueuedCompletionStatus(port, 0, key, overlapped) == 0) {
+        check_and_throw_error("Couldn't post to a completion port");
+    }
+}
+
+auto Alias::CompletionPort::wait() -> Completion {
+    Completion completion{0, nullptr, 0, 0};
+    if(GetQueuedCompletionStatus(port, &completion.bytes, &completion.key, &completion.overlapped, INFINITE) == 0) {
+        // A failed operation still dequeues its packet, the port itself failing leaves overlapped null
+        completion.error = GetLastError();
+        if(completion.overlapped == nullptr) {
+            check_and_throw_error("Couldn't wait on a completion port");
+        }
+        SetLastError(0);
+    }
+    return completion;
+}
+
+Alias::OneShotTimer::OneShotTimer(std::chrono::milliseconds delay, std::function<void()> callback)
+: callback(std::move(callback)) {
+    auto fire = [](void* context, BOOLEAN /*timer_fired*/) { (*static_cast<std::function<void()>*>(context))(); };
+    if(CreateTimerQueueTimer(&timer, nullptr, fire, &this->callback, static_cast<DWORD>(delay.count()), 0, WT_EXECUTEONLYONCE) == 0) {
+        check_and_throw_error("Couldn't create a timer");
+    }
+}
+
+Alias::OneShotTimer::~OneShotTimer() {
+    DeleteTimerQueueTimer(nullptr, timer, INVALID_HANDLE_VALUE);
+    SetLastError(0);
+}
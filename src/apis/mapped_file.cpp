@@ -0,0 +1,85 @@
+#include "apis/alias.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+    auto high_part(size_t value) -> DWORD {
+        return static_cast<DWORD>(static_cast<unsigned long long>(value) >> 32);
+    }
+    auto low_part(size_t value) -> DWORD {
+        return static_cast<DWORD>(value & 0xffffffff);
+    }
+} // namespace
+
+Alias::MappedFile::MappedFile(const std::wstring& path, size_t segment_size) : segment_size(segment_size) {
+    SetLastError(0);
+    file = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS,
+                       FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+    if(file == INVALID_HANDLE_VALUE) {
+        check_and_throw_error("Couldn't create mapped file");
+    }
+}
+
+Alias::MappedFile::~MappedFile() {
+    for(auto& segment : segments) {
+        UnmapViewOfFile(segment.view);
+        CloseHandle(segment.mapping);
+    }
+    CloseHandle(file);
+    SetLastError(0); // Ignore any errors generated by closing
+}
+
+void Alias::MappedFile::add_segment(size_t minimum_size) {
+    // Views have to start on the allocation granularity, which is 64KB on every version of Windows
+    constexpr size_t granularity = 64 * 1024;
+    auto start = segments.empty() ? 0 : segments.back().start + segments.back().size;
+    auto size = std::max(segment_size, (minimum_size + granularity - 1) / granularity * granularity);
+    auto end = start + size;
+
+    SetLastError(0);
+    auto mapping = CreateFileMappingW(file, nullptr, PAGE_READWRITE, high_part(end), low_part(end), nullptr);
+    if(mapping == nullptr) {
+        check_and_throw_error("Couldn't grow mapped file");
+    }
+    auto* view = static_cast<char*>(MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, high_part(start), low_part(start), size));
+    if(view == nullptr) {
+        CloseHandle(mapping);
+        check_and_throw_error("Couldn't map view of file");
+    }
+    segments.push_back(Segment{start, size, mapping, view});
+}
+
+auto Alias::MappedFile::segment_at(size_t offset, size_t count) -> Segment& {
+    auto segment = std::upper_bound(segments.begin(), segments.end(), offset,
+                                    [](size_t offset, const Segment& segment) { return offset < segment.start; });
+    if(segment == segments.begin() || offset + count > (segment - 1)->start + (segment - 1)->size) {
+        throw WindowsError("Mapped file access at " + std::to_string(offset) + " isn't inside a single view");
+    }
+    return *(segment - 1);
+}
+
+auto Alias::MappedFile::append(std::string_view data) -> size_t {
+    if(segments.empty() || length + data.size() > segments.back().start + segments.back().size) {
+        // The rest of the last view is left unused so data is never split between views
+        add_segment(data.size());
+        length = segments.back().start;
+    }
+    auto offset = length;
+    write(offset, data);
+    length += data.size();
+    return offset;
+}
+
+void Alias::MappedFile::write(size_t offset, std::string_view data) {
+    auto& segment = segment_at(offset, data.size());
+    std::memcpy(segment.view + (offset - segment.start), data.data(), data.size());
+}
+
+auto Alias::MappedFile::read(size_t offset, size_t count) -> std::string_view {
+    auto& segment = segment_at(offset, count);
+    return std::string_view{segment.view + (offset - segment.start), count};
+}
+
+auto Alias::MappedFile::size() const -> size_t {
+    return length;
+}
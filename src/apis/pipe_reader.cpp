@@ -0,0 +1,95 @@
+#include "alias.hpp"
+
+namespace Alias {
+    PipeReader::PipeReader(HANDLE handle, bool overlapped) : handle(handle), overlapped(overlapped), reader([this](std::stop_token stop) { run(stop); }) {
+    }
+    PipeReader::~PipeReader() {
+        stop();
+    }
+    auto PipeReader::next(std::stop_token stop, std::chrono::milliseconds timeout) -> std::optional<std::string> {
+        std::unique_lock guard(lock);
+        ready.wait_for(guard, stop, timeout, [&]() { return !chunks.empty() || closed; });
+        return take_chunks();
+    }
+    auto PipeReader::next(std::stop_token stop) -> std::optional<std::string> {
+        std::unique_lock guard(lock);
+        ready.wait(guard, stop, [&]() { return !chunks.empty() || closed; });
+        return take_chunks();
+    }
+    auto PipeReader::take_chunks() -> std::optional<std::string> {
+        if(chunks.empty()) {
+            return std::nullopt;
+        }
+        // Hand over everything that has queued up, the reader can get ahead of a busy consumer
+        auto output = std::move(chunks.front());
+        chunks.pop_front();
+        for(const auto& chunk : chunks) {
+            output += chunk;
+        }
+        chunks.clear();
+        return output;
+    }
+    auto PipeReader::finished() -> bool {
+        std::scoped_lock guard(lock);
+        return closed && chunks.empty();
+    }
+    void PipeReader::stop() {
+        reader.request_stop();
+        std::unique_lock guard(lock);
+        while(!closed) {
+            guard.unlock();
+            // The stop can land between the reader checking for it and starting the next read,
+            // so keep cancelling until the reader says it is done
+            CancelSynchronousIo(reader.native_handle());
+            if(overlapped) {
+                CancelIoEx(handle, nullptr);
+            }
+            guard.lock();
+            ready.wait_for(guard, std::chrono::milliseconds(1), [&]() { return closed; });
+        }
+        guard.unlock();
+        if(reader.joinable()) {
+            reader.join();
+        }
+    }
+    void PipeReader::run(std::stop_token stop) {
+        OVERLAPPED read_overlapped{};
+        HANDLE event = nullptr;
+        if(overlapped) {
+            event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+            // The low bit keeps the completion off any completion port the handle is associated with
+            read_overlapped.hEvent = reinterpret_cast<HANDLE>(reinterpret_cast<ULONG_PTR>(event) | 1);
+        }
+        while(!stop.stop_requested()) {
+            std::string chunk(READ_BUFFER_SIZE, '\0');
+            DWORD bytes_read = 0;
+            auto size = static_cast<DWORD>(chunk.size() * sizeof(char));
+            bool read = false;
+            if(overlapped) {
+                read = (ReadFile(handle, chunk.data(), size, nullptr, &read_overlapped) != 0 || GetLastError() == ERROR_IO_PENDING) &&
+                       GetOverlappedResult(handle, &read_overlapped, &bytes_read, TRUE) != 0;
+            } else {
+                read = ReadFile(handle, chunk.data(), size, &bytes_read, nullptr) != 0;
+            }
+            // Cancelled reads, broken pipes and closed handles all mean there is nothing more to read
+            if(!read || bytes_read == 0) {
+                break;
+            }
+            chunk.resize(bytes_read / sizeof(char));
+            {
+                std::scoped_lock guard(lock);
+                chunks.push_back(std::move(chunk));
+            }
+            ready.notify_all();
+        }
+        if(event != nullptr) {
+            CloseHandle(event);
+        }
+        SetLastError(0);
+        {
+            std::scoped_lock guard(lock);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+} // namespace Alias
@@ -14,17 +14,46 @@ namespace Alias {
         
     }
     void MainConsole::cancel_io() {
-        //SetLastError(0);
-        DWORD error = 0;
-        if(CancelIoEx(this->std_in, nullptr) == 0) {
-            error = GetLastError();
+        std::shared_ptr<PipeReader> reader;
+        {
+            std::scoped_lock lock(input_lock);
+            reader = std::exchange(input_reader, nullptr);
+            this->std_in = nullptr;
         }
-        if(CancelIoEx(this->std_out, nullptr) == 0) {
-            error = 0;
-            error = GetLastError();
+        if(reader) {
+            reader->stop();
         }
-        this->std_in = nullptr;
+        CancelIoEx(this->std_out, nullptr);
         this->std_out = nullptr;
+        SetLastError(0);
+    }
+    auto MainConsole::get_input_reader() -> std::shared_ptr<PipeReader> {
+        std::scoped_lock lock(input_lock);
+        if(!input_reader && std_in != nullptr) {
+            input_reader = std::make_shared<PipeReader>(std_in);
+        }
+        return input_reader;
+    }
+    auto MainConsole::next_input(std::stop_token stop, std::chrono::milliseconds timeout) -> std::optional<std::string> {
+        auto reader = get_input_reader();
+        if(!reader) {
+            return std::nullopt;
+        }
+        return reader->next(stop, timeout);
+    }
+    auto MainConsole::next_input(std::stop_token stop) -> std::optional<std::string> {
+        auto reader = get_input_reader();
+        if(!reader) {
+            return std::nullopt;
+        }
+        return reader->next(stop);
+    }
+    auto MainConsole::input_finished() -> bool {
+        std::scoped_lock lock(input_lock);
+        if(!input_reader) {
+            return std_in == nullptr;
+        }
+        return input_reader->finished();
     }
     auto MainConsole::number_of_input_events() -> size_t {
         DWORD number_of_events = 0;
@@ -51,20 +80,17 @@ namespace Alias {
     auto MainConsole::write_character_to_stdout(char output) -> bool {
         return static_cast<bool>(WriteFile(this->std_out, &output, 1, nullptr, nullptr));
     }
-    auto MainConsole::read_input_from_console() -> std::future<std::string> {
-        return std::async(std::launch::async, [&, this]() {
-            std::string input(16, '\0');
-            DWORD bytes_read = 0;
-            if(std_in != nullptr && ReadFile(std_in, input.data(), input.size() * sizeof(char), &bytes_read, nullptr) == 0) {
-                check_and_throw_error("Couldn't read from stdin");
-            }
-            
-
-            return input.substr(0, bytes_read / sizeof(char));
-        });
-    }
     void MainConsole::reset_stdio() {
-        this->std_out = GetStdHandle(STD_OUTPUT_HANDLE);
-        this->std_in = GetStdHandle(STD_INPUT_HANDLE);
+        std::shared_ptr<PipeReader> reader;
+        {
+            std::scoped_lock lock(input_lock);
+            // The next read starts a reader on the new handle
+            reader = std::exchange(input_reader, nullptr);
+            this->std_out = GetStdHandle(STD_OUTPUT_HANDLE);
+            this->std_in = GetStdHandle(STD_INPUT_HANDLE);
+        }
+        if(reader) {
+            reader->stop();
+        }
     }
 } // namespace Alias
\ No newline at end of file
@@ -29,4 +29,11 @@ auto Alias::Process::stopped() const -> bool {
     DWORD exit_code = 0;
     GetExitCodeProcess(this->process_info.hProcess, &exit_code);
     return exit_code != STILL_ACTIVE;
-}
\ No newline at end of file
+}
+void Alias::Process::on_exit(std::function<void()> callback) {
+    exit_callback = std::move(callback);
+    auto notify = [](void* context, BOOLEAN /*timed_out*/) { static_cast<Alias::Process*>(context)->exit_callback(); };
+    if(RegisterWaitForSingleObject(&exit_wait, process_info.hProcess, notify, this, INFINITE, WT_EXECUTEONLYONCE) == 0) {
+        check_and_throw_error("Couldn't wait for the process to exit");
+    }
+}
@@ -1,4 +1,26 @@
 #include "alias.hpp"
+
+namespace {
+    /**
+     * The output pipe is opened for overlapped I/O, so even a blocking read needs an OVERLAPPED to wait on.
+     */
+    auto read_overlapped_pipe(HANDLE pipe, char* buffer, DWORD size) -> DWORD {
+        OVERLAPPED overlapped{};
+        auto event = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        // The low bit keeps the completion off any completion port the pipe is associated with
+        overlapped.hEvent = reinterpret_cast<HANDLE>(reinterpret_cast<ULONG_PTR>(event) | 1);
+        DWORD bytes_read = 0;
+        auto done = ReadFile(pipe, buffer, size, nullptr, &overlapped) != 0 || GetLastError() == ERROR_IO_PENDING;
+        if(done && GetOverlappedResult(pipe, &overlapped, &bytes_read, TRUE) == 0) {
+            done = false;
+        }
+        CloseHandle(event);
+        if(!done) {
+            Alias::check_and_throw_error("Failed to read from console");
+        }
+        return bytes_read;
+    }
+} // namespace
 auto Alias::CreatePseudoConsole(int x, int y, short columns, short rows) noexcept(false) -> Alias::PseudoConsole::ptr {
     SetLastError(0);
     HRESULT hr{E_UNEXPECTED};
@@ -12,9 +34,8 @@ auto Alias::CreatePseudoConsole(int x, int y, short columns, short rows) noexcep
     if(CreatePipe(&pty_stdin_pipe, &pipe_write_handle, nullptr, Alias::READ_BUFFER_SIZE * sizeof(char)) == 0) {
         check_and_throw_error();
     }
-    if(CreatePipe(&pipe_read_handle, &pty_stdout_pipe, nullptr, Alias::READ_BUFFER_SIZE * sizeof(char)) == 0) {
-        check_and_throw_error();
-    }    
+    // Our end of the output is read through the executor's completion port
+    CreateOverlappedPipe(&pipe_read_handle, &pty_stdout_pipe, Alias::READ_BUFFER_SIZE * sizeof(char));
     // SHORT rows_adjusted = rows + ScreenBufferInfo.dwSize.Y+1;
     COORD consoleSize{columns, rows};
 
@@ -44,7 +65,10 @@ void Alias::PseudoConsole::process_attached(Alias::Process* process) {
 
     std::string output(4, '\0');
     DWORD bytes_read = 0;
-    ReadFile(this->pipe_out, output.data(), output.size(), &bytes_read, nullptr);
+    try {
+        bytes_read = read_overlapped_pipe(this->pipe_out, output.data(), static_cast<DWORD>(output.size()));
+    } catch(Alias::WindowsError&) {
+    }
     if(bytes_read == 4 && std::string{"\x1b[6n"} == output) {
         auto cursor_pos = this->get_cursor_position_as_vt(this->x, this->y);
         DWORD bytes_written = 0;
@@ -64,10 +88,15 @@ void Alias::PseudoConsole::process_attached(Alias::Process* process) {
     //);
 }
 void Alias::PseudoConsole::close_pipes() {
-    
-    
+    std::shared_ptr<PipeReader> reader;
+    {
+        std::scoped_lock lock(reader_lock);
+        reader = std::exchange(output_reader, nullptr);
+    }
+    if(reader) {
+        reader->stop();
+    }
     CancelIoEx(this->pipe_in, nullptr);
-    CancelIoEx(this->pipe_out, nullptr);
     
     CloseHandle(pipe_in);
     CloseHandle(pipe_out);
@@ -77,18 +106,34 @@ void Alias::PseudoConsole::close_pipes() {
     
     SetLastError(0);
 }
-auto Alias::PseudoConsole::read_output() -> std::future<std::string> {
-    return std::async(std::launch::async, [&]() {
-        std::string chars(Alias::READ_BUFFER_SIZE, '\0');
-        DWORD bytes_read = 0;
-        if(pipe_out != 0 && ReadFile(this->pipe_out, chars.data(), Alias::READ_BUFFER_SIZE * sizeof(char), &bytes_read, nullptr) == 0) {
-            check_and_throw_error("Failed to read from console");
-            
+auto Alias::PseudoConsole::next_output(std::stop_token stop, std::chrono::milliseconds timeout) -> std::optional<std::string> {
+    std::shared_ptr<PipeReader> reader;
+    {
+        std::scoped_lock lock(reader_lock);
+        if(!output_reader && pipe_out != 0) {
+            output_reader = std::make_shared<PipeReader>(pipe_out, true);
         }
-        last_read_in = chars.substr(0, bytes_read / sizeof(char));
-        // Want to move the iterator to first instance of the new strings
-        return chars.substr(0, bytes_read / sizeof(char));
-    });
+        reader = output_reader;
+    }
+    if(!reader) {
+        return std::nullopt;
+    }
+    auto output = reader->next(stop, timeout);
+    if(output) {
+        last_read_in = *output;
+    }
+    return output;
+}
+void Alias::PseudoConsole::interrupt_read() {
+    CancelIoEx(this->pipe_out, nullptr);
+    SetLastError(0);
+}
+auto Alias::PseudoConsole::output_finished() -> bool {
+    std::scoped_lock lock(reader_lock);
+    if(!output_reader) {
+        return pipe_out == 0;
+    }
+    return output_reader->finished();
 }
 
 auto Alias::PseudoConsole::read_unbuffered_output() -> std::string {
@@ -97,9 +142,7 @@ auto Alias::PseudoConsole::read_unbuffered_output() -> std::string {
 
     DWORD bytes_read = 0;
     do {
-        if(!static_cast<bool>(ReadFile(this->pipe_out, chars.data(), Alias::READ_BUFFER_SIZE * sizeof(char), &bytes_read, nullptr))) {
-            check_and_throw_error("Failed to read from console");
-        }
+        bytes_read = read_overlapped_pipe(this->pipe_out, chars.data(), Alias::READ_BUFFER_SIZE * sizeof(char));
         output.append(chars.data(), bytes_read);
 
     } while(this->bytes_in_read_pipe() > 0);
@@ -283,4 +283,7 @@ auto Alias::Get_Terminal_Size() -> std::pair<short, short> {
     auto conout = CreateFile(L"CONOUT$", GENERIC_WRITE | GENERIC_READ, FILE_SHARE_WRITE, 0, OPEN_EXISTING, 0, 0);
     auto terminal_info = Alias::GetCursorInfo(conout);
     return std::make_pair(terminal_info.dwSize.X, terminal_info.dwSize.Y);
-}
\ No newline at end of file
+}
+void Alias::Debug_Log(const std::string& message) {
+    OutputDebugStringA(message.c_str());
+}
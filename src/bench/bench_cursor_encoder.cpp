@@ -0,0 +1,101 @@
+#include "catch.hpp"
+#include "omux/cursor_encoder.hpp"
+#include "omux/terminal_model.hpp"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace omux;
+
+namespace {
+    constexpr int screen_width = 120;
+    constexpr int screen_height = 50;
+
+    /**
+     * Reads of something like what PSReadLine and a directory listing put out, a few lines at a time.
+     */
+    auto corpus(size_t lines) -> std::vector<std::string> {
+        std::vector<std::string> chunks;
+        std::string chunk;
+        for(size_t i = 0; i < lines; i++) {
+            chunk += "\x1b[?25l\x1b[93mGet-ChildItem\x1b[?25h\x1b[m \x1b[90m-Path\x1b[m C:\\projects\\omux\\build\\" +
+                     std::to_string(i) + "\x1b[?25h\x1b[?25l\r\n";
+            if(i % 4 == 3) {
+                chunks.push_back(std::move(chunk));
+                chunk.clear();
+            }
+        }
+        return chunks;
+    }
+
+    /**
+     * What a pane at column x writes to the host for the chunks, the way Process does on the main screen,
+     * with every move absolute like it used to be or with the cheapest one from the encoder.
+     * The pane is repainted every so often, as scrolling back does.
+     */
+    auto pane_output(const std::vector<std::string>& chunks, int x, bool encoded) -> std::pair<size_t, uint64_t> {
+        TerminalModel host{screen_width, screen_height};
+        CursorEncoder cursor;
+        cursor.set_screen_size(screen_width, screen_height);
+        auto origin_column = std::max(x, 1);
+        auto pane_width = screen_width - origin_column + 1;
+        std::pair<int, int> saved{origin_column, 1};
+        size_t bytes = 0;
+        auto write = [&](std::string_view output) {
+            bytes += output.size();
+            host.write(output);
+            cursor.wrote(output);
+        };
+        auto absolute = [](int column, int row) { return "\x1b[" + std::to_string(row) + ";" + std::to_string(column) + "H"; };
+        for(size_t i = 0; i < chunks.size(); i++) {
+            write(encoded ? cursor.movement_to(saved.first, saved.second) : absolute(saved.first, saved.second));
+            for(auto character : chunks[i]) {
+                if(character == '\r') {
+                    write(encoded ? cursor.movement_to(origin_column, std::nullopt) : "\r\x1b[" + std::to_string(x) + "G");
+                } else if(character == '\n') {
+                    auto after = cursor;
+                    after.wrote("\n");
+                    write(encoded ? "\n" + after.movement_to(origin_column, std::nullopt) : "\n\x1b[" + std::to_string(x) + "G");
+                } else {
+                    write(std::string_view{&character, 1});
+                }
+            }
+            if(i % 64 == 63) {
+                for(int row = 1; row <= screen_height; row++) {
+                    write(encoded ? cursor.movement_to(origin_column, row) : absolute(origin_column, row));
+                    write("\x1b[" + std::to_string(pane_width) + "X" + std::to_string(i) + " repainted");
+                }
+                write(encoded ? cursor.movement_to(saved.first, saved.second) : absolute(saved.first, saved.second));
+            }
+            auto [column, row] = host.cursor();
+            saved = {column + 1, row + 1};
+            cursor.reported(saved.first, saved.second);
+        }
+        return {bytes, host.screen_hash()};
+    }
+} // namespace
+
+TEST_CASE("Cursor movement") {
+    auto chunks = corpus(20000);
+    for(auto x : {0, 41}) {
+        auto [absolute_bytes, absolute_screen] = pane_output(chunks, x, false);
+        auto [encoded_bytes, encoded_screen] = pane_output(chunks, x, true);
+        REQUIRE(absolute_screen == encoded_screen);
+        std::cout << "Pane at column " << x << ": " << absolute_bytes << " bytes with absolute movement, " << encoded_bytes
+                  << " with the encoder (" << 100 - encoded_bytes * 100 / absolute_bytes << "% saved)" << std::endl;
+    }
+
+    CursorEncoder encoder;
+    encoder.set_screen_size(screen_width, screen_height);
+    encoder.wrote("\x1b[20;41H");
+    BENCHMARK("Follow the corpus") {
+        for(const auto& chunk : chunks) {
+            encoder.wrote(chunk);
+        }
+        return encoder.get_state().row;
+    };
+    BENCHMARK("Pick a movement") {
+        return encoder.movement_to(41, 12);
+    };
+}
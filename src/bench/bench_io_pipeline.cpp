@@ -0,0 +1,135 @@
+#include "catch.hpp"
+#include "omux/io_executor.hpp"
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace omux;
+
+namespace {
+    constexpr size_t PANES = 512;
+    constexpr size_t CHUNK_BYTES = 4096;
+    constexpr size_t CHUNKS_PER_PANE = 8;
+    constexpr size_t BYTES_PER_ROUND = PANES * CHUNK_BYTES * CHUNKS_PER_PANE;
+
+    /**
+     * One pipe per pane, standing in for the pseudo console output pipes.
+     */
+    struct Pipes {
+        std::vector<HANDLE> read_ends;
+        std::vector<HANDLE> write_ends;
+        Pipes() {
+            for(size_t i = 0; i < PANES; i++) {
+                HANDLE read_end = nullptr;
+                HANDLE write_end = nullptr;
+                Alias::CreateOverlappedPipe(&read_end, &write_end, Alias::READ_BUFFER_SIZE);
+                read_ends.push_back(read_end);
+                write_ends.push_back(write_end);
+            }
+        }
+        ~Pipes() {
+            for(auto* handle : write_ends) {
+                CloseHandle(handle);
+            }
+            for(auto* handle : read_ends) {
+                CloseHandle(handle);
+            }
+        }
+        /**
+         * Writes a round of output to every pane in turn, like a lot of busy panes would.
+         */
+        void write_round() {
+            std::string chunk(CHUNK_BYTES, 'x');
+            for(size_t i = 0; i < CHUNKS_PER_PANE; i++) {
+                for(auto* handle : write_ends) {
+                    DWORD written = 0;
+                    WriteFile(handle, chunk.data(), static_cast<DWORD>(chunk.size()), &written, nullptr);
+                }
+            }
+        }
+    };
+
+    void wait_for(std::atomic<size_t>& received, size_t target) {
+        for(auto seen = received.load(); seen < target; seen = received.load()) {
+            received.wait(seen);
+        }
+    }
+
+    auto count_output(HANDLE pipe, std::stop_token stop, std::atomic<size_t>& received, std::atomic<size_t>& finished) -> DetachedTask {
+        while(true) {
+            auto output = co_await IoExecutor::read(pipe, stop);
+            if(output.bytes.empty()) {
+                if(output.closed || stop.stop_requested()) {
+                    break;
+                }
+                continue;
+            }
+            received += output.bytes.size();
+            received.notify_all();
+        }
+        finished++;
+        finished.notify_all();
+    }
+} // namespace
+
+TEST_CASE("Pane output pipeline") {
+    std::cout << PANES << " panes, " << BYTES_PER_ROUND / 1024 << "KB of output a round" << std::endl;
+
+    SECTION("Thread per pane") {
+        Pipes pipes;
+        std::atomic<size_t> received{0};
+        std::vector<std::jthread> readers;
+        for(auto* pipe : pipes.read_ends) {
+            readers.emplace_back([pipe, &received](std::stop_token stop) {
+                std::string buffer(Alias::READ_BUFFER_SIZE, '\0');
+                OVERLAPPED overlapped{};
+                overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+                while(!stop.stop_requested()) {
+                    DWORD bytes = 0;
+                    auto read = (ReadFile(pipe, buffer.data(), static_cast<DWORD>(buffer.size()), nullptr, &overlapped) != 0 ||
+                                 GetLastError() == ERROR_IO_PENDING) &&
+                                GetOverlappedResult(pipe, &overlapped, &bytes, TRUE) != 0;
+                    if(!read) {
+                        break;
+                    }
+                    received += bytes;
+                    received.notify_all();
+                }
+                CloseHandle(overlapped.hEvent);
+            });
+        }
+        size_t target = 0;
+        BENCHMARK("Read a round") {
+            target += BYTES_PER_ROUND;
+            pipes.write_round();
+            wait_for(received, target);
+        };
+        for(auto& reader : readers) {
+            reader.request_stop();
+        }
+        for(auto* pipe : pipes.read_ends) {
+            CancelIoEx(pipe, nullptr);
+        }
+    }
+    SECTION("Coroutines on the I/O executor") {
+        Pipes pipes;
+        IoExecutor executor;
+        std::atomic<size_t> received{0};
+        std::atomic<size_t> finished{0};
+        std::stop_source stop;
+        for(auto* pipe : pipes.read_ends) {
+            executor.associate(pipe);
+            executor.spawn(count_output(pipe, stop.get_token(), received, finished));
+        }
+        size_t target = 0;
+        BENCHMARK("Read a round") {
+            target += BYTES_PER_ROUND;
+            pipes.write_round();
+            wait_for(received, target);
+        };
+        stop.request_stop();
+        wait_for(finished, PANES);
+    }
+}
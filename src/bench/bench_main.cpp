@@ -0,0 +1,3 @@
+// This tells Catch to provide a main(), the benchmarks are turned on for this target in CMakeLists.txt
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
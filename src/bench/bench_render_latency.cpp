@@ -0,0 +1,204 @@
+#include "catch.hpp"
+#include "omux/render_scheduler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace omux;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    // What a write to the host costs on top of its bytes, and the bytes a second it takes after that
+    constexpr auto HOST_WRITE_OVERHEAD = std::chrono::microseconds(60);
+    constexpr double HOST_BYTES_PER_SECOND = 200.0 * 1024 * 1024;
+    constexpr size_t READ_BYTES = 4096;
+
+    enum class Mode {
+        // Every read is shown as soon as it comes in, like before there were frames
+        every_read,
+        // Every read waits for the frame, echoes included
+        frame_cap,
+        adaptive,
+    };
+
+    void spin_for(Clock::duration duration) {
+        auto until = Clock::now() + duration;
+        while(Clock::now() < until) {
+        }
+    }
+
+    /**
+     * A pane whose output goes to a host that is slow to write to, the way a console host is.
+     */
+    class SimulatedPane : public RenderTarget {
+        public:
+        SimulatedPane(RenderScheduler& scheduler, Mode mode) : scheduler(scheduler), mode(mode) {
+        }
+        /**
+         * Hands a read over the way Process does.
+         * @return bytes waiting to be shown
+         */
+        auto output(std::string_view chunk) -> size_t {
+            size_t backlog = 0;
+            {
+                std::scoped_lock lock(pending_lock);
+                pending.append(chunk);
+                backlog = pending.size();
+            }
+            if(mode == Mode::every_read) {
+                scheduler.schedule(this);
+            } else {
+                scheduler.schedule_output(this, chunk.size(), backlog);
+            }
+            return backlog;
+        }
+        auto render_pending() -> bool override {
+            size_t slice = 0;
+            bool more = false;
+            {
+                std::scoped_lock lock(pending_lock);
+                slice = std::min(pending.size(), PANE_RENDER_SLICE);
+                pending.erase(0, slice);
+                more = !pending.empty();
+            }
+            if(slice > 0) {
+                auto cost = HOST_WRITE_OVERHEAD + std::chrono::nanoseconds(static_cast<long long>(static_cast<double>(slice) * 1e9 / HOST_BYTES_PER_SECOND));
+                spin_for(cost);
+                writes++;
+                host_time += cost;
+                shown += slice;
+                shown.notify_all();
+            }
+            return more;
+        }
+        auto backlog() -> size_t {
+            std::scoped_lock lock(pending_lock);
+            return pending.size();
+        }
+
+        std::atomic<size_t> shown{0};
+        // Only touched while rendering
+        size_t writes = 0;
+        Clock::duration host_time{};
+
+        private:
+        RenderScheduler& scheduler;
+        Mode mode;
+        std::mutex pending_lock;
+        std::string pending;
+    };
+
+    void wait_until_shown(SimulatedPane& pane, size_t bytes) {
+        for(auto seen = pane.shown.load(); seen < bytes; seen = pane.shown.load()) {
+            pane.shown.wait(seen);
+        }
+    }
+
+    struct Bulk {
+        double megabytes_per_second;
+        size_t writes;
+        double host_busy;
+    };
+
+    /**
+     * Streams bytes through a pane in reads, holding back at the backlog limit like a pane's reads do.
+     * @param pause time between reads, none to go as fast as the host takes them
+     */
+    auto bulk_output(Mode mode, size_t bytes, Clock::duration pause) -> Bulk {
+        std::mutex output_lock;
+        RenderScheduler scheduler{output_lock};
+        SimulatedPane pane{scheduler, mode};
+        std::string chunk(READ_BYTES, 'x');
+        auto start = Clock::now();
+        for(size_t sent = 0; sent < bytes; sent += chunk.size()) {
+            if(pane.output(chunk) >= PANE_BACKLOG_LIMIT) {
+                while(pane.backlog() >= PANE_BACKLOG_LIMIT) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                }
+            }
+            if(pause > Clock::duration::zero()) {
+                spin_for(pause);
+            }
+        }
+        wait_until_shown(pane, bytes);
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+        std::scoped_lock lock(output_lock);
+        return Bulk{static_cast<double>(bytes) / (1024 * 1024) / elapsed.count(), pane.writes,
+                    std::chrono::duration<double>(pane.host_time).count() / elapsed.count()};
+    }
+
+    /**
+     * Times keystroke echoes from their read to the host while another pane floods.
+     * @return milliseconds each echo took, sorted
+     */
+    auto echo_latencies(Mode mode, size_t keystrokes) -> std::vector<double> {
+        std::mutex output_lock;
+        RenderScheduler scheduler{output_lock};
+        SimulatedPane shell{scheduler, mode};
+        SimulatedPane flood{scheduler, mode};
+        std::jthread flooding([&](std::stop_token stop) {
+            std::string chunk(READ_BYTES, 'x');
+            while(!stop.stop_requested()) {
+                if(flood.output(chunk) >= PANE_BACKLOG_LIMIT) {
+                    while(flood.backlog() >= PANE_BACKLOG_LIMIT && !stop.stop_requested()) {
+                        std::this_thread::sleep_for(std::chrono::microseconds(200));
+                    }
+                }
+            }
+        });
+        // What PSReadLine sends back for a key, the character and a cursor dance around it
+        std::string echo{"\x1b[?25la\x1b[?25h"};
+        std::vector<double> latencies;
+        for(size_t i = 0; i < keystrokes; i++) {
+            if(mode != Mode::frame_cap) {
+                scheduler.input_forwarded();
+            }
+            // The pseudo console takes a moment to echo
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            auto target = shell.shown + echo.size();
+            auto read = Clock::now();
+            shell.output(echo);
+            wait_until_shown(shell, target);
+            latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - read).count());
+            std::this_thread::sleep_for(std::chrono::milliseconds(3));
+        }
+        flooding.request_stop();
+        flooding.join();
+        std::sort(latencies.begin(), latencies.end());
+        return latencies;
+    }
+
+    auto percentile(const std::vector<double>& sorted, double fraction) -> double {
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * static_cast<double>(sorted.size())))];
+    }
+} // namespace
+
+TEST_CASE("Render latency") {
+    constexpr size_t flood_bytes = 64 * 1024 * 1024;
+    constexpr size_t stream_bytes = 16 * 1024 * 1024;
+    constexpr size_t keystrokes = 400;
+    // A build log or tail -f, well within what the host can take
+    constexpr auto stream_pause = std::chrono::microseconds(100);
+    for(auto mode : {Mode::every_read, Mode::frame_cap, Mode::adaptive}) {
+        auto name = mode == Mode::every_read ? "Every read straight away" : mode == Mode::frame_cap ? "Every read at the frame cap" : "Adaptive";
+        auto latencies = echo_latencies(mode, keystrokes);
+        auto flood = bulk_output(mode, flood_bytes, Clock::duration::zero());
+        auto stream = bulk_output(mode, stream_bytes, stream_pause);
+        std::cout << name << ":\n  echo p50 " << percentile(latencies, 0.5) << "ms, p99 " << percentile(latencies, 0.99)
+                  << "ms with another pane flooding\n  flood " << flood.megabytes_per_second << " MB/s in " << flood.writes
+                  << " host writes\n  stream " << stream.megabytes_per_second << " MB/s in " << stream.writes
+                  << " host writes, host busy " << stream.host_busy * 100 << "% of the time" << std::endl;
+    }
+
+    std::mutex output_lock;
+    RenderScheduler scheduler{output_lock};
+    SimulatedPane pane{scheduler, Mode::adaptive};
+    BENCHMARK("Schedule a read") {
+        scheduler.schedule_output(&pane, READ_BYTES, READ_BYTES);
+    };
+}
@@ -0,0 +1,48 @@
+#include "catch.hpp"
+#include "omux/scroll_buffer.hpp"
+#include <iostream>
+#include <string>
+
+using namespace omux;
+
+namespace {
+    /**
+     * Something like what PSReadLine and a directory listing put out, mostly sequences around a little text.
+     */
+    auto fill(ScrollBuffer& buffer, size_t lines) -> size_t {
+        size_t bytes = 0;
+        for(size_t i = 0; i < lines; i++) {
+            auto line = "\x1b[?25l\x1b[93mGet-ChildItem\x1b[?25h\x1b[m \x1b[90m-Path\x1b[m C:\\projects\\omux\\build\\" +
+                        std::to_string(i) + "\x1b[?25h\x1b[?25l\r\n";
+            bytes += line.size();
+            buffer.append(line);
+        }
+        return bytes;
+    }
+} // namespace
+
+TEST_CASE("Cold scrollback") {
+    constexpr size_t lines = 200000;
+    constexpr size_t height = 50;
+    ScrollBuffer buffer{120, height};
+    auto output_bytes = fill(buffer, lines);
+    BlockCompressor::global().wait_until_idle();
+
+    auto memory = buffer.memory_usage();
+    std::cout << "Output: " << output_bytes << " bytes, held in " << memory << " bytes ("
+              << 100 - memory * 100 / output_bytes << "% saved), " << buffer.compressed_blocks()
+              << " compressed blocks" << std::endl;
+
+    // Each page is far enough from the last to land in a block that isn't cached
+    size_t page = 0;
+    BENCHMARK("Scroll a page into cold history") {
+        page = (page + SCROLL_BUFFER_BLOCK_ROWS * (SCROLL_BUFFER_CACHED_BLOCKS + 1)) % (lines - height);
+        return buffer.rows_above(page, height);
+    };
+    BENCHMARK("Scroll a page within cached history") {
+        return buffer.rows_above(lines / 2, height);
+    };
+    BENCHMARK("Search cold history") {
+        return buffer.find(SearchPattern{"build\\\\12345$", true}, buffer.line_count(), true);
+    };
+}
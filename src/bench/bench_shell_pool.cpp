@@ -0,0 +1,94 @@
+#include "catch.hpp"
+#include "omux/console.hpp"
+#include "omux/shell_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace omux;
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+    constexpr size_t SPLITS = 10;
+    constexpr auto PROMPT_TIMEOUT = std::chrono::seconds(10);
+    constexpr auto SHELL_ARGS = L" -nop";
+
+    auto has_prompt(const Console& pane) -> bool {
+        auto snapshot = pane.snapshot();
+        return std::any_of(snapshot->screen.begin(), snapshot->screen.end(), [](const std::string& row) { return row.find("PS ") != std::string::npos; });
+    }
+
+    /**
+     * Splits the first pane and times until the new pane shows pwsh's prompt, then closes the pane again.
+     * @param pool where splits take their shells from, nothing to start one for each split like before there was a pool
+     * @return milliseconds each split took to its prompt, sorted
+     */
+    auto split_to_prompt(const std::shared_ptr<PrimaryConsole>& primary_console, Console& first, const std::shared_ptr<ShellPool>& pool) -> std::vector<double> {
+        primary_console->set_shell_pool(pool);
+        std::vector<double> latencies;
+        for(size_t i = 0; i < SPLITS; i++) {
+            if(pool) {
+                // Splits by hand aren't back to back, the pool has time to catch up between them
+                pool->wait_until_full(PROMPT_TIMEOUT);
+            }
+            primary_console->set_active(&first);
+            auto split_at = Clock::now();
+            auto pane = primary_console->split_active_console(VERT);
+            std::optional<Process> shell;
+            if(!pane->is_running()) {
+                shell.emplace(pane, PWSH_CONSOLE_PATH, SHELL_ARGS);
+            }
+            while(!has_prompt(*pane) && Clock::now() - split_at < PROMPT_TIMEOUT) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            latencies.push_back(std::chrono::duration<double, std::milli>(Clock::now() - split_at).count());
+
+            if(!shell) {
+                primary_console->set_active(pane.get());
+                primary_console->write_input("exit\r");
+                pane->wait_for_process_to_stop(static_cast<int>(std::chrono::milliseconds(PROMPT_TIMEOUT).count()));
+            }
+            shell.reset();
+            // A pooled pane is let go of by the pool once its shell has exited
+            std::weak_ptr<Console> closing = pane;
+            pane.reset();
+            while(!closing.expired()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+        primary_console->set_shell_pool({});
+        std::sort(latencies.begin(), latencies.end());
+        return latencies;
+    }
+
+    auto percentile(const std::vector<double>& sorted, double fraction) -> double {
+        return sorted[std::min(sorted.size() - 1, static_cast<size_t>(fraction * static_cast<double>(sorted.size())))];
+    }
+} // namespace
+
+TEST_CASE("Split to prompt") {
+    try {
+        Alias::SetupConsoleHost();
+    } catch(std::logic_error& ex) {
+    }
+    {
+        auto primary_console = std::make_shared<PrimaryConsole>();
+        auto terminal_size = primary_console->get_terminal_size();
+        auto first = std::make_shared<Console>(primary_console, terminal_size);
+        Process first_shell{first, PWSH_CONSOLE_PATH, SHELL_ARGS};
+
+        auto cold = split_to_prompt(primary_console, *first, nullptr);
+        auto pool = std::make_shared<ShellPool>(primary_console, PWSH_CONSOLE_PATH, SHELL_ARGS, terminal_size);
+        auto warm = split_to_prompt(primary_console, *first, pool);
+        for(auto [name, latencies] : {std::pair{"Shell started on split", &cold}, std::pair{"Shell from the pool", &warm}}) {
+            std::cout << name << ":\n  split to prompt p50 " << percentile(*latencies, 0.5) << "ms, p99 " << percentile(*latencies, 0.99)
+                      << "ms over " << latencies->size() << " splits" << std::endl;
+        }
+    }
+    Alias::ReverseSetupConsoleHost();
+}
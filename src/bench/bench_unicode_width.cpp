@@ -0,0 +1,75 @@
+#include "catch.hpp"
+#include "omux/scroll_buffer.hpp"
+#include "omux/unicode_width.hpp"
+#include <iostream>
+#include <string>
+
+using namespace omux;
+
+namespace {
+    /**
+     * Lines of a build log, nearly all ASCII.
+     */
+    auto ascii_corpus(size_t lines) -> std::string {
+        std::string corpus;
+        for(size_t i = 0; i < lines; i++) {
+            corpus += "[" + std::to_string(i) + "/812] Building CXX object src/omux/scroll_buffer.cpp.obj\r\n";
+        }
+        return corpus;
+    }
+
+    /**
+     * Lines of Chinese and Japanese text with the odd emoji, nearly every character wide.
+     */
+    auto cjk_corpus(size_t lines) -> std::string {
+        std::string corpus;
+        for(size_t i = 0; i < lines; i++) {
+            corpus += std::to_string(i) + " 終端多重化装置は複数の端末を一つの画面に表示します。中文字符也是宽的 \U0001f600\r\n";
+        }
+        return corpus;
+    }
+
+    auto decode(const std::string& corpus) -> size_t {
+        Utf8Decoder decoder;
+        size_t characters = 0;
+        for(auto byte : corpus) {
+            if(decoder.feed(byte)) {
+                characters++;
+            }
+        }
+        return characters;
+    }
+} // namespace
+
+TEST_CASE("Column accounting") {
+    constexpr size_t lines = 20000;
+    auto ascii = ascii_corpus(lines);
+    auto cjk = cjk_corpus(lines);
+    std::cout << "ASCII corpus: " << ascii.size() << " bytes, " << text_columns(ascii) << " columns" << std::endl;
+    std::cout << "CJK corpus: " << cjk.size() << " bytes, " << text_columns(cjk) << " columns" << std::endl;
+
+    BENCHMARK("Measure ASCII text") {
+        return text_columns(ascii);
+    };
+    BENCHMARK("Measure CJK text") {
+        return text_columns(cjk);
+    };
+    BENCHMARK("Decode ASCII text a byte at a time") {
+        return decode(ascii);
+    };
+    BENCHMARK("Decode CJK text a byte at a time") {
+        return decode(cjk);
+    };
+    BENCHMARK("Rewrap ASCII scrollback") {
+        ScrollBuffer buffer{200, 50};
+        buffer.append(ascii);
+        buffer.set_width(40);
+        return buffer.size();
+    };
+    BENCHMARK("Rewrap CJK scrollback") {
+        ScrollBuffer buffer{200, 50};
+        buffer.append(cjk);
+        buffer.set_width(40);
+        return buffer.size();
+    };
+}
@@ -8,6 +8,13 @@ auto omux::ActionFactory::process_to_action(std::string& input) -> Actions {
     auto start = input.begin();
     while(start != input.end()) {
         auto character = *start;
+        if(!action_stack.empty() && action_stack.back()->get_enum() == Actions::copy_mode) {
+            // Copy mode takes every key until it is exited
+            static_cast<CopyModeAction*>(action_stack.back().get())->process_key(character);
+            action_store = Actions::copy_mode;
+            start = input.erase(start);
+            continue;
+        }
         switch(character) {
             
             case PREFIX_CODE: {
@@ -26,6 +33,37 @@ auto omux::ActionFactory::process_to_action(std::string& input) -> Actions {
                 start = input.erase(start);
                 break;
             }
+            case COPY_MODE_CODE: {
+                if(!action_stack.empty() && action_stack.back()->get_enum() == Actions::prefix) {
+                    action_stack.push_back(std::make_unique<CopyModeAction>());
+                    action_store = Actions::copy_mode;
+                    start = input.erase(start);
+                } else {
+                    start++;
+                }
+                break;
+            }
+            case NEXT_WINDOW_CODE:
+            case PREVIOUS_WINDOW_CODE: {
+                if(!action_stack.empty() && action_stack.back()->get_enum() == Actions::prefix) {
+                    action_stack.push_back(std::make_unique<SelectWindowAction>(character == NEXT_WINDOW_CODE ? 1 : -1));
+                    action_store = Actions::select_window;
+                    start = input.erase(start);
+                } else {
+                    start++;
+                }
+                break;
+            }
+            case ZOOM_CODE: {
+                if(!action_stack.empty() && action_stack.back()->get_enum() == Actions::prefix) {
+                    action_stack.push_back(std::make_unique<ZoomAction>());
+                    action_store = Actions::zoom;
+                    start = input.erase(start);
+                } else {
+                    start++;
+                }
+                break;
+            }
             default: {
                 // A character has been hit that isn't part of the keys so we need to remove
                 // the prefix
@@ -40,4 +78,15 @@ auto omux::ActionFactory::process_to_action(std::string& input) -> Actions {
 
     }
     return action_store;
-}
\ No newline at end of file
+}
+void omux::ActionFactory::pop_finished() {
+    auto popped = false;
+    while(!action_stack.empty() && action_stack.back()->get_enum() != Actions::prefix &&
+          action_stack.back()->get_enum() != Actions::copy_mode) {
+        action_stack.pop_back();
+        popped = true;
+    }
+    while(popped && !action_stack.empty() && action_stack.back()->get_enum() == Actions::prefix) {
+        action_stack.pop_back();
+    }
+}
@@ -12,5 +12,10 @@ namespace omux {
         ActionFactory() = default;
         auto get_action_stack() -> std::vector<Action::ptr>*;
         Actions process_to_action(std::string&);
+        /**
+         * Takes the actions that have acted off the stack, along with the prefix that led to them.
+         * A prefix waiting for its key and copy mode until it is exited stay.
+         */
+        void pop_finished();
     };
 }
\ No newline at end of file
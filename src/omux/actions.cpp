@@ -1,5 +1,6 @@
 #include "omux/actions.hpp"
 #include "console.hpp"
+#include <regex>
 using namespace omux;
 
 auto Action::get_enum() -> omux::Actions {
@@ -27,6 +28,36 @@ auto SplitVertAction::undo() -> bool {
     return false;
 }
 
+SelectWindowAction::SelectWindowAction(int step) : step(step) {
+}
+SelectWindowAction::~SelectWindowAction() {
+}
+auto SelectWindowAction::act(PrimaryConsole* console) -> bool {
+    console->select_window(step);
+    return true;
+}
+auto SelectWindowAction::get_enum() -> Actions {
+    return Actions::select_window;
+}
+auto SelectWindowAction::undo() -> bool {
+    return false;
+}
+
+ZoomAction::ZoomAction() {
+}
+ZoomAction::~ZoomAction() {
+}
+auto ZoomAction::act(PrimaryConsole* console) -> bool {
+    console->toggle_zoom();
+    return true;
+}
+auto ZoomAction::get_enum() -> Actions {
+    return Actions::zoom;
+}
+auto ZoomAction::undo() -> bool {
+    return false;
+}
+
 PrefixAction::PrefixAction() {
 }
 PrefixAction::~PrefixAction() {
@@ -39,4 +70,86 @@ auto PrefixAction::get_enum() -> Actions {
 }
 auto PrefixAction::undo() -> bool {
     return false;
+}
+CopyModeAction::CopyModeAction() {
+}
+CopyModeAction::~CopyModeAction() {
+}
+void CopyModeAction::process_key(char key) {
+    if(editing_query) {
+        switch(key) {
+            case '\r':
+                editing_query = false;
+                pending_step = 1;
+                break;
+            case '\b':
+            case '\x7f':
+                if(!query.empty()) {
+                    query.pop_back();
+                }
+                break;
+            case '\x1b':
+                editing_query = false;
+                query.clear();
+                break;
+            default:
+                query.push_back(key);
+        }
+        return;
+    }
+    switch(key) {
+        case COPY_MODE_SEARCH_TEXT:
+        case COPY_MODE_SEARCH_REGEX:
+            editing_query = true;
+            regex = key == COPY_MODE_SEARCH_REGEX;
+            query.clear();
+            break;
+        case COPY_MODE_NEXT_MATCH:
+            pending_step = 1;
+            break;
+        case COPY_MODE_PREVIOUS_MATCH:
+            pending_step = -1;
+            break;
+        case COPY_MODE_EXIT:
+        case '\x1b':
+            exiting = true;
+            break;
+        default:
+            break;
+    }
+}
+auto CopyModeAction::act(PrimaryConsole* console) -> bool {
+    if(exiting) {
+        finished = true;
+    }
+    // The pane is held on to while copy mode works with it, so closing it has to wait
+    return console->with_active_console([&](Console& pane) {
+        if(finished) {
+            pane.scroll_to_bottom();
+            return;
+        }
+        if(!current_line) {
+            current_line = pane.line_count();
+        }
+        if(pending_step != 0 && !query.empty()) {
+            try {
+                SearchPattern pattern{query, regex};
+                auto match = pane.find(pattern, *current_line, pending_step > 0);
+                if(match) {
+                    current_line = match;
+                    pane.scroll_to_line(*match);
+                }
+            } catch(std::regex_error&) {
+                // Still typing a pattern that doesn't compile yet, nothing to show
+            }
+        }
+        pending_step = 0;
+    });
+}
+auto CopyModeAction::get_enum() -> Actions {
+    // Keys after the one that exits aren't copy mode's, it is taken off the stack once it has acted
+    return exiting ? Actions::none : Actions::copy_mode;
+}
+auto CopyModeAction::undo() -> bool {
+    return false;
 }
\ No newline at end of file
@@ -1,10 +1,22 @@
 #pragma once
 
 #include <memory>
+#include <optional>
+#include <string>
 namespace omux {
-    enum Actions { prefix, none, split_vert };
+    enum Actions { prefix, none, split_vert, copy_mode, select_window, zoom };
     constexpr auto PREFIX_CODE = '\x1';
     constexpr auto SPLIT_VERT_CODE = '\x23';
+    constexpr auto COPY_MODE_CODE = '[';
+    constexpr auto NEXT_WINDOW_CODE = 'n';
+    constexpr auto PREVIOUS_WINDOW_CODE = 'p';
+    constexpr auto ZOOM_CODE = 'z';
+    // Keys once in copy mode
+    constexpr auto COPY_MODE_SEARCH_TEXT = '/';
+    constexpr auto COPY_MODE_SEARCH_REGEX = 'r';
+    constexpr auto COPY_MODE_NEXT_MATCH = 'n';
+    constexpr auto COPY_MODE_PREVIOUS_MATCH = 'N';
+    constexpr auto COPY_MODE_EXIT = 'q';
     class PrimaryConsole;
     class Action {
 
@@ -24,6 +36,51 @@ namespace omux {
         virtual auto act(PrimaryConsole*) -> bool;
         virtual auto undo() -> bool;
     };
+    /**
+     * Moves step windows along, wrapping around at either end.
+     */
+    class SelectWindowAction : public Action {
+        int step;
+
+        public:
+        explicit SelectWindowAction(int step);
+        virtual ~SelectWindowAction();
+        virtual auto get_enum() -> omux::Actions;
+        virtual auto act(PrimaryConsole*) -> bool;
+        virtual auto undo() -> bool;
+    };
+    /**
+     * Has the active pane fill its window, or puts it back.
+     */
+    class ZoomAction : public Action {
+        public:
+        ZoomAction();
+        virtual ~ZoomAction();
+        virtual auto get_enum() -> omux::Actions;
+        virtual auto act(PrimaryConsole*) -> bool;
+        virtual auto undo() -> bool;
+    };
+    /**
+     * Takes every key until it is exited. Searches the active pane's history and scrolls to the matches,
+     * n steps to older matches and N back to newer ones.
+     */
+    class CopyModeAction : public Action {
+        std::string query;
+        bool regex = false;
+        bool editing_query = false;
+        bool exiting = false;
+        bool finished = false;
+        int pending_step = 0;
+        std::optional<size_t> current_line;
+
+        public:
+        CopyModeAction();
+        virtual ~CopyModeAction();
+        virtual auto get_enum() -> omux::Actions;
+        virtual auto act(PrimaryConsole*) -> bool;
+        virtual auto undo() -> bool;
+        void process_key(char);
+    };
     class PrefixAction : public Action {
         public:
         PrefixAction();
@@ -0,0 +1,360 @@
+#include "omux/attribute_table.hpp"
+#include <charconv>
+#include <limits>
+
+namespace omux {
+    namespace {
+        auto number(std::string_view text) -> int {
+            int value = 0;
+            std::from_chars(text.data(), text.data() + text.size(), value);
+            return value;
+        }
+
+        auto split(std::string_view text, char separator) -> std::vector<std::string_view> {
+            std::vector<std::string_view> fields;
+            size_t start = 0;
+            while(true) {
+                auto end = text.find(separator, start);
+                fields.push_back(text.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start));
+                if(end == std::string_view::npos) {
+                    return fields;
+                }
+                start = end + 1;
+            }
+        }
+
+        auto palette(int index) -> uint32_t {
+            return CellAttributes::COLOR_PALETTE | static_cast<uint32_t>(index & 0xff);
+        }
+
+        auto rgb(int red, int green, int blue) -> uint32_t {
+            return CellAttributes::COLOR_RGB | static_cast<uint32_t>((red & 0xff) << 16 | (green & 0xff) << 8 | (blue & 0xff));
+        }
+
+        /**
+         * An extended color from 38, 48 or 58, either as : sub parameters or the ; separated fields after it.
+         * @return the color, and how many of the following fields it used
+         */
+        auto extended_color(std::string_view field, const std::vector<std::string_view>& fields, size_t next)
+        -> std::pair<std::optional<uint32_t>, size_t> {
+            auto colon = field.find(':');
+            if(colon != std::string_view::npos) {
+                auto sub = split(field.substr(colon + 1), ':');
+                if(number(sub[0]) == 5 && sub.size() >= 2) {
+                    return {palette(number(sub[1])), 0};
+                }
+                // 38:2:r:g:b and 38:2:colorspace:r:g:b are both written
+                if(number(sub[0]) == 2 && sub.size() >= 4) {
+                    auto last = sub.size() - 1;
+                    return {rgb(number(sub[last - 2]), number(sub[last - 1]), number(sub[last])), 0};
+                }
+                return {std::nullopt, 0};
+            }
+            if(next < fields.size() && number(fields[next]) == 5 && next + 1 < fields.size()) {
+                return {palette(number(fields[next + 1])), 2};
+            }
+            if(next < fields.size() && number(fields[next]) == 2 && next + 3 < fields.size()) {
+                return {rgb(number(fields[next + 1]), number(fields[next + 2]), number(fields[next + 3])), 4};
+            }
+            return {std::nullopt, fields.size() - next};
+        }
+
+        void append_parameter(std::string& parameters, std::string_view parameter) {
+            if(!parameters.empty()) {
+                parameters.push_back(';');
+            }
+            parameters.append(parameter);
+        }
+
+        /**
+         * base is 30 for the foreground, 40 for the background and 50 for the underline, which has no short form.
+         */
+        void append_color(std::string& parameters, uint32_t color, int base) {
+            if(color == 0) {
+                append_parameter(parameters, std::to_string(base + 9));
+                return;
+            }
+            auto value = color & 0xffffff;
+            if((color & CellAttributes::COLOR_PALETTE) != 0 && base != 50 && value < 8) {
+                append_parameter(parameters, std::to_string(base + static_cast<int>(value)));
+            } else if((color & CellAttributes::COLOR_PALETTE) != 0 && base != 50 && value < 16) {
+                append_parameter(parameters, std::to_string(base + 60 + static_cast<int>(value) - 8));
+            } else if((color & CellAttributes::COLOR_PALETTE) != 0) {
+                append_parameter(parameters, std::to_string(base + 8) + ";5;" + std::to_string(value));
+            } else {
+                append_parameter(parameters, std::to_string(base + 8) + ";2;" + std::to_string(value >> 16) + ";" +
+                                             std::to_string(value >> 8 & 0xff) + ";" + std::to_string(value & 0xff));
+            }
+        }
+
+        struct FlagCodes {
+            uint16_t flag;
+            const char* on;
+            const char* off;
+        };
+        // Bold and dim share an off code
+        constexpr FlagCodes FLAG_CODES[] = {
+        {CellAttributes::bold, "1", "22"},         {CellAttributes::dim, "2", "22"},
+        {CellAttributes::italic, "3", "23"},       {CellAttributes::blink, "5", "25"},
+        {CellAttributes::inverse, "7", "27"},      {CellAttributes::hidden, "8", "28"},
+        {CellAttributes::strikethrough, "9", "29"}, {CellAttributes::overline, "53", "55"},
+        };
+    } // namespace
+
+    void CellAttributes::apply_sgr(std::string_view parameters) {
+        auto fields = split(parameters, ';');
+        for(size_t i = 0; i < fields.size(); i++) {
+            auto field = fields[i];
+            auto colon = field.find(':');
+            auto code = number(field.substr(0, colon));
+            if(code >= 30 && code <= 37) {
+                foreground = palette(code - 30);
+            } else if(code >= 90 && code <= 97) {
+                foreground = palette(code - 90 + 8);
+            } else if(code >= 40 && code <= 47) {
+                background = palette(code - 40);
+            } else if(code >= 100 && code <= 107) {
+                background = palette(code - 100 + 8);
+            }
+            switch(code) {
+                case 0:
+                    *this = CellAttributes{.hyperlink = hyperlink};
+                    break;
+                case 1:
+                    flags |= bold;
+                    break;
+                case 2:
+                    flags |= dim;
+                    break;
+                case 3:
+                    flags |= italic;
+                    break;
+                case 4:
+                    underline = colon == std::string_view::npos ? 1 : static_cast<uint8_t>(number(field.substr(colon + 1)));
+                    break;
+                case 5:
+                case 6:
+                    flags |= blink;
+                    break;
+                case 7:
+                    flags |= inverse;
+                    break;
+                case 8:
+                    flags |= hidden;
+                    break;
+                case 9:
+                    flags |= strikethrough;
+                    break;
+                case 21:
+                    underline = 2;
+                    break;
+                case 22:
+                    flags &= static_cast<uint16_t>(~(bold | dim));
+                    break;
+                case 23:
+                    flags &= static_cast<uint16_t>(~italic);
+                    break;
+                case 24:
+                    underline = 0;
+                    break;
+                case 25:
+                    flags &= static_cast<uint16_t>(~blink);
+                    break;
+                case 27:
+                    flags &= static_cast<uint16_t>(~inverse);
+                    break;
+                case 28:
+                    flags &= static_cast<uint16_t>(~hidden);
+                    break;
+                case 29:
+                    flags &= static_cast<uint16_t>(~strikethrough);
+                    break;
+                case 38:
+                case 48:
+                case 58: {
+                    auto [color, used] = extended_color(field, fields, i + 1);
+                    i += used;
+                    if(color) {
+                        (code == 38 ? foreground : code == 48 ? background : underline_color) = *color;
+                    }
+                    break;
+                }
+                case 39:
+                    foreground = 0;
+                    break;
+                case 49:
+                    background = 0;
+                    break;
+                case 53:
+                    flags |= overline;
+                    break;
+                case 55:
+                    flags &= static_cast<uint16_t>(~overline);
+                    break;
+                case 59:
+                    underline_color = 0;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    auto CellAttributes::sgr_between(const CellAttributes& from, const CellAttributes& to) -> std::string {
+        std::string parameters;
+        auto removed = static_cast<uint16_t>(from.flags & ~to.flags);
+        auto added = static_cast<uint16_t>(to.flags & ~from.flags);
+        if((removed & (bold | dim)) != 0) {
+            // Turning off one of bold and dim turns off both
+            added |= static_cast<uint16_t>(to.flags & (bold | dim));
+        }
+        for(const auto& codes : FLAG_CODES) {
+            // Bold's off code covers dim's as well
+            if((removed & codes.flag) != 0 && !(codes.flag == dim && (removed & bold) != 0)) {
+                append_parameter(parameters, codes.off);
+            }
+        }
+        for(const auto& codes : FLAG_CODES) {
+            if((added & codes.flag) != 0) {
+                append_parameter(parameters, codes.on);
+            }
+        }
+        if(from.underline != to.underline) {
+            if(to.underline == 0) {
+                append_parameter(parameters, "24");
+            } else if(to.underline == 1) {
+                append_parameter(parameters, "4");
+            } else {
+                append_parameter(parameters, "4:" + std::to_string(to.underline));
+            }
+        }
+        if(from.foreground != to.foreground) {
+            append_color(parameters, to.foreground, 30);
+        }
+        if(from.background != to.background) {
+            append_color(parameters, to.background, 40);
+        }
+        if(from.underline_color != to.underline_color) {
+            append_color(parameters, to.underline_color, 50);
+        }
+        return parameters;
+    }
+
+    auto AttributeTable::Hash::operator()(const CellAttributes& attributes) const -> size_t {
+        auto hash = static_cast<size_t>(attributes.foreground) * 0x9e3779b97f4a7c15ULL;
+        hash ^= static_cast<size_t>(attributes.background) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        hash ^= static_cast<size_t>(attributes.underline_color) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+        hash ^= (static_cast<size_t>(attributes.flags) | static_cast<size_t>(attributes.hyperlink) << 16 |
+                 static_cast<size_t>(attributes.underline) << 32) +
+                0x9e3779b9 + (hash << 6) + (hash >> 2);
+        return hash;
+    }
+
+    AttributeTable::AttributeTable() : attributes{CellAttributes{}}, hyperlinks{""} {
+        ids.emplace(CellAttributes{}, DEFAULT_ATTRIBUTES);
+    }
+
+    auto AttributeTable::intern(const CellAttributes& added) -> std::optional<AttributeId> {
+        std::scoped_lock lock(table_lock);
+        return intern_locked(added);
+    }
+
+    auto AttributeTable::intern_locked(const CellAttributes& added) -> std::optional<AttributeId> {
+        auto existing = ids.find(added);
+        if(existing != ids.end()) {
+            return existing->second;
+        }
+        if(attributes.size() > std::numeric_limits<AttributeId>::max()) {
+            return std::nullopt;
+        }
+        auto id = static_cast<AttributeId>(attributes.size());
+        attributes.push_back(added);
+        ids.emplace(added, id);
+        return id;
+    }
+
+    auto AttributeTable::get(AttributeId id) const -> CellAttributes {
+        std::scoped_lock lock(table_lock);
+        return attributes[id];
+    }
+
+    auto AttributeTable::apply_sgr(AttributeId from, std::string_view parameters) -> std::optional<AttributeId> {
+        std::scoped_lock lock(table_lock);
+        std::string key{static_cast<char>(from >> 8), static_cast<char>(from & 0xff)};
+        key.append(parameters);
+        auto cached = applied.find(key);
+        if(cached != applied.end()) {
+            return cached->second;
+        }
+        auto changed = attributes[from];
+        changed.apply_sgr(parameters);
+        auto id = intern_locked(changed);
+        if(!id) {
+            return std::nullopt;
+        }
+        if(applied.size() >= ATTRIBUTE_CACHE_LIMIT) {
+            applied.clear();
+        }
+        applied.emplace(std::move(key), *id);
+        return id;
+    }
+
+    auto AttributeTable::apply_hyperlink(AttributeId from, std::string_view parameters) -> std::optional<AttributeId> {
+        std::scoped_lock lock(table_lock);
+        auto changed = attributes[from];
+        auto uri = parameters.find(';');
+        // An empty URI ends the hyperlink
+        if(uri == std::string_view::npos || uri + 1 == parameters.size()) {
+            changed.hyperlink = 0;
+        } else {
+            auto existing = hyperlink_ids.find(std::string{parameters});
+            if(existing != hyperlink_ids.end()) {
+                changed.hyperlink = existing->second;
+            } else if(hyperlinks.size() <= std::numeric_limits<uint16_t>::max()) {
+                changed.hyperlink = static_cast<uint16_t>(hyperlinks.size());
+                hyperlinks.emplace_back(parameters);
+                hyperlink_ids.emplace(parameters, changed.hyperlink);
+            }
+        }
+        return intern_locked(changed);
+    }
+
+    void AttributeTable::append_transition(std::string& output, AttributeId from, AttributeId to) {
+        if(from == to) {
+            return;
+        }
+        std::scoped_lock lock(table_lock);
+        auto key = static_cast<uint32_t>(from) << 16 | to;
+        auto cached = transitions.find(key);
+        if(cached != transitions.end()) {
+            output.append(cached->second);
+            return;
+        }
+        const auto& before = attributes[from];
+        const auto& after = attributes[to];
+        std::string transition;
+        auto changes = CellAttributes::sgr_between(before, after);
+        auto from_reset = CellAttributes::sgr_between(CellAttributes{.hyperlink = after.hyperlink}, after);
+        // A reset and everything that is set can be shorter than turning things off one at a time
+        if(from_reset.empty() && !changes.empty()) {
+            transition = "\x1b[m";
+        } else if(!from_reset.empty() && from_reset.size() + 2 < changes.size()) {
+            transition = "\x1b[0;" + from_reset + "m";
+        } else if(!changes.empty()) {
+            transition = "\x1b[" + changes + "m";
+        }
+        if(before.hyperlink != after.hyperlink) {
+            transition += "\x1b]8;" + (after.hyperlink == 0 ? std::string{";"} : hyperlinks[after.hyperlink]) + "\x1b\\";
+        }
+        if(transitions.size() >= ATTRIBUTE_CACHE_LIMIT) {
+            transitions.clear();
+        }
+        output.append(transition);
+        transitions.emplace(key, std::move(transition));
+    }
+
+    auto AttributeTable::size() const -> size_t {
+        std::scoped_lock lock(table_lock);
+        return attributes.size();
+    }
+} // namespace omux
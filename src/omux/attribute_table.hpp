@@ -0,0 +1,112 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace omux {
+    /**
+     * Index into an attribute table, what a cell or a run of text refers to instead of the SGR that set it.
+     */
+    using AttributeId = uint16_t;
+    constexpr AttributeId DEFAULT_ATTRIBUTES = 0;
+    /**
+     * Memoized SGR applications and transitions kept before the caches are started over.
+     */
+    constexpr size_t ATTRIBUTE_CACHE_LIMIT = 4096;
+
+    /**
+     * How text is drawn, as what it is rather than the SGR that got it there,
+     * so \x1b[1;31m and \x1b[1m\x1b[31m come out the same.
+     */
+    struct CellAttributes {
+        enum Flag : uint16_t {
+            bold = 1 << 0,
+            dim = 1 << 1,
+            italic = 1 << 2,
+            blink = 1 << 3,
+            inverse = 1 << 4,
+            hidden = 1 << 5,
+            strikethrough = 1 << 6,
+            overline = 1 << 7,
+        };
+        /**
+         * 0 is the terminal's default, palette colors are COLOR_PALETTE | index and RGB colors COLOR_RGB | 0xrrggbb.
+         */
+        static constexpr uint32_t COLOR_PALETTE = 1 << 24;
+        static constexpr uint32_t COLOR_RGB = 2 << 24;
+
+        uint32_t foreground = 0;
+        uint32_t background = 0;
+        uint32_t underline_color = 0;
+        uint16_t flags = 0;
+        uint16_t hyperlink = 0;
+        // SGR 4:n style, 0 for none and 1 for a single underline
+        uint8_t underline = 0;
+
+        auto operator==(const CellAttributes&) const -> bool = default;
+        /**
+         * Applies the parameters of an SGR sequence, with ; or : separated sub parameters. Ones it doesn't know are ignored.
+         */
+        void apply_sgr(std::string_view parameters);
+        /**
+         * The SGR parameters that change a terminal from one set of attributes to another, hyperlinks aren't included.
+         */
+        static auto sgr_between(const CellAttributes& from, const CellAttributes& to) -> std::string;
+    };
+
+    /**
+     * Every set of attributes seen in a session, each given a 16 bit id.
+     *
+     * Cells and scroll buffer runs hold ids, so a cell costs a few bytes however it is drawn.
+     * Drawing goes from one id to the next, the output between two ids is worked out once and remembered.
+     * Panes share the table, it has its own lock.
+     */
+    class AttributeTable {
+        public:
+        AttributeTable();
+        /**
+         * @return nothing once every id is taken
+         */
+        auto intern(const CellAttributes& attributes) -> std::optional<AttributeId>;
+        [[nodiscard]] auto get(AttributeId id) const -> CellAttributes;
+        /**
+         * The attributes after an SGR sequence with parameters.
+         * @return nothing if they are new and every id is taken, the caller has to keep the sequence itself
+         */
+        auto apply_sgr(AttributeId from, std::string_view parameters) -> std::optional<AttributeId>;
+        /**
+         * The attributes after an OSC 8 hyperlink, parameters is what comes after "8;".
+         * @return nothing if they are new and every id is taken
+         */
+        auto apply_hyperlink(AttributeId from, std::string_view parameters) -> std::optional<AttributeId>;
+        /**
+         * Appends the shortest output that changes a terminal's attributes from one id to another,
+         * SGR changes or a reset and the hyperlink when it changes.
+         */
+        void append_transition(std::string& output, AttributeId from, AttributeId to);
+        [[nodiscard]] auto size() const -> size_t;
+
+        private:
+        struct Hash {
+            auto operator()(const CellAttributes& attributes) const -> size_t;
+        };
+
+        mutable std::mutex table_lock;
+        std::vector<CellAttributes> attributes;
+        std::unordered_map<CellAttributes, AttributeId, Hash> ids;
+        // Index 0 is no hyperlink, the rest are the OSC 8 parameters and URI
+        std::vector<std::string> hyperlinks;
+        std::unordered_map<std::string, uint16_t> hyperlink_ids;
+        // Keyed by the id followed by the parameters
+        std::unordered_map<std::string, AttributeId> applied;
+        // Keyed by from << 16 | to
+        std::unordered_map<uint32_t, std::string> transitions;
+
+        auto intern_locked(const CellAttributes& added) -> std::optional<AttributeId>;
+    };
+} // namespace omux
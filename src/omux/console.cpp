@@ -1,7 +1,45 @@
 #include "omux/console.hpp"
 #include "apis/alias.hpp"
+#include "omux/memory_governor.hpp"
+#include "omux/metrics.hpp"
+#include <algorithm>
+#include <filesystem>
 
 using namespace omux;
+namespace {
+    std::atomic<unsigned int> next_console_id{1};
+
+    class MappedSpillFile : public SpillFile {
+        public:
+        MappedSpillFile(const std::wstring& path, size_t segment_size) : file(path, segment_size) {
+        }
+        auto append(std::string_view data) -> size_t override {
+            return file.append(data);
+        }
+        void write(size_t offset, std::string_view data) override {
+            file.write(offset, data);
+        }
+        auto read(size_t offset, size_t length) -> std::string_view override {
+            return file.read(offset, length);
+        }
+        [[nodiscard]] auto size() const -> size_t override {
+            return file.size();
+        }
+
+        private:
+        Alias::MappedFile file;
+    };
+
+    auto spill_factory(unsigned int console_id) -> SpillFileFactory {
+        return [console_id](std::string_view name) -> std::unique_ptr<SpillFile> {
+            auto file_name = "omux-" + std::to_string(GetCurrentProcessId()) + "-" + std::to_string(console_id) + "-" +
+                             std::string{name} + ".spill";
+            // The index only takes a record per block, it doesn't need views as big as the data's
+            auto segment_size = name == "index" ? Alias::MAPPED_FILE_SMALL_SEGMENT_SIZE : Alias::MAPPED_FILE_SEGMENT_SIZE;
+            return std::make_unique<MappedSpillFile>((std::filesystem::temp_directory_path() / file_name).wstring(), segment_size);
+        };
+    }
+}
 auto SetupConsoleHost() noexcept(false) -> bool {
     return Alias::SetupConsoleHost();
 }
@@ -12,74 +50,282 @@ void WriteToStdOut(std::string message) {
     Alias::WriteToStdOut(message);
 }
 
-Console::Console(std::shared_ptr<PrimaryConsole> primary_console, Layout layout)
-: layout(layout), running_process(nullptr), primary_console(primary_console) {
+Console::Console(std::shared_ptr<PrimaryConsole> primary_console, Layout layout) : Console(primary_console, layout, Reserved{}) {
+    this->primary_console->add_console(this);
+}
+Console::Console(std::shared_ptr<PrimaryConsole> primary_console, Layout layout, Reserved)
+: id(next_console_id++), layout(layout), requested_layout(layout), running_process(nullptr), primary_console(primary_console),
+scroll_buffer(layout.width, static_cast<size_t>(std::max(layout.height, 0)), primary_console->get_attributes()) {
     if(layout.width < 1 || layout.height < 1) {
         throw OmuxError("Layout has an invalid width or height, they must both be greater than 0");
     }
+    scroll_buffer.set_spill(spill_factory(id), SCROLL_BUFFER_MEMORY_BUDGET);
+    memory_share = MemoryGovernor::global().add_pane(scroll_buffer.get_block_bytes());
     this->pseudo_console = Alias::CreatePseudoConsole(layout.x, layout.y, layout.width, layout.height);
-    this->primary_console->add_console(this);
-        
+}
+auto Console::reserve(std::shared_ptr<PrimaryConsole> primary_console, Layout layout) -> Sptr {
+    Sptr console{new Console(primary_console, layout, Reserved{})};
+    // Nothing else has it yet
+    console->visible = false;
+    return console;
 }
 Console::Console(std::shared_ptr<PrimaryConsole> primary_console, Layout layout, Console* console)
-: layout(layout), running_process(nullptr), primary_console(primary_console) {
+: id(next_console_id++), layout(layout), requested_layout(layout), running_process(nullptr), primary_console(primary_console),
+scroll_buffer(layout.width, static_cast<size_t>(std::max(layout.height, 0)), primary_console->get_attributes()) {
     if(layout.width < 1 || layout.height < 1) {
         throw OmuxError("Layout has an invalid width or height, they must both be greater than 0");
     }
+    scroll_buffer.set_spill(spill_factory(id), SCROLL_BUFFER_MEMORY_BUDGET);
+    memory_share = MemoryGovernor::global().add_pane(scroll_buffer.get_block_bytes());
     this->primary_console->add_console(this);
 }
 Console::~Console() {
     primary_console->remove_console(this);
-    running_process = nullptr;
+    Metrics::global().remove_prefix(Metrics::pane_metric(id, ""));
 }
-auto Console::output_at(size_t index) -> std::string_view {
+auto Console::output_at(size_t index) -> std::string {
     return scroll_buffer.at(index);
 }
-auto Console::get_scroll_buffer() -> std::vector<std::string>* {
+auto Console::get_scroll_buffer() -> ScrollBuffer* {
     return &scroll_buffer;
 }
+auto Console::snapshot() const -> std::shared_ptr<const PaneSnapshot> {
+    return published.load(std::memory_order_acquire);
+}
+void Console::publish_snapshot() {
+    auto snapshot = std::make_shared<PaneSnapshot>();
+    snapshot->generation = published.load(std::memory_order_relaxed)->generation + 1;
+    snapshot->width = scroll_buffer.get_width();
+    snapshot->height = layout.height;
+    snapshot->view_offset = view_offset;
+    snapshot->rows = scroll_buffer.size();
+    snapshot->line_count = scroll_buffer.line_count();
+    auto height = static_cast<size_t>(std::max(layout.height, 0));
+    if(on_alternate_screen) {
+        snapshot->alternate_screen = true;
+        for(int row = 0; row < alternate_screen->get_height(); row++) {
+            snapshot->screen.push_back(alternate_screen->row_text(row));
+        }
+    } else if(view_offset < snapshot->rows) {
+        snapshot->screen = scroll_buffer.rows_above(view_offset, std::min(height, snapshot->rows - view_offset));
+    }
+    published.store(std::move(snapshot), std::memory_order_release);
+}
 auto Console::output() -> std::string {
     return pseudo_console->latest_output();
 }
 void Console::process_attached(Process* process) {
+    std::scoped_lock lock(process_lock);
     this->running_process = process;
     first_process_added = true;
+    update_pane_counts();
 }
 void Console::process_dettached(Process* process) {
+    std::scoped_lock lock(process_lock);
     // Just really be sure this is the process that was attached
     if(running_process == process) {
         this->running_process = nullptr;
+        update_pane_counts();
+        std::scoped_lock stdout_lock(*primary_console->get_stdout_lock());
+        saved_cursor.clear();
     }    
     //primary_console->remove_console(this);
 }
+void Console::update_pane_counts() {
+    // A pane that hasn't had a process yet is still waiting for one, so it counts as live
+    bool registered = !handle.is_null();
+    bool live = registered && (!first_process_added || running_process != nullptr);
+    bool attached = registered && running_process != nullptr;
+    primary_console->pane_counts_changed(static_cast<int>(live) - static_cast<int>(counted_live),
+                                         static_cast<int>(attached) - static_cast<int>(counted_attached));
+    counted_live = live;
+    counted_attached = attached;
+}
 auto Console::is_running() -> bool {
-    if(running_process) {
-        //return running_process->process_running();
-    }
+    std::scoped_lock lock(process_lock);
     return !first_process_added || running_process;
 }
 std::shared_ptr<PrimaryConsole> Console::get_primary_console() {
     return primary_console;
 }
 auto Console::get_saved_cursor() -> std::string {
-    if(running_process) {
-        return this->running_process->saved_cursor_pos;
-    }
-    return "";
+    return saved_cursor;
 }
 void Console::resize(Layout layout) {
-    if(running_process) {
-        running_process->resize_on_next_output(this->layout);
+    // Only record the request here, the pseudo console is resized once the requests settle
+    std::scoped_lock lock(resize_lock);
+    requested_layout = layout;
+    resize_pending = true;
+    resize_deadline = std::chrono::steady_clock::now() + RESIZE_DEBOUNCE_MS;
+    // The output loop may be waiting on a read with no timeout it knows about, have it look again
+    if(pseudo_console) {
+        pseudo_console->interrupt_read();
     }
-    this->layout = layout;
-    this->pseudo_console->resize(layout.width, layout.height);
 }
-auto Console::get_layout() -> Layout& {
-    return this->layout;
+auto Console::pending_resize_delay() -> std::optional<std::chrono::milliseconds> {
+    std::scoped_lock lock(resize_lock);
+    if(!resize_pending) {
+        return std::nullopt;
+    }
+    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(resize_deadline - std::chrono::steady_clock::now());
+    return std::max(remaining, std::chrono::milliseconds(0));
+}
+/**
+ * Applies the last requested layout if no further resize has come in for RESIZE_DEBOUNCE_MS.
+ * @return true if a resize was applied
+ */
+auto Console::apply_pending_resize() -> bool {
+    std::scoped_lock lock(resize_lock);
+    if(!resize_pending || std::chrono::steady_clock::now() < resize_deadline) {
+        return false;
+    }
+    resize_pending = false;
+    resize_generation++;
+    {
+        std::scoped_lock process(process_lock);
+        if(running_process) {
+            running_process->resize_on_next_output(layout, resize_generation);
+        }
+    }
+    {
+        // The renderer writes to the scroll buffer while holding stdout
+        std::scoped_lock stdout_lock(*primary_console->get_stdout_lock());
+        // Output is drawn at the old size right up until the child is told about the new one
+        layout = requested_layout;
+        // Rows on screen get reflowed now, history is left until it is scrolled to
+        scroll_buffer.set_hot_rows(static_cast<size_t>(layout.height));
+        scroll_buffer.set_width(layout.width);
+        if(alternate_screen) {
+            alternate_screen->resize(layout.width, layout.height);
+        }
+    }
+    if(pseudo_console) {
+        this->pseudo_console->resize(layout.width, layout.height);
+    }
+    return true;
+}
+auto Console::get_resize_generation() -> unsigned int {
+    std::scoped_lock lock(resize_lock);
+    return resize_generation;
+}
+auto Console::get_layout() -> Layout {
+    std::scoped_lock lock(resize_lock);
+    return requested_layout;
 }
 auto Console::wait_for_process_to_stop(int timeout) -> Alias::WAIT_RESULT {
+    std::scoped_lock lock(process_lock);
     if(running_process) {
         return running_process->wait_for_stop(timeout);
     }
     return Alias::WAIT_RESULT::R_ERROR;
+}
+auto Console::get_id() const -> unsigned int {
+    return id;
+}
+auto Console::get_handle() const -> SlotHandle {
+    return handle;
+}
+auto Console::line_count() -> size_t {
+    return snapshot()->line_count;
+}
+auto Console::find(const SearchPattern& pattern, size_t from_line, bool older) -> std::optional<size_t> {
+    // The output thread writes to the scroll buffer while holding stdout, only what the search needs is taken under it
+    auto search = [&] {
+        std::scoped_lock lock(*primary_console->get_stdout_lock());
+        return scroll_buffer.search(pattern, primary_console->get_stdout_lock());
+    }();
+    return search.find(from_line, older);
+}
+void Console::viewed() {
+    memory_share->viewed();
+}
+auto Console::apply_memory_budget() -> bool {
+    auto trim = memory_share->take_trim_request();
+    auto budget = std::min(SCROLL_BUFFER_MEMORY_BUDGET, memory_share->get_budget());
+    if(!trim && budget == applied_memory_budget) {
+        return false;
+    }
+    std::scoped_lock lock(*primary_console->get_stdout_lock());
+    scroll_buffer.set_memory_budget(budget);
+    applied_memory_budget = budget;
+    return true;
+}
+void Console::scroll_to_line(size_t line) {
+    viewed();
+    {
+        std::scoped_lock lock(*primary_console->get_stdout_lock());
+        auto line_offset = scroll_buffer.offset_of_line(line);
+        auto rows_below = static_cast<size_t>(std::max(layout.height - 1, 0));
+        view_offset = line_offset > rows_below ? line_offset - rows_below : 0;
+        publish_snapshot();
+    }
+    std::scoped_lock lock(process_lock);
+    if(running_process) {
+        running_process->repaint_view(view_offset);
+    }
+}
+void Console::scroll_to_bottom() {
+    viewed();
+    {
+        std::scoped_lock lock(*primary_console->get_stdout_lock());
+        view_offset = 0;
+        publish_snapshot();
+    }
+    std::scoped_lock lock(process_lock);
+    if(running_process) {
+        running_process->repaint_view(view_offset);
+    }
+}
+auto Console::get_alternate_screen() -> TerminalModel* {
+    return on_alternate_screen ? alternate_screen.get() : nullptr;
+}
+void Console::enter_alternate_screen(bool clear) {
+    if(!alternate_screen) {
+        alternate_screen = std::make_unique<TerminalModel>(layout.width, layout.height, primary_console->get_attributes());
+    } else if(clear) {
+        alternate_screen->clear();
+    }
+    on_alternate_screen = true;
+}
+void Console::exit_alternate_screen() {
+    on_alternate_screen = false;
+}
+void Console::set_visible(bool shown) {
+    std::scoped_lock lock(process_lock);
+    std::scoped_lock stdout_lock(*primary_console->get_stdout_lock());
+    if(visible == shown) {
+        return;
+    }
+    visible = shown;
+    if(running_process) {
+        running_process->visibility_changed();
+    }
+}
+void Console::present(bool shown) {
+    auto changed = visible != shown;
+    visible = shown;
+    if(running_process == nullptr) {
+        return;
+    }
+    if(changed) {
+        running_process->visibility_changed();
+    } else if(shown) {
+        running_process->redraw();
+    }
+}
+auto Console::is_visible() -> bool {
+    std::scoped_lock lock(*primary_console->get_stdout_lock());
+    return visible;
+}
+void Console::report_metrics() {
+    auto& metrics = Metrics::global();
+    const auto& search_index = scroll_buffer.get_search_index();
+    metrics.set(Metrics::pane_metric(id, "scroll_buffer_rows"), static_cast<long long>(scroll_buffer.size()));
+    metrics.set(Metrics::pane_metric(id, "scroll_buffer_bytes"), static_cast<long long>(scroll_buffer.memory_usage()));
+    metrics.set(Metrics::pane_metric(id, "memory_budget"), static_cast<long long>(applied_memory_budget));
+    metrics.set(Metrics::pane_metric(id, "scroll_buffer_spilled_blocks"), static_cast<long long>(scroll_buffer.spilled_blocks()));
+    metrics.set(Metrics::pane_metric(id, "search_index_bytes"), static_cast<long long>(search_index.memory_usage()));
+    metrics.set("attribute_table.ids", static_cast<long long>(primary_console->get_attributes()->size()));
+    metrics.set(Metrics::pane_metric(id, "search_index_lines"),
+                static_cast<long long>(search_index.end_line() - search_index.first_indexed_line()));
 }
\ No newline at end of file
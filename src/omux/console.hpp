@@ -1,21 +1,45 @@
 #pragma once
 #include "action_factory.hpp"
 #include "apis/alias.hpp"
+#include "omux/attribute_table.hpp"
+#include "omux/cursor_encoder.hpp"
+#include "omux/host_profile.hpp"
+#include "omux/io_executor.hpp"
+#include "omux/layout_tree.hpp"
+#include "omux/memory_governor.hpp"
+#include "omux/pane_snapshot.hpp"
+#include "omux/render_scheduler.hpp"
+#include "omux/scroll_buffer.hpp"
+#include "omux/search_index.hpp"
+#include "omux/slot_map.hpp"
+#include "omux/terminal_model.hpp"
+#include "omux/unicode_width.hpp"
 #include <memory>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <mutex>
 #include <ostream>
+#include <shared_mutex>
+#include <stop_token>
+#include <unordered_map>
+#include <vector>
 
 namespace omux {
    /// constexpr auto PWSH_CONSOLE_PATH = L"F:\\dev\\projects\\PowerShell\\src\\powershell-win-core\\bin\\Debug\\net5.0\\pwsh.exe";
     constexpr auto PWSH_CONSOLE_PATH = L"F:\\dev\\bin\\pswh\\pwsh.exe";
-    using Layout = struct Layout {
-        int x;
-        int y;
-        int width;
-        int height;
-    };
-
+    /**
+     * How long a pane waits for resize requests to settle before applying the last one.
+     * Window drags produce a burst of resizes, we only want the child to repaint once.
+     */
+    constexpr auto RESIZE_DEBOUNCE_MS = std::chrono::milliseconds(50);
+    /**
+     * Longest a quiet pane waits on a read before looking at its memory budget again.
+     * Resizes interrupt the read, so this doesn't hold them up.
+     */
+    constexpr auto OUTPUT_IDLE_TIMEOUT_MS = std::chrono::milliseconds(250);
     class OmuxError : public std::logic_error {
         public:
         OmuxError() : std::logic_error("Something went wrong in omux") {}
@@ -25,6 +49,7 @@ namespace omux {
     class Console;
     class Process;
     class PrimaryConsole;
+    class ShellPool;
     
     class Console {
         friend class Process;
@@ -35,28 +60,142 @@ namespace omux {
         Console(std::shared_ptr<PrimaryConsole>, Layout, Console*);
         Console(std::shared_ptr<PrimaryConsole>, Layout);
         ~Console();
+        /**
+         * A pane that isn't part of the primary console until it is added with PrimaryConsole::add_console.
+         * It starts out hidden, so a program started in it writes nothing to the host until then.
+         */
+        static auto reserve(std::shared_ptr<PrimaryConsole>, Layout) -> Sptr;
         auto output() -> std::string;
-        auto output_at(size_t) -> std::string_view;
+        auto output_at(size_t) -> std::string;
         void process_attached(Process*);
         void process_dettached(Process*);
         auto is_running() -> bool;
         auto wait_for_process_to_stop(int) -> Alias::WAIT_RESULT;
         std::shared_ptr<PrimaryConsole> get_primary_console();
-        auto get_scroll_buffer() -> std::vector<std::string>*;
+        /**
+         * The scroll buffer itself, only for the output thread or while holding the stdout lock.
+         * Anything else should read a snapshot.
+         */
+        auto get_scroll_buffer() -> ScrollBuffer*;
+        /**
+         * The last state the output thread published. Never waits on the output thread.
+         */
+        auto snapshot() const -> std::shared_ptr<const PaneSnapshot>;
+        /**
+         * Publishes the pane's current state for snapshot(), the caller must hold the stdout lock.
+         */
+        void publish_snapshot();
         auto get_saved_cursor() -> std::string;
         void resize(Layout);
-        auto get_layout() -> Layout&;
+        auto apply_pending_resize() -> bool;
+        /**
+         * How long until a pending resize can be applied, nothing if there isn't one.
+         */
+        auto pending_resize_delay() -> std::optional<std::chrono::milliseconds>;
+        auto get_resize_generation() -> unsigned int;
+        /**
+         * The layout last asked for, which the pane is drawn at once the resize has been applied.
+         */
+        auto get_layout() -> Layout;
+        auto get_id() const -> unsigned int;
+        /**
+         * Where the pane is registered with its primary console, a null handle once it has been removed.
+         */
+        auto get_handle() const -> SlotHandle;
+        auto line_count() -> size_t;
+        auto find(const SearchPattern&, size_t, bool) -> std::optional<size_t>;
+        /**
+         * Show history so the given logical line is at the top of the pane, used by copy mode.
+         */
+        void scroll_to_line(size_t);
+        /**
+         * Marks the pane's history as just looked at, so it is the last to be spilled.
+         */
+        void viewed();
+        /**
+         * Picks up the pane's share of the global memory budget, spilling history if it has shrunk.
+         * Called from the output thread, it only takes stdout when there is something to do.
+         */
+        auto apply_memory_budget() -> bool;
+        void scroll_to_bottom();
+        void report_metrics();
+        /**
+         * The grid a full screen program is drawing on, nothing while the pane is on its main screen.
+         * Only for the output thread or while holding the stdout lock.
+         */
+        auto get_alternate_screen() -> TerminalModel*;
+        /**
+         * Switches between the main screen and the alternate one, the caller must hold the stdout lock.
+         * The alternate grid is kept between switches, so switching is just a flag.
+         * @param clear blank the alternate screen on the way in, like ?1049h
+         */
+        void enter_alternate_screen(bool clear);
+        void exit_alternate_screen();
+        /**
+         * Hidden panes keep following their program's output but write nothing to the host.
+         * Showing a pane draws it once from where it has got to.
+         */
+        void set_visible(bool);
+        auto is_visible() -> bool;
 
         private:
+        const unsigned int id;
+        /**
+         * The geometry the pseudo console and the scroll buffer actually have, which output is drawn with.
+         * Only changed by apply_pending_resize while holding the stdout lock.
+         */
         Layout layout{0, 0, 0, 0};
+        /**
+         * What resize last asked for, guarded by resize_lock. layout catches up once the debounce window passes.
+         */
+        Layout requested_layout{0, 0, 0, 0};
+        std::mutex resize_lock;
+        bool resize_pending = false;
+        std::chrono::steady_clock::time_point resize_deadline;
+        unsigned int resize_generation = 0;
+        SlotHandle handle;
+        /**
+         * Guards running_process. A Process detaches itself before it is destroyed, which waits for anyone using it.
+         * Taken before the stdout lock, never while holding it.
+         */
+        std::mutex process_lock;
         Process* running_process = nullptr;
+        // The attached process's cursor, guarded by the stdout lock so the primary console can restore it
+        std::string saved_cursor;
         Alias::PseudoConsole::ptr pseudo_console;
         const std::shared_ptr<PrimaryConsole> primary_console;
-        std::vector<std::string> scroll_buffer{std::string{}};
+        ScrollBuffer scroll_buffer;
+        /**
+         * What full screen programs draw, never part of the history. Made the first time the pane switches to it.
+         */
+        std::unique_ptr<TerminalModel> alternate_screen;
+        bool on_alternate_screen = false;
+        std::shared_ptr<MemoryGovernor::Share> memory_share;
+        size_t applied_memory_budget = SCROLL_BUFFER_MEMORY_BUDGET;
+        std::atomic<std::shared_ptr<const PaneSnapshot>> published{std::make_shared<const PaneSnapshot>()};
         bool first_process_added = false;
+        // Whether this pane is counted in the primary console's live panes and attached processes, guarded by process_lock
+        bool counted_live = false;
+        bool counted_attached = false;
+        // How many rows up from the bottom of the scroll buffer the pane is showing
+        size_t view_offset = 0;
+        // Guarded by the stdout lock, like everything the renderer draws from
+        bool visible = true;
+
+        /**
+         * Brings the primary console's counts in line with this pane, the caller must hold process_lock.
+         */
+        void update_pane_counts();
+        struct Reserved {};
+        Console(std::shared_ptr<PrimaryConsole>, Layout, Reserved);
+        /**
+         * Shows or hides the pane as part of showing a window, a pane that stays shown is drawn again.
+         * The caller must hold process_lock and the stdout lock.
+         */
+        void present(bool shown);
     };
 
-    class Process {
+    class Process : public RenderTarget {
         friend class Console;
         
         public:
@@ -65,13 +204,24 @@ namespace omux {
         const std::wstring path;
         const std::wstring args;
         std::string continuing_output_line;
-        Process(Console::Sptr, std::wstring, std::wstring);
+        /**
+         * @param exited called from a thread pool thread once the process exits, it mustn't destroy the Process
+         */
+        Process(Console::Sptr, std::wstring, std::wstring, std::function<void()> exited = {});
         Process(Console::Sptr);
-        ~Process();
+        ~Process() override;
         auto wait_for_idle(int) -> Alias::WAIT_RESULT;
         auto wait_for_stop(int) -> Alias::WAIT_RESULT;
         auto process_running() -> bool;
-        void process_output();
+        /**
+         * Reads and shows the process's output on the I/O executor until stop is requested,
+         * which happens when the process exits or this is destroyed.
+         */
+        auto process_output(std::stop_token stop) -> DetachedTask;
+        /**
+         * Shows a slice of the output process_output has read, on the renderer's thread.
+         */
+        auto render_pending() -> bool override;
         void process_string_for_output(std::string_view);
         void output_line(std::string_view, std::string_view = "");
         void add_to_scrollbuffer(std::string_view);
@@ -79,47 +229,255 @@ namespace omux {
         auto track_cursor_for_sequence(std::string_view sequence) -> std::pair<int, int>;
         auto handle_csi_sequence(std::string_view::iterator& start, std::string_view::iterator& end) -> std::string_view::iterator;
         void set_line_in_screen(unsigned int line_in_screen);
+        /**
+         * Scrolls the pane's rows up one within a scroll region on the host, rather than drawing them all again.
+         * @return false if the host can't, the pane has to be repainted instead
+         */
+        auto scroll_pane_region() -> bool;
         void output_line_from_scroll_buffer(std::string& output, std::ostream& line);
         void process_resize(std::string_view output);
-        void resize_on_next_output(Layout);
-        auto delete_n_renderable_characters_from_string(std::string& line, int n) -> std::string;
+        void resize_on_next_output(Layout, unsigned int);
+        auto origin_column() -> unsigned int;
+        auto column_in_pane(unsigned int column) -> size_t;
+        auto origin_row() -> unsigned int;
+        void repaint_view(size_t offset);
+        /**
+         * repaint_view for a caller that already holds the stdout lock.
+         */
+        void draw_view(size_t offset);
+        void output_to_main_screen(std::string_view);
+        void output_to_alternate_screen(std::string_view);
+        /**
+         * Draws the rows of the alternate screen that changed since it was last drawn.
+         */
+        void draw_alternate_screen();
+        /**
+         * Starts or stops writing to the host to match the pane, the caller must hold the stdout lock.
+         */
+        void visibility_changed();
+        /**
+         * Draws the whole pane again from the scroll buffer or the alternate screen, the caller must hold the stdout lock.
+         */
+        void redraw();
 
         private:
         Alias::Process::ptr process;
-        std::thread output_thread;
+        std::stop_source output_stop;
+        // Set by process_output as the last thing it does with this
+        std::atomic<bool> output_done{true};
+        /**
+         * Output read but not shown yet, unrendered counts the slice being shown as well.
+         * The reads pause while unrendered is over PANE_BACKLOG_LIMIT and the renderer signals as it drains.
+         */
+        std::mutex pending_lock;
+        PendingOutput pending_output;
+        size_t unrendered = 0;
+        WakeSignal backlog_drained{IoExecutor::global()};
         unsigned int line_in_screen = 1; // rows
         unsigned int characters_from_start = 1; // columns
-        std::string saved_cursor_pos{"\x1b[1;1H"};
-        std::atomic<bool> resize_on_next_output_flag = false;
-        std::fstream command_log;
+        // Output can end part way through a character, the rest comes with the next read
+        Utf8Decoder utf8_decoder;
+        // Column then row the host's cursor is left at for this pane, one based
+        std::pair<unsigned int, unsigned int> saved_cursor_pos{1, 1};
+        /**
+         * Generation of the last resize applied to the pseudo console and the generation the renderer
+         * has repainted for. Output is queued with the generation it was read in, the first slice
+         * read in a newer generation than the renderer has handled is the repaint.
+         */
+        std::atomic<unsigned int> resize_generation = 0;
+        unsigned int handled_resize_generation = 0;
+        /**
+         * Alternate screen rows as they were last drawn, nothing for a row that has to be drawn again.
+         */
+        std::vector<std::optional<std::string>> alternate_rows;
+        // Where the cursor was on the main screen when the pane switched away from it
+        std::pair<unsigned int, unsigned int> main_screen_cursor_pos{1, 1};
+        /**
+         * Stands in for the host while the pane is hidden or backed up, so the output moves a cursor the way it would
+         * have on screen. It is as big as the host and nothing while the pane is drawn to the host.
+         */
+        std::unique_ptr<TerminalModel> offscreen;
+        /**
+         * The pane is drawing offscreen because its backlog went over PANE_BACKLOG_LIMIT, and when it has to be repainted
+         * even if it is still backed up.
+         */
+        bool backlog_offscreen = false;
+        std::chrono::steady_clock::time_point backlog_repaint_due;
+
+        /**
+         * Has the output drawn into a model of the host rather than the host, from where the pane left the cursor.
+         */
+        void go_offscreen();
+        /**
+         * Leaves a backlog's offscreen model once it has drained far enough or been there long enough,
+         * and repaints the pane from the scroll buffer.
+         * @param left bytes still waiting to be shown
+         */
+        void catch_up_backlog(size_t left);
+
+        /**
+         * Hands a chunk over to the renderer.
+         * @param generation the resize generation the chunk was read in
+         * @return bytes now waiting to be shown
+         */
+        auto queue_output(std::string_view chunk, unsigned int generation) -> size_t;
+        auto unrendered_bytes() -> size_t;
+        /**
+         * How long until a held synchronized update has to be shown anyway, nothing if none is held.
+         */
+        auto held_frame_delay() -> std::optional<std::chrono::milliseconds>;
+        /**
+         * Remembers where the cursor is left for this pane, for the next chunk and for the primary console.
+         */
+        void save_cursor(unsigned int column, unsigned int row);
+        /**
+         * Output for the host, which goes to the offscreen model instead while the pane is hidden.
+         */
+        void write_to_host(std::string_view output);
+        void write_to_host(char output);
+        auto host_cursor() -> std::pair<unsigned int, unsigned int>;
+        auto move_host_cursor(unsigned int column, std::optional<unsigned int> row) -> std::string;
+        auto host_cursor_encoder() -> CursorEncoder;
     };
-    enum SPLIT_DIRECTION { VERT, HORI };
-    
     class PrimaryConsole {
         Alias::MainConsole primary_console;
-        omux::Console* active_console = nullptr;
         /**
-         * As the active_console is going to called from a lambda thread
-         * and being set from different places, we need to ensure we lock guard
-         * it.
+         * Every attached pane and which one is active. Readers from the input thread and the output threads share
+         * the lock, a pane removing itself takes it exclusively, so a pane can't go away while it is being used.
+         */
+        std::shared_mutex consoles_lock;
+        SlotMap<Console*> consoles;
+        // Where each registered pane is in consoles by its id, which is what windows know panes by
+        std::unordered_map<unsigned int, SlotHandle> pane_handles;
+        SlotHandle active_console;
+        /**
+         * Tabs of panes, every registered pane is in one of them. Only the current window's panes are shown,
+         * the rest are hidden and write nothing to the host. Guarded by consoles_lock.
          */
-        std::mutex active_console_lock;
+        std::vector<Window> windows;
+        size_t current_window = 0;
+        // Guarded by consoles_lock
+        std::weak_ptr<ShellPool> shell_pool;
         
         std::mutex stdout_mutex;
-        std::thread stdin_read_thread;
-        std::vector<Console*> attached_consoles;
+        /**
+         * Shows every pane's output, holding stdout_mutex while it does.
+         */
+        RenderScheduler renderer{stdout_mutex};
+        /**
+         * Attributes seen in every pane's output, panes refer to them by id.
+         */
+        std::shared_ptr<AttributeTable> attributes = std::make_shared<AttributeTable>();
+        /**
+         * Where the host's cursor is, followed through everything written to stdout. A leaf lock.
+         */
+        std::mutex cursor_lock;
+        CursorEncoder cursor_encoder;
+        /**
+         * What the host supports, guarded by the stdout lock. Nothing is used until the host has been probed.
+         */
+        HostProfile host_profile;
+        // Frames being drawn and whether the outermost one was started on the host, guarded by the stdout lock
+        int frame_depth = 0;
+        bool frame_synchronized = false;
+        /**
+         * The probe the input thread is picking answers out of the input for, until it is answered or probe_deadline passes.
+         * A probe that times out is kept until HOST_PROBE_LATE_MS later to take the replies of a slow host.
+         */
+        std::mutex probe_lock;
+        std::optional<HostProbe> probe;
+        std::chrono::steady_clock::time_point probe_deadline;
+        bool probe_timed_out = false;
+        // Only set before the input thread starts
+        std::string probe_identity;
+        std::filesystem::path probe_cache;
+        std::jthread stdin_read_thread;
         std::shared_ptr<omux::ActionFactory> action_factory;
-        bool first_console_added = false;
+        std::atomic<bool> first_console_added = false;
+        /**
+         * Registered panes that haven't finished, and how many of them have a process attached.
+         * Panes keep these up to date themselves so stopping never has to look at every pane.
+         */
+        std::atomic<size_t> live_panes = 0;
+        std::atomic<size_t> attached_processes = 0;
+
+        /**
+         * Uses the host's profile from the cache, or writes the probe for the input thread to pick the answers up.
+         */
+        void start_probe(const std::filesystem::path& host_profiles);
+        /**
+         * How long the input thread can wait for input before the probe has to end, nothing when there isn't one.
+         */
+        auto probe_wait() -> std::optional<std::chrono::milliseconds>;
+        /**
+         * Takes the probe's answers out of input, and ends the probe once it is answered or out of time.
+         * Only a complete profile is cached, one the host was too slow to finish is used until it does and probed again next start.
+         * @return the rest of the input, which is for the panes
+         */
+        auto answer_probe(std::optional<std::string> input) -> std::optional<std::string>;
+        /**
+         * The registered pane with id, the caller must hold consoles_lock.
+         */
+        auto find_console(unsigned int id) -> Console*;
+        auto find_window(unsigned int pane) -> std::optional<size_t>;
+        /**
+         * Lays the current window out and draws it from its panes' models in one frame, hiding every pane that isn't in it.
+         * The caller must hold consoles_lock exclusively.
+         */
+        void present_current_window();
 
         public:
         using Sptr = std::shared_ptr<PrimaryConsole>;
         PrimaryConsole();
         PrimaryConsole(std::shared_ptr<omux::ActionFactory>);
+        /**
+         * Probes what the host supports first, or finds it in the profiles cached at host_profiles.
+         * The host gets HOST_PROBE_TIMEOUT_MS to answer, output goes ahead in the meantime as though it supports nothing.
+         */
+        PrimaryConsole(std::shared_ptr<omux::ActionFactory>, std::optional<std::filesystem::path> host_profiles);
         virtual ~PrimaryConsole();
         void set_active(Console*);
         virtual void write_to_stdout(std::string_view);
         virtual void write_to_stdout(std::stringstream&);
         virtual auto write_character_to_stdout(const char) -> bool;
+        /**
+         * Where the host's cursor is, one based column then row.
+         * Virtual so a console that isn't backed by the real host can answer for itself.
+         */
+        virtual auto cursor_position() -> std::pair<unsigned int, unsigned int>;
+        auto cursor_position_as_movement() -> std::string;
+        /**
+         * Asks the host where the cursor is, like cursor_position, and lets the cursor encoder know.
+         */
+        auto locate_cursor() -> std::pair<unsigned int, unsigned int>;
+        /**
+         * Writes the cheapest movement from where the cursor is to column and row, one based.
+         * @param row nothing to stay on the cursor's row
+         * @return what was written, nothing when the cursor is already there
+         */
+        auto move_cursor(unsigned int column, std::optional<unsigned int> row) -> std::string;
+        /**
+         * Lets the cursor encoder know about output that reached the host without going through write_to_stdout.
+         */
+        void follow_output(std::string_view);
+        void set_screen_size(int width, int height);
+        void set_auto_wrap(bool wraps);
+        auto get_cursor_encoder() -> CursorEncoder;
+        /**
+         * Only while holding the stdout lock.
+         */
+        auto get_host_profile() -> const HostProfile&;
+        void set_host_profile(HostProfile);
+        /**
+         * Everything written until the matching end_frame is shown at once by a host with synchronized output.
+         * Frames can be nested, only the outermost is written. The caller must hold the stdout lock.
+         */
+        void begin_frame();
+        void end_frame();
+        /**
+         * Output that is a frame on its own, wrapped to be shown at once when the host can and it isn't part of a frame already.
+         */
+        auto synchronized_frame(std::string output) -> std::string;
         void write_input(std::string_view);
         auto process_input(std::string_view) -> std::string;
         // TODO This should return an object which is the only way to
@@ -127,16 +485,66 @@ namespace omux {
         void lock_stdout();
         void unlock_stdout();
         void wait_for_attached_consoles();
-        void add_console(Console*);
+        auto add_console(Console*) -> SlotHandle;
         void remove_console(Console*);
+        /**
+         * True once every registered pane has finished, doesn't depend on how many panes there are.
+         */
         auto should_stop() -> bool;
+        /**
+         * Called by a pane when it starts or stops counting as live or as having a process attached.
+         * Wakes anyone waiting once the last one goes.
+         */
+        void pane_counts_changed(int live, int attached);
         void reset_stdio();
         auto get_stdout_lock() -> std::mutex*;
+        auto get_renderer() -> RenderScheduler&;
+        auto get_attributes() -> std::shared_ptr<AttributeTable>;
+        /**
+         * Splits the active pane in its window, the new pane gets the right or bottom half.
+         * With a shell pool the new pane is a pooled one, already running its shell, when there is one ready.
+         */
         auto split_active_console(SPLIT_DIRECTION) -> Console::Sptr;
+        /**
+         * Opens a window with one pane as big as the current window, and makes it current.
+         */
+        auto new_window() -> Console::Sptr;
+        /**
+         * Makes the window step windows on from the current one current, wrapping around.
+         */
+        void select_window(int step);
+        /**
+         * Where splits take a shell that has already started from, the pool is owned elsewhere.
+         */
+        void set_shell_pool(std::weak_ptr<ShellPool>);
+        auto get_current_window() -> size_t;
+        auto window_count() -> size_t;
+        /**
+         * Zooms the active pane to fill its window, or puts the window's panes back if one is zoomed.
+         */
+        void toggle_zoom();
+        /**
+         * The pane that fills the current window, nothing when none does.
+         */
+        auto get_zoomed_pane() -> std::optional<unsigned int>;
         auto get_terminal_size() -> Layout;
-        auto get_active_console() -> Console* {
-            return active_console;
-        };
+        /**
+         * Only safe to use from a thread that keeps the pane alive, anything else should use with_active_console.
+         */
+        auto get_active_console() -> Console*;
+        /**
+         * Runs action on the active pane, the pane can't be removed until it returns.
+         * @return false if there is no active pane
+         */
+        template <typename Action> auto with_active_console(Action&& action) -> bool {
+            std::shared_lock lock(consoles_lock);
+            auto** console = consoles.get(active_console);
+            if(console == nullptr) {
+                return false;
+            }
+            action(**console);
+            return true;
+        }
     };
     
 } // namespace omux
\ No newline at end of file
@@ -0,0 +1,346 @@
+#include "omux/cursor_encoder.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <vector>
+
+namespace omux {
+    namespace {
+        /**
+         * The nth ; separated number, fallback when it is missing or 0.
+         */
+        auto parameter(std::string_view parameters, size_t index, int fallback) -> int {
+            size_t start = 0;
+            for(size_t i = 0; i < index; i++) {
+                start = parameters.find(';', start);
+                if(start == std::string_view::npos) {
+                    return fallback;
+                }
+                start++;
+            }
+            int value = 0;
+            auto end = parameters.find(';', start);
+            auto number = parameters.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+            std::from_chars(number.data(), number.data() + number.size(), value);
+            return value == 0 ? fallback : value;
+        }
+
+        /**
+         * A CSI with a count, which is left out when it is 1.
+         */
+        auto counted(int count, char final_character) -> std::string {
+            if(count == 1) {
+                return std::string{"\x1b["} + final_character;
+            }
+            return "\x1b[" + std::to_string(count) + final_character;
+        }
+
+        auto cup(int column, int row) -> std::string {
+            if(column == 1) {
+                return row == 1 ? "\x1b[H" : "\x1b[" + std::to_string(row) + "H";
+            }
+            return "\x1b[" + std::to_string(row) + ";" + std::to_string(column) + "H";
+        }
+
+        // Private modes that don't move the cursor, any other could switch screens or set origin mode
+        constexpr std::array<std::string_view, 5> STILL_MODES{"?25", "?12", "?2026", "?2004", "?1004"};
+    } // namespace
+
+    void CursorEncoder::set_screen_size(int new_width, int new_height) {
+        width = std::max(new_width, 0);
+        height = std::max(new_height, 0);
+    }
+
+    void CursorEncoder::set_auto_wrap(bool wraps) {
+        auto_wrap = wraps;
+        cursor.pending_wrap = cursor.pending_wrap && wraps;
+    }
+
+    void CursorEncoder::reported(int column, int row) {
+        cursor.row = row;
+        cursor.pending_wrap = false;
+        if(width > 0 && column < width) {
+            cursor.column = column;
+        } else {
+            cursor.column.reset();
+        }
+    }
+
+    void CursorEncoder::forget() {
+        cursor = CursorState{};
+    }
+
+    auto CursorEncoder::get_state() const -> const CursorState& {
+        return cursor;
+    }
+
+    auto CursorEncoder::clamp_column(int column) const -> int {
+        return width > 0 ? std::clamp(column, 1, width) : std::max(column, 1);
+    }
+
+    auto CursorEncoder::clamp_row(int row) const -> int {
+        return height > 0 ? std::clamp(row, 1, height) : std::max(row, 1);
+    }
+
+    void CursorEncoder::wrote(std::string_view output) {
+        for(auto character : output) {
+            auto byte = static_cast<unsigned char>(character);
+            if(!sequence.empty()) {
+                sequence.push_back(character);
+                auto introducer = sequence[1];
+                auto complete = false;
+                if(sequence.size() == 2) {
+                    complete = introducer != '[' && introducer != ']' && !(byte >= 0x20 && byte <= 0x2f);
+                } else if(introducer == '[') {
+                    complete = byte >= 0x40 && byte <= 0x7e;
+                } else if(introducer == ']') {
+                    complete = byte == 0x07 || (character == '\\' && sequence[sequence.size() - 2] == '\x1b');
+                } else {
+                    // Character set designations and the like, the byte after the intermediate ends them
+                    complete = true;
+                }
+                if(complete) {
+                    escape(sequence);
+                    sequence.clear();
+                }
+                continue;
+            }
+            if(byte == 0x1b) {
+                sequence.push_back(character);
+            } else if(byte >= 0x20 && byte < 0x7f) {
+                print();
+            } else if(byte >= 0x80) {
+                // Continuation bytes are part of the character their lead byte already counted
+                if((byte & 0xc0) != 0x80) {
+                    print_unknown();
+                }
+            } else {
+                switch(character) {
+                    case '\r':
+                        cursor.column = 1;
+                        cursor.pending_wrap = false;
+                        break;
+                    case '\n':
+                    case '\v':
+                    case '\f':
+                        line_feed();
+                        break;
+                    case '\b':
+                        if(cursor.column) {
+                            cursor.column = clamp_column(*cursor.column - 1);
+                        }
+                        cursor.pending_wrap = false;
+                        break;
+                    case '\t':
+                        if(cursor.column && width > 0) {
+                            cursor.column = std::min((*cursor.column - 1) / 8 * 8 + 9, width);
+                        } else {
+                            cursor.column.reset();
+                        }
+                        cursor.pending_wrap = false;
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    void CursorEncoder::print() {
+        if(cursor.pending_wrap) {
+            cursor.column = 1;
+            line_feed();
+        }
+        if(!cursor.column || width == 0) {
+            // Where the character went isn't known, or whether it wrapped
+            if(!cursor.column && auto_wrap) {
+                cursor.row.reset();
+            }
+            cursor.column.reset();
+            return;
+        }
+        if(*cursor.column >= width) {
+            cursor.pending_wrap = auto_wrap;
+        } else {
+            ++*cursor.column;
+        }
+    }
+
+    void CursorEncoder::print_unknown() {
+        // Anything but ASCII could take none, one or two columns
+        if(auto_wrap && (cursor.pending_wrap || !cursor.column || width == 0 || *cursor.column + 1 >= width)) {
+            cursor.row.reset();
+        }
+        cursor.column.reset();
+        cursor.pending_wrap = false;
+    }
+
+    void CursorEncoder::line_feed() {
+        cursor.pending_wrap = false;
+        if(cursor.row && height > 0) {
+            cursor.row = std::min(*cursor.row + 1, height);
+        } else {
+            cursor.row.reset();
+        }
+    }
+
+    void CursorEncoder::escape(std::string_view escape_sequence) {
+        if(escape_sequence[1] == '[') {
+            csi(escape_sequence.substr(2, escape_sequence.size() - 3), escape_sequence.back());
+            return;
+        }
+        if(escape_sequence.size() != 2) {
+            // OSC and character sets don't move the cursor
+            return;
+        }
+        switch(escape_sequence[1]) {
+            case 'D':
+                line_feed();
+                break;
+            case 'E':
+                cursor.column = 1;
+                line_feed();
+                break;
+            case 'M':
+                if(cursor.row) {
+                    cursor.row = clamp_row(*cursor.row - 1);
+                }
+                cursor.pending_wrap = false;
+                break;
+            case '8':
+            case 'c':
+                forget();
+                break;
+            default:
+                break;
+        }
+    }
+
+    void CursorEncoder::csi(std::string_view parameters, char final_character) {
+        if(!parameters.empty() && (parameters.front() < '0' || parameters.front() > ';')) {
+            if(parameters == "?7" && (final_character == 'h' || final_character == 'l')) {
+                set_auto_wrap(final_character == 'h');
+            } else if((final_character == 'h' || final_character == 'l') &&
+               std::find(STILL_MODES.begin(), STILL_MODES.end(), parameters) == STILL_MODES.end()) {
+                forget();
+            }
+            return;
+        }
+        if(parameters.find_first_of(" !\"#$%&'()*+,-./") != std::string_view::npos) {
+            // Intermediates, like setting the cursor shape
+            return;
+        }
+        auto first = parameter(parameters, 0, 1);
+        auto move_columns = [&](int by) {
+            if(cursor.column) {
+                cursor.column = clamp_column(*cursor.column + by);
+            }
+            cursor.pending_wrap = false;
+        };
+        auto move_rows = [&](int by) {
+            if(cursor.row) {
+                cursor.row = clamp_row(*cursor.row + by);
+            }
+            cursor.pending_wrap = false;
+        };
+        switch(final_character) {
+            case 'A':
+                move_rows(-first);
+                break;
+            case 'B':
+            case 'e':
+                move_rows(first);
+                break;
+            case 'C':
+            case 'a':
+                move_columns(first);
+                break;
+            case 'D':
+                move_columns(-first);
+                break;
+            case 'E':
+                move_rows(first);
+                cursor.column = 1;
+                break;
+            case 'F':
+                move_rows(-first);
+                cursor.column = 1;
+                break;
+            case 'G':
+            case '`':
+                cursor.column = clamp_column(first);
+                cursor.pending_wrap = false;
+                break;
+            case 'd':
+                cursor.row = clamp_row(first);
+                cursor.pending_wrap = false;
+                break;
+            case 'H':
+            case 'f':
+                cursor.row = clamp_row(first);
+                cursor.column = clamp_column(parameter(parameters, 1, 1));
+                cursor.pending_wrap = false;
+                break;
+            case 'c':
+            case 'm':
+            case 'X':
+            case 'K':
+            case 'J':
+            case 'P':
+            case '@':
+            case 'S':
+            case 'T':
+            case 'n':
+            case 's':
+            case 't':
+                break;
+            default:
+                forget();
+                break;
+        }
+    }
+
+    auto CursorEncoder::movement_to(int column, std::optional<int> row) const -> std::string {
+        return cheapest_move(cursor, column, row);
+    }
+
+    auto CursorEncoder::cheapest_move(const CursorState& from, int column, std::optional<int> row) -> std::string {
+        std::optional<std::string> best;
+        auto consider = [&](std::string movement) {
+            if(!best || movement.size() < best->size()) {
+                best = std::move(movement);
+            }
+        };
+        // Moving between rows leaves the column alone, so a move is a vertical part and then a horizontal one
+        std::vector<std::string> vertical;
+        if(!row || (from.row && *from.row == *row)) {
+            vertical.emplace_back();
+        } else {
+            if(from.row && *row > *from.row) {
+                // The row is on screen, so line feeds down to it never scroll
+                vertical.emplace_back(static_cast<size_t>(*row - *from.row), '\n');
+                vertical.push_back(counted(*row - *from.row, 'B'));
+            } else if(from.row) {
+                vertical.push_back(counted(*from.row - *row, 'A'));
+            }
+            vertical.push_back(counted(*row, 'd'));
+        }
+        for(const auto& down : vertical) {
+            // A pending wrap is cleared by any move, even one that ends where it started
+            if(from.column && *from.column == column && (!down.empty() || !from.pending_wrap)) {
+                consider(down);
+            }
+            if(from.column && column > *from.column) {
+                consider(down + counted(column - *from.column, 'C'));
+            } else if(from.column && column < *from.column) {
+                consider(down + counted(*from.column - column, 'D'));
+            }
+            consider(column == 1 ? down + "\r" : down + "\r" + counted(column - 1, 'C'));
+            consider(down + counted(column, 'G'));
+        }
+        if(row || from.row) {
+            consider(cup(column, row ? *row : *from.row));
+        }
+        return *best;
+    }
+} // namespace omux
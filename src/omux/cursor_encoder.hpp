@@ -0,0 +1,71 @@
+#pragma once
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace omux {
+    /**
+     * Where the host's cursor is as far as omux knows, columns and rows are 1 based like the sequences.
+     */
+    struct CursorState {
+        std::optional<int> column;
+        std::optional<int> row;
+        /**
+         * Something was written in the last column and the next character wraps first.
+         * Moving to where the cursor already is still has to be written to clear it.
+         */
+        bool pending_wrap = false;
+    };
+
+    /**
+     * Follows what is written to the host to know where its cursor is, and picks the fewest bytes that move it:
+     * nothing, CR and LF, CUU/CUD/CUF/CUB, CHA/VPA or CUP.
+     *
+     * Output it can't follow forgets the position, and a part of it that isn't known is only moved to absolutely.
+     * LF moves down without returning the carriage, the host is set up with DISABLE_NEWLINE_AUTO_RETURN.
+     */
+    class CursorEncoder {
+        public:
+        /**
+         * Without a size the right edge isn't known, so a column reported by the host can't be trusted.
+         */
+        void set_screen_size(int width, int height);
+        /**
+         * Whether writing in the last column wraps, as DECAWM sets it. Without it the cursor stays in the last column.
+         */
+        void set_auto_wrap(bool wraps);
+        /**
+         * The host said where its cursor is. A wrap may be pending at the right edge, which it doesn't say.
+         */
+        void reported(int column, int row);
+        void forget();
+        /**
+         * Follows output as it goes to the host, sequences can be split between writes.
+         */
+        void wrote(std::string_view output);
+        /**
+         * The cheapest output from where the cursor is to column and row, which has to be on screen.
+         * Nothing is followed until it is written.
+         * @param row nothing to stay on the row the cursor is on, whether or not it is known
+         */
+        [[nodiscard]] auto movement_to(int column, std::optional<int> row) const -> std::string;
+        [[nodiscard]] auto get_state() const -> const CursorState&;
+        static auto cheapest_move(const CursorState& from, int column, std::optional<int> row) -> std::string;
+
+        private:
+        CursorState cursor;
+        int width = 0;
+        int height = 0;
+        bool auto_wrap = true;
+        // An escape sequence split between writes
+        std::string sequence;
+
+        void print();
+        void print_unknown();
+        void line_feed();
+        void escape(std::string_view escape_sequence);
+        void csi(std::string_view parameters, char final_character);
+        auto clamp_column(int column) const -> int;
+        auto clamp_row(int row) const -> int;
+    };
+} // namespace omux
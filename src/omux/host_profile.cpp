@@ -0,0 +1,296 @@
+#include "omux/host_profile.hpp"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstdlib>
+#include <fstream>
+#include <system_error>
+#include <utility>
+
+namespace omux {
+    namespace {
+        constexpr std::string_view CACHE_HEADER{"omux host profiles 1"};
+        // Replies are short, a sequence that goes on longer than this is something else
+        constexpr size_t LONGEST_REPLY = 256;
+        constexpr int LEFT_RIGHT_MARGIN_MODE = 69;
+        constexpr int SYNCHRONIZED_OUTPUT_MODE = 2026;
+        // What the host sets for what it starts, in the order they go into the identity
+        constexpr std::array<const char*, 6> IDENTITY_VARIABLES{"TERM_PROGRAM", "TERM_PROGRAM_VERSION", "TERM", "COLORTERM", "ConEmuBuild", "WT_SESSION"};
+
+        auto numbers(std::string_view parameters) -> std::vector<int> {
+            std::vector<int> values;
+            while(!parameters.empty()) {
+                auto end = parameters.find(';');
+                auto number = parameters.substr(0, end);
+                int value = 0;
+                std::from_chars(number.data(), number.data() + number.size(), value);
+                values.push_back(value);
+                if(end == std::string_view::npos) {
+                    break;
+                }
+                parameters.remove_prefix(end + 1);
+            }
+            return values;
+        }
+
+        auto split(std::string_view line, char separator) -> std::vector<std::string_view> {
+            std::vector<std::string_view> fields;
+            for(auto end = line.find(separator); end != std::string_view::npos; end = line.find(separator)) {
+                fields.push_back(line.substr(0, end));
+                line.remove_prefix(end + 1);
+            }
+            fields.push_back(line);
+            return fields;
+        }
+
+        /**
+         * Keeps a field on its own line and in its own column.
+         */
+        auto one_line(std::string text) -> std::string {
+            std::replace_if(text.begin(), text.end(), [](char character) { return character == '\t' || character == '\n' || character == '\r'; }, ' ');
+            return text;
+        }
+
+        auto capabilities(const HostProfile& profile) -> std::vector<std::pair<std::string_view, bool>> {
+            return {{"scroll_regions", profile.scroll_regions},
+                    {"left_right_margins", profile.left_right_margins},
+                    {"synchronized_output", profile.synchronized_output},
+                    {"truecolor", profile.truecolor},
+                    {"clipboard", profile.clipboard}};
+        }
+    } // namespace
+
+    auto HostProbe::queries() -> std::string_view {
+        // DA1 goes last, it is answered after everything before it
+        return "\x1b[>0q\x1b[?2026$p\x1b[?69$p\x1b[>c\x1b[c";
+    }
+
+    auto HostProbe::feed(std::string_view input) -> std::string {
+        buffer.append(input);
+        std::string forwarded;
+        size_t start = 0;
+        while(start < buffer.size()) {
+            if(complete()) {
+                forwarded.append(buffer, start);
+                start = buffer.size();
+                break;
+            }
+            auto escape = buffer.find('\x1b', start);
+            if(escape == std::string::npos) {
+                forwarded.append(buffer, start);
+                start = buffer.size();
+                break;
+            }
+            forwarded.append(buffer, start, escape - start);
+            start = escape;
+            auto length = take_reply(std::string_view{buffer}.substr(start));
+            if(!length) {
+                // Held until the rest comes in or the probe ends
+                break;
+            }
+            if(*length == 0) {
+                forwarded.push_back('\x1b');
+                start++;
+            } else {
+                start += *length;
+            }
+        }
+        buffer.erase(0, start);
+        return forwarded;
+    }
+
+    auto HostProbe::take_reply(std::string_view input) -> std::optional<size_t> {
+        if(input.size() < 2) {
+            return std::nullopt;
+        }
+        if(input[1] == '[') {
+            size_t end = 2;
+            while(end < input.size() && end < LONGEST_REPLY) {
+                auto byte = static_cast<unsigned char>(input[end]);
+                if(byte >= 0x40 && byte <= 0x7e) {
+                    break;
+                }
+                if(byte < 0x20 || byte > 0x3f) {
+                    return 0;
+                }
+                end++;
+            }
+            if(end >= LONGEST_REPLY) {
+                return 0;
+            }
+            if(end == input.size()) {
+                return std::nullopt;
+            }
+            auto parameters = input.substr(2, end - 2);
+            auto final_character = input[end];
+            if(final_character == 'c' && parameters.starts_with('?')) {
+                device_attributes = numbers(parameters.substr(1));
+            } else if(final_character == 'c' && parameters.starts_with('>')) {
+                secondary_attributes = std::string{parameters.substr(1)};
+            } else if(final_character == 'y' && parameters.starts_with('?') && parameters.ends_with('$')) {
+                auto values = numbers(parameters.substr(1, parameters.size() - 2));
+                if(values.size() == 2) {
+                    modes[values[0]] = values[1];
+                }
+            } else {
+                return 0;
+            }
+            return end + 1;
+        }
+        if(input[1] == 'P') {
+            auto end = input.find("\x1b\\", 2);
+            if(end == std::string_view::npos) {
+                return input.size() < LONGEST_REPLY ? std::nullopt : std::optional<size_t>{0};
+            }
+            auto body = input.substr(2, end - 2);
+            if(!body.starts_with(">|")) {
+                return 0;
+            }
+            version = std::string{body.substr(2)};
+            return end + 2;
+        }
+        return 0;
+    }
+
+    auto HostProbe::complete() const -> bool {
+        return device_attributes.has_value();
+    }
+
+    auto HostProbe::finish() -> std::string {
+        return std::exchange(buffer, {});
+    }
+
+    auto HostProbe::profile(std::string_view colorterm) const -> HostProfile {
+        HostProfile profile;
+        auto mode_supported = [&](int mode) {
+            auto setting = modes.find(mode);
+            // 1 and 2 are set and reset, 3 is permanently set and 4 permanently reset
+            return setting != modes.end() && setting->second >= 1 && setting->second <= 3;
+        };
+        auto has_attribute = [&](int attribute) {
+            return device_attributes && std::find(device_attributes->begin() + 1, device_attributes->end(), attribute) != device_attributes->end();
+        };
+        // Anything that answers DA1 is at least a VT100, which has scroll regions
+        profile.scroll_regions = device_attributes.has_value() && !device_attributes->empty();
+        profile.left_right_margins = mode_supported(LEFT_RIGHT_MARGIN_MODE);
+        profile.synchronized_output = mode_supported(SYNCHRONIZED_OUTPUT_MODE);
+        // There is no query for it, the hosts that say they have ANSI color take 24 bit SGR as well
+        profile.truecolor = colorterm == "truecolor" || colorterm == "24bit" || has_attribute(22);
+        profile.clipboard = has_attribute(52);
+        if(version) {
+            profile.version = *version;
+        } else if(secondary_attributes) {
+            profile.version = "DA2 " + *secondary_attributes;
+        }
+        return profile;
+    }
+
+    auto host_identity(const std::function<std::optional<std::string>(const char*)>& environment) -> std::string {
+        std::string identity;
+        for(const auto* variable : IDENTITY_VARIABLES) {
+            auto value = environment(variable);
+            if(!value) {
+                continue;
+            }
+            if(!identity.empty()) {
+                identity += ' ';
+            }
+            // A session id changes every time, only that there is one says anything about the host
+            identity += std::string{variable} == "WT_SESSION" ? "WindowsTerminal" : std::string{variable} + "=" + *value;
+        }
+        return one_line(identity.empty() ? "console" : identity);
+    }
+
+    auto host_identity() -> std::string {
+        return host_identity([](const char* variable) -> std::optional<std::string> {
+            const auto* value = std::getenv(variable);
+            if(value == nullptr || *value == '\0') {
+                return std::nullopt;
+            }
+            return std::string{value};
+        });
+    }
+
+    HostProfileCache::HostProfileCache(std::filesystem::path path) : path(std::move(path)) {
+    }
+
+    auto HostProfileCache::default_path() -> std::filesystem::path {
+        if(const auto* local_app_data = std::getenv("LOCALAPPDATA"); local_app_data != nullptr && *local_app_data != '\0') {
+            return std::filesystem::path{local_app_data} / "omux" / "host_profiles.txt";
+        }
+        std::error_code error;
+        auto temp = std::filesystem::temp_directory_path(error);
+        return (error ? std::filesystem::path{"."} : temp) / "omux_host_profiles.txt";
+    }
+
+    auto HostProfileCache::load() -> std::map<std::string, Entry, std::less<>> {
+        std::map<std::string, Entry, std::less<>> entries;
+        std::ifstream file{path};
+        std::string line;
+        if(!std::getline(file, line) || line != CACHE_HEADER) {
+            // Nothing cached yet, or by a version of omux that kept something else
+            return entries;
+        }
+        while(std::getline(file, line)) {
+            auto fields = split(line, '\t');
+            if(fields.size() != 4) {
+                continue;
+            }
+            long long seconds = 0;
+            if(std::from_chars(fields[1].data(), fields[1].data() + fields[1].size(), seconds).ec != std::errc{}) {
+                continue;
+            }
+            Entry entry{std::chrono::system_clock::time_point{std::chrono::seconds{seconds}}, HostProfile{}};
+            for(auto capability : split(fields[2], ',')) {
+                entry.profile.scroll_regions |= capability == "scroll_regions";
+                entry.profile.left_right_margins |= capability == "left_right_margins";
+                entry.profile.synchronized_output |= capability == "synchronized_output";
+                entry.profile.truecolor |= capability == "truecolor";
+                entry.profile.clipboard |= capability == "clipboard";
+            }
+            entry.profile.version = std::string{fields[3]};
+            entries.insert_or_assign(std::string{fields[0]}, std::move(entry));
+        }
+        return entries;
+    }
+
+    auto HostProfileCache::find(std::string_view identity, std::chrono::system_clock::duration max_age) -> std::optional<HostProfile> {
+        auto entries = load();
+        auto entry = entries.find(identity);
+        if(entry == entries.end() || std::chrono::system_clock::now() - entry->second.probed > max_age) {
+            return std::nullopt;
+        }
+        return entry->second.profile;
+    }
+
+    auto HostProfileCache::store(const std::string& identity, const HostProfile& profile) -> bool {
+        auto entries = load();
+        entries.insert_or_assign(one_line(identity), Entry{std::chrono::system_clock::now(), profile});
+        std::error_code error;
+        if(path.has_parent_path()) {
+            std::filesystem::create_directories(path.parent_path(), error);
+        }
+        auto written = path;
+        written += ".tmp";
+        {
+            std::ofstream file{written, std::ios::trunc};
+            file << CACHE_HEADER << '\n';
+            for(const auto& [entry_identity, entry] : entries) {
+                std::string supported;
+                for(auto [name, has] : capabilities(entry.profile)) {
+                    if(has) {
+                        supported += supported.empty() ? "" : ",";
+                        supported += name;
+                    }
+                }
+                file << entry_identity << '\t' << std::chrono::duration_cast<std::chrono::seconds>(entry.probed.time_since_epoch()).count() << '\t'
+                     << supported << '\t' << one_line(entry.profile.version) << '\n';
+            }
+            if(!file.flush()) {
+                return false;
+            }
+        }
+        std::filesystem::rename(written, path, error);
+        return !error;
+    }
+} // namespace omux
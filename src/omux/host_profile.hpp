@@ -0,0 +1,129 @@
+#pragma once
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace omux {
+    /**
+     * Longest startup waits for the host to answer the probe, a host that doesn't answer is treated as supporting none of it.
+     */
+    constexpr auto HOST_PROBE_TIMEOUT_MS = std::chrono::milliseconds(200);
+    /**
+     * How long after the timeout replies are still taken out of the input, a slow host's answers would otherwise go to a pane.
+     */
+    constexpr auto HOST_PROBE_LATE_MS = std::chrono::milliseconds(2000);
+    /**
+     * A cached profile older than this is probed again, hosts get updated without their identity changing.
+     */
+    constexpr auto HOST_PROFILE_MAX_AGE = std::chrono::hours(24 * 7);
+
+    /**
+     * What the host terminal can do beyond what omux has always relied on. Nothing is assumed until it is probed.
+     */
+    struct HostProfile {
+        // DECSTBM, scrolling a band of rows with SU and SD
+        bool scroll_regions = false;
+        // DECLRMM and DECSLRM, so a band of rows can be narrowed to a pane's columns
+        bool left_right_margins = false;
+        // ?2026, the host holds a frame back until it is finished
+        bool synchronized_output = false;
+        bool truecolor = false;
+        // Setting the clipboard with OSC 52
+        bool clipboard = false;
+        // What the host says it is, from XTVERSION or else DA2
+        std::string version;
+
+        auto operator==(const HostProfile&) const -> bool = default;
+    };
+
+    /**
+     * Asks the host what it supports with XTVERSION, DECRQM, DA2 and finally DA1, and picks the answers out of its input.
+     *
+     * Every terminal answers DA1 and answers in order, so the DA1 reply means everything else that was going to be answered has been.
+     * Anything in the input that isn't an answer, like keys pressed while waiting, is handed back.
+     */
+    class HostProbe {
+        public:
+        /**
+         * What to write to the host to start the probe.
+         */
+        static auto queries() -> std::string_view;
+        /**
+         * Takes input from the host, a reply can be split between reads.
+         * @return input that wasn't a reply
+         */
+        auto feed(std::string_view input) -> std::string;
+        /**
+         * The host has answered everything it is going to.
+         */
+        [[nodiscard]] auto complete() const -> bool;
+        /**
+         * Ends the probe whether or not it is complete.
+         * @return input held back in case it was the start of a reply
+         */
+        auto finish() -> std::string;
+        /**
+         * What the answers so far say the host supports.
+         * @param colorterm the COLORTERM the host set, the only way some say they have truecolor
+         */
+        [[nodiscard]] auto profile(std::string_view colorterm) const -> HostProfile;
+
+        private:
+        std::string buffer;
+        std::optional<std::vector<int>> device_attributes;
+        std::optional<std::string> secondary_attributes;
+        std::optional<std::string> version;
+        // DECRPM answers, mode to its setting
+        std::map<int, int> modes;
+
+        /**
+         * Takes one reply from the start of input, which starts with an escape.
+         * @return its length, 0 if input doesn't start with a reply and nothing if it may be one that isn't finished
+         */
+        auto take_reply(std::string_view input) -> std::optional<size_t>;
+    };
+
+    /**
+     * Who the host is, from what it sets in the environment of what it starts, so a profile can be found before asking it anything.
+     * @param environment looks up a variable, nothing when it isn't set
+     */
+    auto host_identity(const std::function<std::optional<std::string>(const char*)>& environment) -> std::string;
+    auto host_identity() -> std::string;
+
+    /**
+     * Host profiles probed on earlier startups, one line each in a text file keyed by the host identity.
+     * The file is read and written whole, it is only touched at startup.
+     */
+    class HostProfileCache {
+        public:
+        explicit HostProfileCache(std::filesystem::path path);
+        /**
+         * Where profiles are kept by default, under LOCALAPPDATA or else the temp directory.
+         */
+        static auto default_path() -> std::filesystem::path;
+        /**
+         * @return nothing if there isn't a profile for the identity or it is older than max_age
+         */
+        auto find(std::string_view identity, std::chrono::system_clock::duration max_age = HOST_PROFILE_MAX_AGE) -> std::optional<HostProfile>;
+        /**
+         * Adds or replaces the identity's profile, the file is replaced rather than rewritten so a reader never sees half of it.
+         * @return false if the file couldn't be written, the profile is only probed again next time
+         */
+        auto store(const std::string& identity, const HostProfile& profile) -> bool;
+
+        private:
+        struct Entry {
+            std::chrono::system_clock::time_point probed;
+            HostProfile profile;
+        };
+
+        std::filesystem::path path;
+
+        auto load() -> std::map<std::string, Entry, std::less<>>;
+    };
+} // namespace omux
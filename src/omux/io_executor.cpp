@@ -0,0 +1,146 @@
+#include "omux/io_executor.hpp"
+
+namespace omux {
+    namespace {
+        // Posted once per worker to stop it, coroutine addresses are never null
+        constexpr ULONG_PTR SHUTDOWN_KEY = 0;
+    } // namespace
+
+    ReadOperation::ReadOperation(HANDLE handle, std::stop_token stop, std::optional<std::chrono::milliseconds> timeout)
+    : handle(handle), stop(std::move(stop)), timeout(timeout) {
+    }
+
+    void ReadOperation::cancel() {
+        cancelled = true;
+        CancelIoEx(handle, &operation.overlapped);
+    }
+
+    auto ReadOperation::await_suspend(std::coroutine_handle<> awaiting) -> bool {
+        operation.waiting = awaiting;
+        if(stop.stop_requested()) {
+            operation.error = ERROR_OPERATION_ABORTED;
+            return false;
+        }
+        buffer.resize(Alias::READ_BUFFER_SIZE);
+        on_stop.emplace(stop, [this]() { cancel(); });
+        if(timeout) {
+            timer.emplace(*timeout, [this]() { cancel(); });
+        }
+        if(ReadFile(handle, buffer.data(), static_cast<DWORD>(buffer.size()), nullptr, &operation.overlapped) == 0) {
+            auto error = GetLastError();
+            if(error != ERROR_IO_PENDING) {
+                // Nothing is queued for a read that failed straight away
+                operation.error = error;
+                SetLastError(0);
+                return false;
+            }
+        }
+        // A cancel that came in before the read was issued had nothing to cancel
+        if(cancelled) {
+            CancelIoEx(handle, &operation.overlapped);
+        }
+        return operation.state.exchange(IoOperation::SUSPENDED) != IoOperation::COMPLETED;
+    }
+
+    auto ReadOperation::await_resume() -> ReadResult {
+        // Both wait for a callback that is already running, so neither can touch the operation after this
+        on_stop.reset();
+        timer.reset();
+        ReadResult result;
+        switch(operation.error) {
+            case 0:
+                buffer.resize(operation.bytes);
+                result.bytes = std::move(buffer);
+                break;
+            case ERROR_OPERATION_ABORTED:
+                // Stopped, timed out or interrupted
+                break;
+            default:
+                // Broken pipes and closed handles, nothing else can come from it
+                result.closed = true;
+        }
+        return result;
+    }
+
+    WakeSignal::WakeSignal(IoExecutor& executor) : executor(executor) {
+    }
+
+    auto WakeSignal::await_ready() -> bool {
+        std::scoped_lock guard(lock);
+        return std::exchange(signalled, false);
+    }
+
+    auto WakeSignal::await_suspend(std::coroutine_handle<> awaiting) -> bool {
+        std::scoped_lock guard(lock);
+        // Signalled since await_ready looked
+        if(std::exchange(signalled, false)) {
+            return false;
+        }
+        waiting = awaiting;
+        return true;
+    }
+
+    void WakeSignal::signal() {
+        std::coroutine_handle<> resume;
+        {
+            std::scoped_lock guard(lock);
+            resume = std::exchange(waiting, {});
+            signalled = !resume;
+        }
+        if(resume) {
+            executor.resume_later(resume);
+        }
+    }
+
+    IoExecutor::IoExecutor(size_t threads) {
+        for(size_t i = 0; i < threads; i++) {
+            workers.emplace_back([this]() { run(); });
+        }
+    }
+
+    IoExecutor::~IoExecutor() {
+        for(size_t i = 0; i < workers.size(); i++) {
+            port.post(SHUTDOWN_KEY);
+        }
+        workers.clear();
+    }
+
+    auto IoExecutor::global() -> IoExecutor& {
+        static IoExecutor executor;
+        return executor;
+    }
+
+    void IoExecutor::associate(HANDLE handle) {
+        port.associate(handle, 0);
+    }
+
+    void IoExecutor::spawn(DetachedTask task) {
+        resume_later(task.release());
+    }
+
+    void IoExecutor::resume_later(std::coroutine_handle<> handle) {
+        port.post(reinterpret_cast<ULONG_PTR>(handle.address()));
+    }
+
+    auto IoExecutor::read(HANDLE handle, std::stop_token stop, std::optional<std::chrono::milliseconds> timeout) -> ReadOperation {
+        return ReadOperation{handle, std::move(stop), timeout};
+    }
+
+    void IoExecutor::run() {
+        while(true) {
+            auto completion = port.wait();
+            if(completion.overlapped != nullptr) {
+                auto* operation = reinterpret_cast<IoOperation*>(completion.overlapped);
+                operation->bytes = completion.bytes;
+                operation->error = completion.error;
+                if(operation->state.exchange(IoOperation::COMPLETED) == IoOperation::SUSPENDED) {
+                    operation->waiting.resume();
+                }
+            } else if(completion.key == SHUTDOWN_KEY) {
+                return;
+            } else {
+                std::coroutine_handle<>::from_address(reinterpret_cast<void*>(completion.key)).resume();
+            }
+        }
+    }
+} // namespace omux
@@ -0,0 +1,172 @@
+#pragma once
+#include "apis/alias.hpp"
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace omux {
+    /**
+     * Threads the shared executor runs. Panes spend nearly all their time waiting on reads, so a couple go a long way.
+     */
+    constexpr size_t IO_EXECUTOR_THREADS = 2;
+
+    /**
+     * A coroutine that starts once it is spawned on an executor and frees itself when it finishes.
+     * Anything that needs to know it has finished has to be told by the coroutine itself.
+     */
+    class DetachedTask {
+        public:
+        struct promise_type {
+            auto get_return_object() -> DetachedTask {
+                return DetachedTask{std::coroutine_handle<promise_type>::from_promise(*this)};
+            }
+            auto initial_suspend() noexcept -> std::suspend_always {
+                return {};
+            }
+            auto final_suspend() noexcept -> std::suspend_never {
+                return {};
+            }
+            void return_void() noexcept {
+            }
+            void unhandled_exception() noexcept {
+                std::terminate();
+            }
+        };
+        explicit DetachedTask(std::coroutine_handle<promise_type> handle) : handle(handle) {
+        }
+        DetachedTask(DetachedTask&& other) noexcept : handle(std::exchange(other.handle, {})) {
+        }
+        DetachedTask(const DetachedTask&) = delete;
+        ~DetachedTask() {
+            // Only a task that was never spawned still owns its frame
+            if(handle) {
+                handle.destroy();
+            }
+        }
+        auto release() -> std::coroutine_handle<> {
+            return std::exchange(handle, {});
+        }
+
+        private:
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    struct ReadResult {
+        std::string bytes;
+        /**
+         * Nothing more will ever be read, the other end has closed.
+         */
+        bool closed = false;
+    };
+
+    /**
+     * What a completion packet points back to. The OVERLAPPED has to stay first so the executor can get from one to the other.
+     */
+    struct IoOperation {
+        OVERLAPPED overlapped{};
+        std::coroutine_handle<> waiting;
+        DWORD bytes = 0;
+        DWORD error = 0;
+        /**
+         * The completion can arrive before await_suspend has finished with the operation,
+         * whichever of the two gets here second resumes the coroutine.
+         */
+        std::atomic<int> state{0};
+        static constexpr int ISSUING = 0;
+        static constexpr int SUSPENDED = 1;
+        static constexpr int COMPLETED = 2;
+    };
+
+    /**
+     * co_await'ing this reads what is available from an overlapped handle associated with the executor.
+     */
+    class ReadOperation {
+        public:
+        ReadOperation(HANDLE handle, std::stop_token stop, std::optional<std::chrono::milliseconds> timeout);
+        auto await_ready() const noexcept -> bool {
+            return false;
+        }
+        auto await_suspend(std::coroutine_handle<> awaiting) -> bool;
+        auto await_resume() -> ReadResult;
+
+        private:
+        IoOperation operation;
+        HANDLE handle;
+        std::stop_token stop;
+        std::optional<std::chrono::milliseconds> timeout;
+        std::string buffer;
+        std::atomic<bool> cancelled{false};
+        std::optional<std::stop_callback<std::function<void()>>> on_stop;
+        std::optional<Alias::OneShotTimer> timer;
+
+        void cancel();
+    };
+
+    class IoExecutor;
+
+    /**
+     * co_await'ing this waits for another thread to call signal(), the coroutine is resumed on the executor.
+     * A signal with nothing waiting is kept for the next wait. Only one coroutine can wait at a time.
+     */
+    class WakeSignal {
+        public:
+        explicit WakeSignal(IoExecutor& executor);
+        auto await_ready() -> bool;
+        auto await_suspend(std::coroutine_handle<> awaiting) -> bool;
+        void await_resume() const noexcept {
+        }
+        void signal();
+
+        private:
+        IoExecutor& executor;
+        std::mutex lock;
+        std::coroutine_handle<> waiting;
+        bool signalled = false;
+    };
+
+    /**
+     * Runs coroutines on a few threads waiting on an I/O completion port. A pane waiting for output is
+     * just its coroutine frame, rather than a thread with a stack of its own.
+     */
+    class IoExecutor {
+        public:
+        explicit IoExecutor(size_t threads = IO_EXECUTOR_THREADS);
+        ~IoExecutor();
+        IoExecutor(const IoExecutor&) = delete;
+        auto operator=(const IoExecutor&) -> IoExecutor& = delete;
+        static auto global() -> IoExecutor&;
+        /**
+         * Overlapped handles have to be associated before they are read with read().
+         */
+        void associate(HANDLE handle);
+        /**
+         * Starts task on one of the executor's threads.
+         */
+        void spawn(DetachedTask task);
+        /**
+         * Resumes a suspended coroutine on one of the executor's threads rather than the caller's.
+         */
+        void resume_later(std::coroutine_handle<> handle);
+        /**
+         * Reads up to READ_BUFFER_SIZE bytes. Comes back with nothing read, and not closed, when stop is
+         * requested, when timeout passes or when the read is interrupted.
+         */
+        static auto read(HANDLE handle, std::stop_token stop, std::optional<std::chrono::milliseconds> timeout = std::nullopt)
+        -> ReadOperation;
+
+        private:
+        Alias::CompletionPort port;
+        std::vector<std::jthread> workers;
+
+        void run();
+    };
+} // namespace omux
@@ -0,0 +1,118 @@
+#include "omux/layout_tree.hpp"
+#include <algorithm>
+#include <functional>
+
+namespace omux {
+    LayoutTree::LayoutTree(unsigned int pane) : root(std::make_unique<Node>()) {
+        root->pane = pane;
+    }
+
+    auto LayoutTree::find(std::unique_ptr<Node>& node, unsigned int pane) -> std::unique_ptr<Node>* {
+        if(!node) {
+            return nullptr;
+        }
+        if(node->leaf()) {
+            return node->pane == pane ? &node : nullptr;
+        }
+        if(auto* found = find(node->first, pane)) {
+            return found;
+        }
+        return find(node->second, pane);
+    }
+
+    auto LayoutTree::split(unsigned int pane, SPLIT_DIRECTION direction, unsigned int new_pane) -> bool {
+        auto* leaf = find(root, pane);
+        if(leaf == nullptr) {
+            return false;
+        }
+        auto split_node = std::make_unique<Node>();
+        split_node->direction = direction;
+        split_node->first = std::move(*leaf);
+        split_node->second = std::make_unique<Node>();
+        split_node->second->pane = new_pane;
+        *leaf = std::move(split_node);
+        return true;
+    }
+
+    auto LayoutTree::remove(unsigned int pane) -> bool {
+        if(root && root->leaf()) {
+            if(root->pane != pane) {
+                return false;
+            }
+            root.reset();
+            return true;
+        }
+        // Looks for the split pane is directly under, which is replaced by the other side
+        std::function<bool(std::unique_ptr<Node>&)> remove_from = [&](std::unique_ptr<Node>& node) {
+            if(!node || node->leaf()) {
+                return false;
+            }
+            for(auto [side, other] : {std::pair{&node->first, &node->second}, std::pair{&node->second, &node->first}}) {
+                if((*side)->leaf() && (*side)->pane == pane) {
+                    node = std::move(*other);
+                    return true;
+                }
+            }
+            return remove_from(node->first) || remove_from(node->second);
+        };
+        return remove_from(root);
+    }
+
+    auto LayoutTree::replace(unsigned int pane, unsigned int new_pane) -> bool {
+        auto* leaf = find(root, pane);
+        if(leaf == nullptr) {
+            return false;
+        }
+        (*leaf)->pane = new_pane;
+        return true;
+    }
+
+    auto LayoutTree::contains(unsigned int pane) const -> bool {
+        auto all = panes();
+        return std::find(all.begin(), all.end(), pane) != all.end();
+    }
+
+    auto LayoutTree::empty() const -> bool {
+        return root == nullptr;
+    }
+
+    auto LayoutTree::panes() const -> std::vector<unsigned int> {
+        std::vector<unsigned int> found;
+        for(const auto& [pane, layout] : arrange(Layout{0, 0, 0, 0})) {
+            found.push_back(pane);
+        }
+        return found;
+    }
+
+    auto LayoutTree::arrange(Layout area) const -> std::vector<std::pair<unsigned int, Layout>> {
+        std::vector<std::pair<unsigned int, Layout>> arranged;
+        std::function<void(const Node&, Layout)> place = [&](const Node& node, Layout space) {
+            if(node.leaf()) {
+                arranged.emplace_back(node.pane, space);
+                return;
+            }
+            auto first = space;
+            auto second = space;
+            if(node.direction == VERT) {
+                first.width = second.width = space.width / 2 - 1;
+                second.x = space.x + first.width + 2;
+            } else {
+                first.height = second.height = space.height / 2 - 1;
+                second.y = space.y + first.height + 2;
+            }
+            place(*node.first, first);
+            place(*node.second, second);
+        };
+        if(root) {
+            place(*root, area);
+        }
+        return arranged;
+    }
+
+    auto Window::arrange() const -> std::vector<std::pair<unsigned int, Layout>> {
+        if(zoomed && panes.contains(*zoomed)) {
+            return {{*zoomed, area}};
+        }
+        return panes.arrange(area);
+    }
+} // namespace omux
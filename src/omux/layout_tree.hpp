@@ -0,0 +1,90 @@
+#pragma once
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace omux {
+    using Layout = struct Layout {
+        int x;
+        int y;
+        int width;
+        int height;
+
+        auto operator==(const Layout&) const -> bool = default;
+    };
+    enum SPLIT_DIRECTION { VERT, HORI };
+    /**
+     * Stands in for a pane that is still being made, pane ids start at 1.
+     */
+    constexpr unsigned int NO_PANE = 0;
+
+    /**
+     * How a window's panes divide it up, each split gives half of a pane's space to a new pane.
+     * Panes are known by their id, the tree doesn't own them.
+     */
+    class LayoutTree {
+        public:
+        LayoutTree() = default;
+        explicit LayoutTree(unsigned int pane);
+        /**
+         * Splits pane's space in two, pane keeps the left or top half and new_pane gets the other.
+         * @return false if pane isn't in the tree
+         */
+        auto split(unsigned int pane, SPLIT_DIRECTION direction, unsigned int new_pane) -> bool;
+        /**
+         * Takes pane out, the other side of the split it was in gets its space.
+         * @return false if pane isn't in the tree
+         */
+        auto remove(unsigned int pane) -> bool;
+        /**
+         * Puts new_pane where pane is.
+         */
+        auto replace(unsigned int pane, unsigned int new_pane) -> bool;
+        [[nodiscard]] auto contains(unsigned int pane) const -> bool;
+        [[nodiscard]] auto empty() const -> bool;
+        /**
+         * Every pane, left to right and top to bottom.
+         */
+        [[nodiscard]] auto panes() const -> std::vector<unsigned int>;
+        /**
+         * Where each pane goes in area. Halves are a column or row short, with two between them for the border,
+         * the way splitting a pane has always left them.
+         */
+        [[nodiscard]] auto arrange(Layout area) const -> std::vector<std::pair<unsigned int, Layout>>;
+
+        private:
+        struct Node {
+            // Only for a leaf
+            unsigned int pane = NO_PANE;
+            SPLIT_DIRECTION direction = VERT;
+            std::unique_ptr<Node> first;
+            std::unique_ptr<Node> second;
+
+            [[nodiscard]] auto leaf() const -> bool {
+                return first == nullptr;
+            }
+        };
+
+        std::unique_ptr<Node> root;
+
+        static auto find(std::unique_ptr<Node>& node, unsigned int pane) -> std::unique_ptr<Node>*;
+    };
+
+    /**
+     * A tab of panes laid out in its own area. Only the current window is drawn.
+     */
+    struct Window {
+        LayoutTree panes;
+        Layout area{0, 0, 0, 0};
+        // The pane that gets input while the window is current
+        unsigned int active = NO_PANE;
+        // Fills the whole window while the rest of its panes are hidden
+        std::optional<unsigned int> zoomed;
+
+        /**
+         * Where each pane that is shown goes, only the zoomed one while there is one.
+         */
+        [[nodiscard]] auto arrange() const -> std::vector<std::pair<unsigned int, Layout>>;
+    };
+} // namespace omux
@@ -0,0 +1,126 @@
+#include "omux/lz_codec.hpp"
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace omux {
+    namespace {
+        constexpr size_t MIN_MATCH = 4;
+        constexpr size_t MAX_OFFSET = 65535;
+        constexpr unsigned int HASH_BITS = 12;
+        constexpr uint32_t NO_POSITION = UINT32_MAX;
+
+        auto read32(const char* data) -> uint32_t {
+            uint32_t value = 0;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        auto hash(uint32_t value) -> uint32_t {
+            return (value * 2654435761U) >> (32 - HASH_BITS);
+        }
+
+        void write_length(std::string& output, size_t length) {
+            while(length >= 255) {
+                output.push_back(static_cast<char>(255));
+                length -= 255;
+            }
+            output.push_back(static_cast<char>(length));
+        }
+
+        void write_sequence(std::string& output, std::string_view literals, size_t offset, size_t match_length) {
+            auto literal_nibble = std::min<size_t>(literals.size(), 15);
+            auto match_nibble = match_length > 0 ? std::min<size_t>(match_length - MIN_MATCH, 15) : 0;
+            output.push_back(static_cast<char>(literal_nibble << 4 | match_nibble));
+            if(literal_nibble == 15) {
+                write_length(output, literals.size() - 15);
+            }
+            output.append(literals);
+            if(match_length == 0) {
+                return;
+            }
+            output.push_back(static_cast<char>(offset & 0xff));
+            output.push_back(static_cast<char>(offset >> 8));
+            if(match_nibble == 15) {
+                write_length(output, match_length - MIN_MATCH - 15);
+            }
+        }
+    } // namespace
+
+    auto lz_compress(std::string_view input) -> std::string {
+        std::string output;
+        output.reserve(input.size() / 2 + 16);
+        std::vector<uint32_t> table(size_t{1} << HASH_BITS, NO_POSITION);
+        size_t anchor = 0;
+        size_t position = 0;
+        while(position + MIN_MATCH <= input.size()) {
+            auto value = read32(input.data() + position);
+            auto& slot = table[hash(value)];
+            auto candidate = slot;
+            slot = static_cast<uint32_t>(position);
+            if(candidate == NO_POSITION || position - candidate > MAX_OFFSET || read32(input.data() + candidate) != value) {
+                position++;
+                continue;
+            }
+            auto length = MIN_MATCH;
+            while(position + length < input.size() && input[candidate + length] == input[position + length]) {
+                length++;
+            }
+            write_sequence(output, input.substr(anchor, position - anchor), position - candidate, length);
+            position += length;
+            anchor = position;
+        }
+        write_sequence(output, input.substr(anchor), 0, 0);
+        return output;
+    }
+
+    auto lz_decompress(std::string_view input, size_t size) -> std::string {
+        std::string output;
+        output.reserve(size);
+        size_t position = 0;
+        auto read_byte = [&]() -> size_t {
+            if(position >= input.size()) {
+                throw std::runtime_error("Compressed block ends part way through a sequence");
+            }
+            return static_cast<unsigned char>(input[position++]);
+        };
+        auto read_length = [&](size_t length) {
+            if(length == 15) {
+                size_t more = 0;
+                do {
+                    more = read_byte();
+                    length += more;
+                } while(more == 255);
+            }
+            return length;
+        };
+        while(position < input.size()) {
+            auto token = read_byte();
+            auto literals = read_length(token >> 4);
+            if(literals > input.size() - position || output.size() + literals > size) {
+                throw std::runtime_error("Compressed block has more literals than it holds");
+            }
+            output.append(input.substr(position, literals));
+            position += literals;
+            if(position == input.size()) {
+                break;
+            }
+            auto offset = read_byte();
+            offset |= read_byte() << 8;
+            auto length = read_length(token & 0x0f) + MIN_MATCH;
+            if(offset == 0 || offset > output.size() || output.size() + length > size) {
+                throw std::runtime_error("Compressed block refers outside of its output");
+            }
+            // Byte at a time, the match can overlap what it is copying
+            auto from = output.size() - offset;
+            for(size_t i = 0; i < length; i++) {
+                output.push_back(output[from + i]);
+            }
+        }
+        if(output.size() != size) {
+            throw std::runtime_error("Compressed block is a different size than expected");
+        }
+        return output;
+    }
+} // namespace omux
@@ -0,0 +1,20 @@
+#pragma once
+#include <string>
+#include <string_view>
+
+namespace omux {
+    /**
+     * A small LZ77 codec in the style of LZ4 blocks, tuned for speed over ratio.
+     * Terminal output repeats itself a lot so even this gets most of the way there.
+     *
+     * A block is a list of sequences: a token byte with the literal count in the high nibble and the match
+     * length - 4 in the low nibble, more length bytes when a nibble is 15, the literals, then a 2 byte
+     * little endian offset back into the output. The last sequence is only literals.
+     */
+    auto lz_compress(std::string_view input) -> std::string;
+    /**
+     * @param size the length of the original input
+     * @throws std::runtime_error if input isn't a valid block or doesn't decompress to size
+     */
+    auto lz_decompress(std::string_view input, size_t size) -> std::string;
+} // namespace omux
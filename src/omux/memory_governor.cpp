@@ -0,0 +1,126 @@
+#include "omux/memory_governor.hpp"
+#include "omux/metrics.hpp"
+#include <algorithm>
+
+namespace omux {
+    namespace {
+        auto now() -> long long {
+            return std::chrono::steady_clock::now().time_since_epoch().count();
+        }
+    } // namespace
+
+    MemoryGovernor::Share::Share(std::shared_ptr<const std::atomic<size_t>> bytes)
+    : bytes(std::move(bytes)), last_viewed(now()) {
+    }
+
+    void MemoryGovernor::Share::viewed() {
+        last_viewed = now();
+    }
+
+    auto MemoryGovernor::Share::get_bytes() const -> size_t {
+        return bytes->load();
+    }
+
+    auto MemoryGovernor::Share::get_budget() const -> size_t {
+        return budget.load();
+    }
+
+    auto MemoryGovernor::Share::take_trim_request() -> bool {
+        // Cheap enough to check on every pass of the output loop
+        return trim_requested.load(std::memory_order_relaxed) && trim_requested.exchange(false);
+    }
+
+    MemoryGovernor::MemoryGovernor(size_t budget) : budget(budget) {
+    }
+
+    MemoryGovernor::~MemoryGovernor() {
+        // Requesting the stop wakes the worker from its wait
+        if(worker.joinable()) {
+            worker.request_stop();
+            worker.join();
+        }
+    }
+
+    auto MemoryGovernor::global() -> MemoryGovernor& {
+        static MemoryGovernor governor;
+        return governor;
+    }
+
+    auto MemoryGovernor::add_pane(std::shared_ptr<const std::atomic<size_t>> bytes) -> std::shared_ptr<Share> {
+        auto share = std::make_shared<Share>(std::move(bytes));
+        std::scoped_lock lock(panes_lock);
+        panes.push_back(share);
+        return share;
+    }
+
+    void MemoryGovernor::usage_changed() {
+        if(pending.exchange(true)) {
+            return;
+        }
+        {
+            std::scoped_lock lock(worker_lock);
+            if(!worker.joinable()) {
+                worker = std::jthread([this](std::stop_token stop) { run(stop); });
+            }
+        }
+        wake.notify_all();
+    }
+
+    void MemoryGovernor::rebalance() {
+        std::vector<std::shared_ptr<Share>> live;
+        {
+            std::scoped_lock lock(panes_lock);
+            std::erase_if(panes, [](const auto& pane) { return pane.expired(); });
+            for(const auto& pane : panes) {
+                if(auto share = pane.lock()) {
+                    live.push_back(std::move(share));
+                }
+            }
+        }
+        std::sort(live.begin(), live.end(), [](const auto& a, const auto& b) { return a->last_viewed > b->last_viewed; });
+        // The most recently viewed pane can use the whole budget, each pane after gets what the ones before left
+        auto remaining = budget.load();
+        size_t used = 0;
+        for(auto& share : live) {
+            auto bytes = share->get_bytes();
+            used += bytes;
+            share->budget = remaining;
+            if(bytes > remaining) {
+                share->trim_requested = true;
+            }
+            remaining -= std::min(bytes, remaining);
+        }
+        total = used;
+        auto& metrics = Metrics::global();
+        metrics.set("memory_governor.bytes", static_cast<long long>(used));
+        metrics.set("memory_governor.panes", static_cast<long long>(live.size()));
+    }
+
+    void MemoryGovernor::set_budget(size_t new_budget) {
+        budget = new_budget;
+        usage_changed();
+    }
+
+    auto MemoryGovernor::get_budget() const -> size_t {
+        return budget.load();
+    }
+
+    auto MemoryGovernor::total_bytes() const -> size_t {
+        return total.load();
+    }
+
+    void MemoryGovernor::run(std::stop_token stop) {
+        std::unique_lock lock(worker_lock);
+        while(true) {
+            if(!wake.wait(lock, stop, [&]() { return pending.load(); })) {
+                return;
+            }
+            pending = false;
+            lock.unlock();
+            rebalance();
+            lock.lock();
+            // Output keeps coming in while a pane is busy, this keeps it to a few passes a second
+            wake.wait_for(lock, stop, MEMORY_GOVERNOR_INTERVAL, []() { return false; });
+        }
+    }
+} // namespace omux
@@ -0,0 +1,92 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+namespace omux {
+    /**
+     * How much sealed history every pane together keeps in memory before the least recently viewed is spilled.
+     */
+    constexpr size_t MEMORY_GOVERNOR_BUDGET = 256 * 1024 * 1024;
+    /**
+     * Budgets are worked out again at most this often, however much output is coming in.
+     */
+    constexpr std::chrono::milliseconds MEMORY_GOVERNOR_INTERVAL{100};
+
+    /**
+     * Shares one memory budget between the history of every pane, see docs/scroll_buffer_dev_notes.md.
+     *
+     * The governor only ever reads and writes atomics on each pane's share, it never takes a pane's lock.
+     * Panes are handed whatever is left of the budget in the order they were last viewed, so the least recently
+     * viewed panes are asked to give memory back first and do it themselves from their output thread.
+     */
+    class MemoryGovernor {
+        public:
+        /**
+         * A pane's side of the budget.
+         */
+        class Share {
+            public:
+            explicit Share(std::shared_ptr<const std::atomic<size_t>> bytes);
+            void viewed();
+            [[nodiscard]] auto get_bytes() const -> size_t;
+            [[nodiscard]] auto get_budget() const -> size_t;
+            /**
+             * True once after the budget has dropped below what the pane is using.
+             */
+            auto take_trim_request() -> bool;
+
+            private:
+            friend class MemoryGovernor;
+            std::shared_ptr<const std::atomic<size_t>> bytes;
+            std::atomic<long long> last_viewed;
+            std::atomic<size_t> budget{std::numeric_limits<size_t>::max()};
+            std::atomic<bool> trim_requested{false};
+        };
+
+        explicit MemoryGovernor(size_t budget = MEMORY_GOVERNOR_BUDGET);
+        ~MemoryGovernor();
+        MemoryGovernor(const MemoryGovernor&) = delete;
+        auto operator=(const MemoryGovernor&) -> MemoryGovernor& = delete;
+        static auto global() -> MemoryGovernor&;
+        /**
+         * Starts tracking a pane, bytes is the memory its history is using. Dropping the share stops tracking it.
+         */
+        auto add_pane(std::shared_ptr<const std::atomic<size_t>> bytes) -> std::shared_ptr<Share>;
+        /**
+         * Lets the governor know some pane's usage has grown. Never blocks, the budgets are
+         * worked out again on the governor's own thread.
+         */
+        void usage_changed();
+        /**
+         * Hands out the budget to every pane straight away.
+         */
+        void rebalance();
+        void set_budget(size_t new_budget);
+        [[nodiscard]] auto get_budget() const -> size_t;
+        /**
+         * What every pane was using at the last rebalance.
+         */
+        [[nodiscard]] auto total_bytes() const -> size_t;
+
+        private:
+        std::atomic<size_t> budget;
+        std::atomic<size_t> total{0};
+        std::mutex panes_lock;
+        std::vector<std::weak_ptr<Share>> panes;
+        std::mutex worker_lock;
+        std::condition_variable_any wake;
+        std::atomic<bool> pending{false};
+        // Declared last so it is stopped and joined before anything it uses goes away
+        std::jthread worker;
+
+        void run(std::stop_token stop);
+    };
+} // namespace omux
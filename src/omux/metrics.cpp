@@ -0,0 +1,45 @@
+#include "omux/metrics.hpp"
+
+namespace omux {
+    auto Metrics::global() -> Metrics& {
+        static Metrics metrics;
+        return metrics;
+    }
+    void Metrics::set(std::string_view name, long long value) {
+        std::scoped_lock lock(metrics_lock);
+        auto metric = values.find(name);
+        if(metric == values.end()) {
+            values.emplace(std::string{name}, value);
+        } else {
+            metric->second = value;
+        }
+    }
+    void Metrics::add(std::string_view name, long long value) {
+        std::scoped_lock lock(metrics_lock);
+        auto metric = values.find(name);
+        if(metric == values.end()) {
+            values.emplace(std::string{name}, value);
+        } else {
+            metric->second += value;
+        }
+    }
+    auto Metrics::get(std::string_view name) -> long long {
+        std::scoped_lock lock(metrics_lock);
+        auto metric = values.find(name);
+        return metric == values.end() ? 0 : metric->second;
+    }
+    auto Metrics::snapshot() -> std::map<std::string, long long, std::less<>> {
+        std::scoped_lock lock(metrics_lock);
+        return values;
+    }
+    void Metrics::remove_prefix(std::string_view prefix) {
+        std::scoped_lock lock(metrics_lock);
+        auto metric = values.lower_bound(prefix);
+        while(metric != values.end() && metric->first.compare(0, prefix.size(), prefix) == 0) {
+            metric = values.erase(metric);
+        }
+    }
+    auto Metrics::pane_metric(unsigned int pane_id, std::string_view name) -> std::string {
+        return "pane." + std::to_string(pane_id) + "." + std::string{name};
+    }
+} // namespace omux
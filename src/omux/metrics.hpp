@@ -0,0 +1,25 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace omux {
+    /**
+     * Named gauges that omux keeps about itself, like how much memory each pane's history is using.
+     * Pane values are named pane.<id>.<name>.
+     */
+    class Metrics {
+        std::mutex metrics_lock;
+        std::map<std::string, long long, std::less<>> values;
+
+        public:
+        static auto global() -> Metrics&;
+        void set(std::string_view name, long long value);
+        void add(std::string_view name, long long value);
+        auto get(std::string_view name) -> long long;
+        auto snapshot() -> std::map<std::string, long long, std::less<>>;
+        void remove_prefix(std::string_view prefix);
+        static auto pane_metric(unsigned int pane_id, std::string_view name) -> std::string;
+    };
+} // namespace omux
@@ -1,4 +1,7 @@
 #include "omux/console.hpp"
+#include "omux/session_recorder.hpp"
+#include "omux/shell_pool.hpp"
+#include <cstdlib>
 #include <iostream>
 
 auto main() -> int {
@@ -8,8 +11,17 @@ auto main() -> int {
     } catch(std::logic_error& ex) {
     }
 
-    auto console = std::make_shared<PrimaryConsole>();
+    // Recording is opt in, set OMUX_RECORD to where the recording should go
+    if(const auto* recording = std::getenv("OMUX_RECORD"); recording != nullptr && *recording != '\0') {
+        SessionRecorder::global().start(recording);
+    }
+
+    // What the host supports is probed once and kept for the next start
+    auto console = std::make_shared<PrimaryConsole>(std::make_shared<ActionFactory>(), HostProfileCache::default_path());
     auto console_one = std::make_shared<Console>(console, Layout{0, 0, 80, 10});
+    // Splits take a shell that has already started rather than waiting for one
+    auto shells = std::make_shared<ShellPool>(console, omux::PWSH_CONSOLE_PATH, L"", Layout{0, 0, 80, 10});
+    console->set_shell_pool(shells);
     //auto console_two = std::make_shared<Console>(console, Layout{0, 11, 80, 10 });
     //auto console_three = std::make_shared<Console>(console, Layout{85, 0, 30, 10});
 
@@ -26,5 +38,10 @@ auto main() -> int {
     // console.set_active(console_one);
 
     console->wait_for_attached_consoles();
+    SessionRecorder::global().stop();
     Alias::ReverseSetupConsoleHost();
+    // Only reported once the console is back to normal, nothing written before then would be seen
+    if(auto error = SessionRecorder::global().write_error()) {
+        std::cerr << *error << "\n";
+    }
 }
@@ -0,0 +1,132 @@
+#include "omux/console.hpp"
+#include "omux/replay.hpp"
+#include "omux/terminal_model.hpp"
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+namespace {
+    using namespace omux;
+
+    /**
+     * Stands in for the host console. Everything omux writes goes into a TerminalModel, and on to the real
+     * console as well unless it is headless.
+     */
+    class ReplayConsole : public PrimaryConsole {
+        public:
+        ReplayConsole(int width, int height, bool headless) : screen(width, height), headless(headless) {
+            set_screen_size(width, height);
+            // The cursor is asked of the screen model, which wraps
+            set_auto_wrap(true);
+        }
+        void write_to_stdout(std::string_view output) override {
+            bytes_emitted += output.size();
+            screen.write(output);
+            if(!headless) {
+                PrimaryConsole::write_to_stdout(output);
+            } else {
+                follow_output(output);
+            }
+        }
+        void write_to_stdout(std::stringstream& output) override {
+            write_to_stdout(std::string_view{output.str()});
+        }
+        auto write_character_to_stdout(const char output) -> bool override {
+            write_to_stdout(std::string_view{&output, 1});
+            return true;
+        }
+        auto cursor_position() -> std::pair<unsigned int, unsigned int> override {
+            auto [column, row] = screen.cursor();
+            return {static_cast<unsigned int>(column + 1), static_cast<unsigned int>(row + 1)};
+        }
+
+        TerminalModel screen;
+        size_t bytes_emitted = 0;
+
+        private:
+        bool headless;
+    };
+
+    void usage() {
+        std::cerr << "usage: omux_replay <recording> [--realtime] [--terminal] [--width <columns>] [--height <rows>]\n"
+                  << "  Replays an omux session recording or asciicast v2 file through the pane output pipeline.\n"
+                  << "  --realtime  keep the recorded pacing rather than going as fast as possible\n"
+                  << "  --terminal  write to this console as well as the headless screen\n";
+    }
+} // namespace
+
+auto main(int argc, char** argv) -> int {
+    if(argc < 2) {
+        usage();
+        return 2;
+    }
+    auto pacing = ReplayPacing::fastest;
+    auto headless = true;
+    int width = 0;
+    int height = 0;
+    for(int i = 2; i < argc; i++) {
+        std::string_view argument{argv[i]};
+        if(argument == "--realtime") {
+            pacing = ReplayPacing::original;
+        } else if(argument == "--terminal") {
+            headless = false;
+        } else if(argument == "--width" && i + 1 < argc) {
+            width = std::stoi(argv[++i]);
+        } else if(argument == "--height" && i + 1 < argc) {
+            height = std::stoi(argv[++i]);
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    std::ifstream input{argv[1], std::ios::binary};
+    if(!input) {
+        std::cerr << "Couldn't open " << argv[1] << "\n";
+        return 1;
+    }
+    Recording recording;
+    try {
+        recording = load_recording(input);
+    } catch(std::exception& ex) {
+        std::cerr << ex.what() << "\n";
+        return 1;
+    }
+    recording.width = width > 0 ? width : recording.width;
+    recording.height = height > 0 ? height : recording.height;
+
+    // Each recorded pane gets its own stripe of the screen, one above the other
+    std::map<unsigned int, int> pane_rows;
+    for(const auto& frame : recording.frames) {
+        pane_rows.try_emplace(frame.pane, static_cast<int>(pane_rows.size()) * recording.height);
+    }
+    auto screen_height = std::max(static_cast<int>(pane_rows.size()), 1) * recording.height;
+    if(!headless) {
+        Alias::SetupConsoleHost();
+    }
+    auto primary_console = std::make_shared<ReplayConsole>(recording.width, screen_height, headless);
+    std::map<unsigned int, std::pair<Console::Sptr, std::unique_ptr<Process>>> panes;
+    for(auto [pane, row] : pane_rows) {
+        auto console = std::make_shared<Console>(primary_console, Layout{0, row, recording.width, recording.height});
+        // Nothing is attached for the primary console to wait on
+        primary_console->remove_console(console.get());
+        auto process = std::make_unique<Process>(console);
+        panes.emplace(pane, std::make_pair(std::move(console), std::move(process)));
+    }
+
+    auto report = replay(recording, pacing, [&](const RecordedFrame& frame) {
+        auto& process = panes.at(frame.pane).second;
+        std::scoped_lock lock(*primary_console->get_stdout_lock());
+        process->process_string_for_output(frame.bytes);
+    });
+    report.bytes_emitted = primary_console->bytes_emitted;
+    report.screen_hash = primary_console->screen.screen_hash();
+
+    panes.clear();
+    if(!headless) {
+        Alias::ReverseSetupConsoleHost();
+    }
+    std::cout << report.to_string();
+    return 0;
+}
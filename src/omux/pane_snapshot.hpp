@@ -0,0 +1,29 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace omux {
+    /**
+     * What a pane looked like after its output thread finished with a chunk of output.
+     * Snapshots are never changed once published, readers can hold on to one for as long as they like.
+     */
+    struct PaneSnapshot {
+        // Goes up by one for every snapshot a pane publishes
+        uint64_t generation = 0;
+        int width = 0;
+        int height = 0;
+        size_t view_offset = 0;
+        size_t rows = 0;
+        size_t line_count = 0;
+        // A full screen program has the pane on its alternate screen
+        bool alternate_screen = false;
+        /**
+         * The rows the pane is showing, top to bottom, as they are stored in the scroll buffer.
+         * There are fewer than height of them when the history is shorter than the pane.
+         * On the alternate screen they are the text of its rows instead.
+         */
+        std::vector<std::string> screen;
+    };
+} // namespace omux
@@ -1,11 +1,17 @@
 #include "apis/alias.hpp"
 #include "omux/console.hpp"
+#include "omux/session_recorder.hpp"
+#include "omux/shell_pool.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
 #include <fstream>
 #include <future>
 #include <mutex>
+#include <optional>
 #include <thread>
+#include <utility>
 
 using namespace omux;
 
@@ -14,23 +20,37 @@ using namespace omux;
 PrimaryConsole::PrimaryConsole() : PrimaryConsole(std::make_shared<ActionFactory>()) {
 }
 
-PrimaryConsole::PrimaryConsole(std::shared_ptr<ActionFactory> action_factory) : action_factory(action_factory) {
-    stdin_read_thread = std::thread([&]() {
-        std::future<std::string> input_read;
+PrimaryConsole::PrimaryConsole(std::shared_ptr<ActionFactory> action_factory) : PrimaryConsole(action_factory, std::nullopt) {
+}
+
+PrimaryConsole::PrimaryConsole(std::shared_ptr<ActionFactory> action_factory, std::optional<std::filesystem::path> host_profiles)
+    : action_factory(action_factory) {
+    auto size = get_terminal_size();
+    cursor_encoder.set_screen_size(size.width, size.height);
+    // The host is set up without ENABLE_WRAP_AT_EOL_OUTPUT
+    cursor_encoder.set_auto_wrap(false);
+    if(host_profiles) {
+        start_probe(*host_profiles);
+    }
+    stdin_read_thread = std::jthread([this](std::stop_token stop) {
         try {
-        
-            input_read = this->primary_console.read_input_from_console();
-            while(!this->should_stop()) {
-
-                auto result = input_read.wait_for(std::chrono::milliseconds(16));
-                if(result == std::future_status::ready) {
-                    process_input(input_read.get());
-                    input_read = primary_console.read_input_from_console();
+            // Nothing is polled, the wait ends for input or once the last pane finishes and stop is requested.
+            // While the host is being probed it ends in time to give up on the answers as well
+            while(!stop.stop_requested() && !this->should_stop()) {
+                auto wait = probe_wait();
+                auto input = wait ? primary_console.next_input(stop, *wait) : primary_console.next_input(stop);
+                if(wait) {
+                    input = answer_probe(std::move(input));
                 }
-
+                if(input) {
+                    process_input(*input);
+                } else if(primary_console.input_finished()) {
+                    break;
+                }
+            }
+            if(this->should_stop()) {
+                primary_console.cancel_io();
             }
-        
-            primary_console.cancel_io();
         } catch(Alias::IO_Operation_Aborted e) {
         } catch(Alias::Not_Found e) {
         }
@@ -40,115 +60,518 @@ PrimaryConsole::PrimaryConsole(std::shared_ptr<ActionFactory> action_factory) :
 auto PrimaryConsole::process_input(std::string_view input) -> std::string {
     std::string processed_input{input};
     if(action_factory->process_to_action(processed_input) == Actions::none) {
-        std::scoped_lock lock(active_console_lock);
-        if(active_console != nullptr && active_console->is_running()) {
-            this->active_console->pseudo_console->write_input(processed_input);
-        }
+        with_active_console([&](Console& active) {
+            if(active.is_running()) {
+                SessionRecorder::global().record(active.get_id(), RecordDirection::input, processed_input);
+                active.pseudo_console->write_input(processed_input);
+                renderer.input_forwarded();
+            }
+        });
     } else {
         action_factory->get_action_stack()->back()->act(this);
+        action_factory->pop_finished();
     }
     return processed_input;
 }
 
 void PrimaryConsole::write_input(std::string_view input) {
-    if(active_console != nullptr) {
-        std::scoped_lock lock(active_console_lock);
-        this->active_console->pseudo_console->write_input(input);
-    }
+    with_active_console([&](Console& active) {
+        SessionRecorder::global().record(active.get_id(), RecordDirection::input, input);
+        active.pseudo_console->write_input(input);
+        renderer.input_forwarded();
+    });
 }
 void PrimaryConsole::reset_stdio() {
     primary_console.reset_stdio();
 }
 [[nodiscard]] auto PrimaryConsole::should_stop() -> bool {
-    bool all_processes_done = attached_consoles.empty();
-    
-    
-    for(auto console : attached_consoles) {
-        all_processes_done = all_processes_done || !console->is_running();
+    return first_console_added && live_panes == 0;
+}
+void PrimaryConsole::pane_counts_changed(int live, int attached) {
+    // Adding a negative count as size_t wraps around to the subtraction
+    if(attached != 0 && attached_processes.fetch_add(static_cast<size_t>(attached)) + static_cast<size_t>(attached) == 0) {
+        attached_processes.notify_all();
+    }
+    if(live != 0 && live_panes.fetch_add(static_cast<size_t>(live)) + static_cast<size_t>(live) == 0) {
+        // Wake the input thread rather than have it poll
+        stdin_read_thread.request_stop();
     }
-
-    auto result = first_console_added && all_processes_done;
-    return result;
 }
 [[nodiscard]] auto PrimaryConsole::get_stdout_lock() -> std::mutex* {
     return &this->stdout_mutex;
 }
+auto PrimaryConsole::get_renderer() -> RenderScheduler& {
+    return renderer;
+}
+auto PrimaryConsole::get_attributes() -> std::shared_ptr<AttributeTable> {
+    return attributes;
+}
 void PrimaryConsole::lock_stdout() {
     this->stdout_mutex.lock();
 }
 void PrimaryConsole::unlock_stdout() {
-    if(active_console != nullptr) {
-        write_to_stdout(active_console->get_saved_cursor());
-    }        
+    with_active_console([&](Console& active) { write_to_stdout(active.get_saved_cursor()); });
     this->stdout_mutex.unlock();
 }
 void PrimaryConsole::write_to_stdout(std::string_view output) {
     //std::scoped_lock lock{stdout_mutex};
-
+    follow_output(output);
     this->primary_console.write_to_stdout(output);
 }
 void PrimaryConsole::write_to_stdout(std::stringstream& output) {
 
     //std::scoped_lock lock{stdout_mutex};
+    follow_output(output.view());
     this->primary_console.write_to_stdout(output);
 }
 auto PrimaryConsole::write_character_to_stdout(const char output) -> bool {
     // std::scoped_lock lock{stdout_mutex};
-
+    follow_output(std::string_view{&output, 1});
     return this->primary_console.write_character_to_stdout(output);
 }
+auto PrimaryConsole::cursor_position() -> std::pair<unsigned int, unsigned int> {
+    return Alias::PseudoConsole::get_cursor_position_as_pair();
+}
+auto PrimaryConsole::cursor_position_as_movement() -> std::string {
+    auto [column, row] = cursor_position();
+    return "\x1b[" + std::to_string(row) + ";" + std::to_string(column) + "H";
+}
+auto PrimaryConsole::locate_cursor() -> std::pair<unsigned int, unsigned int> {
+    auto position = cursor_position();
+    std::scoped_lock lock(cursor_lock);
+    cursor_encoder.reported(static_cast<int>(position.first), static_cast<int>(position.second));
+    return position;
+}
+auto PrimaryConsole::move_cursor(unsigned int column, std::optional<unsigned int> row) -> std::string {
+    std::string movement;
+    {
+        std::scoped_lock lock(cursor_lock);
+        movement = cursor_encoder.movement_to(static_cast<int>(column), row ? std::optional<int>{static_cast<int>(*row)} : std::nullopt);
+    }
+    if(!movement.empty()) {
+        write_to_stdout(movement);
+    }
+    return movement;
+}
+void PrimaryConsole::follow_output(std::string_view output) {
+    std::scoped_lock lock(cursor_lock);
+    cursor_encoder.wrote(output);
+}
+void PrimaryConsole::set_screen_size(int width, int height) {
+    std::scoped_lock lock(cursor_lock);
+    cursor_encoder.set_screen_size(width, height);
+}
+void PrimaryConsole::set_auto_wrap(bool wraps) {
+    std::scoped_lock lock(cursor_lock);
+    cursor_encoder.set_auto_wrap(wraps);
+}
+auto PrimaryConsole::get_cursor_encoder() -> CursorEncoder {
+    std::scoped_lock lock(cursor_lock);
+    return cursor_encoder;
+}
+void PrimaryConsole::start_probe(const std::filesystem::path& host_profiles) {
+    probe_identity = host_identity();
+    probe_cache = host_profiles;
+    if(auto cached = HostProfileCache{probe_cache}.find(probe_identity)) {
+        set_host_profile(std::move(*cached));
+        return;
+    }
+    std::scoped_lock lock(stdout_mutex, probe_lock);
+    try {
+        write_to_stdout(HostProbe::queries());
+    } catch(Alias::WindowsError& e) {
+        // Nothing is going to answer, the next start tries again
+        return;
+    }
+    probe.emplace();
+    probe_deadline = std::chrono::steady_clock::now() + HOST_PROBE_TIMEOUT_MS;
+}
+auto PrimaryConsole::probe_wait() -> std::optional<std::chrono::milliseconds> {
+    std::scoped_lock lock(probe_lock);
+    if(!probe) {
+        return std::nullopt;
+    }
+    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(probe_deadline - std::chrono::steady_clock::now());
+    return std::max(remaining, std::chrono::milliseconds(0));
+}
+auto PrimaryConsole::answer_probe(std::optional<std::string> input) -> std::optional<std::string> {
+    std::string forwarded;
+    std::optional<HostProfile> answered;
+    auto complete = false;
+    {
+        std::scoped_lock lock(probe_lock);
+        if(!probe) {
+            return input;
+        }
+        if(input) {
+            forwarded = probe->feed(*input);
+        }
+        complete = probe->complete();
+        auto now = std::chrono::steady_clock::now();
+        if(complete || now >= probe_deadline) {
+            const auto* colorterm = std::getenv("COLORTERM");
+            // Once late replies stop coming the profile used at the timeout stands
+            if(complete || !probe_timed_out) {
+                answered = probe->profile(colorterm == nullptr ? "" : colorterm);
+            }
+            if(complete || probe_timed_out) {
+                forwarded += probe->finish();
+                probe.reset();
+            } else {
+                // A slow host's replies are still on their way, they are taken out of the input until DA1 says they're all in
+                probe_timed_out = true;
+                probe_deadline = now + HOST_PROBE_LATE_MS;
+            }
+        }
+    }
+    if(answered) {
+        // A host that was too slow is probed again next time rather than remembered as supporting nothing
+        if(complete) {
+            HostProfileCache{probe_cache}.store(probe_identity, *answered);
+        }
+        set_host_profile(std::move(*answered));
+    }
+    if(forwarded.empty()) {
+        return std::nullopt;
+    }
+    return forwarded;
+}
+auto PrimaryConsole::get_host_profile() -> const HostProfile& {
+    return host_profile;
+}
+void PrimaryConsole::set_host_profile(HostProfile profile) {
+    std::scoped_lock lock(stdout_mutex);
+    host_profile = std::move(profile);
+}
+void PrimaryConsole::begin_frame() {
+    if(frame_depth++ == 0 && host_profile.synchronized_output) {
+        frame_synchronized = true;
+        write_to_stdout(BEGIN_SYNCHRONIZED_UPDATE);
+    }
+}
+void PrimaryConsole::end_frame() {
+    if(--frame_depth == 0 && std::exchange(frame_synchronized, false)) {
+        write_to_stdout(END_SYNCHRONIZED_UPDATE);
+    }
+}
+auto PrimaryConsole::synchronized_frame(std::string output) -> std::string {
+    if(frame_depth > 0 || !host_profile.synchronized_output || output.empty()) {
+        return output;
+    }
+    return std::string{BEGIN_SYNCHRONIZED_UPDATE} + output + std::string{END_SYNCHRONIZED_UPDATE};
+}
 void PrimaryConsole::wait_for_attached_consoles() {
-    for(auto* console : attached_consoles) {
-        console->wait_for_process_to_stop(-1);
+    // Panes can be split and closed while we wait, they keep the count up to date
+    for(auto attached = attached_processes.load(); attached != 0; attached = attached_processes.load()) {
+        attached_processes.wait(attached);
     }
 }
-void PrimaryConsole::add_console(Console* console) {
+auto PrimaryConsole::add_console(Console* console) -> SlotHandle {
+    std::unique_lock lock(consoles_lock);
+    std::scoped_lock process_lock(console->process_lock);
+    console->handle = consoles.insert(console);
+    pane_handles[console->get_id()] = console->handle;
+    // Counted before first_console_added is set so should_stop never sees the pane missing
+    console->update_pane_counts();
     first_console_added = true;
-    this->attached_consoles.push_back(console);
+    // A pane made by splitting or for a new window has its place kept for it, any other joins the current window
+    // beside its last pane and keeps the layout it was made with until the window is laid out again
+    auto id = console->get_id();
+    auto placed = std::find_if(windows.begin(), windows.end(), [&](Window& window) { return window.panes.replace(NO_PANE, id); });
+    if(placed != windows.end()) {
+        if(placed->active == NO_PANE) {
+            placed->active = id;
+        }
+    } else if(windows.empty()) {
+        windows.push_back(Window{LayoutTree{id}, console->get_layout(), id, std::nullopt});
+        placed = windows.begin();
+    } else {
+        placed = windows.begin() + static_cast<std::ptrdiff_t>(current_window);
+        placed->panes.split(placed->panes.panes().back(), VERT, id);
+    }
+    if(placed != windows.begin() + static_cast<std::ptrdiff_t>(current_window)) {
+        // Nothing is attached yet, the process starts out writing offscreen
+        std::scoped_lock stdout_lock(stdout_mutex);
+        console->visible = false;
+    }
+    return console->handle;
 }
 void PrimaryConsole::remove_console(Console* console) {
-    std::scoped_lock lock(active_console_lock);
-    auto console_to_remove = std::find(this->attached_consoles.begin(), this->attached_consoles.end(), console);
-    this->attached_consoles.erase(console_to_remove);
-    if(console == active_console && !attached_consoles.empty()) {
-        
-        this->active_console = attached_consoles.front();
+    std::unique_lock lock(consoles_lock);
+    // Consoles that were taken off early are removed again when they are destroyed
+    if(!consoles.erase(console->handle)) {
+        return;
+    }
+    pane_handles.erase(console->get_id());
+    {
+        std::scoped_lock process_lock(console->process_lock);
+        console->handle = SlotHandle{};
+        console->update_pane_counts();
+    }
+    auto window = find_window(console->get_id());
+    auto shown = window == current_window;
+    if(window) {
+        auto& from = windows[*window];
+        from.panes.remove(console->get_id());
+        if(from.zoomed == console->get_id()) {
+            from.zoomed.reset();
+        }
+        if(from.panes.empty()) {
+            windows.erase(windows.begin() + static_cast<std::ptrdiff_t>(*window));
+            if(current_window > *window || current_window == windows.size()) {
+                current_window = current_window == 0 ? 0 : current_window - 1;
+            }
+        } else if(from.active == console->get_id()) {
+            from.active = from.panes.panes().front();
+        }
+    }
+    if(!consoles.contains(active_console)) {
+        auto* next = windows.empty() ? nullptr : find_console(windows[current_window].active);
+        active_console = next != nullptr ? next->handle : consoles.empty() ? SlotHandle{} : consoles.handle_at(0);
+    }
+    if(shown && !windows.empty()) {
+        // What is left of the window, or the window before it once it is empty, takes over the screen
+        try {
+            present_current_window();
+        } catch(Alias::WindowsError& e) {
+        }
     }
 }
  PrimaryConsole::~PrimaryConsole() {
-    //stdin_read_thread.detach();
+    // Wakes the input thread whether or not the panes have finished
     if(this->stdin_read_thread.joinable()) {
-         this->stdin_read_thread.join();
+        this->stdin_read_thread.request_stop();
+        this->stdin_read_thread.join();
     }
-    
 }
 void PrimaryConsole::set_active(Console* new_active_console) {
-    std::scoped_lock lock(active_console_lock);
-    this->active_console = new_active_console;
+    std::unique_lock lock(consoles_lock);
+    // Leaving a pane counts as having just looked at it as well
+    if(auto** current = consoles.get(active_console)) {
+        (*current)->viewed();
+    }
+    if(new_active_console != nullptr) {
+        new_active_console->viewed();
+    }
+    this->active_console = new_active_console != nullptr ? new_active_console->handle : SlotHandle{};
+    auto window = new_active_console != nullptr ? find_window(new_active_console->get_id()) : std::nullopt;
+    if(window) {
+        windows[*window].active = new_active_console->get_id();
+        if(*window != current_window) {
+            current_window = *window;
+            present_current_window();
+        }
+    }
+}
+auto PrimaryConsole::get_active_console() -> Console* {
+    std::shared_lock lock(consoles_lock);
+    auto** console = consoles.get(active_console);
+    return console != nullptr ? *console : nullptr;
 }
 
 
 [[nodiscard]] auto PrimaryConsole::split_active_console(SPLIT_DIRECTION direction) -> Console::Sptr {
-    std::scoped_lock lock(active_console_lock);
-    if(active_console == nullptr) {
+    std::optional<Layout> split_layout;
+    std::shared_ptr<PrimaryConsole> owner;
+    std::shared_ptr<ShellPool> pool;
+    bool was_zoomed = false;
+    {
+        std::unique_lock lock(consoles_lock);
+        pool = shell_pool.lock();
+        auto** active = consoles.get(active_console);
+        auto window = active != nullptr ? find_window((*active)->get_id()) : std::nullopt;
+        if(window) {
+            owner = (*active)->get_primary_console();
+            auto& split_window = windows[*window];
+            // Splitting a zoomed pane shows the rest of its window again
+            was_zoomed = split_window.zoomed.has_value();
+            split_window.zoomed.reset();
+            split_window.panes.split((*active)->get_id(), direction, NO_PANE);
+            for(const auto& [pane, layout] : split_window.arrange()) {
+                auto* console = find_console(pane);
+                if(pane == NO_PANE) {
+                    split_layout = layout;
+                } else if(console != nullptr && !(console->get_layout() == layout)) {
+                    console->resize(layout);
+                }
+            }
+        }
+    }
+    if(!split_layout) {
         throw OmuxError("Trying to split the active console when it hasn't been set yet");
     }
-    Layout split_layout{active_console->get_layout()};
-    if(direction == SPLIT_DIRECTION::VERT) {
-        split_layout.width /= 2;
-        split_layout.width--;
-        active_console->resize(Layout{split_layout});
-        split_layout.x = split_layout.width+2;
-       // split_layout.width;
-            
+    // The new pane registers itself into the place kept for it, which can't happen while the panes are locked
+    Console::Sptr console = pool ? pool->take() : nullptr;
+    try {
+        if(console) {
+            // Its shell has been drawing offscreen at the pool's size, it is shown once it has been moved into place
+            add_console(console.get());
+            console->resize(*split_layout);
+            console->set_visible(true);
+        } else {
+            console = std::make_shared<Console>(owner, *split_layout);
+        }
+    } catch(...) {
+        std::unique_lock lock(consoles_lock);
+        for(auto& window : windows) {
+            window.panes.remove(NO_PANE);
+        }
+        throw;
+    }
+    if(was_zoomed) {
+        std::unique_lock lock(consoles_lock);
+        present_current_window();
+    }
+    return console;
+}
+
+void PrimaryConsole::set_shell_pool(std::weak_ptr<ShellPool> pool) {
+    std::unique_lock lock(consoles_lock);
+    shell_pool = std::move(pool);
+}
+
+auto PrimaryConsole::new_window() -> Console::Sptr {
+    std::shared_ptr<PrimaryConsole> owner;
+    Layout area{0, 0, 0, 0};
+    {
+        std::unique_lock lock(consoles_lock);
+        auto** active = consoles.get(active_console);
+        if(active == nullptr || windows.empty()) {
+            throw OmuxError("Trying to open a window before there is a pane to take its size from");
+        }
+        owner = (*active)->get_primary_console();
+        area = windows[current_window].area;
+        windows.push_back(Window{LayoutTree{NO_PANE}, area, NO_PANE, std::nullopt});
+    }
+    Console::Sptr console;
+    try {
+        console = std::make_shared<Console>(owner, area);
+    } catch(...) {
+        std::unique_lock lock(consoles_lock);
+        std::erase_if(windows, [](Window& window) { return window.panes.remove(NO_PANE) && window.panes.empty(); });
+        throw;
+    }
+    std::unique_lock lock(consoles_lock);
+    if(auto window = find_window(console->get_id())) {
+        current_window = *window;
+        active_console = console->handle;
+        present_current_window();
+    }
+    return console;
+}
+
+void PrimaryConsole::select_window(int step) {
+    std::unique_lock lock(consoles_lock);
+    if(windows.size() < 2) {
+        return;
+    }
+    auto count = static_cast<long long>(windows.size());
+    current_window = static_cast<size_t>(((static_cast<long long>(current_window) + step) % count + count) % count);
+    if(auto* active = find_console(windows[current_window].active)) {
+        active_console = active->handle;
+        active->viewed();
+    }
+    present_current_window();
+}
+
+auto PrimaryConsole::get_current_window() -> size_t {
+    std::shared_lock lock(consoles_lock);
+    return current_window;
+}
+
+auto PrimaryConsole::window_count() -> size_t {
+    std::shared_lock lock(consoles_lock);
+    return windows.size();
+}
+
+void PrimaryConsole::toggle_zoom() {
+    std::unique_lock lock(consoles_lock);
+    auto** active = consoles.get(active_console);
+    if(active == nullptr || windows.empty() || !windows[current_window].panes.contains((*active)->get_id())) {
+        return;
+    }
+    auto& window = windows[current_window];
+    if(window.zoomed) {
+        window.zoomed.reset();
     } else {
-        split_layout.height /= 2;
-        split_layout.height--;
-        active_console->resize(Layout{split_layout});
-        split_layout.y = split_layout.height+2;
-        
+        window.zoomed = (*active)->get_id();
+    }
+    present_current_window();
+}
+
+auto PrimaryConsole::get_zoomed_pane() -> std::optional<unsigned int> {
+    std::shared_lock lock(consoles_lock);
+    return windows.empty() ? std::nullopt : windows[current_window].zoomed;
+}
+
+auto PrimaryConsole::find_console(unsigned int id) -> Console* {
+    auto handle = pane_handles.find(id);
+    if(handle == pane_handles.end()) {
+        return nullptr;
+    }
+    auto** console = consoles.get(handle->second);
+    return console != nullptr ? *console : nullptr;
+}
+
+auto PrimaryConsole::find_window(unsigned int pane) -> std::optional<size_t> {
+    for(size_t i = 0; i < windows.size(); i++) {
+        if(windows[i].panes.contains(pane)) {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+void PrimaryConsole::present_current_window() {
+    if(windows.empty()) {
+        return;
+    }
+    std::vector<std::pair<Console*, bool>> panes;
+    panes.reserve(consoles.size());
+    for(auto* console : consoles) {
+        panes.emplace_back(console, false);
+    }
+    // panes is in the same order as consoles, so each pane shown is found from its handle
+    for(const auto& [pane, layout] : windows[current_window].arrange()) {
+        auto handle = pane_handles.find(pane);
+        auto position = handle != pane_handles.end() ? consoles.position_of(handle->second) : std::nullopt;
+        if(!position) {
+            continue;
+        }
+        auto& [console, shown] = panes[*position];
+        if(!(console->get_layout() == layout)) {
+            console->resize(layout);
+        }
+        shown = true;
+    }
+    // Every pane is locked before stdout, so the window goes out as one frame
+    std::vector<std::unique_lock<std::mutex>> process_locks;
+    process_locks.reserve(panes.size());
+    for(auto& [console, shown] : panes) {
+        process_locks.emplace_back(console->process_lock);
+    }
+    std::scoped_lock lock(stdout_mutex);
+    begin_frame();
+    try {
+        // Whatever was on the host is cleared, the hidden panes go first so they stop writing before the rest draw
+        write_to_stdout("\x1b[2J");
+        for(auto& [console, shown] : panes) {
+            if(!shown) {
+                console->present(false);
+            }
+        }
+        for(auto& [console, shown] : panes) {
+            if(shown) {
+                console->present(true);
+            }
+        }
+        if(auto** active = consoles.get(active_console)) {
+            write_to_stdout((*active)->saved_cursor);
+        }
+    } catch(Alias::WindowsError& e) {
+        // The host has gone away, the frame still has to be ended
     }
-    return std::make_shared<Console>(active_console->get_primary_console(), Layout{split_layout});
+    end_frame();
 }
 
 [[nodiscard]] auto PrimaryConsole::get_terminal_size() -> Layout {
@@ -1,31 +1,50 @@
 #include "apis/alias.hpp"
 #include "omux/console.hpp"
+#include "omux/metrics.hpp"
+#include "omux/session_recorder.hpp"
+#include "omux/unicode_width.hpp"
 #include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <regex>
+#include <stop_token>
 #include <thread>
 
 namespace omux {
     
-    Process::Process(Console::Sptr host_in, std::wstring path, std::wstring args)
+    Process::Process(Console::Sptr host_in, std::wstring path, std::wstring args, std::function<void()> exited)
     : host(host_in), path(path), args(args) {
-        command_log.open(L"command_pty."+args+L".log", std::ios_base::out);
         this->process = std::unique_ptr<Alias::Process>(Alias::NewProcess(host->pseudo_console.get(), path + args));
+        saved_cursor_pos = {origin_column(), origin_row()};
         this->host->process_attached(this);
-        saved_cursor_pos = std::string{"\x1b[" + std::to_string(host->layout.y) + ";" + std::to_string(host->layout.x) + "H"};
-        this->output_thread = std::thread(&Process::process_output, this);
-        
+        {
+            std::scoped_lock lock(*host->get_primary_console()->get_stdout_lock());
+            visibility_changed();
+        }
+        auto& executor = IoExecutor::global();
+        executor.associate(host->pseudo_console->output_pipe());
+        output_done = false;
+        executor.spawn(process_output(output_stop.get_token()));
+        // Cancels the pending read as soon as the process exits
+        this->process->on_exit([stop = output_stop, exited = std::move(exited)]() mutable {
+            stop.request_stop();
+            if(exited) {
+                exited();
+            }
+        });
     }
     Process::Process(Console::Sptr host_in) : host(host_in), path(L""), args(L"") {
         this->host->process_attached(this);
+        std::scoped_lock lock(*host->get_primary_console()->get_stdout_lock());
+        visibility_changed();
     }
     Process::~Process() {
-        if(output_thread.joinable()) {
-            output_thread.join();
-        }
+        output_stop.request_stop();
+        output_done.wait(false);
+        host->get_primary_console()->get_renderer().remove(this);
         this->host->process_dettached(this);
     }
 
@@ -64,65 +83,20 @@ namespace omux {
     }
 
     auto Process::track_cursor_for_sequence(std::string_view sequence) -> std::pair<int, int> {
-        auto cursor_start = host->pseudo_console->get_cursor_position_as_pair();
+        auto cursor_start = host_cursor();
         // Ensure the x offset is adhered to
-        this->host->get_primary_console()->write_to_stdout(sequence);
+        write_to_host(sequence);
         if(sequence.back() == 'H') {
-            auto pre_offset_cursor = host->pseudo_console->get_cursor_position_as_pair();
+            auto pre_offset_cursor = host_cursor();
             auto corrected_column = pre_offset_cursor.first + host->layout.x;
             auto corrected_row = pre_offset_cursor.second + host->layout.y;
-            host->get_primary_console()->write_to_stdout("\x1b[?25h");
+            write_to_host("\x1b[?25h");
             // The absolute movement sequences are relative to the psuedoconsole, so we need to ensure the global offset is applied
-            host->get_primary_console()->write_to_stdout("\x1b[" + std::to_string(corrected_row) + ";" + std::to_string(corrected_column) + "H");
+            move_host_cursor(corrected_column, corrected_row);
         }
-        auto cursor_end = host->pseudo_console->get_cursor_position_as_pair();
+        auto cursor_end = host_cursor();
         return std::make_pair(cursor_end.first - cursor_start.first, cursor_end.second - cursor_start.second);
     }
-    /**
-    * Deletes length-n characters from a string that aren't part of a control sequence.
-    * n > 0 will find n renderable characters from the front of the string and delete the rest.
-    * n < 0 will find n renderable characters from the back of the string and up to there.
-    * @return the changed line
-    */
-    auto Process::delete_n_renderable_characters_from_string(std::string& line, int count) -> std::string {
-        int n = count;
-        if(n > 0) {
-            auto start = line.begin();
-            auto last_renderable_char = line.begin();
-            while(start != line.end() && n > 1) {
-
-                if(*start == '\x1b') {
-                    // Everything after ? in ascii is a character that ends a control sequence (maybe)
-                    while(*start == '[' || *start == ']' ||
-                          static_cast<unsigned int>(*start) <= static_cast<unsigned int>('?')) {
-                        start++;
-                    }
-                    start++;
-                } else if(*start == '\r'){
-                    n = count;
-                    start++;
-                    //n--;
-                } else {
-                    if(n > 1) {
-
-                        n--;
-                        last_renderable_char = start;
-                        start++;
-                    }
-                    if(n == 1){
-                        start = line.erase(start, line.end());
-                    }
-                }
-            }
-            // This happens when the place desired by n is larger than there are renderable characters in the string.
-            // So we need to fill the last parts with spaces.
-            if(n > 1) {
-                line.erase(++last_renderable_char, line.end());
-                line.append(n-1, ' ');
-            }
-        }
-        return line;
-    }
 
     auto Process::handle_csi_sequence(std::string_view::iterator& start, std::string_view::iterator& end)
     -> std::string_view::iterator {
@@ -132,8 +106,8 @@ namespace omux {
             // Re-interpret reset control sequence as movement to origin
             if(sequence.compare("\x1b[H") == 0) {
                 std::string origin_movement{"\x1b[" + std::to_string(host->layout.y) + ";" + std::to_string(host->layout.x) + "H"};
-                host->get_primary_console()->write_to_stdout(origin_movement);
-                this->host->scroll_buffer.back().append(origin_movement);
+                move_host_cursor(origin_column(), origin_row());
+                this->host->scroll_buffer.append_sequence(origin_movement);
                 return control_seq_end;
             }
             auto cursor_movement_diff = track_cursor_for_sequence(sequence);
@@ -144,30 +118,26 @@ namespace omux {
             if(cursor_movement_diff.second > 0) {
                 // host->scroll_buffer.back().push_back(char_out);
                 for(int i = 0; i < cursor_movement_diff.second; i++) {
-                    host->scroll_buffer.back().append("\r\n");
-                    host->scroll_buffer.push_back(std::string{});
-                    host->get_primary_console()->write_to_stdout("\x1b[" + std::to_string(host->layout.x) + "G");
+                    host->scroll_buffer.new_line();
                 }
+                move_host_cursor(origin_column(), std::nullopt);
             } else if(cursor_movement_diff.first < 0 || cursor_movement_diff.second < 0) {
-                auto cursor = host->pseudo_console->get_cursor_position_as_pair();
+                auto cursor = host_cursor();
                 auto* buffer = host->get_scroll_buffer();
                 
                 
                 if(cursor_movement_diff.second != 0) {
                     // When we are moving up lines, we need to delete the lines in the scoll buffer
                     auto line_row_erase_offset = std::min(buffer->size(), static_cast<size_t>(std::abs(cursor_movement_diff.second)));
-                    buffer->erase(buffer->end() - line_row_erase_offset, buffer->end());
+                    buffer->erase_last(line_row_erase_offset);
                     if(!buffer->empty()) {
-                        auto& line = buffer->back();
                         // then ensure we are in the right position on the line
-                        auto line_position_erase_offset = std::min(line.size(), static_cast<size_t>(cursor.first - host->get_layout().x)) - 1;
-                        line.erase(line.begin() + line_position_erase_offset, line.end());
+                        buffer->truncate_back(column_in_pane(cursor.first));
                     } else {
                         buffer->push_back(std::string{});
                     }            
                 } else if(cursor_movement_diff.first < 0) {
-                    auto& line = buffer->back();
-                    delete_n_renderable_characters_from_string(line, (cursor.first));
+                    buffer->truncate_back(column_in_pane(cursor.first));
                    // line.erase(line.begin() + (cursor.first - 1), line.end());
                 }
                 
@@ -175,14 +145,14 @@ namespace omux {
             } else if(sequence.back() == 'H' && cursor_movement_diff.first > 0 && cursor_movement_diff.second == 0) {
                 // An absolute movement sequence has been used to perform an a column movement
                 // this should be a relative movement on the line, not an absolute one so we fix it here
-                this->host->scroll_buffer.back().append(std::string{"\x1b[" + std::to_string(cursor_movement_diff.first) + "C"});
+                this->host->scroll_buffer.cursor_forward(static_cast<size_t>(cursor_movement_diff.first));
             } else if(cursor_movement_diff.second == 0 && cursor_movement_diff.first == 0 && sequence.back() == 'H') {
                 // Capital H is the control code for absolute movement. So if nothing happened in the absolute movement
                 // then we don't want the sequence in the scroll buffer
                 // These seem to appear from the conhost when the max screen buffer line limit is reached
                 // host->scroll_buffer.push_back(std::string{});
             } else {
-                this->host->scroll_buffer.back().append(sequence);
+                this->host->scroll_buffer.append_sequence(sequence);
             }
         }
         return control_seq_end;
@@ -210,37 +180,262 @@ namespace omux {
         }
     }
     void Process::set_line_in_screen(unsigned int new_line_in_screen) {
-        if(new_line_in_screen > host->layout.height+host->layout.y) {
+        if(offscreen && new_line_in_screen > host->layout.height + host->layout.y) {
+            // The offscreen model scrolls itself, and the pane is drawn from the scroll buffer when it is shown
+            line_in_screen = host->layout.height;
+        } else if(new_line_in_screen > host->layout.height + host->layout.y && scroll_pane_region()) {
+            line_in_screen = host->layout.height;
+        } else if(new_line_in_screen > host->layout.height+host->layout.y) {
             auto repaint = get_repaint_sequence(host->layout);
             //this->host->get_primary_console()->write_to_stdout(repaint);
-            auto start = host->scroll_buffer.end() - std::min(host->scroll_buffer.size()-1, static_cast<size_t>(host->layout.height));
-          //  start++; // As we have gone to the top of screen buffer, we advance one line so it has space to draw the new line coming
-            auto end = host->scroll_buffer.end();
+            auto rows = host->scroll_buffer.last_rows(std::min(host->scroll_buffer.size()-1, static_cast<size_t>(host->layout.height)));
 
-            //std::stringstream line;
-            std::ostream& line = std::cout;
+            std::stringstream line;
 
             line << repaint;
             //line << "\x1b[?12l\x1b[?25l";
             line << "\x1b[?12h\x1b[?25h";
-            while(start != end) {
-                output_line_from_scroll_buffer(*start, line);
-                command_log << *start;
-                start++;
+            for(auto& row : rows) {
+                output_line_from_scroll_buffer(row, line);
             }
-            command_log.flush();
             line << "\x1b[?12h\x1b[?25h";
            // host->get_primary_console()->write_to_stdout(line.str());
+            write_to_host(host->get_primary_console()->synchronized_frame(line.str()));
             line_in_screen = host->layout.height;
         } else {
             line_in_screen = new_line_in_screen;
         }
     }
 
+    auto Process::scroll_pane_region() -> bool {
+        auto primary_console = host->get_primary_console();
+        const auto& profile = primary_console->get_host_profile();
+        auto top = static_cast<int>(origin_row());
+        auto bottom = static_cast<int>(line_in_screen);
+        if(!profile.scroll_regions || bottom <= top || host->layout.width <= 0) {
+            return false;
+        }
+        auto screen_width = primary_console->get_terminal_size().width;
+        auto left = static_cast<int>(origin_column());
+        auto right = std::min(left + host->layout.width - 1, screen_width);
+        auto full_width = left == 1 && right >= screen_width;
+        if(!full_width && !profile.left_right_margins) {
+            return false;
+        }
+        std::string scroll;
+        if(!full_width) {
+            scroll += "\x1b[?69h\x1b[" + std::to_string(left) + ";" + std::to_string(right) + "s";
+        }
+        scroll += "\x1b[" + std::to_string(top) + ";" + std::to_string(bottom) + "r\x1b[S\x1b[r";
+        if(!full_width) {
+            // Leaving left and right margin mode puts the margins back to the whole width
+            scroll += "\x1b[?69l";
+        }
+        write_to_host(scroll);
+        // Setting the margins sent the cursor home, the new line this is for goes on to the row that was scrolled clear
+        move_host_cursor(origin_column(), line_in_screen - 1);
+        return true;
+    }
+
+    /**
+     * The column the cursor is in after moving to the start of the pane.
+     * The cursor columns are 1 based, so a pane at x 0 starts in column 1.
+     */
+    auto Process::origin_column() -> unsigned int {
+        return static_cast<unsigned int>(std::max(host->layout.x, 1));
+    }
+
+    /**
+     * Columns into the pane a 1 based cursor column is, which is how much of the row is before it.
+     */
+    auto Process::column_in_pane(unsigned int column) -> size_t {
+        return column > origin_column() ? column - origin_column() : 0;
+    }
+
+    auto Process::origin_row() -> unsigned int {
+        return static_cast<unsigned int>(std::max(host->layout.y, 1));
+    }
+
+    /**
+     * Draw the pane from the scroll buffer, with the bottom row of the pane offset rows up from the bottom.
+     */
+    void Process::repaint_view(size_t offset) {
+        std::scoped_lock lock(*this->host->get_primary_console()->get_stdout_lock());
+        draw_view(offset);
+    }
+
+    void Process::draw_view(size_t offset) {
+        if(offscreen) {
+            return;
+        }
+        // Leaving copy mode on the alternate screen goes back to what the program had drawn
+        if(offset == 0 && host->get_alternate_screen() != nullptr) {
+            alternate_rows.assign(alternate_rows.size(), std::nullopt);
+            draw_alternate_screen();
+            return;
+        }
+        auto height = static_cast<size_t>(std::max(host->layout.height, 0));
+        auto rows = host->scroll_buffer.rows_above(offset, height);
+        // Each move is worked out from where the view drawn so far leaves the cursor
+        auto cursor = host->get_primary_console()->get_cursor_encoder();
+        std::string view;
+        auto draw = [&](std::string_view text) {
+            cursor.wrote(text);
+            view.append(text);
+        };
+        for(size_t i = 0; i < height; i++) {
+            draw(cursor.movement_to(static_cast<int>(origin_column()), static_cast<int>(origin_row() + i)));
+            draw("\x1b[" + std::to_string(host->layout.width) + "X");
+            if(i < rows.size()) {
+                // Moving between rows is done above, a new line on the last row would scroll the whole screen
+                auto& row = rows[i];
+                while(!row.empty() && (row.back() == '\n' || row.back() == '\r')) {
+                    row.pop_back();
+                }
+                std::stringstream line;
+                output_line_from_scroll_buffer(row, line);
+                draw(line.view());
+            }
+        }
+        if(offset == 0) {
+            draw(cursor.movement_to(static_cast<int>(saved_cursor_pos.first), static_cast<int>(saved_cursor_pos.second)));
+        }
+        // Every row is drawn again, a host that can shows them all at once rather than row by row
+        write_to_host(host->get_primary_console()->synchronized_frame(std::move(view)));
+    }
+
+    /**
+     * Where a program switches between the main and alternate screens, with ?1049, ?1047 or the older ?47.
+     */
+    struct ScreenSwitch {
+        size_t position;
+        size_t length;
+        bool enter;
+        bool clear;
+        // The other modes set by the same sequence as a sequence of their own, empty if it only switched screens
+        std::string other_modes;
+    };
+
+    auto find_screen_switch(std::string_view output) -> std::optional<ScreenSwitch> {
+        constexpr std::string_view private_mode{"\x1b[?"};
+        for(auto position = output.find(private_mode); position != std::string_view::npos;
+            position = output.find(private_mode, position + 1)) {
+            auto parameters = position + private_mode.size();
+            auto end = output.find_first_not_of("0123456789;", parameters);
+            if(end == std::string_view::npos || (output[end] != 'h' && output[end] != 'l')) {
+                continue;
+            }
+            // Any number of modes can be set at once, like ?1049;1h
+            std::optional<ScreenSwitch> screen_switch;
+            std::string other_modes;
+            for(auto start = parameters; start <= end;) {
+                auto mode_end = std::min(output.find(';', start), end);
+                auto mode = output.substr(start, mode_end - start);
+                if(mode == "1049" || mode == "1047" || mode == "47") {
+                    if(!screen_switch) {
+                        screen_switch = ScreenSwitch{position, end + 1 - position, output[end] == 'h', false, {}};
+                    }
+                    screen_switch->clear = screen_switch->clear || mode != "47";
+                } else if(!mode.empty()) {
+                    other_modes.append(other_modes.empty() ? "" : ";").append(mode);
+                }
+                start = mode_end + 1;
+            }
+            if(screen_switch) {
+                if(!other_modes.empty()) {
+                    screen_switch->other_modes = std::string{private_mode} + other_modes + output[end];
+                }
+                return screen_switch;
+            }
+        }
+        return std::nullopt;
+    }
+
     void Process::process_string_for_output(std::string_view output) {
-        command_log << output;
-        
-        this->host->get_primary_console()->write_to_stdout(saved_cursor_pos);
+        // The host stays on omux's own screen, only the pane switches
+        while(auto screen_switch = find_screen_switch(output)) {
+            auto before = output.substr(0, screen_switch->position);
+            if(host->get_alternate_screen() != nullptr) {
+                output_to_alternate_screen(before);
+            } else {
+                output_to_main_screen(before);
+            }
+            output.remove_prefix(screen_switch->position + screen_switch->length);
+            auto on_alternate = host->get_alternate_screen() != nullptr;
+            if(screen_switch->enter && !on_alternate) {
+                main_screen_cursor_pos = saved_cursor_pos;
+                host->enter_alternate_screen(screen_switch->clear);
+                alternate_rows.assign(static_cast<size_t>(host->get_alternate_screen()->get_height()), std::nullopt);
+                draw_alternate_screen();
+            } else if(!screen_switch->enter && on_alternate) {
+                host->exit_alternate_screen();
+                save_cursor(main_screen_cursor_pos.first, main_screen_cursor_pos.second);
+                draw_view(0);
+            }
+            // Modes set along with the switch go to the screen the pane is on now
+            if(host->get_alternate_screen() != nullptr) {
+                output_to_alternate_screen(screen_switch->other_modes);
+            } else {
+                output_to_main_screen(screen_switch->other_modes);
+            }
+        }
+        if(host->get_alternate_screen() != nullptr) {
+            output_to_alternate_screen(output);
+        } else {
+            output_to_main_screen(output);
+        }
+    }
+
+    void Process::output_to_alternate_screen(std::string_view output) {
+        if(output.empty()) {
+            return;
+        }
+        host->get_alternate_screen()->write(output);
+        draw_alternate_screen();
+    }
+
+    void Process::draw_alternate_screen() {
+        auto* screen = host->get_alternate_screen();
+        auto height = static_cast<size_t>(screen->get_height());
+        if(alternate_rows.size() != height) {
+            alternate_rows.assign(height, std::nullopt);
+        }
+        auto [cursor_column, cursor_row] = screen->cursor();
+        save_cursor(origin_column() + static_cast<unsigned int>(cursor_column), origin_row() + static_cast<unsigned int>(cursor_row));
+        if(offscreen) {
+            // Every row is drawn when the pane is shown
+            return;
+        }
+        auto cursor = host->get_primary_console()->get_cursor_encoder();
+        std::string drawn;
+        auto draw = [&](std::string_view text) {
+            cursor.wrote(text);
+            drawn.append(text);
+        };
+        size_t rows_drawn = 0;
+        for(size_t row = 0; row < height; row++) {
+            auto text = screen->render_row(static_cast<int>(row));
+            if(alternate_rows[row] == text) {
+                continue;
+            }
+            rows_drawn++;
+            draw(cursor.movement_to(static_cast<int>(origin_column()), static_cast<int>(origin_row() + row)));
+            draw("\x1b[0m\x1b[" + std::to_string(host->layout.width) + "X");
+            draw(text);
+            alternate_rows[row] = std::move(text);
+        }
+        draw(cursor.movement_to(static_cast<int>(saved_cursor_pos.first), static_cast<int>(saved_cursor_pos.second)));
+        if(rows_drawn > 1) {
+            drawn = host->get_primary_console()->synchronized_frame(std::move(drawn));
+        }
+        write_to_host(drawn);
+    }
+
+    void Process::output_to_main_screen(std::string_view output) {
+        if(output.empty()) {
+            return;
+        }
+        move_host_cursor(saved_cursor_pos.first, saved_cursor_pos.second);
 
         auto start = output.begin();
         auto end = output.end();
@@ -249,105 +444,264 @@ namespace omux {
             switch(char_out) {
                 case '\r': {
                     // Ensure the origin is shifted about any newlines or carriage returns
-                    std::string command{"\r\x1b[" + std::to_string(host->layout.x) + "G"};
-                    command_log << command;
-                    this->host->get_primary_console()->write_to_stdout(command);
-                    // Put the character directly in the scroll buffer as it will handle origin shifting again
-                    host->scroll_buffer.back().push_back(char_out);
-                    characters_from_start = host->layout.x;
+                    move_host_cursor(origin_column(), std::nullopt);
+                    host->scroll_buffer.carriage_return();
+                    characters_from_start = origin_column();
 
                     break;
                 }
                 case '\n': {
                     set_line_in_screen(line_in_screen + 1);
                     // Same as carriage return but new line needs to create a new line in the scroll buffer
-                    std::string command{"\n\x1b[" + std::to_string(host->layout.x) + "G"};
-                    command_log << command;
-                    this->host->get_primary_console()->write_to_stdout(command);
-                    host->scroll_buffer.back().push_back(char_out);
-                    host->scroll_buffer.push_back(std::string{});
+                    auto cursor = host_cursor_encoder();
+                    cursor.wrote("\n");
+                    write_to_host("\n" + cursor.movement_to(static_cast<int>(origin_column()), std::nullopt));
+                    host->scroll_buffer.new_line();
 
                     
-                    characters_from_start = host->layout.x;
+                    characters_from_start = origin_column();
                     break;
                 }
                 case '\x1b': {
-                    // don't care about OSC commands
-                    if(*(start + 1) == ']') {
-                        host->scroll_buffer.back().push_back(char_out);
-                        this->host->get_primary_console()->write_character_to_stdout(char_out);
+                    // OSC commands don't move the cursor, pass them through whole
+                    if(start + 1 != end && *(start + 1) == ']') {
+                        auto position = static_cast<size_t>(start - output.begin());
+                        auto sequence = output.substr(position, control_sequence_length(output, position));
+                        host->scroll_buffer.append_sequence(sequence);
+                        write_to_host(std::string{sequence});
+                        start += static_cast<std::ptrdiff_t>(sequence.size()) - 1;
                     } else {
                         // Backup one here because we are about to increment but we are already where we want to be
                         start = handle_csi_sequence(start, end) - 1;
 
                         // control sequences could put us anywhere
-                        auto cursor_pos = host->pseudo_console->get_cursor_position_as_pair();
+                        auto cursor_pos = host_cursor();
                         set_line_in_screen(cursor_pos.second);
                         characters_from_start = cursor_pos.first;
                     }
                     break;
                 }
                 case '\b': {
-                    if(!host->get_scroll_buffer()->back().empty()) {
+                    if(!host->get_scroll_buffer()->back_empty()) {
                         characters_from_start--;
-                        auto& line = host->get_scroll_buffer()->back();
-                        this->delete_n_renderable_characters_from_string(line, characters_from_start);
+                        host->get_scroll_buffer()->truncate_back(column_in_pane(characters_from_start));
                         
-                        this->host->get_primary_console()->write_character_to_stdout(char_out);
+                        write_to_host(char_out);
                     }                    
                     break;
                 }
                 default: {
-                    host->scroll_buffer.back().push_back(char_out);
-                    this->host->get_primary_console()->write_character_to_stdout(char_out);
-                    characters_from_start++;
+                    // ASCII goes straight through, anything else waits until the whole character is in
+                    std::string_view bytes{&*start, 1};
+                    unsigned int width = 1;
+                    if(static_cast<unsigned char>(char_out) >= 0x80 || utf8_decoder.in_sequence()) {
+                        auto character = utf8_decoder.feed(char_out);
+                        if(!character) {
+                            break;
+                        }
+                        bytes = utf8_decoder.bytes();
+                        width = static_cast<unsigned int>(codepoint_width(*character));
+                    }
+                    if(width > 0 && characters_from_start + width > origin_column() + host->layout.width) {
+                        // Past the edge of the pane, remember this was a wrap and not a new line so it can be reflowed
+                        host->scroll_buffer.wrap_back();
+                        characters_from_start = origin_column();
+                    }
+                    host->scroll_buffer.append_character(bytes);
+                    if(bytes.size() == 1) {
+                        write_to_host(bytes.front());
+                    } else {
+                        write_to_host(bytes);
+                    }
+                    characters_from_start += width;
                 }
             }
             start++;
         }
-        saved_cursor_pos = host->pseudo_console->get_cursor_position_as_movement();
-        command_log.flush();
+        auto [column, row] = host_cursor();
+        save_cursor(column, row);
         //this->host->get_primary_console()->unlock_stdout();
     }
 
     void Process::process_resize(std::string_view output) {
+        // The alternate screen isn't history, the program's repaint is drawn over all of it
+        if(host->get_alternate_screen() != nullptr) {
+            alternate_rows.clear();
+            process_string_for_output(output);
+            return;
+        }
         // A resize causes a repaint, so we just erase that far in the buffer and let it be re-written in.
-        auto start = host->scroll_buffer.end() - std::min(host->scroll_buffer.size(), static_cast<size_t>(host->layout.height));
-        host->scroll_buffer.erase(start, host->scroll_buffer.end());
-        // If we clear everything, I.E we haven't scrolled yet, we need to ensure there is still something in the buffer
+        host->scroll_buffer.erase_last(std::min(host->scroll_buffer.size(), static_cast<size_t>(host->layout.height)));
+        // If we clear everything, I.E we haven't scrolled yet, we need to ensure there is still something in the buffer.
+        // Otherwise the rows above are history and the repaint starts on a row of its own
         if(host->scroll_buffer.empty()) {
             host->scroll_buffer.push_back("");
+        } else {
+            host->scroll_buffer.new_line();
         }
         process_string_for_output(output);
     }
 
-    void Process::process_output() {
+    auto Process::render_pending() -> bool {
+        PendingOutput::Slice slice;
+        auto backed_up = false;
+        {
+            std::scoped_lock lock(pending_lock);
+            backed_up = unrendered >= PANE_BACKLOG_LIMIT;
+            // A frame too big to wait for would hold the reads up as well, and a finished pane won't get the end of one
+            auto flush = backed_up || output_stop.stop_requested();
+            slice = pending_output.take(PANE_RENDER_SLICE, std::chrono::steady_clock::now(), flush);
+        }
+        if(slice.used == 0) {
+            return false;
+        }
+        if(backed_up && !offscreen) {
+            // Drawing every byte of a flood to the host only for it to scroll away, it gets one repaint instead
+            go_offscreen();
+            backlog_offscreen = true;
+            backlog_repaint_due = std::chrono::steady_clock::now() + BACKLOG_REPAINT_INTERVAL_MS;
+            Metrics::global().add(Metrics::pane_metric(host->get_id(), "backlog_repaints"), 1);
+        }
+        if(!slice.bytes.empty()) {
+            // A program's frame is shown at once on a host that can, everything drawn for it is part of the one frame
+            auto synchronized = slice.frame && !offscreen;
+            try {
+                if(synchronized) {
+                    host->get_primary_console()->begin_frame();
+                }
+                // The first output read after any number of resizes only needs the one repaint
+                if(slice.generation != handled_resize_generation) {
+                    handled_resize_generation = slice.generation;
+                    process_resize(slice.bytes);
+                } else {
+                    process_string_for_output(slice.bytes);
+                }
+            } catch(Alias::WindowsError& e) {
+                // The host has gone away, the pane is going away with it
+            }
+            if(synchronized) {
+                try {
+                    host->get_primary_console()->end_frame();
+                } catch(Alias::WindowsError& e) {
+                }
+            }
+            // Only the state the slice left behind is published, a backed up pane skips everything in between
+            host->publish_snapshot();
+            host->report_metrics();
+            MemoryGovernor::global().usage_changed();
+        }
+        if(offscreen) {
+            Metrics::global().add(Metrics::pane_metric(host->get_id(), host->visible ? "backlog_offscreen_bytes" : "hidden_bytes"),
+                                  static_cast<long long>(slice.used));
+        }
+        if(slice.frame) {
+            Metrics::global().add(Metrics::pane_metric(host->get_id(), slice.timed_out ? "synchronized_timeouts" : "synchronized_frames"), 1);
+        }
+        size_t left = 0;
+        bool more = false;
+        {
+            std::scoped_lock lock(pending_lock);
+            unrendered -= slice.used;
+            left = unrendered;
+            // A held frame is looked at again when more output comes in or it times out
+            more = pending_output.ready();
+        }
+        Metrics::global().set(Metrics::pane_metric(host->get_id(), "render_backlog_bytes"), static_cast<long long>(left));
+        catch_up_backlog(left);
+        if(left < PANE_BACKLOG_LIMIT) {
+            backlog_drained.signal();
+        }
+        return more;
+    }
+
+    auto Process::queue_output(std::string_view chunk, unsigned int generation) -> size_t {
+        SessionRecorder::global().record(host->get_id(), RecordDirection::output, chunk);
+        size_t backlog = 0;
+        {
+            std::scoped_lock lock(pending_lock);
+            pending_output.append(chunk, generation);
+            unrendered += chunk.size();
+            backlog = unrendered;
+        }
+        host->get_primary_console()->get_renderer().schedule_output(this, chunk.size(), backlog);
+        return backlog;
+    }
+
+    auto Process::held_frame_delay() -> std::optional<std::chrono::milliseconds> {
+        std::scoped_lock lock(pending_lock);
+        auto held_until = pending_output.held_until();
+        if(!held_until) {
+            return std::nullopt;
+        }
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(*held_until - std::chrono::steady_clock::now());
+        return std::max(remaining, std::chrono::milliseconds(0));
+    }
+
+    auto Process::unrendered_bytes() -> size_t {
+        std::scoped_lock lock(pending_lock);
+        return unrendered;
+    }
+
+    auto Process::process_output(std::stop_token stop) -> DetachedTask {
         auto* pseudo_console = host->pseudo_console.get();
-        std::future<std::string> output_future;
+        // A paused pane has to wake up to stop as well
+        std::stop_callback wake_on_stop(stop, [this]() { backlog_drained.signal(); });
         try {
-            output_future = pseudo_console->read_output();
-            while(!this->process->stopped()) {
-                auto result = output_future.wait_for(std::chrono::milliseconds(16));
-                if( result == std::future_status::ready) {
-                    std::scoped_lock lock(*this->host->get_primary_console()->get_stdout_lock());
-                    if(resize_on_next_output_flag) {
-                        resize_on_next_output_flag = false;
-                        process_resize(output_future.get());
-                    } else {
-                        process_string_for_output(output_future.get());
+            while(!stop.stop_requested()) {
+                // A pending resize shortens the wait to when it can be applied
+                auto timeout = host->pending_resize_delay().value_or(OUTPUT_IDLE_TIMEOUT_MS);
+                // So is a held frame's timeout, nothing else would show it if the program goes quiet
+                auto held_frame = held_frame_delay();
+                if(held_frame) {
+                    timeout = std::min(timeout, *held_frame);
+                }
+                auto output = co_await IoExecutor::read(pseudo_console->output_pipe(), stop, timeout);
+                // What was just read was written for the size from before any resize applied now
+                auto generation = resize_generation.load();
+                host->apply_pending_resize();
+                host->apply_memory_budget();
+                if(held_frame && output.bytes.empty()) {
+                    host->get_primary_console()->get_renderer().schedule(this);
+                }
+                if(!output.bytes.empty()) {
+                    auto backlog = queue_output(output.bytes, generation);
+                    // No reads until the host catches up, the pipe filling up holds the child back
+                    if(backlog >= PANE_BACKLOG_LIMIT) {
+                        Metrics::global().add(Metrics::pane_metric(host->get_id(), "render_pauses"), 1);
                     }
-                    output_future = pseudo_console->read_output();
+                    while(backlog >= PANE_BACKLOG_LIMIT && !stop.stop_requested()) {
+                        co_await backlog_drained;
+                        backlog = unrendered_bytes();
+                    }
+                } else if(output.closed) {
+                    break;
                 }
             }
-
-            // Do this to ensure any lingering blocking reads are cancelled in the future above
-            pseudo_console->close_pipes();
-        } catch(Alias::IO_Operation_Aborted& e) {
-           // host->process_dettached(this);
-        } catch(Alias::Not_Found e) {
+            // Whatever the process wrote before it exited is still shown
+            while(pseudo_console->bytes_in_read_pipe() > 0) {
+                auto output = co_await IoExecutor::read(pseudo_console->output_pipe(), {});
+                if(output.bytes.empty()) {
+                    break;
+                }
+                queue_output(output.bytes, resize_generation.load());
+            }
+        } catch(Alias::WindowsError& e) {
+            // Broken pipes, the pane is going away either way
+        } catch(std::exception& e) {
+            // Spilling history or recording failed, the pane stops reading but still has to be detached.
+            // Letting it out of the task would terminate omux.
+            Metrics::global().add(Metrics::pane_metric(host->get_id(), "output_errors"), 1);
+            Alias::Debug_Log("omux: pane " + std::to_string(host->get_id()) + " stopped reading output: " + e.what() + "\n");
+        }
+        // The pipe may have closed before anything asked to stop, either way a frame the program never finished is shown as far as it got
+        output_stop.request_stop();
+        host->get_primary_console()->get_renderer().schedule(this);
+        while(unrendered_bytes() > 0) {
+            co_await backlog_drained;
         }
         host->process_dettached(this);
-        
+        output_done = true;
+        output_done.notify_all();
     }
     auto Process::wait_for_idle(int timeout) -> Alias::WAIT_RESULT {
         return this->process->wait_for_idle(timeout);
@@ -358,13 +712,112 @@ namespace omux {
     auto Process::process_running() -> bool {
         return !this->process->stopped();
     }
-    void Process::resize_on_next_output(Layout old_layout) {
+    void Process::resize_on_next_output(Layout old_layout, unsigned int generation) {
         // This will be the last chance we have access to the existing layout
         // so we need to clear the screen now
         std::scoped_lock lock(*this->host->get_primary_console()->get_stdout_lock());
-        host->get_primary_console()->write_to_stdout(get_repaint_sequence(old_layout));
-        resize_on_next_output_flag = true;
-        saved_cursor_pos = std::string{"\x1b[" + std::to_string(host->layout.y) + ";" + std::to_string(host->layout.x) + "H"};
+        write_to_host(get_repaint_sequence(old_layout));
+        resize_generation = generation;
+        save_cursor(origin_column(), origin_row());
+    }
+
+    void Process::go_offscreen() {
+        // Cursor positions are the host's, so the model covers the host and starts where the pane left the cursor
+        auto size = host->get_primary_console()->get_terminal_size();
+        offscreen = std::make_unique<TerminalModel>(std::max(size.width, host->layout.x + host->layout.width),
+                                                    std::max(size.height, host->layout.y + host->layout.height),
+                                                    host->get_primary_console()->get_attributes());
+        offscreen->write("\x1b[" + std::to_string(saved_cursor_pos.second) + ";" + std::to_string(saved_cursor_pos.first) + "H");
+    }
+
+    void Process::catch_up_backlog(size_t left) {
+        if(!backlog_offscreen || (left > PANE_BACKLOG_LIMIT / 2 && std::chrono::steady_clock::now() < backlog_repaint_due)) {
+            return;
+        }
+        backlog_offscreen = false;
+        // A pane hidden in the meantime stays offscreen until it is shown, which repaints it then
+        if(!offscreen || !host->visible) {
+            return;
+        }
+        offscreen.reset();
+        redraw();
+    }
+
+    void Process::visibility_changed() {
+        if(!host->visible) {
+            if(!offscreen) {
+                go_offscreen();
+            }
+            return;
+        }
+        // Shown again, the backlog's offscreen model goes as well
+        backlog_offscreen = false;
+        if(!offscreen) {
+            return;
+        }
+        offscreen.reset();
+        redraw();
+    }
+
+    void Process::redraw() {
+        if(offscreen) {
+            return;
+        }
+        if(host->get_alternate_screen() != nullptr) {
+            alternate_rows.assign(alternate_rows.size(), std::nullopt);
+            draw_alternate_screen();
+        } else {
+            draw_view(host->view_offset);
+        }
+    }
+
+    void Process::write_to_host(std::string_view output) {
+        if(offscreen) {
+            offscreen->write(output);
+            return;
+        }
+        SessionRecorder::global().record(host->get_id(), RecordDirection::host, output);
+        host->get_primary_console()->write_to_stdout(output);
+    }
+
+    void Process::write_to_host(char output) {
+        if(offscreen) {
+            offscreen->write(std::string_view{&output, 1});
+            return;
+        }
+        SessionRecorder::global().record(host->get_id(), RecordDirection::host, std::string_view{&output, 1});
+        host->get_primary_console()->write_character_to_stdout(output);
+    }
+
+    auto Process::host_cursor() -> std::pair<unsigned int, unsigned int> {
+        if(!offscreen) {
+            return host->get_primary_console()->locate_cursor();
+        }
+        auto [column, row] = offscreen->cursor();
+        return {static_cast<unsigned int>(column + 1), static_cast<unsigned int>(row + 1)};
+    }
+
+    auto Process::move_host_cursor(unsigned int column, std::optional<unsigned int> row) -> std::string {
+        auto movement = host_cursor_encoder().movement_to(static_cast<int>(column), row ? std::optional<int>{static_cast<int>(*row)} : std::nullopt);
+        if(!movement.empty()) {
+            write_to_host(movement);
+        }
+        return movement;
+    }
+
+    auto Process::host_cursor_encoder() -> CursorEncoder {
+        if(!offscreen) {
+            return host->get_primary_console()->get_cursor_encoder();
+        }
+        CursorEncoder encoder;
+        encoder.set_screen_size(offscreen->get_width(), offscreen->get_height());
+        auto [column, row] = host_cursor();
+        encoder.reported(static_cast<int>(column), static_cast<int>(row));
+        return encoder;
+    }
 
+    void Process::save_cursor(unsigned int column, unsigned int row) {
+        saved_cursor_pos = {column, row};
+        host->saved_cursor = "\x1b[" + std::to_string(row) + ";" + std::to_string(column) + "H";
     }
 } // namespace omux
\ No newline at end of file
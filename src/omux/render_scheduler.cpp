@@ -0,0 +1,240 @@
+#include "omux/render_scheduler.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace omux {
+    namespace {
+        /**
+         * How many bytes at the end of output could be the start of a private mode sequence, which the next chunk
+         * may finish. Frames and screen switches are both private modes, neither can be found in half of one.
+         */
+        auto partial_private_mode(std::string_view output) -> size_t {
+            constexpr std::string_view private_mode{"\x1b[?"};
+            auto start = output.rfind('\x1b');
+            if(start == std::string_view::npos) {
+                return 0;
+            }
+            auto rest = output.substr(start);
+            if(rest.size() <= private_mode.size()) {
+                return private_mode.starts_with(rest) ? rest.size() : 0;
+            }
+            auto parameters = rest.substr(private_mode.size());
+            return rest.starts_with(private_mode) && parameters.find_first_not_of("0123456789;") == std::string_view::npos ? rest.size() : 0;
+        }
+    } // namespace
+
+    void PendingOutput::append(std::string_view chunk, unsigned int generation) {
+        if(chunk.empty()) {
+            return;
+        }
+        if(generations.empty() || generations.back().value != generation) {
+            generations.push_back({bytes.size(), generation});
+        }
+        bytes.append(chunk);
+    }
+
+    auto PendingOutput::generation_end() const -> size_t {
+        return generations.size() > 1 ? generations[1].from : bytes.size();
+    }
+
+    auto PendingOutput::generation_at(size_t offset) const -> unsigned int {
+        unsigned int generation = 0;
+        for(const auto& mark : generations) {
+            if(mark.from > offset) {
+                break;
+            }
+            generation = mark.value;
+        }
+        return generation;
+    }
+
+    void PendingOutput::consume(size_t count) {
+        bytes.erase(0, count);
+        for(auto& mark : generations) {
+            mark.from = mark.from > count ? mark.from - count : 0;
+        }
+        while(generations.size() > 1 && generations[1].from == 0) {
+            generations.pop_front();
+        }
+        if(bytes.empty()) {
+            generations.clear();
+        }
+    }
+
+    auto PendingOutput::size() const -> size_t {
+        return bytes.size();
+    }
+
+    auto PendingOutput::ready() const -> bool {
+        return !deadline && bytes.size() > partial_private_mode(bytes);
+    }
+
+    auto PendingOutput::held_until() const -> std::optional<std::chrono::steady_clock::time_point> {
+        return deadline;
+    }
+
+    auto PendingOutput::take(size_t max_bytes, std::chrono::steady_clock::time_point now, bool flush) -> Slice {
+        Slice slice;
+        if(!deadline) {
+            auto begin = bytes.find(BEGIN_SYNCHRONIZED_UPDATE);
+            if(begin != 0) {
+                // Everything before a frame is shown as usual, apart from what may be a frame starting in the next chunk
+                auto shown = begin != std::string::npos || flush ? std::min(begin, bytes.size()) : bytes.size() - partial_private_mode(bytes);
+                // Output from before a resize is never drawn in the same slice as output from after it
+                slice.used = std::min(shown, generation_end());
+                if(slice.used > max_bytes) {
+                    // A slice cut short doesn't split a private mode either, unless the sequence is the whole slice
+                    auto split = partial_private_mode(std::string_view{bytes}.substr(0, max_bytes));
+                    slice.used = split < max_bytes ? max_bytes - split : max_bytes;
+                }
+                slice.bytes = bytes.substr(0, slice.used);
+                slice.generation = generation_at(0);
+                consume(slice.used);
+                return slice;
+            }
+            consume(BEGIN_SYNCHRONIZED_UPDATE.size());
+            slice.used = BEGIN_SYNCHRONIZED_UPDATE.size();
+            deadline = now + SYNCHRONIZED_UPDATE_TIMEOUT_MS;
+        }
+        auto end = bytes.find(END_SYNCHRONIZED_UPDATE);
+        if(end != std::string::npos) {
+            slice.bytes = bytes.substr(0, end);
+            slice.used += end + END_SYNCHRONIZED_UPDATE.size();
+            slice.generation = generation_at(end + END_SYNCHRONIZED_UPDATE.size() - 1);
+            consume(end + END_SYNCHRONIZED_UPDATE.size());
+        } else if(flush || now >= *deadline) {
+            slice.timed_out = !flush;
+            slice.used += bytes.size();
+            slice.bytes = bytes;
+            slice.generation = generation_at(bytes.empty() ? 0 : bytes.size() - 1);
+            consume(bytes.size());
+        } else {
+            return slice;
+        }
+        deadline.reset();
+        slice.frame = true;
+        return slice;
+    }
+
+    RenderScheduler::RenderScheduler(std::mutex& output_lock) : output_lock(output_lock) {
+        worker = std::jthread([this](std::stop_token stop) { run(stop); });
+    }
+
+    RenderScheduler::~RenderScheduler() {
+        // Requesting the stop wakes the worker from its wait
+        worker.request_stop();
+        worker.join();
+    }
+
+    void RenderScheduler::schedule(RenderTarget* target) {
+        {
+            std::scoped_lock lock(queue_lock);
+            std::erase_if(waiting, [&](const auto& frame) { return frame.first == target; });
+            if(std::find(queue.begin(), queue.end(), target) != queue.end()) {
+                return;
+            }
+            // Queued even while it is being rendered, the output may have come in after its slice was taken
+            queue.push_back(target);
+        }
+        queue_changed.notify_all();
+    }
+
+    void RenderScheduler::schedule_output(RenderTarget* target, size_t chunk, size_t backlog) {
+        auto now = std::chrono::steady_clock::now();
+        auto echo = chunk <= INTERACTIVE_CHUNK_LIMIT && now - last_input.load(std::memory_order_relaxed) <= INTERACTIVE_ECHO_WINDOW_MS;
+        if(echo || backlog >= PANE_RENDER_SLICE) {
+            {
+                std::scoped_lock lock(queue_lock);
+                echo_chunks += echo ? 1 : 0;
+            }
+            schedule(target);
+            return;
+        }
+        {
+            std::scoped_lock lock(queue_lock);
+            batched_chunks++;
+            // Output that comes in while a target waits goes in the same frame
+            if(std::find(queue.begin(), queue.end(), target) != queue.end() ||
+               std::find_if(waiting.begin(), waiting.end(), [&](const auto& frame) { return frame.first == target; }) != waiting.end()) {
+                return;
+            }
+            waiting.emplace_back(target, now + RENDER_FRAME_INTERVAL_MS);
+        }
+        queue_changed.notify_all();
+    }
+
+    void RenderScheduler::input_forwarded() {
+        last_input.store(std::chrono::steady_clock::now(), std::memory_order_relaxed);
+    }
+
+    void RenderScheduler::remove(RenderTarget* target) {
+        std::unique_lock lock(queue_lock);
+        std::erase(queue, target);
+        std::erase_if(waiting, [&](const auto& frame) { return frame.first == target; });
+        queue_changed.wait(lock, [&]() { return rendering != target; });
+        std::erase(queue, target);
+        std::erase_if(waiting, [&](const auto& frame) { return frame.first == target; });
+    }
+
+    auto RenderScheduler::rendered() const -> size_t {
+        std::scoped_lock lock(queue_lock);
+        return slices;
+    }
+
+    auto RenderScheduler::echoes() const -> size_t {
+        std::scoped_lock lock(queue_lock);
+        return echo_chunks;
+    }
+
+    auto RenderScheduler::batched() const -> size_t {
+        std::scoped_lock lock(queue_lock);
+        return batched_chunks;
+    }
+
+    auto RenderScheduler::queue_due(std::chrono::steady_clock::time_point now) -> std::optional<std::chrono::steady_clock::time_point> {
+        std::optional<std::chrono::steady_clock::time_point> next_frame;
+        std::erase_if(waiting, [&](const auto& frame) {
+            if(frame.second <= now) {
+                if(std::find(queue.begin(), queue.end(), frame.first) == queue.end()) {
+                    queue.push_back(frame.first);
+                }
+                return true;
+            }
+            next_frame = next_frame ? std::min(*next_frame, frame.second) : frame.second;
+            return false;
+        });
+        return next_frame;
+    }
+
+    void RenderScheduler::run(std::stop_token stop) {
+        std::unique_lock lock(queue_lock);
+        while(!stop.stop_requested()) {
+            auto next_frame = queue_due(std::chrono::steady_clock::now());
+            if(queue.empty()) {
+                if(next_frame) {
+                    queue_changed.wait_until(lock, stop, *next_frame, [&]() { return !queue.empty(); });
+                } else {
+                    queue_changed.wait(lock, stop, [&]() { return !queue.empty() || !waiting.empty(); });
+                }
+                continue;
+            }
+            rendering = queue.front();
+            queue.pop_front();
+            lock.unlock();
+            bool more = false;
+            {
+                std::scoped_lock output(output_lock);
+                more = rendering->render_pending();
+            }
+            lock.lock();
+            slices++;
+            // Back of the queue, so every other pane gets its turn first
+            if(more && std::find(queue.begin(), queue.end(), rendering) == queue.end()) {
+                std::erase_if(waiting, [&](const auto& frame) { return frame.first == rendering; });
+                queue.push_back(rendering);
+            }
+            rendering = nullptr;
+            queue_changed.notify_all();
+        }
+    }
+} // namespace omux
@@ -0,0 +1,183 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace omux {
+    /**
+     * Output a pane has read but not yet shown, past this its reads stop until the host catches up.
+     * The pipe filling up is what holds the child back, so memory stays bounded however fast it writes.
+     */
+    constexpr size_t PANE_BACKLOG_LIMIT = 256 * 1024;
+    /**
+     * A pane over PANE_BACKLOG_LIMIT draws its output offscreen, and is repainted on the host once it is down to half
+     * of it or this long after it went offscreen, whichever comes first.
+     */
+    constexpr auto BACKLOG_REPAINT_INTERVAL_MS = std::chrono::milliseconds(100);
+    /**
+     * Most of a pane's backlog shown in one go, so a flooding pane can't keep the others off the host.
+     */
+    constexpr size_t PANE_RENDER_SLICE = 32 * 1024;
+    /**
+     * Longest a frame is held waiting for the end of a synchronized update, a program that never ends one still gets shown.
+     */
+    constexpr auto SYNCHRONIZED_UPDATE_TIMEOUT_MS = std::chrono::milliseconds(150);
+    constexpr std::string_view BEGIN_SYNCHRONIZED_UPDATE{"\x1b[?2026h"};
+    constexpr std::string_view END_SYNCHRONIZED_UPDATE{"\x1b[?2026l"};
+    /**
+     * Output this small that comes in this soon after input was forwarded is taken to be the echo, and shown straight away.
+     */
+    constexpr size_t INTERACTIVE_CHUNK_LIMIT = 1024;
+    constexpr auto INTERACTIVE_ECHO_WINDOW_MS = std::chrono::milliseconds(20);
+    /**
+     * Any other output is gathered up and shown at most this often, unless a whole slice of it is waiting.
+     */
+    constexpr auto RENDER_FRAME_INTERVAL_MS = std::chrono::milliseconds(16);
+
+    /**
+     * Output a pane has read but not handed to the renderer yet.
+     *
+     * A synchronized update (from ?2026h to ?2026l) is one frame. It is held back until it ends and
+     * then taken whole, so it is drawn in one go and never interleaved with other panes.
+     * The markers themselves aren't passed on.
+     */
+    class PendingOutput {
+        public:
+        struct Slice {
+            std::string bytes;
+            // How much pending output the slice used up, markers included
+            size_t used = 0;
+            // The slice is a whole synchronized update, or as much of one as there was when it had to be shown
+            bool frame = false;
+            bool timed_out = false;
+            // The resize generation the bytes were read in, a frame has the generation its last bytes were read in
+            unsigned int generation = 0;
+        };
+        /**
+         * @param generation the resize generation the pane was at when chunk was read, ordinary output
+         * read in different generations never ends up in the same slice
+         */
+        void append(std::string_view chunk, unsigned int generation = 0);
+        [[nodiscard]] auto size() const -> size_t;
+        /**
+         * Whether take would give something without more output coming in. Neither a held frame nor the start
+         * of a private mode sequence (like a frame marker or a screen switch) waiting for the rest of it is.
+         */
+        [[nodiscard]] auto ready() const -> bool;
+        /**
+         * When a held frame has to be shown anyway, nothing if no frame is held.
+         */
+        [[nodiscard]] auto held_until() const -> std::optional<std::chrono::steady_clock::time_point>;
+        /**
+         * Takes up to max_bytes of ordinary output or a whole frame, nothing while a frame is held.
+         * @param flush take a held frame as far as it has got, for a pane that is backed up or finishing
+         */
+        auto take(size_t max_bytes, std::chrono::steady_clock::time_point now, bool flush) -> Slice;
+
+        private:
+        struct Generation {
+            size_t from;
+            unsigned int value;
+        };
+        std::string bytes;
+        // Where each generation's bytes start in bytes, oldest first and the first one always from 0
+        std::deque<Generation> generations;
+        std::optional<std::chrono::steady_clock::time_point> deadline;
+
+        /**
+         * Where the oldest generation's bytes end.
+         */
+        [[nodiscard]] auto generation_end() const -> size_t;
+        [[nodiscard]] auto generation_at(size_t offset) const -> unsigned int;
+        void consume(size_t count);
+    };
+
+    /**
+     * Something with output waiting to be shown on the host.
+     */
+    class RenderTarget {
+        public:
+        virtual ~RenderTarget() = default;
+        /**
+         * Shows up to a slice of what is waiting, called with the host's output lock held.
+         * @return true if there is more left
+         */
+        virtual auto render_pending() -> bool = 0;
+    };
+
+    /**
+     * Shows the output of every pane on the host from one thread, taking turns a slice at a time.
+     *
+     * Panes only ever hand output over, so a slow host never blocks a pane's reads or the threads they run on.
+     * Each pane decides for itself when its backlog is too big and stops reading.
+     *
+     * Echoes of what was typed are shown as soon as they come in. Bulk output waits for the next frame, so a
+     * stream of small reads becomes a few big writes to the host.
+     */
+    class RenderScheduler {
+        public:
+        explicit RenderScheduler(std::mutex& output_lock);
+        ~RenderScheduler();
+        RenderScheduler(const RenderScheduler&) = delete;
+        auto operator=(const RenderScheduler&) -> RenderScheduler& = delete;
+        /**
+         * Queues target to be rendered, a target that is already queued keeps its place.
+         */
+        void schedule(RenderTarget* target);
+        /**
+         * Queues target for output that has just come in, straight away for an echo or a whole slice,
+         * otherwise for the next frame.
+         * @param chunk bytes that just came in
+         * @param backlog bytes target now has waiting, chunk included
+         */
+        void schedule_output(RenderTarget* target, size_t chunk, size_t backlog);
+        /**
+         * Input has just been forwarded to a pane, the output right after it is likely the echo.
+         */
+        void input_forwarded();
+        /**
+         * Takes target out of the queue, waiting for it to finish if it is being rendered.
+         */
+        void remove(RenderTarget* target);
+        /**
+         * Slices rendered so far.
+         */
+        [[nodiscard]] auto rendered() const -> size_t;
+        /**
+         * Chunks shown straight away as echoes of input, and chunks held for a frame.
+         */
+        [[nodiscard]] auto echoes() const -> size_t;
+        [[nodiscard]] auto batched() const -> size_t;
+
+        private:
+        std::mutex& output_lock;
+        mutable std::mutex queue_lock;
+        std::condition_variable_any queue_changed;
+        std::deque<RenderTarget*> queue;
+        // Targets waiting for their frame and when it is, none of them are in queue as well
+        std::vector<std::pair<RenderTarget*, std::chrono::steady_clock::time_point>> waiting;
+        RenderTarget* rendering = nullptr;
+        size_t slices = 0;
+        size_t echo_chunks = 0;
+        size_t batched_chunks = 0;
+        std::atomic<std::chrono::steady_clock::time_point> last_input{};
+        std::jthread worker;
+
+        void run(std::stop_token stop);
+        /**
+         * Moves the targets whose frame has come to the queue, the caller must hold queue_lock.
+         * @return when the next frame is, if anything is still waiting
+         */
+        auto queue_due(std::chrono::steady_clock::time_point now) -> std::optional<std::chrono::steady_clock::time_point>;
+    };
+} // namespace omux
@@ -0,0 +1,186 @@
+#include "omux/replay.hpp"
+#include "omux/terminal_model.hpp"
+#include <charconv>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace omux {
+    namespace {
+        auto hex_value(std::string_view digits) -> uint32_t {
+            uint32_t value = 0;
+            auto result = std::from_chars(digits.data(), digits.data() + digits.size(), value, 16);
+            if(result.ptr != digits.data() + digits.size()) {
+                throw std::runtime_error("Bad \\u escape in asciicast");
+            }
+            return value;
+        }
+
+        /**
+         * Reads the JSON string starting at the quote at position, leaving position after the closing quote.
+         */
+        auto parse_json_string(std::string_view line, size_t& position) -> std::string {
+            if(position >= line.size() || line[position] != '"') {
+                throw std::runtime_error("Expected a string in asciicast event");
+            }
+            std::string text;
+            position++;
+            while(position < line.size() && line[position] != '"') {
+                auto character = line[position++];
+                if(character != '\\') {
+                    text.push_back(character);
+                    continue;
+                }
+                if(position >= line.size()) {
+                    break;
+                }
+                auto escaped = line[position++];
+                switch(escaped) {
+                    case 'n':
+                        text.push_back('\n');
+                        break;
+                    case 'r':
+                        text.push_back('\r');
+                        break;
+                    case 't':
+                        text.push_back('\t');
+                        break;
+                    case 'b':
+                        text.push_back('\b');
+                        break;
+                    case 'f':
+                        text.push_back('\f');
+                        break;
+                    case 'u': {
+                        auto character_code = hex_value(line.substr(position, 4));
+                        position += 4;
+                        // Characters outside the BMP come as a surrogate pair
+                        if(character_code >= 0xd800 && character_code < 0xdc00 && line.substr(position, 2) == "\\u") {
+                            auto low = hex_value(line.substr(position + 2, 4));
+                            position += 6;
+                            character_code = 0x10000 + ((character_code - 0xd800) << 10) + (low - 0xdc00);
+                        }
+                        append_utf8(text, static_cast<char32_t>(character_code));
+                        break;
+                    }
+                    default:
+                        text.push_back(escaped);
+                }
+            }
+            if(position >= line.size()) {
+                throw std::runtime_error("Unterminated string in asciicast event");
+            }
+            position++;
+            return text;
+        }
+
+        void skip_to(std::string_view line, size_t& position, char character) {
+            position = line.find(character, position);
+            if(position == std::string_view::npos) {
+                throw std::runtime_error("Malformed asciicast event");
+            }
+            position++;
+            while(position < line.size() && line[position] == ' ') {
+                position++;
+            }
+        }
+
+        auto header_number(std::string_view header, std::string_view key, int fallback) -> int {
+            auto found = header.find("\"" + std::string{key} + "\"");
+            if(found == std::string_view::npos) {
+                return fallback;
+            }
+            auto position = header.find(':', found);
+            if(position == std::string_view::npos) {
+                return fallback;
+            }
+            position = header.find_first_not_of(' ', position + 1);
+            int value = fallback;
+            std::from_chars(header.data() + position, header.data() + header.size(), value);
+            return value;
+        }
+    } // namespace
+
+    auto load_recording(std::istream& input) -> Recording {
+        if(input.peek() == SESSION_RECORDING_MAGIC.front()) {
+            Recording recording;
+            recording.frames = SessionRecorder::read_frames(input);
+            return recording;
+        }
+        return parse_asciicast(input);
+    }
+
+    auto parse_asciicast(std::istream& input) -> Recording {
+        Recording recording;
+        std::string line;
+        if(!std::getline(input, line) || header_number(line, "version", 0) != 2) {
+            throw std::runtime_error("Only asciicast version 2 recordings can be replayed");
+        }
+        recording.width = header_number(line, "width", recording.width);
+        recording.height = header_number(line, "height", recording.height);
+        while(std::getline(input, line)) {
+            if(line.empty() || line.front() != '[') {
+                continue;
+            }
+            size_t position = 1;
+            // from_chars for doubles isn't everywhere yet
+            char* time_end = nullptr;
+            auto seconds = std::strtod(line.c_str() + position, &time_end);
+            position = static_cast<size_t>(time_end - line.c_str());
+            skip_to(line, position, ',');
+            auto code = parse_json_string(line, position);
+            skip_to(line, position, ',');
+            auto data = parse_json_string(line, position);
+            if(code != "o" && code != "i") {
+                // Markers and resizes
+                continue;
+            }
+            RecordedFrame frame;
+            frame.time = std::chrono::microseconds{static_cast<long long>(seconds * 1e6)};
+            frame.pane = 1;
+            frame.direction = code == "o" ? RecordDirection::output : RecordDirection::input;
+            frame.bytes = std::move(data);
+            recording.frames.push_back(std::move(frame));
+        }
+        return recording;
+    }
+
+    auto ReplayReport::megabytes_per_second() const -> double {
+        auto seconds = std::chrono::duration<double>(elapsed).count();
+        return seconds > 0 ? static_cast<double>(bytes_in) / (1024.0 * 1024.0) / seconds : 0;
+    }
+
+    auto ReplayReport::to_string() const -> std::string {
+        std::stringstream report;
+        report << "frames=" << frames << "\n";
+        report << "bytes_in=" << bytes_in << "\n";
+        report << "bytes_emitted=" << bytes_emitted << "\n";
+        report << "elapsed_ms=" << std::fixed << std::setprecision(3)
+               << std::chrono::duration<double, std::milli>(elapsed).count() << "\n";
+        report << "throughput_mb_s=" << std::setprecision(2) << megabytes_per_second() << "\n";
+        report << "screen_hash=" << std::hex << std::setw(16) << std::setfill('0') << screen_hash << "\n";
+        return report.str();
+    }
+
+    auto replay(const Recording& recording, ReplayPacing pacing, const std::function<void(const RecordedFrame&)>& feed)
+    -> ReplayReport {
+        ReplayReport report;
+        auto start = std::chrono::steady_clock::now();
+        for(const auto& frame : recording.frames) {
+            // Input went to a shell that isn't there any more, what it echoed is in the output
+            if(frame.direction != RecordDirection::output) {
+                continue;
+            }
+            if(pacing == ReplayPacing::original) {
+                std::this_thread::sleep_until(start + frame.time);
+            }
+            feed(frame);
+            report.frames++;
+            report.bytes_in += frame.bytes.size();
+        }
+        report.elapsed = std::chrono::steady_clock::now() - start;
+        return report;
+    }
+} // namespace omux
@@ -0,0 +1,57 @@
+#pragma once
+#include "omux/session_recorder.hpp"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace omux {
+    /**
+     * Frames to replay and the size of the screen they were recorded on.
+     * omux recordings don't have a size, so they keep the defaults unless told otherwise.
+     */
+    struct Recording {
+        int width = 80;
+        int height = 24;
+        std::vector<RecordedFrame> frames;
+    };
+
+    /**
+     * Reads either an omux session recording or an asciicast v2 file, going by how it starts.
+     */
+    auto load_recording(std::istream& input) -> Recording;
+    /**
+     * Output events become output frames and input events input frames, everything is put in pane 1.
+     */
+    auto parse_asciicast(std::istream& input) -> Recording;
+
+    enum class ReplayPacing {
+        // Frames are fed with the same gaps between them as when they were recorded
+        original,
+        // Frames are fed back to back, for measuring throughput
+        fastest
+    };
+
+    struct ReplayReport {
+        size_t frames = 0;
+        size_t bytes_in = 0;
+        size_t bytes_emitted = 0;
+        std::chrono::nanoseconds elapsed{0};
+        uint64_t screen_hash = 0;
+
+        [[nodiscard]] auto megabytes_per_second() const -> double;
+        /**
+         * One key=value per line, so runs can be diffed and parsed by scripts.
+         */
+        [[nodiscard]] auto to_string() const -> std::string;
+    };
+
+    /**
+     * Feeds every output frame to feed in order, timing how long it takes.
+     * The caller fills in the bytes emitted and the screen hash, it is the one that knows where the output went.
+     */
+    auto replay(const Recording& recording, ReplayPacing pacing, const std::function<void(const RecordedFrame&)>& feed)
+    -> ReplayReport;
+} // namespace omux
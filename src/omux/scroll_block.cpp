@@ -0,0 +1,343 @@
+#include "omux/scroll_block.hpp"
+#include "omux/lz_codec.hpp"
+#include <bit>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+
+namespace omux {
+    namespace {
+        constexpr uint8_t SOFT_WRAPPED = 1;
+        constexpr uint8_t ENDED = 2;
+
+        template <typename T> void write_array(std::string& data, const T& array) {
+            auto count = static_cast<uint32_t>(array.size());
+            data.append(reinterpret_cast<const char*>(&count), sizeof(count));
+            data.append(reinterpret_cast<const char*>(array.data()), array.size() * sizeof(typename T::value_type));
+        }
+
+        template <typename T> void read_array(std::string_view& data, T& array) {
+            uint32_t count = 0;
+            if(data.size() < sizeof(count)) {
+                throw std::runtime_error("Packed rows are missing an array");
+            }
+            std::memcpy(&count, data.data(), sizeof(count));
+            data.remove_prefix(sizeof(count));
+            auto bytes = count * sizeof(typename T::value_type);
+            if(data.size() < bytes) {
+                throw std::runtime_error("Packed rows are shorter than their arrays");
+            }
+            array.resize(count);
+            if(bytes > 0) {
+                std::memcpy(array.data(), data.data(), bytes);
+            }
+            data.remove_prefix(bytes);
+        }
+    } // namespace
+
+    template <typename Rows> auto PackedRows::pack(const Rows& rows) -> PackedRows {
+        PackedRows packed;
+        for(const auto& row : rows) {
+            packed.text.append(row.text);
+            packed.text_ends.push_back(static_cast<uint32_t>(packed.text.size()));
+            packed.run_columns.insert(packed.run_columns.end(), row.run_columns.begin(), row.run_columns.end());
+            packed.run_sequences.insert(packed.run_sequences.end(), row.run_sequences.begin(), row.run_sequences.end());
+            packed.run_ends.push_back(static_cast<uint32_t>(packed.run_columns.size()));
+            packed.flags.push_back(static_cast<uint8_t>((row.soft_wrapped ? SOFT_WRAPPED : 0) | (row.ended ? ENDED : 0)));
+        }
+        packed.text.shrink_to_fit();
+        packed.text_ends.shrink_to_fit();
+        packed.run_ends.shrink_to_fit();
+        packed.run_columns.shrink_to_fit();
+        packed.run_sequences.shrink_to_fit();
+        packed.flags.shrink_to_fit();
+        return packed;
+    }
+    template auto PackedRows::pack(const std::vector<Row>& rows) -> PackedRows;
+    template auto PackedRows::pack(const std::deque<Row>& rows) -> PackedRows;
+
+    auto PackedRows::size() const -> size_t {
+        return text_ends.size();
+    }
+
+    auto PackedRows::row(size_t index) const -> Row {
+        Row unpacked;
+        size_t text_start = index > 0 ? text_ends[index - 1] : 0;
+        size_t run_start = index > 0 ? run_ends[index - 1] : 0;
+        unpacked.text = text.substr(text_start, text_ends[index] - text_start);
+        unpacked.run_columns.assign(run_columns.begin() + static_cast<std::ptrdiff_t>(run_start),
+                                    run_columns.begin() + run_ends[index]);
+        unpacked.run_sequences.assign(run_sequences.begin() + static_cast<std::ptrdiff_t>(run_start),
+                                      run_sequences.begin() + run_ends[index]);
+        unpacked.soft_wrapped = (flags[index] & SOFT_WRAPPED) != 0;
+        unpacked.ended = (flags[index] & ENDED) != 0;
+        return unpacked;
+    }
+
+    auto PackedRows::rows() const -> std::vector<Row> {
+        std::vector<Row> unpacked;
+        unpacked.reserve(size());
+        for(size_t index = 0; index < size(); index++) {
+            unpacked.push_back(row(index));
+        }
+        return unpacked;
+    }
+
+    auto PackedRows::soft_wrapped(size_t index) const -> bool {
+        return (flags[index] & SOFT_WRAPPED) != 0;
+    }
+
+    auto PackedRows::memory_usage() const -> size_t {
+        return sizeof(PackedRows) + text.capacity() +
+               (text_ends.capacity() + run_ends.capacity() + run_columns.capacity()) * sizeof(uint32_t) +
+               run_sequences.capacity() * sizeof(SequenceId) + flags.capacity();
+    }
+
+    auto PackedRows::serialize() const -> std::string {
+        std::string data;
+        data.reserve(memory_usage());
+        write_array(data, text);
+        write_array(data, text_ends);
+        write_array(data, run_ends);
+        write_array(data, run_columns);
+        write_array(data, run_sequences);
+        write_array(data, flags);
+        return data;
+    }
+
+    auto PackedRows::deserialize(std::string_view data) -> PackedRows {
+        PackedRows packed;
+        read_array(data, packed.text);
+        read_array(data, packed.text_ends);
+        read_array(data, packed.run_ends);
+        read_array(data, packed.run_columns);
+        read_array(data, packed.run_sequences);
+        read_array(data, packed.flags);
+        if(packed.run_ends.size() != packed.size() || packed.flags.size() != packed.size() ||
+           packed.run_columns.size() != packed.run_sequences.size()) {
+            throw std::runtime_error("Packed rows have arrays of different lengths");
+        }
+        return packed;
+    }
+
+    ScrollBlock::ScrollBlock(std::shared_ptr<const PackedRows> rows, std::shared_ptr<std::atomic<size_t>> owner_bytes)
+    : packed(std::move(rows)), owner_bytes(std::move(owner_bytes)) {
+        this->rows = packed->size();
+        *this->owner_bytes += storage_bytes();
+    }
+
+    ScrollBlock::~ScrollBlock() {
+        *owner_bytes -= storage_bytes();
+    }
+
+    auto ScrollBlock::size() const -> size_t {
+        return rows;
+    }
+
+    auto ScrollBlock::storage_bytes() const -> size_t {
+        return sizeof(ScrollBlock) + (packed ? packed->memory_usage() : compressed.capacity());
+    }
+
+    auto ScrollBlock::get_packed() -> std::shared_ptr<const PackedRows> {
+        std::scoped_lock lock(storage_lock);
+        return packed;
+    }
+
+    auto ScrollBlock::decompress() -> std::shared_ptr<const PackedRows> {
+        std::scoped_lock lock(storage_lock);
+        if(packed) {
+            return packed;
+        }
+        return std::make_shared<const PackedRows>(PackedRows::deserialize(lz_decompress(compressed, packed_size)));
+    }
+
+    void ScrollBlock::set_packed(std::shared_ptr<const PackedRows> new_rows) {
+        std::scoped_lock lock(storage_lock);
+        *owner_bytes -= storage_bytes();
+        packed = std::move(new_rows);
+        rows = packed->size();
+        compressed = std::string{};
+        *owner_bytes += storage_bytes();
+    }
+
+    void ScrollBlock::compress() {
+        auto rows_to_compress = get_packed();
+        if(!rows_to_compress) {
+            return;
+        }
+        auto serialized = rows_to_compress->serialize();
+        auto compressed_rows = lz_compress(serialized);
+        compressed_rows.shrink_to_fit();
+
+        std::scoped_lock lock(storage_lock);
+        if(packed != rows_to_compress) {
+            return;
+        }
+        *owner_bytes -= storage_bytes();
+        compressed = std::move(compressed_rows);
+        packed_size = serialized.size();
+        packed.reset();
+        *owner_bytes += storage_bytes();
+    }
+
+    auto ScrollBlock::is_compressed() -> bool {
+        std::scoped_lock lock(storage_lock);
+        return !packed;
+    }
+
+    auto ScrollBlock::get_compressed() -> std::optional<std::pair<std::string, size_t>> {
+        std::scoped_lock lock(storage_lock);
+        if(packed) {
+            return std::nullopt;
+        }
+        return std::make_pair(compressed, packed_size);
+    }
+
+    auto ScrollBlock::memory_usage() -> size_t {
+        std::scoped_lock lock(storage_lock);
+        return storage_bytes();
+    }
+
+    BlockSpill::BlockSpill(std::unique_ptr<SpillFile> data, std::unique_ptr<SpillFile> index)
+    : data(std::move(data)), index(std::move(index)) {
+    }
+
+    auto BlockSpill::size() const -> size_t {
+        return blocks;
+    }
+
+    auto BlockSpill::record(size_t block) const -> SpillRecord {
+        SpillRecord found;
+        auto bytes = index->read(block * sizeof(SpillRecord), sizeof(SpillRecord));
+        std::memcpy(&found, bytes.data(), sizeof(SpillRecord));
+        return found;
+    }
+
+    void BlockSpill::write_record(size_t block, const SpillRecord& record) {
+        std::string_view bytes{reinterpret_cast<const char*>(&record), sizeof(SpillRecord)};
+        // Blocks taken back out leave their records behind to be written over
+        if(block * sizeof(SpillRecord) < index->size()) {
+            index->write(block * sizeof(SpillRecord), bytes);
+        } else {
+            index->append(bytes);
+        }
+    }
+
+    auto spill_extent(size_t length) -> size_t {
+        if(length <= SPILL_SMALLEST_EXTENT) {
+            return SPILL_SMALLEST_EXTENT;
+        }
+        auto step = std::bit_floor(length) / 4;
+        return (length + step - 1) / step * step;
+    }
+
+    auto BlockSpill::store(std::string_view compressed) -> uint64_t {
+        auto reusable = free_extents.find(spill_extent(compressed.size()));
+        if(reusable == free_extents.end()) {
+            // Appended whole so the extent is never split between views
+            std::string extent{compressed};
+            extent.resize(spill_extent(compressed.size()));
+            return data->append(extent);
+        }
+        auto offset = reusable->second;
+        free_extents.erase(reusable);
+        data->write(offset, compressed);
+        return offset;
+    }
+
+    void BlockSpill::push_back(SpillRecord record, std::string_view compressed) {
+        record.offset = store(compressed);
+        record.length = static_cast<uint32_t>(compressed.size());
+        write_record(blocks, record);
+        blocks++;
+    }
+
+    void BlockSpill::replace(size_t block, SpillRecord record, std::string_view compressed) {
+        auto old = this->record(block);
+        // The data goes in before the record points at it, readers hold the same lock as the writer
+        if(spill_extent(compressed.size()) == spill_extent(old.length)) {
+            data->write(old.offset, compressed);
+            record.offset = old.offset;
+        } else {
+            record.offset = store(compressed);
+            free_extents.emplace(spill_extent(old.length), old.offset);
+        }
+        record.length = static_cast<uint32_t>(compressed.size());
+        write_record(block, record);
+    }
+
+    void BlockSpill::pop_back() {
+        blocks--;
+        auto taken = record(blocks);
+        free_extents.emplace(spill_extent(taken.length), taken.offset);
+    }
+
+    auto BlockSpill::rows(size_t block) const -> std::shared_ptr<const PackedRows> {
+        auto found = record(block);
+        auto compressed = data->read(found.offset, found.length);
+        return std::make_shared<const PackedRows>(PackedRows::deserialize(lz_decompress(compressed, found.packed_size)));
+    }
+
+    auto BlockSpill::block_of_line(size_t line) const -> size_t {
+        size_t low = 0;
+        size_t high = blocks;
+        while(high - low > 1) {
+            auto middle = low + (high - low) / 2;
+            if(record(middle).first_line <= line) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+        return low;
+    }
+
+    auto BlockCompressor::global() -> BlockCompressor& {
+        static BlockCompressor compressor;
+        return compressor;
+    }
+
+    BlockCompressor::~BlockCompressor() {
+        if(worker.joinable()) {
+            worker.request_stop();
+            worker.join();
+        }
+    }
+
+    void BlockCompressor::enqueue(std::weak_ptr<ScrollBlock> block) {
+        {
+            std::scoped_lock lock(queue_lock);
+            queue.push_back(std::move(block));
+            if(!worker.joinable()) {
+                worker = std::jthread([this](std::stop_token stop) { run(stop); });
+            }
+        }
+        queue_changed.notify_all();
+    }
+
+    void BlockCompressor::wait_until_idle() {
+        std::unique_lock lock(queue_lock);
+        queue_changed.wait(lock, [&]() { return queue.empty() && !busy; });
+    }
+
+    void BlockCompressor::run(std::stop_token stop) {
+        std::unique_lock lock(queue_lock);
+        while(true) {
+            if(!queue_changed.wait(lock, stop, [&]() { return !queue.empty(); }) || stop.stop_requested()) {
+                return;
+            }
+            auto block = queue.front().lock();
+            queue.pop_front();
+            busy = true;
+            lock.unlock();
+            // Blocks that have been dropped since they were queued don't need anything doing
+            if(block) {
+                block->compress();
+                block.reset();
+            }
+            lock.lock();
+            busy = false;
+            queue_changed.notify_all();
+        }
+    }
+} // namespace omux
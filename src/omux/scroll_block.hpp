@@ -0,0 +1,230 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace omux {
+    /**
+     * Index into a scroll buffer's table of control sequences.
+     */
+    using SequenceId = uint16_t;
+
+    /**
+     * A row is its renderable text as UTF-8, with the control sequences held apart as runs.
+     * run_sequences[i] takes effect from byte run_columns[i] of the text, not the column on screen; the two are
+     * kept in separate arrays so each stays tightly packed. Wide characters and combining marks mean bytes and
+     * columns only line up for plain ASCII.
+     */
+    struct Row {
+        std::string text;
+        std::vector<uint32_t> run_columns;
+        std::vector<SequenceId> run_sequences;
+        /**
+         * The program didn't end this row, we wrapped it because it ran past the pane width.
+         * A row with this set and the rows after it up to one without it are a single logical line.
+         */
+        bool soft_wrapped = false;
+        /**
+         * The program ended this row with a new line.
+         */
+        bool ended = false;
+    };
+
+    /**
+     * Rows packed into flat arrays. Row i's text is text[text_ends[i - 1], text_ends[i]) and its runs end at
+     * run_ends[i] the same way, so a row costs a few bytes on top of what is in it.
+     */
+    struct PackedRows {
+        std::string text;
+        std::vector<uint32_t> text_ends;
+        std::vector<uint32_t> run_ends;
+        std::vector<uint32_t> run_columns;
+        std::vector<SequenceId> run_sequences;
+        std::vector<uint8_t> flags;
+
+        template <typename Rows> static auto pack(const Rows& rows) -> PackedRows;
+        [[nodiscard]] auto size() const -> size_t;
+        [[nodiscard]] auto row(size_t index) const -> Row;
+        [[nodiscard]] auto rows() const -> std::vector<Row>;
+        [[nodiscard]] auto soft_wrapped(size_t index) const -> bool;
+        [[nodiscard]] auto memory_usage() const -> size_t;
+        [[nodiscard]] auto serialize() const -> std::string;
+        /**
+         * @throws std::runtime_error if data wasn't made by serialize
+         */
+        static auto deserialize(std::string_view data) -> PackedRows;
+    };
+
+    /**
+     * Sealed rows of a scroll buffer. They are held packed until the block is old enough to be compressed.
+     *
+     * Everything but the storage is only touched by the buffer that owns the block. The storage is
+     * guarded by its own lock so the compressor can swap it out from another thread.
+     */
+    class ScrollBlock : public std::enable_shared_from_this<ScrollBlock> {
+        public:
+        /**
+         * @param owner_bytes total the block adds its footprint to, shared with the buffer that owns it
+         */
+        ScrollBlock(std::shared_ptr<const PackedRows> rows, std::shared_ptr<std::atomic<size_t>> owner_bytes);
+        ~ScrollBlock();
+        ScrollBlock(const ScrollBlock&) = delete;
+        auto operator=(const ScrollBlock&) -> ScrollBlock& = delete;
+
+        int width = 0;
+        size_t first_line = 0;
+        size_t lines = 0;
+
+        [[nodiscard]] auto size() const -> size_t;
+        /**
+         * The rows if they aren't compressed, otherwise nullptr.
+         */
+        auto get_packed() -> std::shared_ptr<const PackedRows>;
+        auto decompress() -> std::shared_ptr<const PackedRows>;
+        void set_packed(std::shared_ptr<const PackedRows> rows);
+        /**
+         * Swap the packed rows for their compressed form. The compression itself is done without holding the
+         * lock, if the rows are replaced in the meantime the result is thrown away.
+         */
+        void compress();
+        auto is_compressed() -> bool;
+        /**
+         * The compressed rows and their size once decompressed, if the block has been compressed.
+         */
+        auto get_compressed() -> std::optional<std::pair<std::string, size_t>>;
+        auto memory_usage() -> size_t;
+
+        private:
+        std::mutex storage_lock;
+        std::shared_ptr<const PackedRows> packed;
+        std::string compressed;
+        size_t packed_size = 0;
+        size_t rows = 0;
+        std::shared_ptr<std::atomic<size_t>> owner_bytes;
+
+        [[nodiscard]] auto storage_bytes() const -> size_t;
+    };
+
+    /**
+     * Storage outside of memory for blocks past a buffer's memory budget, a memory mapped file on Windows.
+     */
+    class SpillFile {
+        public:
+        virtual ~SpillFile() = default;
+        /**
+         * Add data to the end of the file. It may be moved past the end to keep it readable in one piece.
+         * @return where the data starts
+         */
+        virtual auto append(std::string_view data) -> size_t = 0;
+        /**
+         * Overwrite data already in the file, it must not cross where an append would have moved data to.
+         */
+        virtual void write(size_t offset, std::string_view data) = 0;
+        /**
+         * Data is only valid until the file is destroyed.
+         */
+        virtual auto read(size_t offset, size_t length) -> std::string_view = 0;
+        [[nodiscard]] virtual auto size() const -> size_t = 0;
+    };
+    /**
+     * Makes the spill file for a buffer when it first goes over budget, name tells apart the files one buffer needs.
+     */
+    using SpillFileFactory = std::function<std::unique_ptr<SpillFile>(std::string_view name)>;
+
+    /**
+     * Where a spilled block is. Records are a power of two in size so they never straddle a mapped view.
+     */
+    struct SpillRecord {
+        uint64_t offset = 0;
+        uint64_t first_line = 0;
+        uint32_t length = 0;
+        uint32_t packed_size = 0;
+        uint32_t rows = 0;
+        int32_t width = 0;
+    };
+    static_assert(sizeof(SpillRecord) == 32);
+    /**
+     * Smallest space a spilled block takes in the data file.
+     */
+    constexpr size_t SPILL_SMALLEST_EXTENT = 256;
+    /**
+     * The space a spilled block of length bytes takes. Lengths are rounded up to a quarter of their power of two,
+     * so a block written again at about the same size fits where it was and freed space fits other blocks whole.
+     */
+    auto spill_extent(size_t length) -> size_t;
+
+    /**
+     * The oldest blocks of a buffer, compressed into extents of a data file with a record for each in an index file.
+     * Nothing about a spilled block is kept in memory so history can grow without the process growing with it.
+     * The files don't outlive the process, so extents are written over in place rather than logged.
+     */
+    class BlockSpill {
+        public:
+        BlockSpill(std::unique_ptr<SpillFile> data, std::unique_ptr<SpillFile> index);
+        [[nodiscard]] auto size() const -> size_t;
+        [[nodiscard]] auto record(size_t block) const -> SpillRecord;
+        /**
+         * @param record everything but where the data is
+         */
+        void push_back(SpillRecord record, std::string_view compressed);
+        /**
+         * Replace a block's data, in place when it has the same extent. Space it no longer uses is reused by later blocks.
+         */
+        void replace(size_t block, SpillRecord record, std::string_view compressed);
+        void pop_back();
+        auto rows(size_t block) const -> std::shared_ptr<const PackedRows>;
+        /**
+         * The last block that starts at or before line.
+         */
+        [[nodiscard]] auto block_of_line(size_t line) const -> size_t;
+
+        private:
+        std::unique_ptr<SpillFile> data;
+        std::unique_ptr<SpillFile> index;
+        size_t blocks = 0;
+        // Space in the data file no block uses, by its extent then where it starts
+        std::multimap<size_t, size_t> free_extents;
+
+        void write_record(size_t block, const SpillRecord& record);
+        /**
+         * Writes data into free space of its extent, or appends a new extent.
+         * @return where the data starts
+         */
+        auto store(std::string_view compressed) -> uint64_t;
+    };
+
+    /**
+     * Compresses cold blocks for every pane on a single background thread, so the output threads never wait on it.
+     */
+    class BlockCompressor {
+        public:
+        static auto global() -> BlockCompressor&;
+        ~BlockCompressor();
+        void enqueue(std::weak_ptr<ScrollBlock> block);
+        /**
+         * Blocks until everything queued so far has been compressed.
+         */
+        void wait_until_idle();
+
+        private:
+        BlockCompressor() = default;
+        std::mutex queue_lock;
+        std::condition_variable_any queue_changed;
+        std::deque<std::weak_ptr<ScrollBlock>> queue;
+        bool busy = false;
+        std::jthread worker;
+
+        void run(std::stop_token stop);
+    };
+} // namespace omux
@@ -0,0 +1,936 @@
+#include "omux/scroll_buffer.hpp"
+#include "omux/lz_codec.hpp"
+#include "omux/unicode_width.hpp"
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+namespace omux {
+
+    auto control_sequence_length(std::string_view line, size_t position) -> size_t {
+        if(position >= line.size() || line[position] != '\x1b') {
+            return 0;
+        }
+        if(position + 1 >= line.size()) {
+            return 1;
+        }
+        auto end = position + 2;
+        switch(line[position + 1]) {
+            case '[': {
+                // Parameters and intermediates are all below @, the final character is @ to ~
+                while(end < line.size() && (line[end] < '\x40' || line[end] > '\x7e')) {
+                    end++;
+                }
+                return std::min(end + 1, line.size()) - position;
+            }
+            case ']': {
+                // OSC runs until BEL or ST (ESC \)
+                while(end < line.size() && line[end] != '\x07') {
+                    if(line[end] == '\x1b' && end + 1 < line.size() && line[end + 1] == '\\') {
+                        end++;
+                        break;
+                    }
+                    end++;
+                }
+                return std::min(end + 1, line.size()) - position;
+            }
+            default:
+                return 2;
+        }
+    }
+
+    auto strip_control_sequences(std::string_view line) -> std::string {
+        std::string text;
+        text.reserve(line.size());
+        size_t position = 0;
+        while(position < line.size()) {
+            auto sequence_length = control_sequence_length(line, position);
+            if(sequence_length > 0) {
+                position += sequence_length;
+                continue;
+            }
+            auto character = line[position];
+            if(character == '\t') {
+                text.push_back(' ');
+            } else if(static_cast<unsigned char>(character) >= ' ') {
+                text.push_back(character);
+            }
+            position++;
+        }
+        return text;
+    }
+
+    namespace {
+        /**
+         * Sequences that change nothing about the cells they are stored with.
+         */
+        auto is_no_op(std::string_view sequence) -> bool {
+            if(sequence == "\x1b[?25h" || sequence == "\x1b[?25l" || sequence == "\x1b[?12h" || sequence == "\x1b[?12l") {
+                return true;
+            }
+            // Window titles and the like, hyperlinks are the only OSC that belongs to the text
+            return sequence.substr(0, 2) == "\x1b]" && sequence.substr(0, 4) != "\x1b]8;";
+        }
+
+        auto is_attribute(std::string_view sequence) -> bool {
+            return sequence.size() > 2 && sequence.substr(0, 2) == "\x1b[" && sequence.back() == 'm' &&
+                   sequence[2] != '?' && sequence[2] != '>';
+        }
+
+        /**
+         * The parameters and URI of an OSC 8 hyperlink, ended by BEL or ST.
+         */
+        auto hyperlink_parameters(std::string_view sequence) -> std::optional<std::string_view> {
+            if(sequence.substr(0, 4) != "\x1b]8;") {
+                return std::nullopt;
+            }
+            sequence.remove_prefix(4);
+            if(sequence.ends_with("\x07")) {
+                sequence.remove_suffix(1);
+            } else if(sequence.ends_with("\x1b\\")) {
+                sequence.remove_suffix(2);
+            }
+            return sequence;
+        }
+    } // namespace
+
+    ScrollBuffer::ScrollBuffer(int width, size_t hot_rows) : ScrollBuffer(width, hot_rows, std::make_shared<AttributeTable>()) {
+    }
+
+    ScrollBuffer::ScrollBuffer(int width, size_t hot_rows, std::shared_ptr<AttributeTable> attributes)
+    : width(width), hot_rows(hot_rows), attributes(std::move(attributes)) {
+        hot.push_back(Row{});
+    }
+
+    auto ScrollBuffer::render(const Row& row) const -> std::string {
+        std::string rendered;
+        rendered.reserve(row.text.size() + row.run_sequences.size() * 8 + 1);
+        std::optional<AttributeId> current = DEFAULT_ATTRIBUTES;
+        auto render_run = [&](SequenceId sequence) {
+            if(auto id = sequence_attributes[sequence]) {
+                // What a sequence kept as it was set isn't known, the attributes are set again from a reset
+                if(!current) {
+                    rendered.append("\x1b[m");
+                    current = DEFAULT_ATTRIBUTES;
+                }
+                attributes->append_transition(rendered, *current, *id);
+                current = *id;
+            } else {
+                rendered.append(sequences[sequence]);
+                if(sets_attributes(sequence)) {
+                    current.reset();
+                }
+            }
+        };
+        size_t run = 0;
+        for(size_t at_column = 0; at_column < row.text.size(); at_column++) {
+            for(; run < row.run_columns.size() && row.run_columns[run] <= at_column; run++) {
+                render_run(row.run_sequences[run]);
+            }
+            rendered.push_back(row.text[at_column]);
+        }
+        for(; run < row.run_columns.size(); run++) {
+            render_run(row.run_sequences[run]);
+        }
+        if(row.ended) {
+            rendered.push_back('\n');
+        }
+        return rendered;
+    }
+
+    auto ScrollBuffer::intern(std::string_view sequence) -> std::optional<SequenceId> {
+        auto existing = sequence_ids.find(std::string{sequence});
+        if(existing != sequence_ids.end()) {
+            return existing->second;
+        }
+        // Once every id is taken new sequences are left out of history, the live output still has them
+        if(sequences.size() > std::numeric_limits<SequenceId>::max()) {
+            return std::nullopt;
+        }
+        auto id = static_cast<SequenceId>(sequences.size());
+        sequences.emplace_back(sequence);
+        sequence_attributes.emplace_back();
+        sequence_ids.emplace(sequence, id);
+        return id;
+    }
+
+    auto ScrollBuffer::intern_attribute(AttributeId id) -> std::optional<SequenceId> {
+        auto existing = attribute_sequences.find(id);
+        if(existing != attribute_sequences.end()) {
+            return existing->second;
+        }
+        if(sequences.size() > std::numeric_limits<SequenceId>::max()) {
+            return std::nullopt;
+        }
+        auto sequence = static_cast<SequenceId>(sequences.size());
+        // The text is what sets the attributes from a reset, for anything that needs the sequence on its own
+        std::string text{"\x1b[m"};
+        attributes->append_transition(text, DEFAULT_ATTRIBUTES, id);
+        sequences.push_back(std::move(text));
+        sequence_attributes.emplace_back(id);
+        attribute_sequences.emplace(id, sequence);
+        return sequence;
+    }
+
+    auto ScrollBuffer::sets_attributes(SequenceId sequence) const -> bool {
+        return sequence_attributes[sequence] || is_attribute(sequences[sequence]);
+    }
+
+    auto ScrollBuffer::attribute_before(const Row& row, size_t run) const -> std::optional<SequenceId> {
+        while(run > 0) {
+            if(sets_attributes(row.run_sequences[--run])) {
+                return row.run_sequences[run];
+            }
+        }
+        return std::nullopt;
+    }
+
+    void ScrollBuffer::add_run(Row& row, size_t at_column, SequenceId sequence) const {
+        auto run = static_cast<size_t>(std::upper_bound(row.run_columns.begin(), row.run_columns.end(), at_column) -
+                                       row.run_columns.begin());
+        if(sequence_attributes[sequence]) {
+            // Attributes set one after the other with nothing written between, only the last one matters
+            if(run > 0 && row.run_columns[run - 1] == at_column && sequence_attributes[row.run_sequences[run - 1]]) {
+                run--;
+                row.run_columns.erase(row.run_columns.begin() + static_cast<std::ptrdiff_t>(run));
+                row.run_sequences.erase(row.run_sequences.begin() + static_cast<std::ptrdiff_t>(run));
+            }
+            // Rows are drawn from the default attributes, so there is nothing to reset before the first one
+            auto before = attribute_before(row, run);
+            if(before == sequence || (!before && sequence_attributes[sequence] == DEFAULT_ATTRIBUTES)) {
+                return;
+            }
+        }
+        row.run_columns.insert(row.run_columns.begin() + static_cast<std::ptrdiff_t>(run), static_cast<uint32_t>(at_column));
+        row.run_sequences.insert(row.run_sequences.begin() + static_cast<std::ptrdiff_t>(run), sequence);
+    }
+
+    void ScrollBuffer::replace_text(Row& row, size_t at, size_t length, std::string_view text) {
+        row.text.replace(at, length, text);
+        // Runs are at byte offsets, the ones after the text move with it and the ones inside carry on after it
+        for(auto& run_column : row.run_columns) {
+            if(run_column >= at + length) {
+                run_column = static_cast<uint32_t>(run_column - length + text.size());
+            } else if(run_column > at) {
+                run_column = static_cast<uint32_t>(at + text.size());
+            }
+        }
+    }
+
+    void ScrollBuffer::join_row(Row& line, const Row& row) const {
+        auto offset = line.text.size();
+        for(size_t run = 0; run < row.run_columns.size(); run++) {
+            auto sequence = row.run_sequences[run];
+            // Wrapping repeats the attributes at the start of each row, they are already set when joined
+            if(offset > 0 && row.run_columns[run] == 0 && sequence_attributes[sequence] &&
+               attribute_before(line, line.run_columns.size()) == sequence) {
+                continue;
+            }
+            line.run_columns.push_back(static_cast<uint32_t>(row.run_columns[run] + offset));
+            line.run_sequences.push_back(sequence);
+        }
+        line.text.append(row.text);
+        line.ended = row.ended;
+    }
+
+    void ScrollBuffer::wrap_into(std::vector<Row>& rows, Row line, int width) const {
+        auto row_width = static_cast<size_t>(width);
+        // Every byte takes at most one column unless it is UTF-8, so most lines can skip counting columns
+        if(width <= 0 || line.text.size() <= row_width || text_columns(line.text) <= row_width) {
+            line.soft_wrapped = false;
+            rows.push_back(std::move(line));
+            return;
+        }
+        size_t run = 0;
+        std::optional<SequenceId> attribute;
+        for(size_t start = 0, end = 0; start < line.text.size(); start = end) {
+            Row row;
+            // A wide character that doesn't fit goes on the next row, the row always takes at least one character
+            end = start + std::max<size_t>(column_offset(std::string_view{line.text}.substr(start), row_width).first, 1);
+            auto last = end >= line.text.size();
+            row.text = line.text.substr(start, end - start);
+            // Each row sets the attributes it starts with so it can be drawn on its own
+            if(attribute && !(run < line.run_columns.size() && line.run_columns[run] == start &&
+                              sets_attributes(line.run_sequences[run]))) {
+                row.run_columns.push_back(0);
+                row.run_sequences.push_back(*attribute);
+            }
+            for(; run < line.run_columns.size() && (last || line.run_columns[run] < end); run++) {
+                row.run_columns.push_back(static_cast<uint32_t>(line.run_columns[run] - start));
+                row.run_sequences.push_back(line.run_sequences[run]);
+                if(sets_attributes(line.run_sequences[run])) {
+                    attribute = line.run_sequences[run];
+                }
+            }
+            row.soft_wrapped = !last;
+            row.ended = last && line.ended;
+            rows.push_back(std::move(row));
+        }
+    }
+
+    template <typename Rows> auto ScrollBuffer::reflow(const Rows& rows, int width) const -> std::vector<Row> {
+        std::vector<Row> reflowed;
+        Row logical_line;
+        auto in_line = false;
+        for(const auto& row : rows) {
+            join_row(logical_line, row);
+            in_line = true;
+            if(!row.soft_wrapped) {
+                wrap_into(reflowed, std::move(logical_line), width);
+                logical_line = Row{};
+                in_line = false;
+            }
+        }
+        // Only the last hot row can still be in the middle of a logical line
+        if(in_line) {
+            wrap_into(reflowed, std::move(logical_line), width);
+        }
+        return reflowed;
+    }
+
+    template <typename Rows> auto ScrollBuffer::logical_lines(const Rows& rows) -> std::vector<std::string> {
+        std::vector<std::string> lines;
+        std::string logical_line;
+        for(const auto& row : rows) {
+            logical_line.append(row.text);
+            if(!row.soft_wrapped) {
+                lines.push_back(std::move(logical_line));
+                logical_line.clear();
+            }
+        }
+        if(!logical_line.empty()) {
+            lines.push_back(std::move(logical_line));
+        }
+        return lines;
+    }
+
+    auto ScrollBuffer::row_bytes(const Row& row) -> size_t {
+        return sizeof(Row) + row.text.capacity() + row.run_columns.capacity() * sizeof(uint32_t) +
+               row.run_sequences.capacity() * sizeof(SequenceId);
+    }
+
+    auto ScrollBuffer::hot_lines() -> std::vector<std::string> {
+        return logical_lines(hot);
+    }
+
+    auto ScrollBuffer::spilled() const -> size_t {
+        return spill ? spill->size() : 0;
+    }
+
+    auto ScrollBuffer::block_count() const -> size_t {
+        return spilled() + blocks.size();
+    }
+
+    auto ScrollBuffer::block_size(size_t block) const -> size_t {
+        if(block < spilled()) {
+            return spill->record(block).rows;
+        }
+        return blocks[block - spilled()]->size();
+    }
+
+    auto ScrollBuffer::block_first_line(size_t block) const -> size_t {
+        if(block < spilled()) {
+            return spill->record(block).first_line;
+        }
+        return blocks[block - spilled()]->first_line;
+    }
+
+    auto ScrollBuffer::block_of_line(size_t line) const -> size_t {
+        if(blocks.empty() || line < blocks.front()->first_line) {
+            return spill->block_of_line(line);
+        }
+        auto block = std::upper_bound(blocks.begin(), blocks.end(), line,
+                                      [](size_t line, const auto& block) { return line < block->first_line; });
+        return spilled() + static_cast<size_t>(block - blocks.begin()) - 1;
+    }
+
+    auto ScrollBuffer::rows_of(size_t block) -> std::shared_ptr<const PackedRows> {
+        if(block >= spilled()) {
+            if(auto packed = blocks[block - spilled()]->get_packed()) {
+                return packed;
+            }
+        }
+        auto first_line = block_first_line(block);
+        auto cached = std::find_if(cache.begin(), cache.end(), [&](const auto& entry) { return entry.first == first_line; });
+        if(cached != cache.end()) {
+            cache.splice(cache.begin(), cache, cached);
+            return cached->second;
+        }
+        cache.emplace_front(first_line, block < spilled() ? spill->rows(block) : blocks[block - spilled()]->decompress());
+        if(cache.size() > SCROLL_BUFFER_CACHED_BLOCKS) {
+            cache.pop_back();
+        }
+        return cache.front().second;
+    }
+
+    void ScrollBuffer::forget_cached(size_t first_line) {
+        cache.remove_if([&](const auto& entry) { return entry.first == first_line; });
+        if(cached_block_line == first_line) {
+            cached_block_line = std::numeric_limits<size_t>::max();
+        }
+    }
+
+    void ScrollBuffer::reflow_block(size_t block) {
+        if(block < spilled()) {
+            auto record = spill->record(block);
+            if(record.width == width) {
+                return;
+            }
+            auto rows = reflow(rows_of(block)->rows(), width);
+            block_rows = block_rows - record.rows + rows.size();
+            forget_cached(record.first_line);
+            // Spilled blocks are written out again, where they were if they still fit
+            auto serialized = PackedRows::pack(rows).serialize();
+            record.packed_size = static_cast<uint32_t>(serialized.size());
+            record.rows = static_cast<uint32_t>(rows.size());
+            record.width = width;
+            spill->replace(block, record, lz_compress(serialized));
+            return;
+        }
+        auto& sealed = *blocks[block - spilled()];
+        if(sealed.width == width) {
+            return;
+        }
+        auto rows = reflow(rows_of(block)->rows(), width);
+        block_rows = block_rows - sealed.size() + rows.size();
+        forget_cached(sealed.first_line);
+        sealed.set_packed(std::make_shared<const PackedRows>(PackedRows::pack(rows)));
+        sealed.width = width;
+        // Reading cold history after a resize leaves it uncompressed, so it goes back in the queue
+        if(block + SCROLL_BUFFER_WARM_BLOCKS < block_count()) {
+            BlockCompressor::global().enqueue(sealed.shared_from_this());
+        }
+    }
+
+    void ScrollBuffer::set_spill(SpillFileFactory factory, size_t budget) {
+        spill_factory = std::move(factory);
+        memory_budget = budget;
+        spill_over_budget();
+    }
+
+    void ScrollBuffer::set_memory_budget(size_t budget) {
+        if(budget < memory_budget && *block_bytes > budget) {
+            cache.clear();
+        }
+        memory_budget = budget;
+        spill_over_budget();
+    }
+
+    auto ScrollBuffer::get_block_bytes() const -> std::shared_ptr<const std::atomic<size_t>> {
+        return block_bytes;
+    }
+
+    void ScrollBuffer::spill_over_budget() {
+        // Only blocks the compressor has finished with are spilled, anything else waits for the next seal
+        while(*block_bytes > memory_budget && blocks.size() > SCROLL_BUFFER_WARM_BLOCKS && spill_factory) {
+            auto& oldest = *blocks.front();
+            auto compressed = oldest.get_compressed();
+            if(!compressed) {
+                return;
+            }
+            if(!spill) {
+                spill.emplace(spill_factory("data"), spill_factory("index"));
+            }
+            SpillRecord record;
+            record.first_line = oldest.first_line;
+            record.packed_size = static_cast<uint32_t>(compressed->second);
+            record.rows = static_cast<uint32_t>(oldest.size());
+            record.width = oldest.width;
+            spill->push_back(record, compressed->first);
+            blocks.pop_front();
+        }
+    }
+
+    void ScrollBuffer::seal() {
+        if(hot.size() <= hot_rows + SCROLL_BUFFER_BLOCK_ROWS) {
+            return;
+        }
+        auto limit = hot.size() - hot_rows;
+        auto count = SCROLL_BUFFER_BLOCK_ROWS;
+        // Extend the block to the end of the logical line it stops in
+        while(count <= limit && hot[count - 1].soft_wrapped) {
+            count++;
+        }
+        if(count > limit) {
+            return;
+        }
+        std::vector<Row> rows{std::make_move_iterator(hot.begin()), std::make_move_iterator(hot.begin() + count)};
+        hot.erase(hot.begin(), hot.begin() + count);
+        auto block = std::make_shared<ScrollBlock>(std::make_shared<const PackedRows>(PackedRows::pack(rows)), block_bytes);
+        block->width = width;
+        block_rows += count;
+
+        // These lines won't be edited any more so this is when they go into the search index
+        block->first_line = committed_lines;
+        auto lines = logical_lines(rows);
+        for(const auto& line : lines) {
+            search_index.add_line(committed_lines++, line);
+        }
+        block->lines = lines.size();
+        blocks.push_back(std::move(block));
+        if(blocks.size() > SCROLL_BUFFER_WARM_BLOCKS) {
+            BlockCompressor::global().enqueue(blocks[blocks.size() - 1 - SCROLL_BUFFER_WARM_BLOCKS]);
+        }
+        spill_over_budget();
+    }
+
+    void ScrollBuffer::unseal_last() {
+        auto last = block_count() - 1;
+        reflow_block(last);
+        auto rows = rows_of(last)->rows();
+        auto first_line = block_first_line(last);
+        block_rows -= rows.size();
+        committed_lines = first_line;
+        search_index.truncate(committed_lines);
+        forget_cached(first_line);
+        hot.insert(hot.begin(), std::make_move_iterator(rows.begin()), std::make_move_iterator(rows.end()));
+        if(blocks.empty()) {
+            spill->pop_back();
+        } else {
+            blocks.pop_back();
+        }
+    }
+
+    auto ScrollBuffer::size() const -> size_t {
+        return block_rows + hot.size();
+    }
+    auto ScrollBuffer::empty() const -> bool {
+        return size() == 0;
+    }
+
+    auto ScrollBuffer::at(size_t index) -> std::string {
+        if(index >= block_rows) {
+            return render(hot.at(index - block_rows));
+        }
+        size_t block_start = 0;
+        for(size_t block = 0; block < block_count(); block++) {
+            if(index < block_start + block_size(block)) {
+                // Reflowing changes how many rows the block has, the index may now be in a later block
+                reflow_block(block);
+                if(index < block_start + block_size(block)) {
+                    return render(rows_of(block)->row(index - block_start));
+                }
+            }
+            block_start += block_size(block);
+        }
+        throw std::out_of_range("Scroll buffer row " + std::to_string(index) + " doesn't exist");
+    }
+
+    auto ScrollBuffer::row_from_bottom(size_t offset) -> std::string {
+        auto rows = rows_above(offset, 1);
+        if(rows.empty()) {
+            throw std::out_of_range("Scroll buffer doesn't have that many rows");
+        }
+        return rows.front();
+    }
+
+    auto ScrollBuffer::rows_above(size_t offset, size_t count) -> std::vector<std::string> {
+        std::vector<std::string> rows;
+        auto row = offset;
+        auto end = offset + count;
+        for(; row < end && row < hot.size(); row++) {
+            rows.push_back(render(hot[hot.size() - 1 - row]));
+        }
+        // Walk up from the bottom so only the blocks between here and the rows asked for get reflowed,
+        // and only the blocks the rows are in get decompressed
+        auto block_end = hot.size();
+        for(auto block = block_count(); block > 0 && row < end; block--) {
+            reflow_block(block - 1);
+            auto block_start = block_end + block_size(block - 1);
+            if(row < block_start) {
+                auto packed = rows_of(block - 1);
+                for(; row < end && row < block_start; row++) {
+                    rows.push_back(render(packed->row(block_start - 1 - row)));
+                }
+            }
+            block_end = block_start;
+        }
+        std::reverse(rows.begin(), rows.end());
+        return rows;
+    }
+
+    auto ScrollBuffer::last_rows(size_t count) -> std::vector<std::string> {
+        return rows_above(0, count);
+    }
+
+    auto ScrollBuffer::last_row() -> Row& {
+        if(hot.empty()) {
+            if(block_count() == 0) {
+                hot.push_back(Row{});
+                column = 0;
+            } else {
+                unseal_last();
+                column = hot.back().text.size();
+            }
+        }
+        return hot.back();
+    }
+
+    void ScrollBuffer::push_back(std::string_view output) {
+        hot.push_back(Row{});
+        column = 0;
+        seal();
+        append(output);
+    }
+
+    void ScrollBuffer::append(std::string_view output) {
+        size_t position = 0;
+        while(position < output.size()) {
+            auto sequence_length = control_sequence_length(output, position);
+            if(sequence_length > 0) {
+                append_sequence(output.substr(position, sequence_length));
+                position += sequence_length;
+                continue;
+            }
+            auto character = output[position];
+            if(character == '\r') {
+                carriage_return();
+            } else if(character == '\n') {
+                new_line();
+            } else if(character == '\t') {
+                append_character(" ");
+            } else if(static_cast<unsigned char>(character) >= 0x80) {
+                auto length = decode_utf8(output, position).second;
+                append_character(output.substr(position, length));
+                position += length;
+                continue;
+            } else if(static_cast<unsigned char>(character) >= ' ') {
+                append_character(output.substr(position, 1));
+            }
+            position++;
+        }
+    }
+
+    void ScrollBuffer::append_character(std::string_view character) {
+        auto& row = last_row();
+        if(column >= row.text.size()) {
+            row.text.append(character);
+            column = row.text.size();
+            return;
+        }
+        // ASCII over ASCII that nothing joins onto covers exactly the one byte, no columns need counting
+        auto ascii = [&](size_t at) { return at >= row.text.size() || static_cast<unsigned char>(row.text[at]) < 0x80; };
+        if(character.size() == 1 && static_cast<unsigned char>(character[0]) < 0x80 && ascii(column) && ascii(column + 1)) {
+            replace_text(row, column, 1, character);
+            column++;
+            return;
+        }
+        auto width = static_cast<size_t>(codepoint_width(decode_utf8(character, 0).first));
+        auto rest = std::string_view{row.text}.substr(column);
+        // The column is in bytes, the characters written over are the ones in the cells the new one covers
+        size_t covered = 0;
+        size_t blanked = 0;
+        if(width > 0) {
+            auto [offset, missing] = column_offset(rest, width);
+            covered = offset;
+            if(missing > 0 && offset < rest.size()) {
+                // Half of a wide character is left over, it is blanked like the terminal would
+                blanked = static_cast<size_t>(codepoint_width(decode_utf8(rest, offset).first)) - missing;
+                covered = column_offset(rest, width + blanked).first;
+            }
+        }
+        replace_text(row, column, covered, std::string{character} + std::string(blanked, ' '));
+        column += character.size();
+    }
+
+    void ScrollBuffer::append_sequence(std::string_view sequence) {
+        if(is_no_op(sequence)) {
+            return;
+        }
+        auto& row = last_row();
+        std::optional<SequenceId> id;
+        if(is_attribute(sequence)) {
+            auto parameters = sequence.substr(2, sequence.size() - 3);
+            // A reset sets everything, so the attributes are known again after one
+            if(parameters.empty() || parameters == "0" || parameters.starts_with("0;")) {
+                attribute = DEFAULT_ATTRIBUTES;
+            }
+            attribute = attribute ? attributes->apply_sgr(*attribute, parameters) : std::nullopt;
+            // Attributes the table has no room for are kept as the sequence that set them
+            id = attribute ? intern_attribute(*attribute) : intern(sequence);
+        } else if(auto hyperlink = hyperlink_parameters(sequence)) {
+            attribute = attribute ? attributes->apply_hyperlink(*attribute, *hyperlink) : std::nullopt;
+            id = attribute ? intern_attribute(*attribute) : intern(sequence);
+        } else {
+            id = intern(sequence);
+        }
+        if(id) {
+            add_run(row, column, *id);
+        }
+    }
+
+    void ScrollBuffer::carriage_return() {
+        last_row();
+        column = 0;
+    }
+
+    void ScrollBuffer::new_line() {
+        last_row().ended = true;
+        push_back({});
+    }
+
+    void ScrollBuffer::wrap_back() {
+        last_row().soft_wrapped = true;
+        push_back({});
+    }
+
+    void ScrollBuffer::cursor_forward(size_t count) {
+        auto& row = last_row();
+        auto from = std::min(column, row.text.size());
+        auto [offset, missing] = column_offset(std::string_view{row.text}.substr(from), count);
+        auto at = from + offset;
+        if(missing > 0 && at < row.text.size()) {
+            // Landed in the middle of a wide character, which is blanked like the terminal would
+            auto [character, length] = decode_utf8(row.text, at);
+            replace_text(row, at, length, std::string(static_cast<size_t>(codepoint_width(character)), ' '));
+        }
+        column = at + missing;
+        if(row.text.size() < column) {
+            row.text.resize(column, ' ');
+        }
+    }
+
+    void ScrollBuffer::truncate_back(size_t new_column) {
+        auto& row = last_row();
+        // Columns are where the cursor is on screen, half a wide character before it is blanked
+        auto [offset, missing] = column_offset(row.text, new_column);
+        auto cut = offset + missing;
+        row.text.resize(offset);
+        row.text.resize(cut, ' ');
+        while(!row.run_columns.empty() && row.run_columns.back() > cut) {
+            row.run_columns.pop_back();
+            row.run_sequences.pop_back();
+        }
+        column = cut;
+    }
+
+    auto ScrollBuffer::back_empty() const -> bool {
+        return hot.empty() || (hot.back().text.empty() && hot.back().run_columns.empty());
+    }
+
+    void ScrollBuffer::erase_last(size_t count) {
+        while(count > 0 && !empty()) {
+            if(hot.empty()) {
+                unseal_last();
+            }
+            hot.pop_back();
+            count--;
+        }
+        // The new last row is going to be written to, so it has to be hot again
+        if(hot.empty() && block_count() > 0) {
+            unseal_last();
+        }
+        // Whatever the last row continued onto is gone now
+        if(!hot.empty()) {
+            hot.back().soft_wrapped = false;
+            hot.back().ended = false;
+            column = hot.back().text.size();
+        }
+    }
+
+    void ScrollBuffer::set_width(int new_width) {
+        if(new_width == width) {
+            return;
+        }
+        width = new_width;
+        auto rows = reflow(hot, width);
+        hot.assign(std::make_move_iterator(rows.begin()), std::make_move_iterator(rows.end()));
+        if(!hot.empty()) {
+            column = hot.back().text.size();
+        }
+        seal();
+    }
+
+    void ScrollBuffer::set_hot_rows(size_t rows) {
+        hot_rows = rows;
+    }
+
+    auto ScrollBuffer::get_width() const -> int {
+        return width;
+    }
+
+    auto ScrollBuffer::stale_blocks() const -> size_t {
+        auto stale = static_cast<size_t>(
+        std::count_if(blocks.begin(), blocks.end(), [&](const auto& block) { return block->width != width; }));
+        for(size_t block = 0; block < spilled(); block++) {
+            stale += spill->record(block).width != width ? 1 : 0;
+        }
+        return stale;
+    }
+
+    auto ScrollBuffer::memory_usage() const -> size_t {
+        auto bytes = block_bytes->load();
+        for(const auto& [first_line, rows] : cache) {
+            bytes += rows->memory_usage();
+        }
+        for(const auto& row : hot) {
+            bytes += row_bytes(row);
+        }
+        for(const auto& sequence : sequences) {
+            // Once in the table and once as the key of the lookup
+            bytes += 2 * (sizeof(std::string) + sequence.capacity()) + sizeof(SequenceId) + sizeof(std::optional<AttributeId>);
+        }
+        return bytes;
+    }
+
+    auto ScrollBuffer::compressed_blocks() const -> size_t {
+        return std::count_if(blocks.begin(), blocks.end(), [](const auto& block) { return block->is_compressed(); });
+    }
+
+    auto ScrollBuffer::spilled_blocks() const -> size_t {
+        return spilled();
+    }
+
+    auto ScrollBuffer::line_count() const -> size_t {
+        return committed_lines + static_cast<size_t>(std::count_if(hot.begin(), hot.end(), [](const Row& row) { return !row.soft_wrapped; }));
+    }
+
+    auto ScrollBuffer::line_text(size_t line) -> std::string {
+        if(line >= committed_lines) {
+            return hot_lines().at(line - committed_lines);
+        }
+        auto block = block_of_line(line);
+        auto first_line = block_first_line(block);
+        if(cached_block_line != first_line) {
+            cached_block_lines = logical_lines(rows_of(block)->rows());
+            cached_block_line = first_line;
+        }
+        return cached_block_lines.at(line - first_line);
+    }
+
+    auto ScrollBuffer::offset_of_line(size_t line) -> size_t {
+        // Row that a logical line starts on, counting logical lines from the top of rows
+        auto first_row_of = [](size_t rows, auto soft_wrapped, size_t logical_line) -> size_t {
+            size_t row = 0;
+            while(logical_line > 0 && row < rows) {
+                if(!soft_wrapped(row)) {
+                    logical_line--;
+                }
+                row++;
+            }
+            return row;
+        };
+        if(line >= committed_lines) {
+            auto row = std::min(first_row_of(hot.size(), [&](size_t row) { return hot[row].soft_wrapped; }, line - committed_lines),
+                                hot.size() - 1);
+            return hot.size() - 1 - row;
+        }
+        auto offset = hot.size();
+        for(auto block = block_count(); block > 0; block--) {
+            reflow_block(block - 1);
+            auto first_line = block_first_line(block - 1);
+            if(line >= first_line) {
+                auto rows = rows_of(block - 1);
+                auto soft_wrapped = [&](size_t row) { return rows->soft_wrapped(row); };
+                return offset + rows->size() - 1 - first_row_of(rows->size(), soft_wrapped, line - first_line);
+            }
+            offset += block_size(block - 1);
+        }
+        return offset;
+    }
+
+    auto ScrollBuffer::find(const SearchPattern& pattern, size_t from_line, bool older) -> std::optional<size_t> {
+        return search(pattern).find(from_line, older);
+    }
+
+    auto ScrollBuffer::search(const SearchPattern& pattern, std::mutex* writer_lock) -> ScrollSearch {
+        return ScrollSearch{*this, pattern, writer_lock};
+    }
+
+    ScrollSearch::ScrollSearch(ScrollBuffer& buffer, const SearchPattern& pattern, std::mutex* writer_lock)
+    : buffer(buffer), pattern(pattern), writer_lock(writer_lock), hot_text(buffer.hot_lines()), committed_lines(buffer.committed_lines),
+      indexed_from(std::min(buffer.search_index.first_indexed_line(), buffer.committed_lines)),
+      candidates(buffer.search_index.candidates(pattern)), blocks(buffer.blocks.begin(), buffer.blocks.end()) {
+    }
+
+    auto ScrollSearch::matches(size_t line) -> bool {
+        if(line >= committed_lines) {
+            return pattern.matches(hot_text[line - committed_lines]);
+        }
+        if(cached_block_line > line || line - cached_block_line >= cached_block_lines.size()) {
+            if(!blocks.empty() && line >= blocks.front()->first_line) {
+                // The buffer only changes the storage of these, which has its own lock
+                auto block = *--std::upper_bound(blocks.begin(), blocks.end(), line,
+                                                 [](size_t line, const auto& block) { return line < block->first_line; });
+                auto packed = block->get_packed();
+                cached_block_lines = ScrollBuffer::logical_lines((packed ? packed : block->decompress())->rows());
+                cached_block_line = block->first_line;
+            } else {
+                std::unique_lock<std::mutex> lock;
+                if(writer_lock) {
+                    lock = std::unique_lock(*writer_lock);
+                }
+                // The line may have been taken back for editing since
+                if(line >= buffer.committed_lines) {
+                    return false;
+                }
+                auto block = buffer.block_of_line(line);
+                cached_block_lines = ScrollBuffer::logical_lines(buffer.rows_of(block)->rows());
+                cached_block_line = buffer.block_first_line(block);
+            }
+        }
+        return pattern.matches(cached_block_lines.at(line - cached_block_line));
+    }
+
+    auto ScrollSearch::find(size_t from_line, bool older) -> std::optional<size_t> {
+        auto total_lines = committed_lines + hot_text.size();
+
+        if(older) {
+            auto line = std::min(from_line, total_lines);
+            while(line > committed_lines) {
+                if(matches(--line)) {
+                    return line;
+                }
+            }
+            if(line > indexed_from) {
+                if(candidates) {
+                    auto candidate = std::lower_bound(candidates->begin(), candidates->end(), line);
+                    while(candidate != candidates->begin()) {
+                        if(matches(*--candidate)) {
+                            return *candidate;
+                        }
+                    }
+                    line = indexed_from;
+                }
+            }
+            // Anything that has been dropped from the index, or everything if the pattern was too short
+            while(line > 0) {
+                if(matches(--line)) {
+                    return line;
+                }
+            }
+            return std::nullopt;
+        }
+
+        if(from_line >= total_lines) {
+            return std::nullopt;
+        }
+        auto line = from_line + 1;
+        auto scan_to = candidates ? indexed_from : committed_lines;
+        for(; line < scan_to; line++) {
+            if(matches(line)) {
+                return line;
+            }
+        }
+        if(candidates) {
+            auto candidate = std::lower_bound(candidates->begin(), candidates->end(), line);
+            for(; candidate != candidates->end(); candidate++) {
+                if(matches(*candidate)) {
+                    return *candidate;
+                }
+            }
+            line = std::max(line, committed_lines);
+        }
+        for(; line < total_lines; line++) {
+            if(matches(line)) {
+                return line;
+            }
+        }
+        return std::nullopt;
+    }
+
+    auto ScrollBuffer::get_search_index() const -> const SearchIndex& {
+        return search_index;
+    }
+} // namespace omux
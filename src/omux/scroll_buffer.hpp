@@ -0,0 +1,256 @@
+#pragma once
+#include "omux/attribute_table.hpp"
+#include "omux/scroll_block.hpp"
+#include "omux/search_index.hpp"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace omux {
+    /**
+     * Rows are sealed into history blocks of at least this many rows.
+     * Blocks always end on a logical line so they can be reflowed on their own.
+     */
+    constexpr size_t SCROLL_BUFFER_BLOCK_ROWS = 256;
+    /**
+     * This many of the newest blocks are left as they are, older blocks are compressed.
+     */
+    constexpr size_t SCROLL_BUFFER_WARM_BLOCKS = 4;
+    /**
+     * Compressed blocks kept decompressed after being read, for scrolling and searching through cold history.
+     */
+    constexpr size_t SCROLL_BUFFER_CACHED_BLOCKS = 8;
+    /**
+     * How much sealed history a pane keeps in memory before the oldest blocks are spilled to disk.
+     */
+    constexpr size_t SCROLL_BUFFER_MEMORY_BUDGET = 64 * 1024 * 1024;
+
+    /**
+     * Find the length of the control sequence starting at position.
+     * @return length of the sequence, or 0 if there isn't one at position
+     */
+    auto control_sequence_length(std::string_view line, size_t position) -> size_t;
+    /**
+     * Just the renderable text of a line, control sequences and new lines removed.
+     */
+    auto strip_control_sequences(std::string_view line) -> std::string;
+
+    /**
+     * Rows of output from a pane, see docs/scroll_buffer_dev_notes.md.
+     *
+     * The rows at the bottom that can still be edited (at least the visible screen) are kept "hot".
+     * Everything above is sealed into blocks. When the width changes only the hot rows are
+     * reflowed straight away, blocks are reflowed when something reads them. This keeps
+     * resizing a pane with a huge history proportional to what is visible.
+     * Blocks past the newest few are compressed in the background and decompressed when read.
+     * With a spill file, compressed blocks past the memory budget are moved out of memory altogether.
+     */
+    class ScrollBuffer;
+
+    /**
+     * What a search of a scroll buffer needs, taken from it so the regex can run while the buffer is being written.
+     * Lines still in memory are read from the blocks as they were when the search was made. Lines that had been
+     * spilled are read from the buffer itself, holding the lock its writer holds.
+     */
+    class ScrollSearch {
+        public:
+        /**
+         * Find the closest line to from_line that matches, not including from_line itself.
+         * @param older search up towards the top of history rather than down towards the bottom
+         */
+        auto find(size_t from_line, bool older) -> std::optional<size_t>;
+
+        private:
+        friend class ScrollBuffer;
+        ScrollSearch(ScrollBuffer& buffer, const SearchPattern& pattern, std::mutex* writer_lock);
+        ScrollBuffer& buffer;
+        // A copy, the search can outlive the pattern it was made with
+        SearchPattern pattern;
+        std::mutex* writer_lock;
+        std::vector<std::string> hot_text;
+        size_t committed_lines;
+        size_t indexed_from;
+        std::optional<std::vector<size_t>> candidates;
+        // Sealed blocks that were in memory, lines before the first of them were spilled
+        std::vector<std::shared_ptr<ScrollBlock>> blocks;
+        size_t cached_block_line = std::numeric_limits<size_t>::max();
+        std::vector<std::string> cached_block_lines;
+
+        auto matches(size_t line) -> bool;
+    };
+
+    class ScrollBuffer {
+        public:
+        ScrollBuffer(int width, size_t hot_rows);
+        /**
+         * @param attributes table the SGR and hyperlinks in the output are interned in, shared with the rest of the session
+         */
+        ScrollBuffer(int width, size_t hot_rows, std::shared_ptr<AttributeTable> attributes);
+        /**
+         * Number of rows. Blocks that haven't been reflowed yet are counted at the width they
+         * were last wrapped at, so this can change as history is read.
+         */
+        [[nodiscard]] auto size() const -> size_t;
+        [[nodiscard]] auto empty() const -> bool;
+        /**
+         * Row counting from the top of history. Indexes above the hot rows move as stale blocks are
+         * reflowed, use row_from_bottom for anything that needs a stable position.
+         */
+        auto at(size_t index) -> std::string;
+        auto row_from_bottom(size_t offset) -> std::string;
+        /**
+         * count rows ending offset rows up from the bottom, in top to bottom order.
+         */
+        auto rows_above(size_t offset, size_t count) -> std::vector<std::string>;
+        auto last_rows(size_t count) -> std::vector<std::string>;
+        /**
+         * Starts a new row holding output.
+         */
+        void push_back(std::string_view output);
+        /**
+         * Adds raw output to the last row: text, control sequences, carriage returns and new lines.
+         */
+        void append(std::string_view output);
+        /**
+         * Writes one whole character, as UTF-8, at the current column of the last row over the cells it covers.
+         * Half of a wide character left over is blanked, a combining mark joins onto the character before it.
+         */
+        void append_character(std::string_view character);
+        /**
+         * Sequences that can't change how a row looks, like cursor visibility or the attributes that
+         * are already set, are dropped rather than stored. SGR and hyperlinks are stored as the attributes
+         * they leave in effect, rows are drawn going from one set of attributes to the next.
+         */
+        void append_sequence(std::string_view sequence);
+        void carriage_return();
+        /**
+         * Ends the last row and starts a new one.
+         */
+        void new_line();
+        /**
+         * Marks the last row as soft wrapped and starts a new row for the rest of the logical line.
+         */
+        void wrap_back();
+        /**
+         * Moves the column forward count columns, the row is padded with spaces if it is shorter.
+         */
+        void cursor_forward(size_t count);
+        /**
+         * Cuts the last row at column and carries on writing from there.
+         * The row is padded with spaces if it is shorter. Columns are counted on screen, so wide characters take two.
+         */
+        void truncate_back(size_t column);
+        [[nodiscard]] auto back_empty() const -> bool;
+        void erase_last(size_t count);
+        void set_width(int new_width);
+        void set_hot_rows(size_t rows);
+        [[nodiscard]] auto get_width() const -> int;
+        [[nodiscard]] auto stale_blocks() const -> size_t;
+        /**
+         * Approximate bytes held by the rows and the sequence table.
+         */
+        [[nodiscard]] auto memory_usage() const -> size_t;
+        [[nodiscard]] auto compressed_blocks() const -> size_t;
+        /**
+         * Once sealed blocks take more than memory_budget bytes the oldest are spilled to a file made by factory.
+         */
+        void set_spill(SpillFileFactory factory, size_t memory_budget);
+        [[nodiscard]] auto spilled_blocks() const -> size_t;
+        /**
+         * Spills what is over the new budget straight away and lets go of decompressed copies of cold blocks.
+         */
+        void set_memory_budget(size_t budget);
+        /**
+         * Bytes held by sealed blocks, kept up to date by the background compressor as well.
+         */
+        [[nodiscard]] auto get_block_bytes() const -> std::shared_ptr<const std::atomic<size_t>>;
+        /**
+         * Logical lines are numbered from the top of history. Sealed lines keep their number,
+         * so it can be used to get back to a line after the rows have been reflowed.
+         */
+        [[nodiscard]] auto line_count() const -> size_t;
+        auto line_text(size_t line) -> std::string;
+        auto offset_of_line(size_t line) -> size_t;
+        /**
+         * Find the closest line to from_line that matches, not including from_line itself.
+         * @param older search up towards the top of history rather than down towards the bottom
+         */
+        auto find(const SearchPattern& pattern, size_t from_line, bool older) -> std::optional<size_t>;
+        /**
+         * Takes what a search needs so it can run without holding writer_lock, which has to be held while this is called.
+         * Spilled lines are read holding writer_lock, no lock is taken when it is nullptr.
+         */
+        auto search(const SearchPattern& pattern, std::mutex* writer_lock = nullptr) -> ScrollSearch;
+        [[nodiscard]] auto get_search_index() const -> const SearchIndex&;
+
+        private:
+        // Blocks are numbered from the top of history, the spilled blocks come first then these
+        std::deque<std::shared_ptr<ScrollBlock>> blocks;
+        std::optional<BlockSpill> spill;
+        SpillFileFactory spill_factory;
+        size_t memory_budget = std::numeric_limits<size_t>::max();
+        // Decompressed blocks by their first line, most recently read first
+        std::list<std::pair<size_t, std::shared_ptr<const PackedRows>>> cache;
+        std::deque<Row> hot;
+        int width;
+        size_t hot_rows;
+        size_t block_rows = 0;
+        size_t committed_lines = 0;
+        std::shared_ptr<std::atomic<size_t>> block_bytes = std::make_shared<std::atomic<size_t>>(0);
+        // Where the next character goes in the last row
+        size_t column = 0;
+        std::vector<std::string> sequences;
+        // The attributes a sequence sets, nothing for sequences that aren't attributes
+        std::vector<std::optional<AttributeId>> sequence_attributes;
+        std::unordered_map<std::string, SequenceId> sequence_ids;
+        std::unordered_map<AttributeId, SequenceId> attribute_sequences;
+        std::shared_ptr<AttributeTable> attributes;
+        // What the output has set so far, SGR changes it from here. Nothing from when the attribute table
+        // had no room for what was set until the next reset
+        std::optional<AttributeId> attribute = DEFAULT_ATTRIBUTES;
+        SearchIndex search_index;
+        // Stripped lines of the last block searched, verifying candidates tends to hit the same block
+        size_t cached_block_line = std::numeric_limits<size_t>::max();
+        std::vector<std::string> cached_block_lines;
+
+        auto render(const Row& row) const -> std::string;
+        auto intern(std::string_view sequence) -> std::optional<SequenceId>;
+        auto intern_attribute(AttributeId id) -> std::optional<SequenceId>;
+        /**
+         * Interned attributes, or an SGR sequence kept as it was because the attribute table was full.
+         */
+        [[nodiscard]] auto sets_attributes(SequenceId sequence) const -> bool;
+        auto attribute_before(const Row& row, size_t run) const -> std::optional<SequenceId>;
+        void add_run(Row& row, size_t at_column, SequenceId sequence) const;
+        static void replace_text(Row& row, size_t at, size_t length, std::string_view text);
+        void join_row(Row& line, const Row& row) const;
+        void wrap_into(std::vector<Row>& rows, Row line, int width) const;
+        template <typename Rows> auto reflow(const Rows& rows, int width) const -> std::vector<Row>;
+        [[nodiscard]] auto spilled() const -> size_t;
+        [[nodiscard]] auto block_count() const -> size_t;
+        [[nodiscard]] auto block_size(size_t block) const -> size_t;
+        [[nodiscard]] auto block_first_line(size_t block) const -> size_t;
+        void reflow_block(size_t block);
+        auto rows_of(size_t block) -> std::shared_ptr<const PackedRows>;
+        void forget_cached(size_t first_line);
+        void spill_over_budget();
+        template <typename Rows> static auto logical_lines(const Rows& rows) -> std::vector<std::string>;
+        static auto row_bytes(const Row& row) -> size_t;
+        auto last_row() -> Row&;
+        auto hot_lines() -> std::vector<std::string>;
+        [[nodiscard]] auto block_of_line(size_t line) const -> size_t;
+        void seal();
+        void unseal_last();
+
+        friend class ScrollSearch;
+    };
+} // namespace omux
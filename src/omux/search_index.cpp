@@ -0,0 +1,260 @@
+#include "omux/search_index.hpp"
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <optional>
+#include <utility>
+
+namespace omux {
+    namespace {
+        auto fold(char character) -> uint32_t {
+            return static_cast<uint32_t>(std::tolower(static_cast<unsigned char>(character)));
+        }
+        /**
+         * Trigrams are case folded so the index can serve case insensitive patterns as well,
+         * the matching itself is done against the real text.
+         */
+        auto trigrams_of(std::string_view text) -> std::vector<uint32_t> {
+            std::vector<uint32_t> trigrams;
+            if(text.size() < 3) {
+                return trigrams;
+            }
+            trigrams.reserve(text.size() - 2);
+            for(size_t i = 0; i + 2 < text.size(); i++) {
+                trigrams.push_back(fold(text[i]) << 16 | fold(text[i + 1]) << 8 | fold(text[i + 2]));
+            }
+            std::sort(trigrams.begin(), trigrams.end());
+            trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+            return trigrams;
+        }
+    } // namespace
+
+    SearchPattern::SearchPattern(std::string pattern, bool regex)
+    : pattern(pattern), literals(required_literals(pattern, regex)) {
+        if(regex) {
+            expression = std::regex{pattern};
+        }
+    }
+
+    auto SearchPattern::matches(std::string_view text) const -> bool {
+        if(expression) {
+            return std::regex_search(text.begin(), text.end(), *expression);
+        }
+        return text.find(pattern) != std::string_view::npos;
+    }
+
+    auto SearchPattern::get_literals() const -> const std::vector<std::string>& {
+        return literals;
+    }
+
+    auto SearchPattern::required_literals(std::string_view pattern, bool regex) -> std::vector<std::string> {
+        if(!regex) {
+            return {std::string{pattern}};
+        }
+        std::vector<std::string> literals;
+        std::string run;
+        auto end_run = [&]() {
+            if(!run.empty()) {
+                literals.push_back(run);
+            }
+            run.clear();
+        };
+        // Where each open group's literals start, and whether it is a lookaround that doesn't have to be in the text
+        std::vector<std::pair<size_t, bool>> groups;
+        // Where the literals of the group that just closed start, for a quantifier straight after it
+        std::optional<size_t> closed_group;
+        for(size_t i = 0; i < pattern.size(); i++) {
+            auto character = pattern[i];
+            auto after_group = std::exchange(closed_group, std::nullopt);
+            switch(character) {
+                case '|':
+                    // Any alternative could match, so nothing is required
+                    return {};
+                case '\\': {
+                    if(i + 1 < pattern.size() && !std::isalnum(static_cast<unsigned char>(pattern[i + 1]))) {
+                        run.push_back(pattern[++i]);
+                        break;
+                    }
+                    // Character classes, assertions like \b and escapes like \x41 that stand for a character
+                    end_run();
+                    i++;
+                    if(i < pattern.size()) {
+                        i += pattern[i] == 'x' ? 2 : pattern[i] == 'u' ? 4 : pattern[i] == 'c' ? 1 : 0;
+                    }
+                    break;
+                }
+                case '[': {
+                    end_run();
+                    // Skip the bracket expression, a ] straight after the [ or ^ is part of it
+                    i++;
+                    if(i < pattern.size() && pattern[i] == '^') {
+                        i++;
+                    }
+                    if(i < pattern.size() && pattern[i] == ']') {
+                        i++;
+                    }
+                    while(i < pattern.size() && pattern[i] != ']') {
+                        if(pattern[i] == '\\') {
+                            i++;
+                        }
+                        i++;
+                    }
+                    break;
+                }
+                case '(': {
+                    end_run();
+                    bool lookaround = false;
+                    if(i + 2 < pattern.size() && pattern[i + 1] == '?') {
+                        lookaround = pattern[i + 2] != ':';
+                        i += 2;
+                    }
+                    groups.emplace_back(literals.size(), lookaround);
+                    break;
+                }
+                case ')': {
+                    end_run();
+                    if(groups.empty()) {
+                        return {};
+                    }
+                    auto [group_start, lookaround] = groups.back();
+                    groups.pop_back();
+                    if(lookaround) {
+                        literals.resize(group_start);
+                    }
+                    closed_group = group_start;
+                    break;
+                }
+                case '*':
+                case '?':
+                case '{': {
+                    // {n} and {n,} with n at least one still need what they repeat, like +
+                    bool optional = true;
+                    if(character == '{') {
+                        auto close = pattern.find('}', i);
+                        if(close == std::string_view::npos) {
+                            return {};
+                        }
+                        optional = pattern[i + 1] < '1' || pattern[i + 1] > '9';
+                        i = close;
+                    }
+                    if(optional) {
+                        // The character or group before could be missing entirely
+                        if(after_group) {
+                            literals.resize(*after_group);
+                        } else if(!run.empty()) {
+                            run.pop_back();
+                        }
+                    }
+                    end_run();
+                    break;
+                }
+                case '+':
+                case '.':
+                case '^':
+                case '$':
+                    end_run();
+                    break;
+                default:
+                    run.push_back(character);
+            }
+        }
+        end_run();
+        if(!groups.empty()) {
+            // Not a pattern std::regex takes, nothing can be relied on
+            return {};
+        }
+        return literals;
+    }
+
+    SearchIndex::SearchIndex(size_t max_bytes) : max_bytes(max_bytes) {
+    }
+
+    void SearchIndex::add_line(size_t line, std::string_view text) {
+        if(line < next_line) {
+            truncate(line);
+        }
+        next_line = line + 1;
+        for(auto trigram : trigrams_of(text)) {
+            auto& posting = postings[trigram];
+            if(posting.empty()) {
+                bytes += POSTING_OVERHEAD_BYTES;
+            }
+            posting.push_back(static_cast<LineId>(line));
+            bytes += sizeof(LineId);
+        }
+        if(bytes > max_bytes) {
+            evict_oldest();
+        }
+    }
+
+    void SearchIndex::truncate(size_t line) {
+        for(auto posting = postings.begin(); posting != postings.end();) {
+            auto& lines = posting->second;
+            while(!lines.empty() && lines.back() >= line) {
+                lines.pop_back();
+                bytes -= sizeof(LineId);
+            }
+            if(lines.empty()) {
+                bytes -= POSTING_OVERHEAD_BYTES;
+                posting = postings.erase(posting);
+            } else {
+                posting++;
+            }
+        }
+        next_line = std::max(first_line, std::min(next_line, line));
+    }
+
+    void SearchIndex::evict_oldest() {
+        // Drop the older half of what is indexed in one go so this doesn't happen on every line
+        auto new_first_line = first_line + (next_line - first_line) / 2;
+        for(auto posting = postings.begin(); posting != postings.end();) {
+            auto& lines = posting->second;
+            auto keep_from = std::lower_bound(lines.begin(), lines.end(), static_cast<LineId>(new_first_line));
+            bytes -= sizeof(LineId) * static_cast<size_t>(std::distance(lines.begin(), keep_from));
+            lines.erase(lines.begin(), keep_from);
+            if(lines.empty()) {
+                bytes -= POSTING_OVERHEAD_BYTES;
+                posting = postings.erase(posting);
+            } else {
+                lines.shrink_to_fit();
+                posting++;
+            }
+        }
+        first_line = new_first_line;
+    }
+
+    auto SearchIndex::candidates(const SearchPattern& pattern) const -> std::optional<std::vector<size_t>> {
+        std::vector<const std::vector<LineId>*> lists;
+        for(const auto& literal : pattern.get_literals()) {
+            for(auto trigram : trigrams_of(literal)) {
+                auto posting = postings.find(trigram);
+                if(posting == postings.end()) {
+                    return std::vector<size_t>{};
+                }
+                lists.push_back(&posting->second);
+            }
+        }
+        if(lists.empty()) {
+            return std::nullopt;
+        }
+        // Start from the rarest trigram so the intersection only ever shrinks from there
+        std::sort(lists.begin(), lists.end(), [](auto* a, auto* b) { return a->size() < b->size(); });
+        std::vector<LineId> lines{*lists.front()};
+        for(auto list = lists.begin() + 1; list != lists.end() && !lines.empty(); list++) {
+            std::vector<LineId> intersection;
+            std::set_intersection(lines.begin(), lines.end(), (*list)->begin(), (*list)->end(), std::back_inserter(intersection));
+            lines = std::move(intersection);
+        }
+        return std::vector<size_t>{lines.begin(), lines.end()};
+    }
+
+    auto SearchIndex::memory_usage() const -> size_t {
+        return bytes;
+    }
+    auto SearchIndex::first_indexed_line() const -> size_t {
+        return first_line;
+    }
+    auto SearchIndex::end_line() const -> size_t {
+        return next_line;
+    }
+} // namespace omux
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstdint>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace omux {
+    /**
+     * Upper bound on what a single pane's search index can hold.
+     * Once it is reached the oldest lines are dropped from the index and searched by scanning instead.
+     */
+    constexpr size_t SEARCH_INDEX_MAX_BYTES = 32 * 1024 * 1024;
+
+    /**
+     * What is being searched for, either a plain substring or an ECMAScript regex.
+     */
+    class SearchPattern {
+        public:
+        SearchPattern(std::string pattern, bool regex);
+        [[nodiscard]] auto matches(std::string_view text) const -> bool;
+        /**
+         * Runs of characters every match has to contain, used to narrow down the lines to check.
+         */
+        [[nodiscard]] auto get_literals() const -> const std::vector<std::string>&;
+        static auto required_literals(std::string_view pattern, bool regex) -> std::vector<std::string>;
+
+        private:
+        std::string pattern;
+        std::optional<std::regex> expression;
+        std::vector<std::string> literals;
+    };
+
+    /**
+     * Trigram postings over the text of committed lines, with the control sequences stripped.
+     * Lines have to be added in ascending order so each posting list stays sorted.
+     */
+    class SearchIndex {
+        public:
+        explicit SearchIndex(size_t max_bytes = SEARCH_INDEX_MAX_BYTES);
+        void add_line(size_t line, std::string_view text);
+        /**
+         * Forget every line from line onwards, used when committed lines are taken back for editing.
+         */
+        void truncate(size_t line);
+        /**
+         * Lines that contain every trigram of the pattern's literals, in ascending order.
+         * Nothing is returned when the pattern is too short to narrow anything down, every line needs checking.
+         */
+        [[nodiscard]] auto candidates(const SearchPattern& pattern) const -> std::optional<std::vector<size_t>>;
+        [[nodiscard]] auto memory_usage() const -> size_t;
+        /**
+         * Lines before this have been dropped to keep under the memory cap.
+         */
+        [[nodiscard]] auto first_indexed_line() const -> size_t;
+        [[nodiscard]] auto end_line() const -> size_t;
+
+        private:
+        // 32 bits of line number is over 4 billion lines, far past anything we keep
+        using LineId = uint32_t;
+        static constexpr size_t POSTING_OVERHEAD_BYTES = 64;
+        std::unordered_map<uint32_t, std::vector<LineId>> postings;
+        size_t max_bytes;
+        size_t bytes = 0;
+        size_t first_line = 0;
+        size_t next_line = 0;
+
+        void evict_oldest();
+    };
+} // namespace omux
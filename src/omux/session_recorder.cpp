@@ -0,0 +1,245 @@
+#include "omux/session_recorder.hpp"
+#include <array>
+#include <stdexcept>
+#include <utility>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace omux {
+    namespace {
+        // Pane id, direction and length after the timestamp, all little endian
+        constexpr size_t FRAME_HEADER_BYTES = 8 + 4 + 1 + 4;
+
+        template <typename T> void put(char*& out, T value) {
+            for(size_t i = 0; i < sizeof(T); i++) {
+                *out++ = static_cast<char>(static_cast<uint64_t>(value) >> (8 * i) & 0xff);
+            }
+        }
+        template <typename T> auto take(const char*& in) -> T {
+            uint64_t value = 0;
+            for(size_t i = 0; i < sizeof(T); i++) {
+                value |= static_cast<uint64_t>(static_cast<unsigned char>(*in++)) << (8 * i);
+            }
+            return static_cast<T>(value);
+        }
+        auto numbered(const std::filesystem::path& path, size_t number) -> std::filesystem::path {
+            auto numbered_path = path;
+            numbered_path += "." + std::to_string(number);
+            return numbered_path;
+        }
+    } // namespace
+
+    auto SessionRecorder::global() -> SessionRecorder& {
+        static SessionRecorder recorder;
+        return recorder;
+    }
+
+    SessionRecorder::~SessionRecorder() {
+        stop();
+        discard_pending();
+    }
+
+    void SessionRecorder::start(const std::filesystem::path& new_path, size_t new_rotate_bytes) {
+        stop();
+        discard_pending();
+        {
+            std::scoped_lock lock(error_lock);
+            error.reset();
+        }
+        path = new_path;
+        rotate_bytes = new_rotate_bytes;
+        open();
+        started = std::chrono::steady_clock::now();
+        session.fetch_add(1, std::memory_order_release);
+        writer = std::jthread([this](std::stop_token stop) { run(stop); });
+        recording.store(true, std::memory_order_release);
+    }
+
+    void SessionRecorder::stop() {
+        if(!writer.joinable()) {
+            return;
+        }
+        recording = false;
+        // Requesting the stop wakes the writer, which writes what is left before it exits
+        writer.request_stop();
+        writer.join();
+        if(file != nullptr && std::fclose(file) != 0) {
+            fail("Couldn't close session recording " + path.string());
+        }
+        file = nullptr;
+        // Whatever was pushed after the writer's last look belongs to no recording
+        discard_pending();
+    }
+
+    auto SessionRecorder::write_error() -> std::optional<std::string> {
+        std::scoped_lock lock(error_lock);
+        return error;
+    }
+
+    void SessionRecorder::record(unsigned int pane, RecordDirection direction, std::string_view bytes) {
+        // Loaded before checking, so a frame that races a stop and a start is tagged with the old recording
+        auto current = session.load(std::memory_order_acquire);
+        if(!recording.load(std::memory_order_acquire)) {
+            return;
+        }
+        auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+        auto* node = new Node{nullptr, current, RecordedFrame{time, pane, direction, std::string{bytes}}};
+        node->next = pending.load(std::memory_order_relaxed);
+        while(!pending.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
+
+    void SessionRecorder::run(std::stop_token stop) {
+        std::unique_lock lock(writer_lock);
+        auto last_sync = std::chrono::steady_clock::now();
+        while(true) {
+            wake.wait_for(lock, stop, SESSION_RECORDER_WRITE_INTERVAL, []() { return false; });
+            auto stopping = stop.stop_requested();
+            lock.unlock();
+            write_pending();
+            auto now = std::chrono::steady_clock::now();
+            if(stopping || now - last_sync >= SESSION_RECORDER_SYNC_INTERVAL) {
+                sync();
+                last_sync = now;
+            }
+            lock.lock();
+            if(stopping) {
+                return;
+            }
+        }
+    }
+
+    void SessionRecorder::write_pending() {
+        // Taking the whole list at once means producers never contend with the writer
+        auto* node = pending.exchange(nullptr, std::memory_order_acquire);
+        Node* oldest = nullptr;
+        while(node != nullptr) {
+            auto* next = node->next;
+            node->next = oldest;
+            oldest = node;
+            node = next;
+        }
+        auto current = session.load(std::memory_order_relaxed);
+        while(oldest != nullptr) {
+            if(oldest->session == current && file != nullptr) {
+                write_frame(oldest->frame);
+            }
+            delete std::exchange(oldest, oldest->next);
+        }
+    }
+
+    void SessionRecorder::discard_pending() {
+        auto* node = pending.exchange(nullptr, std::memory_order_acquire);
+        while(node != nullptr) {
+            delete std::exchange(node, node->next);
+        }
+    }
+
+    void SessionRecorder::fail(std::string message) {
+        recording = false;
+        std::scoped_lock lock(error_lock);
+        if(!error) {
+            error = std::move(message);
+        }
+    }
+
+    void SessionRecorder::write_frame(const RecordedFrame& frame) {
+        auto frame_bytes = FRAME_HEADER_BYTES + frame.bytes.size();
+        if(file_bytes > SESSION_RECORDING_MAGIC.size() && file_bytes + frame_bytes > rotate_bytes) {
+            rotate();
+            if(file == nullptr) {
+                return;
+            }
+        }
+        std::array<char, FRAME_HEADER_BYTES> header{};
+        auto* out = header.data();
+        put(out, static_cast<uint64_t>(frame.time.count()));
+        put(out, static_cast<uint32_t>(frame.pane));
+        put(out, static_cast<uint8_t>(frame.direction));
+        put(out, static_cast<uint32_t>(frame.bytes.size()));
+        if(std::fwrite(header.data(), 1, header.size(), file) != header.size() ||
+           std::fwrite(frame.bytes.data(), 1, frame.bytes.size(), file) != frame.bytes.size()) {
+            fail("Couldn't write to session recording " + path.string());
+            std::fclose(std::exchange(file, nullptr));
+            return;
+        }
+        file_bytes += frame_bytes;
+    }
+
+    void SessionRecorder::open() {
+#ifdef _WIN32
+        file = _wfopen(path.c_str(), L"wb");
+#else
+        file = std::fopen(path.c_str(), "wb");
+#endif
+        if(file == nullptr) {
+            throw std::runtime_error("Couldn't open session recording " + path.string());
+        }
+        if(std::fwrite(SESSION_RECORDING_MAGIC.data(), 1, SESSION_RECORDING_MAGIC.size(), file) != SESSION_RECORDING_MAGIC.size()) {
+            std::fclose(file);
+            file = nullptr;
+            throw std::runtime_error("Couldn't write to session recording " + path.string());
+        }
+        file_bytes = SESSION_RECORDING_MAGIC.size();
+    }
+
+    void SessionRecorder::rotate() {
+        sync();
+        if(file == nullptr) {
+            return;
+        }
+        std::fclose(std::exchange(file, nullptr));
+        std::error_code ignored;
+        std::filesystem::remove(numbered(path, SESSION_RECORDER_KEPT_FILES), ignored);
+        for(auto number = SESSION_RECORDER_KEPT_FILES; number > 1; number--) {
+            std::filesystem::rename(numbered(path, number - 1), numbered(path, number), ignored);
+        }
+        std::filesystem::rename(path, numbered(path, 1), ignored);
+        try {
+            open();
+        } catch(std::runtime_error& e) {
+            // On the writer thread, the recording just stops
+            fail(e.what());
+        }
+    }
+
+    void SessionRecorder::sync() {
+        if(file == nullptr) {
+            return;
+        }
+#ifdef _WIN32
+        auto synced = std::fflush(file) == 0 && _commit(_fileno(file)) == 0;
+#else
+        auto synced = std::fflush(file) == 0 && fsync(fileno(file)) == 0;
+#endif
+        if(!synced) {
+            fail("Couldn't sync session recording " + path.string());
+            std::fclose(std::exchange(file, nullptr));
+        }
+    }
+
+    auto SessionRecorder::read_frames(std::istream& recording) -> std::vector<RecordedFrame> {
+        std::vector<RecordedFrame> frames;
+        std::string magic(SESSION_RECORDING_MAGIC.size(), '\0');
+        if(!recording.read(magic.data(), static_cast<std::streamsize>(magic.size())) || magic != SESSION_RECORDING_MAGIC) {
+            throw std::runtime_error("Not a session recording");
+        }
+        std::array<char, FRAME_HEADER_BYTES> header{};
+        while(recording.read(header.data(), header.size())) {
+            const auto* in = static_cast<const char*>(header.data());
+            RecordedFrame frame;
+            frame.time = std::chrono::microseconds{take<uint64_t>(in)};
+            frame.pane = take<uint32_t>(in);
+            frame.direction = static_cast<RecordDirection>(take<uint8_t>(in));
+            frame.bytes.resize(take<uint32_t>(in));
+            if(!recording.read(frame.bytes.data(), static_cast<std::streamsize>(frame.bytes.size()))) {
+                break;
+            }
+            frames.push_back(std::move(frame));
+        }
+        return frames;
+    }
+} // namespace omux
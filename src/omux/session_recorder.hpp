@@ -0,0 +1,117 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace omux {
+    /**
+     * A recording is rotated once it grows past this, the previous file is kept with .1 added to its name and so on.
+     */
+    constexpr size_t SESSION_RECORDER_ROTATE_BYTES = 64 * 1024 * 1024;
+    constexpr size_t SESSION_RECORDER_KEPT_FILES = 3;
+    /**
+     * How long frames wait in the queue before the writer picks them up, and how long written frames wait to be synced.
+     */
+    constexpr std::chrono::milliseconds SESSION_RECORDER_WRITE_INTERVAL{20};
+    constexpr std::chrono::milliseconds SESSION_RECORDER_SYNC_INTERVAL{1000};
+    /**
+     * Every recording starts with this, followed by the frames.
+     */
+    constexpr std::string_view SESSION_RECORDING_MAGIC = "OMUXREC1";
+
+    enum class RecordDirection : uint8_t {
+        // What a pane's pseudo console sent us
+        output = 0,
+        // What was typed into a pane
+        input = 1,
+        // What we wrote to the host console on a pane's behalf, beyond the output itself
+        host = 2
+    };
+
+    struct RecordedFrame {
+        // Since the recording was started
+        std::chrono::microseconds time;
+        unsigned int pane;
+        RecordDirection direction;
+        std::string bytes;
+    };
+
+    /**
+     * Records what goes in and out of every pane, see docs/session_recording.md.
+     *
+     * Recording is off unless started, and then costs an atomic load per call. When it is on, frames are pushed
+     * onto a lock free list and written out by a background thread, which syncs the file to disk in batches.
+     */
+    class SessionRecorder {
+        public:
+        SessionRecorder() = default;
+        ~SessionRecorder();
+        SessionRecorder(const SessionRecorder&) = delete;
+        auto operator=(const SessionRecorder&) -> SessionRecorder& = delete;
+        static auto global() -> SessionRecorder&;
+        /**
+         * Starts a new recording at path, replacing anything already there.
+         */
+        void start(const std::filesystem::path& path, size_t rotate_bytes = SESSION_RECORDER_ROTATE_BYTES);
+        /**
+         * Writes out everything recorded so far and closes the file. Frames recorded as it stops are dropped.
+         */
+        void stop();
+        /**
+         * Why the recording couldn't be written, nothing is recorded after the first error.
+         */
+        [[nodiscard]] auto write_error() -> std::optional<std::string>;
+        [[nodiscard]] auto enabled() const -> bool {
+            return recording.load(std::memory_order_relaxed);
+        }
+        void record(unsigned int pane, RecordDirection direction, std::string_view bytes);
+        /**
+         * Frames from a recording, stopping at the first incomplete frame.
+         */
+        static auto read_frames(std::istream& recording) -> std::vector<RecordedFrame>;
+
+        private:
+        struct Node {
+            Node* next;
+            // The recording the frame was made for, a frame that comes in as one recording ends isn't written to the next
+            unsigned int session;
+            RecordedFrame frame;
+        };
+        std::atomic<bool> recording{false};
+        std::atomic<unsigned int> session{0};
+        std::atomic<Node*> pending{nullptr};
+        std::chrono::steady_clock::time_point started;
+        std::filesystem::path path;
+        size_t rotate_bytes = SESSION_RECORDER_ROTATE_BYTES;
+        std::FILE* file = nullptr;
+        size_t file_bytes = 0;
+        std::mutex writer_lock;
+        std::condition_variable_any wake;
+        std::jthread writer;
+        std::mutex error_lock;
+        std::optional<std::string> error;
+
+        void run(std::stop_token stop);
+        void write_pending();
+        void discard_pending();
+        /**
+         * Stops the recording after a write fails, keeping the first error.
+         */
+        void fail(std::string message);
+        void write_frame(const RecordedFrame& frame);
+        void open();
+        void rotate();
+        void sync();
+    };
+} // namespace omux
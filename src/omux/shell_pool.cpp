@@ -0,0 +1,101 @@
+#include "omux/shell_pool.hpp"
+#include <algorithm>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+
+namespace omux {
+    ShellPool::ShellPool(std::shared_ptr<PrimaryConsole> primary_console, std::wstring path, std::wstring args, Layout layout, size_t size)
+    : primary_console(std::move(primary_console)), path(std::move(path)), args(std::move(args)), layout(layout), size(size),
+      replenisher([this](std::stop_token stop) { replenish(stop); }) {
+    }
+
+    ShellPool::~ShellPool() {
+        replenisher.request_stop();
+        replenisher.join();
+        std::deque<Shell> ending;
+        {
+            std::scoped_lock lock(pool_lock);
+            ending = std::move(warm);
+            std::move(handed_out.begin(), handed_out.end(), std::back_inserter(ending));
+            handed_out.clear();
+        }
+        // Ending a shell waits for its exit callback, which takes the pool lock
+        ending.clear();
+    }
+
+    auto ShellPool::take() -> Console::Sptr {
+        // Let go of after the lock, for the same reason as in the destructor
+        std::vector<Shell> finished;
+        std::scoped_lock lock(pool_lock);
+        while(!warm.empty()) {
+            auto shell = std::move(warm.front());
+            warm.pop_front();
+            changed.notify_all();
+            if(!shell.process->process_running()) {
+                finished.push_back(std::move(shell));
+                continue;
+            }
+            auto console = shell.console;
+            handed_out.push_back(std::move(shell));
+            return console;
+        }
+        return nullptr;
+    }
+
+    auto ShellPool::ready() -> size_t {
+        std::scoped_lock lock(pool_lock);
+        return warm.size();
+    }
+
+    auto ShellPool::wait_until_full(std::chrono::milliseconds timeout) -> bool {
+        std::unique_lock lock(pool_lock);
+        return changed.wait_for(lock, timeout, [&] { return failed || warm.size() >= size; }) && !failed;
+    }
+
+    auto ShellPool::start() -> Shell {
+        Shell shell{Console::reserve(primary_console, layout), nullptr};
+        shell.process = std::make_unique<Process>(shell.console, path, args, [this]() {
+            std::scoped_lock lock(pool_lock);
+            exited = true;
+            changed.notify_all();
+        });
+        return shell;
+    }
+
+    void ShellPool::replenish(std::stop_token stop) {
+        std::unique_lock lock(pool_lock);
+        while(changed.wait(lock, stop, [&] { return exited || (!failed && warm.size() < size); }) && !stop.stop_requested()) {
+            std::vector<Shell> finished;
+            if(std::exchange(exited, false)) {
+                auto take_finished = [&](auto& shells) {
+                    auto first_finished = std::stable_partition(shells.begin(), shells.end(), [](Shell& shell) { return shell.process->process_running(); });
+                    std::move(first_finished, shells.end(), std::back_inserter(finished));
+                    shells.erase(first_finished, shells.end());
+                };
+                take_finished(handed_out);
+                take_finished(warm);
+            }
+            auto starting = !failed && warm.size() < size;
+            lock.unlock();
+            // Letting go of a pane that was handed out detaches it, so it stops counting as live
+            finished.clear();
+            std::optional<Shell> started;
+            if(starting) {
+                try {
+                    started = start();
+                } catch(std::logic_error& e) {
+                    // Splits make their own shells like they always have
+                }
+            }
+            lock.lock();
+            if(started) {
+                warm.push_back(std::move(*started));
+            } else if(starting) {
+                failed = true;
+            }
+            changed.notify_all();
+        }
+    }
+} // namespace omux
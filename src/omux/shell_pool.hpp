@@ -0,0 +1,75 @@
+#pragma once
+#include "omux/console.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stop_token>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace omux {
+    /**
+     * How many shells are kept started by default, enough for a couple of splits in quick succession.
+     */
+    constexpr size_t SHELL_POOL_SIZE = 2;
+
+    /**
+     * Shells started ahead of time in reserved panes, so a split has a prompt straight away rather than waiting hundreds of
+     * milliseconds for the shell to start. A shell that is taken or exits is replaced in the background.
+     *
+     * The pool owns the processes of the panes it hands out until they exit, the panes belong to whoever took them.
+     * Shells still waiting in the pool are ended with it.
+     */
+    class ShellPool {
+        public:
+        /**
+         * @param layout the size the shells are started at, a pane is resized to where it goes when it is taken
+         */
+        ShellPool(std::shared_ptr<PrimaryConsole> primary_console, std::wstring path, std::wstring args, Layout layout,
+                  size_t size = SHELL_POOL_SIZE);
+        ~ShellPool();
+        ShellPool(const ShellPool&) = delete;
+        auto operator=(const ShellPool&) -> ShellPool& = delete;
+        /**
+         * A reserved pane whose shell has started, nothing when the pool hasn't caught up.
+         * The pane is hidden and isn't part of the primary console until it is added with PrimaryConsole::add_console.
+         */
+        auto take() -> Console::Sptr;
+        /**
+         * How many shells are waiting to be taken.
+         */
+        auto ready() -> size_t;
+        /**
+         * Waits until every shell has been started.
+         * @return false if it timed out or shells can't be started
+         */
+        auto wait_until_full(std::chrono::milliseconds timeout) -> bool;
+
+        private:
+        struct Shell {
+            Console::Sptr console;
+            std::unique_ptr<Process> process;
+        };
+
+        const std::shared_ptr<PrimaryConsole> primary_console;
+        const std::wstring path;
+        const std::wstring args;
+        const Layout layout;
+        const size_t size;
+        std::mutex pool_lock;
+        std::condition_variable_any changed;
+        std::deque<Shell> warm;
+        std::vector<Shell> handed_out;
+        // A shell has exited and should be let go of
+        bool exited = false;
+        // Starting a shell failed, there is no point trying again
+        bool failed = false;
+        std::jthread replenisher;
+
+        auto start() -> Shell;
+        void replenish(std::stop_token stop);
+    };
+} // namespace omux
@@ -0,0 +1,133 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+namespace omux {
+    /**
+     * Refers to a value in a SlotMap. Once the value is erased the handle stays stale for good,
+     * even after its slot is reused, because the slot's generation has moved on.
+     */
+    struct SlotHandle {
+        static constexpr uint32_t NO_INDEX = std::numeric_limits<uint32_t>::max();
+        uint32_t index = NO_INDEX;
+        uint32_t generation = 0;
+
+        [[nodiscard]] auto is_null() const -> bool {
+            return index == NO_INDEX;
+        }
+        friend auto operator==(const SlotHandle&, const SlotHandle&) -> bool = default;
+    };
+
+    /**
+     * Values stored densely with O(1) insert, erase and lookup by handle. Erasing moves the last value into the
+     * hole, so iteration order isn't insertion order.
+     */
+    template <typename T> class SlotMap {
+        public:
+        auto insert(T value) -> SlotHandle {
+            uint32_t index = 0;
+            if(free_head != SlotHandle::NO_INDEX) {
+                index = free_head;
+                free_head = slots[index].position;
+                slots[index].generation++;
+            } else {
+                index = static_cast<uint32_t>(slots.size());
+                slots.push_back(Slot{});
+            }
+            slots[index].position = static_cast<uint32_t>(values.size());
+            values.push_back(std::move(value));
+            value_slots.push_back(index);
+            return SlotHandle{index, slots[index].generation};
+        }
+
+        /**
+         * @return false if the handle was already stale
+         */
+        auto erase(SlotHandle handle) -> bool {
+            if(!contains(handle)) {
+                return false;
+            }
+            auto& slot = slots[handle.index];
+            auto position = slot.position;
+            auto last = static_cast<uint32_t>(values.size() - 1);
+            if(position != last) {
+                values[position] = std::move(values[last]);
+                value_slots[position] = value_slots[last];
+                slots[value_slots[position]].position = position;
+            }
+            values.pop_back();
+            value_slots.pop_back();
+            slot.generation++;
+            slot.position = free_head;
+            free_head = handle.index;
+            return true;
+        }
+
+        [[nodiscard]] auto contains(SlotHandle handle) const -> bool {
+            return handle.index < slots.size() && slots[handle.index].generation == handle.generation &&
+                   (slots[handle.index].generation & 1) == 0;
+        }
+
+        /**
+         * @return nullptr if the handle is stale
+         */
+        auto get(SlotHandle handle) -> T* {
+            return contains(handle) ? &values[slots[handle.index].position] : nullptr;
+        }
+        auto get(SlotHandle handle) const -> const T* {
+            return contains(handle) ? &values[slots[handle.index].position] : nullptr;
+        }
+
+        /**
+         * Handle of the value at a position when iterating.
+         */
+        [[nodiscard]] auto handle_at(size_t position) const -> SlotHandle {
+            auto index = value_slots[position];
+            return SlotHandle{index, slots[index].generation};
+        }
+
+        /**
+         * Where the value is when iterating, the opposite of handle_at. Nothing if the handle is stale.
+         */
+        [[nodiscard]] auto position_of(SlotHandle handle) const -> std::optional<size_t> {
+            if(!contains(handle)) {
+                return std::nullopt;
+            }
+            return slots[handle.index].position;
+        }
+
+        [[nodiscard]] auto size() const -> size_t {
+            return values.size();
+        }
+        [[nodiscard]] auto empty() const -> bool {
+            return values.empty();
+        }
+        auto begin() {
+            return values.begin();
+        }
+        auto end() {
+            return values.end();
+        }
+        auto begin() const {
+            return values.begin();
+        }
+        auto end() const {
+            return values.end();
+        }
+
+        private:
+        struct Slot {
+            // Odd while the slot is free, so a handle can never match a free slot
+            uint32_t generation = 0;
+            // Where the value is in values, or the next free slot while it is free
+            uint32_t position = SlotHandle::NO_INDEX;
+        };
+        std::vector<Slot> slots;
+        std::vector<T> values;
+        std::vector<uint32_t> value_slots;
+        uint32_t free_head = SlotHandle::NO_INDEX;
+    };
+} // namespace omux
@@ -0,0 +1,472 @@
+#include "omux/terminal_model.hpp"
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <unordered_map>
+
+namespace omux {
+    namespace {
+        constexpr uint64_t FNV_OFFSET = 14695981039346656037ULL;
+        constexpr uint64_t FNV_PRIME = 1099511628211ULL;
+
+        void hash_bytes(uint64_t& hash, uint64_t value, size_t bytes) {
+            for(size_t i = 0; i < bytes; i++) {
+                hash ^= (value >> (8 * i)) & 0xff;
+                hash *= FNV_PRIME;
+            }
+        }
+
+        /**
+         * The nth ; separated number, fallback when it is missing or 0.
+         */
+        auto parameter(std::string_view parameters, size_t index, int fallback) -> int {
+            size_t start = 0;
+            for(size_t i = 0; i < index; i++) {
+                start = parameters.find(';', start);
+                if(start == std::string_view::npos) {
+                    return fallback;
+                }
+                start++;
+            }
+            int value = 0;
+            auto end = parameters.find(';', start);
+            auto number = parameters.substr(start, end == std::string_view::npos ? std::string_view::npos : end - start);
+            std::from_chars(number.data(), number.data() + number.size(), value);
+            return value == 0 ? fallback : value;
+        }
+    } // namespace
+
+    void append_utf8(std::string& text, char32_t character) {
+        if(character < 0x80) {
+            text.push_back(static_cast<char>(character));
+        } else if(character < 0x800) {
+            text.push_back(static_cast<char>(0xc0 | character >> 6));
+            text.push_back(static_cast<char>(0x80 | (character & 0x3f)));
+        } else if(character < 0x10000) {
+            text.push_back(static_cast<char>(0xe0 | character >> 12));
+            text.push_back(static_cast<char>(0x80 | (character >> 6 & 0x3f)));
+            text.push_back(static_cast<char>(0x80 | (character & 0x3f)));
+        } else {
+            text.push_back(static_cast<char>(0xf0 | character >> 18));
+            text.push_back(static_cast<char>(0x80 | (character >> 12 & 0x3f)));
+            text.push_back(static_cast<char>(0x80 | (character >> 6 & 0x3f)));
+            text.push_back(static_cast<char>(0x80 | (character & 0x3f)));
+        }
+    }
+
+    TerminalModel::TerminalModel(int width, int height) : TerminalModel(width, height, std::make_shared<AttributeTable>()) {
+    }
+
+    TerminalModel::TerminalModel(int width, int height, std::shared_ptr<AttributeTable> attributes)
+    : width(std::max(width, 1)), height(std::max(height, 1)),
+      cells(static_cast<size_t>(this->width) * static_cast<size_t>(this->height)), attributes(std::move(attributes)) {
+    }
+
+    auto TerminalModel::cell(int at_column, int at_row) -> Cell& {
+        return cells[static_cast<size_t>(at_row) * static_cast<size_t>(width) + static_cast<size_t>(at_column)];
+    }
+    auto TerminalModel::cell(int at_column, int at_row) const -> const Cell& {
+        return cells[static_cast<size_t>(at_row) * static_cast<size_t>(width) + static_cast<size_t>(at_column)];
+    }
+
+    void TerminalModel::write(std::string_view output) {
+        for(auto character : output) {
+            auto byte = static_cast<unsigned char>(character);
+            switch(state) {
+                case State::ground:
+                    if(utf8_remaining > 0 && (byte & 0xc0) == 0x80) {
+                        utf8_character = utf8_character << 6 | (byte & 0x3f);
+                        if(--utf8_remaining == 0) {
+                            put(utf8_character);
+                        }
+                        break;
+                    }
+                    // Anything else cuts a UTF-8 character short, which is dropped
+                    utf8_remaining = 0;
+                    if(byte == 0x1b) {
+                        state = State::escape;
+                    } else if(byte < 0x20 || byte == 0x7f) {
+                        control(character);
+                    } else if(byte < 0x80) {
+                        put(byte);
+                    } else if((byte & 0xe0) == 0xc0) {
+                        utf8_character = byte & 0x1f;
+                        utf8_remaining = 1;
+                    } else if((byte & 0xf0) == 0xe0) {
+                        utf8_character = byte & 0x0f;
+                        utf8_remaining = 2;
+                    } else if((byte & 0xf8) == 0xf0) {
+                        utf8_character = byte & 0x07;
+                        utf8_remaining = 3;
+                    } else {
+                        put(U'\uFFFD');
+                    }
+                    break;
+                case State::escape:
+                    if(character == '[') {
+                        sequence.clear();
+                        state = State::csi;
+                    } else if(character == ']') {
+                        sequence.clear();
+                        state = State::osc;
+                    } else if(byte >= 0x20 && byte <= 0x2f) {
+                        // Character set designations and the like have one more byte
+                        state = State::escape_intermediate;
+                    } else {
+                        state = State::ground;
+                        escape(character);
+                    }
+                    break;
+                case State::escape_intermediate:
+                    state = State::ground;
+                    break;
+                case State::csi:
+                    if(byte >= 0x40 && byte <= 0x7e) {
+                        state = State::ground;
+                        csi(sequence, character);
+                    } else if(byte == 0x1b) {
+                        state = State::escape;
+                    } else {
+                        sequence.push_back(character);
+                    }
+                    break;
+                case State::osc:
+                    if(byte == 0x07) {
+                        state = State::ground;
+                        osc(sequence);
+                    } else if(byte == 0x1b) {
+                        state = State::osc_escape;
+                    } else {
+                        sequence.push_back(character);
+                    }
+                    break;
+                case State::osc_escape:
+                    if(character == '\\') {
+                        state = State::ground;
+                        osc(sequence);
+                    } else {
+                        state = State::osc;
+                    }
+                    break;
+            }
+        }
+    }
+
+    void TerminalModel::put(char32_t character) {
+        if(pending_wrap) {
+            pending_wrap = false;
+            column = 0;
+            line_feed();
+        }
+        cell(column, row) = Cell{character, attribute};
+        if(column == width - 1) {
+            pending_wrap = true;
+        } else {
+            column++;
+        }
+    }
+
+    void TerminalModel::control(char character) {
+        switch(character) {
+            case '\r':
+                column = 0;
+                pending_wrap = false;
+                break;
+            case '\n':
+            case '\v':
+            case '\f':
+                line_feed();
+                break;
+            case '\b':
+                move_to(column - 1, row);
+                break;
+            case '\t':
+                move_to(std::min((column / 8 + 1) * 8, width - 1), row);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void TerminalModel::escape(char final_character) {
+        switch(final_character) {
+            case '7':
+                saved_column = column;
+                saved_row = row;
+                break;
+            case '8':
+                move_to(saved_column, saved_row);
+                break;
+            case 'D':
+                line_feed();
+                break;
+            case 'E':
+                column = 0;
+                line_feed();
+                break;
+            case 'M':
+                if(row == 0) {
+                    scroll_down(0, 1);
+                } else {
+                    row--;
+                }
+                pending_wrap = false;
+                break;
+            case 'c':
+                *this = TerminalModel{width, height, attributes};
+                break;
+            default:
+                break;
+        }
+    }
+
+    void TerminalModel::csi(std::string_view parameters, char final_character) {
+        if(!parameters.empty() && (parameters.front() < '0' || parameters.front() > ';')) {
+            // Private sequences like cursor visibility don't change what is on screen
+            return;
+        }
+        auto first = parameter(parameters, 0, 1);
+        switch(final_character) {
+            case 'A':
+                move_to(column, row - first);
+                break;
+            case 'B':
+            case 'e':
+                move_to(column, row + first);
+                break;
+            case 'C':
+            case 'a':
+                move_to(column + first, row);
+                break;
+            case 'D':
+                move_to(column - first, row);
+                break;
+            case 'E':
+                move_to(0, row + first);
+                break;
+            case 'F':
+                move_to(0, row - first);
+                break;
+            case 'G':
+            case '`':
+                move_to(first - 1, row);
+                break;
+            case 'd':
+                move_to(column, first - 1);
+                break;
+            case 'H':
+            case 'f':
+                move_to(parameter(parameters, 1, 1) - 1, first - 1);
+                break;
+            case 'J': {
+                auto mode = parameter(parameters, 0, 0);
+                if(mode == 0) {
+                    erase(column, row, width - 1, height - 1);
+                } else if(mode == 1) {
+                    erase(0, 0, column, row);
+                } else {
+                    erase(0, 0, width - 1, height - 1);
+                }
+                break;
+            }
+            case 'K': {
+                auto mode = parameter(parameters, 0, 0);
+                if(mode == 0) {
+                    erase(column, row, width - 1, row);
+                } else if(mode == 1) {
+                    erase(0, row, column, row);
+                } else {
+                    erase(0, row, width - 1, row);
+                }
+                break;
+            }
+            case 'X':
+                erase(column, row, std::min(column + first, width) - 1, row);
+                break;
+            case 'P': {
+                auto count = std::min(first, width - column);
+                auto line = cells.begin() + row * width;
+                std::move(line + column + count, line + width, line + column);
+                erase(width - count, row, width - 1, row);
+                break;
+            }
+            case '@': {
+                auto count = std::min(first, width - column);
+                auto line = cells.begin() + row * width;
+                std::move_backward(line + column, line + width - count, line + width);
+                erase(column, row, column + count - 1, row);
+                break;
+            }
+            case 'L':
+                scroll_down(row, first);
+                break;
+            case 'M':
+                scroll_up(row, first);
+                break;
+            case 'S':
+                scroll_up(0, first);
+                break;
+            case 'T':
+                scroll_down(0, first);
+                break;
+            case 'm':
+                sgr(parameters);
+                break;
+            case 's':
+                saved_column = column;
+                saved_row = row;
+                break;
+            case 'u':
+                move_to(saved_column, saved_row);
+                break;
+            default:
+                break;
+        }
+    }
+
+    void TerminalModel::osc(std::string_view parameters) {
+        // Hyperlinks are the only OSC that belongs to the cells, titles and the like are ignored
+        if(parameters.substr(0, 2) == "8;") {
+            attribute = attributes->apply_hyperlink(attribute, parameters.substr(2)).value_or(attribute);
+        }
+    }
+
+    void TerminalModel::sgr(std::string_view parameters) {
+        // Cells only hold ids, once the table is full new attributes are drawn as the last ones that fitted
+        attribute = attributes->apply_sgr(attribute, parameters).value_or(attribute);
+    }
+
+    void TerminalModel::line_feed() {
+        pending_wrap = false;
+        if(row == height - 1) {
+            scroll_up(0, 1);
+        } else {
+            row++;
+        }
+    }
+
+    void TerminalModel::scroll_up(int top, int count) {
+        count = std::min(count, height - top);
+        auto first = cells.begin() + top * width;
+        std::move(first + count * width, cells.end(), first);
+        erase(0, height - count, width - 1, height - 1);
+    }
+
+    void TerminalModel::scroll_down(int top, int count) {
+        count = std::min(count, height - top);
+        auto first = cells.begin() + top * width;
+        std::move_backward(first, cells.end() - count * width, cells.end());
+        erase(0, top, width - 1, top + count - 1);
+    }
+
+    void TerminalModel::erase(int from_column, int from_row, int to_column, int to_row) {
+        auto from = static_cast<std::ptrdiff_t>(from_row) * width + from_column;
+        auto to = static_cast<std::ptrdiff_t>(to_row) * width + to_column;
+        if(to >= from) {
+            std::fill(cells.begin() + from, cells.begin() + to + 1, Cell{});
+        }
+    }
+
+    void TerminalModel::move_to(int to_column, int to_row) {
+        column = std::clamp(to_column, 0, width - 1);
+        row = std::clamp(to_row, 0, height - 1);
+        pending_wrap = false;
+    }
+
+    void TerminalModel::resize(int new_width, int new_height) {
+        new_width = std::max(new_width, 1);
+        new_height = std::max(new_height, 1);
+        std::vector<Cell> resized(static_cast<size_t>(new_width) * static_cast<size_t>(new_height));
+        // Keep the bottom of the screen where the cursor is, like a terminal does when it gets shorter
+        auto dropped = std::max(row - (new_height - 1), 0);
+        for(int from_row = dropped; from_row < height && from_row - dropped < new_height; from_row++) {
+            for(int from_column = 0; from_column < std::min(width, new_width); from_column++) {
+                resized[static_cast<size_t>(from_row - dropped) * static_cast<size_t>(new_width) + static_cast<size_t>(from_column)] =
+                cell(from_column, from_row);
+            }
+        }
+        cells = std::move(resized);
+        width = new_width;
+        height = new_height;
+        move_to(column, row - dropped);
+    }
+
+    void TerminalModel::clear() {
+        std::fill(cells.begin(), cells.end(), Cell{});
+        column = 0;
+        row = 0;
+        pending_wrap = false;
+        saved_column = 0;
+        saved_row = 0;
+        attribute = DEFAULT_ATTRIBUTES;
+    }
+
+    auto TerminalModel::get_width() const -> int {
+        return width;
+    }
+    auto TerminalModel::get_height() const -> int {
+        return height;
+    }
+
+    auto TerminalModel::row_text(int at_row) const -> std::string {
+        std::string text;
+        for(int at_column = 0; at_column < width; at_column++) {
+            append_utf8(text, cell(at_column, at_row).character);
+        }
+        text.erase(text.find_last_not_of(' ') + 1);
+        return text;
+    }
+
+    auto TerminalModel::attribute_at(int at_column, int at_row) const -> std::string {
+        std::string text;
+        attributes->append_transition(text, DEFAULT_ATTRIBUTES, cell(at_column, at_row).attribute);
+        return text;
+    }
+
+    auto TerminalModel::render_row(int at_row) const -> std::string {
+        auto end = width;
+        while(end > 0 && cell(end - 1, at_row).character == U' ' && cell(end - 1, at_row).attribute == DEFAULT_ATTRIBUTES) {
+            end--;
+        }
+        std::string text;
+        auto current = DEFAULT_ATTRIBUTES;
+        for(int at_column = 0; at_column < end; at_column++) {
+            const auto& at = cell(at_column, at_row);
+            attributes->append_transition(text, current, at.attribute);
+            current = at.attribute;
+            append_utf8(text, at.character);
+        }
+        attributes->append_transition(text, current, DEFAULT_ATTRIBUTES);
+        return text;
+    }
+
+    auto TerminalModel::cursor() const -> std::pair<int, int> {
+        return {column, row};
+    }
+
+    auto TerminalModel::screen_hash() const -> uint64_t {
+        // Attribute ids depend on the order they were first seen, so the output that sets them is hashed instead
+        std::unordered_map<AttributeId, uint64_t> attribute_hashes;
+        auto attribute_hash = [&](AttributeId id) {
+            auto [found, added] = attribute_hashes.try_emplace(id, FNV_OFFSET);
+            if(added) {
+                std::string text;
+                attributes->append_transition(text, DEFAULT_ATTRIBUTES, id);
+                for(auto character : text) {
+                    hash_bytes(found->second, static_cast<unsigned char>(character), 1);
+                }
+            }
+            return found->second;
+        };
+        auto hash = FNV_OFFSET;
+        hash_bytes(hash, static_cast<uint64_t>(width), 4);
+        hash_bytes(hash, static_cast<uint64_t>(height), 4);
+        for(const auto& screen_cell : cells) {
+            hash_bytes(hash, screen_cell.character, 4);
+            hash_bytes(hash, attribute_hash(screen_cell.attribute), 8);
+        }
+        hash_bytes(hash, static_cast<uint64_t>(column), 4);
+        hash_bytes(hash, static_cast<uint64_t>(row), 4);
+        return hash;
+    }
+} // namespace omux
@@ -0,0 +1,96 @@
+#pragma once
+#include "omux/attribute_table.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace omux {
+    void append_utf8(std::string& text, char32_t character);
+
+    /**
+     * A headless screen that output can be written to instead of the host console, for replaying sessions
+     * and checking what ends up on screen. It understands the sequences omux and ConPTY write: cursor movement,
+     * erasing, inserting and deleting, scrolling, SGR attributes and hyperlinks. Anything else is parsed and ignored.
+     * Cells hold attribute ids from a table that can be shared with the rest of the session.
+     *
+     * Every code point takes one column.
+     */
+    class TerminalModel {
+        public:
+        TerminalModel(int width, int height);
+        TerminalModel(int width, int height, std::shared_ptr<AttributeTable> attributes);
+        /**
+         * Sequences and UTF-8 characters can be split across writes.
+         */
+        void write(std::string_view output);
+        void resize(int new_width, int new_height);
+        /**
+         * Blanks every cell and puts the cursor and attributes back to how they start.
+         */
+        void clear();
+        [[nodiscard]] auto get_width() const -> int;
+        [[nodiscard]] auto get_height() const -> int;
+        /**
+         * Text of a row with the trailing blanks removed, attributes aren't included.
+         */
+        [[nodiscard]] auto row_text(int row) const -> std::string;
+        /**
+         * Output that sets the attributes of a cell from the defaults, empty for the default attributes.
+         */
+        [[nodiscard]] auto attribute_at(int column, int row) const -> std::string;
+        /**
+         * A row as output that draws it from its first column with the default attributes, going from one cell's
+         * attributes to the next with only what changes. Trailing blanks are left out.
+         */
+        [[nodiscard]] auto render_row(int row) const -> std::string;
+        /**
+         * Zero based column and row.
+         */
+        [[nodiscard]] auto cursor() const -> std::pair<int, int>;
+        /**
+         * FNV-1a over every cell's character and attributes and the cursor position.
+         * Two screens that look the same hash the same, however they got there.
+         */
+        [[nodiscard]] auto screen_hash() const -> uint64_t;
+
+        private:
+        struct Cell {
+            char32_t character = U' ';
+            AttributeId attribute = DEFAULT_ATTRIBUTES;
+        };
+        enum class State { ground, escape, escape_intermediate, csi, osc, osc_escape };
+
+        int width;
+        int height;
+        std::vector<Cell> cells;
+        int column = 0;
+        int row = 0;
+        // Set when a character was written in the last column, the next one wraps first
+        bool pending_wrap = false;
+        int saved_column = 0;
+        int saved_row = 0;
+        AttributeId attribute = DEFAULT_ATTRIBUTES;
+        std::shared_ptr<AttributeTable> attributes;
+        State state = State::ground;
+        std::string sequence;
+        char32_t utf8_character = 0;
+        int utf8_remaining = 0;
+
+        auto cell(int at_column, int at_row) -> Cell&;
+        [[nodiscard]] auto cell(int at_column, int at_row) const -> const Cell&;
+        void put(char32_t character);
+        void control(char character);
+        void escape(char final_character);
+        void csi(std::string_view parameters, char final_character);
+        void osc(std::string_view parameters);
+        void sgr(std::string_view parameters);
+        void line_feed();
+        void scroll_up(int top, int count);
+        void scroll_down(int top, int count);
+        void erase(int from_column, int from_row, int to_column, int to_row);
+        void move_to(int to_column, int to_row);
+    };
+} // namespace omux
@@ -0,0 +1,370 @@
+#include "omux/unicode_width.hpp"
+#include "omux/terminal_model.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+
+namespace omux {
+    namespace {
+        struct Range {
+            char32_t first;
+            char32_t last;
+        };
+
+        /**
+         * East Asian Wide (W) and Fullwidth (F) from Unicode 15's EastAsianWidth.txt, emoji presentation included.
+         */
+        constexpr Range WIDE[] = {
+        {0x1100, 0x115f},   {0x231a, 0x231b},   {0x2329, 0x232a},   {0x23e9, 0x23ec},   {0x23f0, 0x23f0},   {0x23f3, 0x23f3},
+        {0x25fd, 0x25fe},   {0x2614, 0x2615},   {0x2648, 0x2653},   {0x267f, 0x267f},   {0x2693, 0x2693},   {0x26a1, 0x26a1},
+        {0x26aa, 0x26ab},   {0x26bd, 0x26be},   {0x26c4, 0x26c5},   {0x26ce, 0x26ce},   {0x26d4, 0x26d4},   {0x26ea, 0x26ea},
+        {0x26f2, 0x26f3},   {0x26f5, 0x26f5},   {0x26fa, 0x26fa},   {0x26fd, 0x26fd},   {0x2705, 0x2705},   {0x270a, 0x270b},
+        {0x2728, 0x2728},   {0x274c, 0x274c},   {0x274e, 0x274e},   {0x2753, 0x2755},   {0x2757, 0x2757},   {0x2795, 0x2797},
+        {0x27b0, 0x27b0},   {0x27bf, 0x27bf},   {0x2b1b, 0x2b1c},   {0x2b50, 0x2b50},   {0x2b55, 0x2b55},   {0x2e80, 0x2e99},
+        {0x2e9b, 0x2ef3},   {0x2f00, 0x2fd5},   {0x2ff0, 0x2ffb},   {0x3000, 0x303e},   {0x3041, 0x3096},   {0x3099, 0x30ff},
+        {0x3105, 0x312f},   {0x3131, 0x318e},   {0x3190, 0x31e3},   {0x31f0, 0x321e},   {0x3220, 0x3247},   {0x3250, 0x4dbf},
+        {0x4e00, 0xa48c},   {0xa490, 0xa4c6},   {0xa960, 0xa97c},   {0xac00, 0xd7a3},   {0xf900, 0xfaff},   {0xfe10, 0xfe19},
+        {0xfe30, 0xfe52},   {0xfe54, 0xfe66},   {0xfe68, 0xfe6b},   {0xff01, 0xff60},   {0xffe0, 0xffe6},   {0x16fe0, 0x16fe4},
+        {0x16ff0, 0x16ff1}, {0x17000, 0x187f7}, {0x18800, 0x18cd5}, {0x18d00, 0x18d08}, {0x1aff0, 0x1aff3}, {0x1aff5, 0x1affb},
+        {0x1affd, 0x1affe}, {0x1b000, 0x1b122}, {0x1b132, 0x1b132}, {0x1b150, 0x1b152}, {0x1b155, 0x1b155}, {0x1b164, 0x1b167},
+        {0x1b170, 0x1b2fb}, {0x1f004, 0x1f004}, {0x1f0cf, 0x1f0cf}, {0x1f18e, 0x1f18e}, {0x1f191, 0x1f19a}, {0x1f200, 0x1f202},
+        {0x1f210, 0x1f23b}, {0x1f240, 0x1f248}, {0x1f250, 0x1f251}, {0x1f260, 0x1f265}, {0x1f300, 0x1f320}, {0x1f32d, 0x1f335},
+        {0x1f337, 0x1f37c}, {0x1f37e, 0x1f393}, {0x1f3a0, 0x1f3ca}, {0x1f3cf, 0x1f3d3}, {0x1f3e0, 0x1f3f0}, {0x1f3f4, 0x1f3f4},
+        {0x1f3f8, 0x1f43e}, {0x1f440, 0x1f440}, {0x1f442, 0x1f4fc}, {0x1f4ff, 0x1f53d}, {0x1f54b, 0x1f54e}, {0x1f550, 0x1f567},
+        {0x1f57a, 0x1f57a}, {0x1f595, 0x1f596}, {0x1f5a4, 0x1f5a4}, {0x1f5fb, 0x1f64f}, {0x1f680, 0x1f6c5}, {0x1f6cc, 0x1f6cc},
+        {0x1f6d0, 0x1f6d2}, {0x1f6d5, 0x1f6d7}, {0x1f6dc, 0x1f6df}, {0x1f6eb, 0x1f6ec}, {0x1f6f4, 0x1f6fc}, {0x1f7e0, 0x1f7eb},
+        {0x1f7f0, 0x1f7f0}, {0x1f90c, 0x1f93a}, {0x1f93c, 0x1f945}, {0x1f947, 0x1f9ff}, {0x1fa70, 0x1fa7c}, {0x1fa80, 0x1fa88},
+        {0x1fa90, 0x1fabd}, {0x1fabf, 0x1fac5}, {0x1face, 0x1fadb}, {0x1fae0, 0x1fae8}, {0x1faf0, 0x1faf8}, {0x20000, 0x2fffd},
+        {0x30000, 0x3fffd},
+        };
+
+        /**
+         * Nonspacing and enclosing marks, format characters and the Hangul medial vowels and final consonants,
+         * which all draw over or join onto the character before.
+         */
+        constexpr Range ZERO_WIDTH[] = {
+        {0x0300, 0x036f},   {0x0483, 0x0489},   {0x0591, 0x05bd},   {0x05bf, 0x05bf},   {0x05c1, 0x05c2},   {0x05c4, 0x05c5},
+        {0x05c7, 0x05c7},   {0x0610, 0x061a},   {0x064b, 0x065f},   {0x0670, 0x0670},   {0x06d6, 0x06dc},   {0x06df, 0x06e4},
+        {0x06e7, 0x06e8},   {0x06ea, 0x06ed},   {0x0711, 0x0711},   {0x0730, 0x074a},   {0x07a6, 0x07b0},   {0x07eb, 0x07f3},
+        {0x0816, 0x0819},   {0x081b, 0x0823},   {0x0825, 0x0827},   {0x0829, 0x082d},   {0x0859, 0x085b},   {0x08d3, 0x08e1},
+        {0x08e3, 0x0902},   {0x093a, 0x093a},   {0x093c, 0x093c},   {0x0941, 0x0948},   {0x094d, 0x094d},   {0x0951, 0x0957},
+        {0x0962, 0x0963},   {0x0981, 0x0981},   {0x09bc, 0x09bc},   {0x09c1, 0x09c4},   {0x09cd, 0x09cd},   {0x09e2, 0x09e3},
+        {0x0a01, 0x0a02},   {0x0a3c, 0x0a3c},   {0x0a41, 0x0a42},   {0x0a47, 0x0a48},   {0x0a4b, 0x0a4d},   {0x0a70, 0x0a71},
+        {0x0a81, 0x0a82},   {0x0abc, 0x0abc},   {0x0ac1, 0x0ac5},   {0x0ac7, 0x0ac8},   {0x0acd, 0x0acd},   {0x0b01, 0x0b01},
+        {0x0b3c, 0x0b3c},   {0x0b3f, 0x0b3f},   {0x0b41, 0x0b44},   {0x0b4d, 0x0b4d},   {0x0b82, 0x0b82},   {0x0bc0, 0x0bc0},
+        {0x0bcd, 0x0bcd},   {0x0c3e, 0x0c40},   {0x0c46, 0x0c48},   {0x0c4a, 0x0c4d},   {0x0cbc, 0x0cbc},   {0x0ccc, 0x0ccd},
+        {0x0d41, 0x0d44},   {0x0d4d, 0x0d4d},   {0x0dca, 0x0dca},   {0x0dd2, 0x0dd4},   {0x0dd6, 0x0dd6},   {0x0e31, 0x0e31},
+        {0x0e34, 0x0e3a},   {0x0e47, 0x0e4e},   {0x0eb1, 0x0eb1},   {0x0eb4, 0x0ebc},   {0x0ec8, 0x0ecd},   {0x0f18, 0x0f19},
+        {0x0f35, 0x0f35},   {0x0f37, 0x0f37},   {0x0f39, 0x0f39},   {0x0f71, 0x0f7e},   {0x0f80, 0x0f84},   {0x0f86, 0x0f87},
+        {0x0f8d, 0x0fbc},   {0x0fc6, 0x0fc6},   {0x102d, 0x1030},   {0x1032, 0x1037},   {0x1039, 0x103a},   {0x103d, 0x103e},
+        {0x1058, 0x1059},   {0x105e, 0x1060},   {0x1071, 0x1074},   {0x1082, 0x1082},   {0x1085, 0x1086},   {0x108d, 0x108d},
+        {0x109d, 0x109d},   {0x1160, 0x11ff},   {0x135d, 0x135f},   {0x1712, 0x1714},   {0x1732, 0x1734},   {0x1752, 0x1753},
+        {0x1772, 0x1773},   {0x17b4, 0x17b5},   {0x17b7, 0x17bd},   {0x17c6, 0x17c6},   {0x17c9, 0x17d3},   {0x17dd, 0x17dd},
+        {0x180b, 0x180f},   {0x18a9, 0x18a9},   {0x1920, 0x1922},   {0x1927, 0x1928},   {0x1932, 0x1932},   {0x1939, 0x193b},
+        {0x1a17, 0x1a18},   {0x1ab0, 0x1aff},   {0x1b00, 0x1b03},   {0x1b34, 0x1b34},   {0x1b36, 0x1b3a},   {0x1b3c, 0x1b3c},
+        {0x1b42, 0x1b42},   {0x1b6b, 0x1b73},   {0x1dc0, 0x1dff},   {0x200b, 0x200f},   {0x202a, 0x202e},   {0x2060, 0x2064},
+        {0x20d0, 0x20f0},   {0x2cef, 0x2cf1},   {0x2de0, 0x2dff},   {0x302a, 0x302d},   {0x3099, 0x309a},   {0xa66f, 0xa672},
+        {0xa674, 0xa67d},   {0xa69e, 0xa69f},   {0xa6f0, 0xa6f1},   {0xa802, 0xa802},   {0xa806, 0xa806},   {0xa80b, 0xa80b},
+        {0xa825, 0xa826},   {0xa8c4, 0xa8c5},   {0xa8e0, 0xa8f1},   {0xa926, 0xa92d},   {0xa947, 0xa951},   {0xa980, 0xa982},
+        {0xa9b3, 0xa9b3},   {0xa9b6, 0xa9b9},   {0xa9bc, 0xa9bd},   {0xaab0, 0xaab0},   {0xaab2, 0xaab4},   {0xaab7, 0xaab8},
+        {0xaabe, 0xaabf},   {0xaac1, 0xaac1},   {0xabe5, 0xabe5},   {0xabe8, 0xabe8},   {0xabed, 0xabed},   {0xd7b0, 0xd7ff},
+        {0xfb1e, 0xfb1e},   {0xfe00, 0xfe0f},   {0xfe20, 0xfe2f},   {0xfeff, 0xfeff},   {0x101fd, 0x101fd}, {0x10a01, 0x10a0f},
+        {0x10a38, 0x10a3f}, {0x11001, 0x11001}, {0x11038, 0x11046}, {0x1107f, 0x11081}, {0x110b3, 0x110b6}, {0x110b9, 0x110ba},
+        {0x1d167, 0x1d169}, {0x1d173, 0x1d182}, {0x1d185, 0x1d18b}, {0x1d1aa, 0x1d1ad}, {0x1d242, 0x1d244}, {0x1e8d0, 0x1e8d6},
+        {0x1e944, 0x1e94a}, {0xe0001, 0xe0001}, {0xe0020, 0xe007f}, {0xe0100, 0xe01ef},
+        };
+
+        constexpr char32_t CODE_POINTS = 0x110000;
+        constexpr char32_t BLOCK_SIZE = 256;
+        constexpr size_t BLOCKS = CODE_POINTS / BLOCK_SIZE;
+        // Widths are 0, 1 or 2, so four fit in a byte
+        constexpr size_t BLOCK_BYTES = BLOCK_SIZE / 4;
+        // Far more than the tables need, the unused blocks are dropped once they are built
+        constexpr size_t MAX_UNIQUE_BLOCKS = 256;
+        using Block = std::array<uint8_t, BLOCK_BYTES>;
+
+        /**
+         * Index of the first range that ends at or after character.
+         */
+        template <size_t N> constexpr auto first_range_from(const Range (&ranges)[N], char32_t character) -> size_t {
+            size_t low = 0;
+            size_t high = N;
+            while(low < high) {
+                auto middle = (low + high) / 2;
+                if(ranges[middle].last < character) {
+                    low = middle + 1;
+                } else {
+                    high = middle;
+                }
+            }
+            return low;
+        }
+
+        constexpr void set_width(Block& block, char32_t offset, uint8_t width) {
+            auto shift = offset % 4 * 2;
+            block[offset / 4] = static_cast<uint8_t>((block[offset / 4] & ~(0x3 << shift)) | width << shift);
+        }
+
+        constexpr auto uniform_block(uint8_t width) -> Block {
+            Block block{};
+            for(auto& packed : block) {
+                packed = static_cast<uint8_t>(width | width << 2 | width << 4 | width << 6);
+            }
+            return block;
+        }
+
+        /**
+         * Sets the width of every code point in the block that falls in one of the ranges.
+         */
+        template <size_t N> constexpr void paint(Block& block, char32_t first, const Range (&ranges)[N], uint8_t width) {
+            auto last = static_cast<char32_t>(first + BLOCK_SIZE - 1);
+            for(auto range = first_range_from(ranges, first); range < N && ranges[range].first <= last; range++) {
+                // The big CJK ranges cover whole blocks, filling those a code point at a time is too slow to compile
+                if(ranges[range].first <= first && ranges[range].last >= last) {
+                    block = uniform_block(width);
+                    return;
+                }
+                auto from = std::max(ranges[range].first, first);
+                auto to = std::min(ranges[range].last, last);
+                for(auto character = from; character <= to; character++) {
+                    set_width(block, character - first, width);
+                }
+            }
+        }
+
+        template <size_t N> constexpr auto touches(const Range (&ranges)[N], char32_t first, char32_t last) -> bool {
+            auto range = first_range_from(ranges, first);
+            return range < N && ranges[range].first <= last;
+        }
+
+        template <size_t N> constexpr auto covers(const Range (&ranges)[N], char32_t first, char32_t last) -> bool {
+            auto range = first_range_from(ranges, first);
+            return range < N && ranges[range].first <= first && ranges[range].last >= last;
+        }
+
+        /**
+         * The width every code point in the block has, if they all have the same one.
+         */
+        constexpr auto uniform_width(size_t index) -> std::optional<uint8_t> {
+            auto first = static_cast<char32_t>(index) * BLOCK_SIZE;
+            auto last = static_cast<char32_t>(first + BLOCK_SIZE - 1);
+            if(index == 0 || touches(ZERO_WIDTH, first, last)) {
+                return std::nullopt;
+            }
+            if(!touches(WIDE, first, last)) {
+                return 1;
+            }
+            if(covers(WIDE, first, last)) {
+                return 2;
+            }
+            return std::nullopt;
+        }
+
+        /**
+         * Painted in order of precedence, a zero width mark inside a wide range is still zero width.
+         */
+        constexpr auto make_block(size_t index) -> Block {
+            auto first = static_cast<char32_t>(index) * BLOCK_SIZE;
+            auto block = uniform_block(1);
+            paint(block, first, WIDE, 2);
+            paint(block, first, ZERO_WIDTH, 0);
+            if(index == 0) {
+                // C0 controls, delete and the C1 controls don't take a column
+                for(char32_t character = 0; character < 0xa0; character++) {
+                    if(character < 0x20 || character >= 0x7f) {
+                        set_width(block, character, 0);
+                    }
+                }
+            }
+            return block;
+        }
+
+        struct BuiltTables {
+            std::array<uint8_t, BLOCKS> block_of{};
+            std::array<Block, MAX_UNIQUE_BLOCKS> blocks{};
+            size_t unique = 0;
+        };
+
+        /**
+         * Splits the code points into blocks and keeps one copy of each distinct block.
+         * Nearly every block is all one width, those are spotted from the ranges without being built or compared.
+         */
+        constexpr auto build_tables() -> BuiltTables {
+            BuiltTables built;
+            std::array<std::optional<size_t>, 3> uniform_blocks{};
+            auto add = [&](const Block& block) {
+                built.blocks[built.unique] = block;
+                return built.unique++;
+            };
+            for(size_t index = 0; index < BLOCKS; index++) {
+                size_t found = 0;
+                if(auto width = uniform_width(index)) {
+                    auto& uniform = uniform_blocks[*width];
+                    if(!uniform) {
+                        uniform = add(uniform_block(*width));
+                    }
+                    found = *uniform;
+                } else {
+                    auto block = make_block(index);
+                    while(found < built.unique && built.blocks[found] != block) {
+                        found++;
+                    }
+                    if(found == built.unique) {
+                        add(block);
+                    }
+                }
+                built.block_of[index] = static_cast<uint8_t>(found);
+            }
+            return built;
+        }
+
+        constexpr auto BUILT = build_tables();
+        static_assert(BUILT.unique <= MAX_UNIQUE_BLOCKS, "More distinct width blocks than a byte can index");
+
+        template <size_t N> struct WidthTables {
+            std::array<uint8_t, BLOCKS> block_of;
+            std::array<Block, N> blocks;
+        };
+
+        template <size_t N> constexpr auto compact(const BuiltTables& built) -> WidthTables<N> {
+            WidthTables<N> tables{built.block_of, {}};
+            std::copy_n(built.blocks.begin(), N, tables.blocks.begin());
+            return tables;
+        }
+
+        // Only the blocks in use end up in the binary, a few kilobytes for all of Unicode
+        constexpr auto TABLES = compact<BUILT.unique>(BUILT);
+
+        constexpr auto table_width(char32_t character) -> int {
+            if(character >= CODE_POINTS) {
+                return 1;
+            }
+            const auto& block = TABLES.blocks[TABLES.block_of[character / BLOCK_SIZE]];
+            auto offset = character % BLOCK_SIZE;
+            return block[offset / 4] >> (offset % 4 * 2) & 0x3;
+        }
+
+        static_assert(table_width(U'a') == 1);
+        static_assert(table_width(U'é') == 1);
+        static_assert(table_width(U'́') == 0);
+        static_assert(table_width(U'中') == 2);
+        static_assert(table_width(U'가') == 2);
+        static_assert(table_width(U'\U0001f600') == 2);
+        static_assert(table_width(U'─') == 1);
+    } // namespace
+
+    auto codepoint_width(char32_t character) -> int {
+        // Printable ASCII is nearly everything a shell writes
+        if(character >= 0x20 && character < 0x7f) {
+            return 1;
+        }
+        return table_width(character);
+    }
+
+    auto decode_utf8(std::string_view text, size_t position) -> std::pair<char32_t, size_t> {
+        auto lead = static_cast<unsigned char>(text[position]);
+        if(lead < 0x80) {
+            return {lead, 1};
+        }
+        size_t length = 0;
+        char32_t character = 0;
+        if((lead & 0xe0) == 0xc0) {
+            length = 2;
+            character = lead & 0x1f;
+        } else if((lead & 0xf0) == 0xe0) {
+            length = 3;
+            character = lead & 0x0f;
+        } else if((lead & 0xf8) == 0xf0) {
+            length = 4;
+            character = lead & 0x07;
+        } else {
+            return {U'�', 1};
+        }
+        if(position + length > text.size()) {
+            return {U'�', 1};
+        }
+        for(size_t i = 1; i < length; i++) {
+            auto byte = static_cast<unsigned char>(text[position + i]);
+            if((byte & 0xc0) != 0x80) {
+                return {U'�', 1};
+            }
+            character = character << 6 | (byte & 0x3f);
+        }
+        return {character, length};
+    }
+
+    auto text_columns(std::string_view text) -> size_t {
+        size_t columns = 0;
+        size_t position = 0;
+        while(position < text.size()) {
+            auto byte = static_cast<unsigned char>(text[position]);
+            if(byte < 0x80) {
+                columns += byte >= 0x20 && byte < 0x7f ? 1 : 0;
+                position++;
+                continue;
+            }
+            auto [character, length] = decode_utf8(text, position);
+            columns += static_cast<size_t>(codepoint_width(character));
+            position += length;
+        }
+        return columns;
+    }
+
+    auto column_offset(std::string_view text, size_t column) -> std::pair<size_t, size_t> {
+        size_t columns = 0;
+        size_t position = 0;
+        while(position < text.size()) {
+            auto [character, length] = decode_utf8(text, position);
+            auto width = static_cast<size_t>(codepoint_width(character));
+            // Marks that join onto the last character before the column stay with it
+            if(columns + width > column || (columns == column && width > 0)) {
+                return {position, column - columns};
+            }
+            columns += width;
+            position += length;
+        }
+        return {position, column - columns};
+    }
+
+    auto Utf8Decoder::feed(char byte) -> std::optional<char32_t> {
+        auto value = static_cast<unsigned char>(byte);
+        if(remaining > 0 && (value & 0xc0) == 0x80) {
+            character.push_back(byte);
+            partial = partial << 6 | (value & 0x3f);
+            if(--remaining > 0) {
+                return std::nullopt;
+            }
+            return partial;
+        }
+        // Anything else cuts a character short, which is dropped
+        remaining = 0;
+        character.clear();
+        if(value < 0x80) {
+            character.push_back(byte);
+            return value;
+        }
+        if((value & 0xe0) == 0xc0) {
+            partial = value & 0x1f;
+            remaining = 1;
+        } else if((value & 0xf0) == 0xe0) {
+            partial = value & 0x0f;
+            remaining = 2;
+        } else if((value & 0xf8) == 0xf0) {
+            partial = value & 0x07;
+            remaining = 3;
+        } else {
+            append_utf8(character, U'�');
+            return U'�';
+        }
+        character.push_back(byte);
+        return std::nullopt;
+    }
+
+    auto Utf8Decoder::in_sequence() const -> bool {
+        return remaining > 0;
+    }
+
+    auto Utf8Decoder::bytes() const -> std::string_view {
+        return character;
+    }
+} // namespace omux
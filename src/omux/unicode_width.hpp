@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace omux {
+    /**
+     * Columns a code point takes on screen: 2 for East Asian wide and fullwidth characters and most emoji,
+     * 0 for combining marks, format characters and controls, 1 for everything else.
+     * Looked up in two level tables generated at compile time.
+     */
+    auto codepoint_width(char32_t character) -> int;
+    /**
+     * The code point starting at position and how many bytes it takes. Malformed UTF-8 is U+FFFD one byte at a time.
+     */
+    auto decode_utf8(std::string_view text, size_t position) -> std::pair<char32_t, size_t>;
+    /**
+     * Columns text takes, control characters take none. Control sequences are counted as text, strip them first.
+     */
+    auto text_columns(std::string_view text) -> size_t;
+    /**
+     * Byte offset of the character at a column in text, a wide character the column falls inside counts as at it.
+     * @return the offset, and how many columns short of column the text before it is.
+     * That is when the column is inside a wide character or text isn't wide enough.
+     */
+    auto column_offset(std::string_view text, size_t column) -> std::pair<size_t, size_t>;
+
+    /**
+     * Decodes UTF-8 a byte at a time, so characters split between reads come out whole.
+     */
+    class Utf8Decoder {
+        public:
+        /**
+         * @return the code point byte finishes, nothing while there is more of it to come.
+         * A character cut short by another is dropped, a stray continuation byte comes out as U+FFFD.
+         */
+        auto feed(char byte) -> std::optional<char32_t>;
+        /**
+         * Part of a character has been fed.
+         */
+        [[nodiscard]] auto in_sequence() const -> bool;
+        /**
+         * The UTF-8 of the last code point feed returned.
+         */
+        [[nodiscard]] auto bytes() const -> std::string_view;
+
+        private:
+        std::string character;
+        char32_t partial = 0;
+        int remaining = 0;
+    };
+} // namespace omux
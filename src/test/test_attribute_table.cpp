@@ -0,0 +1,85 @@
+#include "catch.hpp"
+#include "omux/attribute_table.hpp"
+#include <limits>
+#include <string>
+
+using namespace omux;
+
+namespace {
+    auto transition(AttributeTable& table, AttributeId from, AttributeId to) -> std::string {
+        std::string output;
+        table.append_transition(output, from, to);
+        return output;
+    }
+} // namespace
+
+TEST_CASE("Attribute table") {
+    AttributeTable table;
+
+    SECTION("SGR is read into what it sets") {
+        CellAttributes attributes;
+        attributes.apply_sgr("1;97;48;5;236;58:2::255:0:128;4:3");
+
+        REQUIRE(attributes.flags == CellAttributes::bold);
+        REQUIRE(attributes.foreground == (CellAttributes::COLOR_PALETTE | 15));
+        REQUIRE(attributes.background == (CellAttributes::COLOR_PALETTE | 236));
+        REQUIRE(attributes.underline_color == (CellAttributes::COLOR_RGB | 0xff0080));
+        REQUIRE(attributes.underline == 3);
+
+        attributes.apply_sgr("22;39;38;2;1;2;3;24");
+        REQUIRE(attributes.flags == 0);
+        REQUIRE(attributes.foreground == (CellAttributes::COLOR_RGB | 0x010203));
+        REQUIRE(attributes.underline == 0);
+
+        attributes.apply_sgr("");
+        REQUIRE(attributes == CellAttributes{});
+    }
+    SECTION("Sequences that set the same attributes get the same id") {
+        auto split = table.apply_sgr(*table.apply_sgr(DEFAULT_ATTRIBUTES, "1"), "31");
+        auto combined = table.apply_sgr(DEFAULT_ATTRIBUTES, "31;1");
+
+        REQUIRE(split == combined);
+        REQUIRE(table.apply_sgr(*combined, "0") == DEFAULT_ATTRIBUTES);
+        REQUIRE(table.size() == 3);
+    }
+    SECTION("Transitions are the shortest output between two ids") {
+        auto red = *table.apply_sgr(DEFAULT_ATTRIBUTES, "31");
+        auto bold_red = *table.apply_sgr(red, "1");
+        auto dim_red = *table.apply_sgr(bold_red, "22;2");
+        auto busy = *table.apply_sgr(DEFAULT_ATTRIBUTES, "1;3;4;7;31;44");
+        auto blue = *table.apply_sgr(DEFAULT_ATTRIBUTES, "34");
+
+        REQUIRE(transition(table, red, red).empty());
+        REQUIRE(transition(table, DEFAULT_ATTRIBUTES, bold_red) == "\x1b[1;31m");
+        REQUIRE(transition(table, bold_red, red) == "\x1b[22m");
+        // Bold's off code turns off dim too
+        REQUIRE(transition(table, bold_red, dim_red) == "\x1b[22;2m");
+        REQUIRE(transition(table, red, DEFAULT_ATTRIBUTES) == "\x1b[m");
+        REQUIRE(transition(table, busy, blue) == "\x1b[0;34m");
+        // Remembered transitions come out the same
+        REQUIRE(transition(table, busy, blue) == "\x1b[0;34m");
+    }
+    SECTION("Hyperlinks are part of the attributes") {
+        auto linked = *table.apply_hyperlink(DEFAULT_ATTRIBUTES, ";https://omux");
+        auto bold_linked = *table.apply_sgr(linked, "1");
+
+        REQUIRE(table.get(linked).hyperlink != 0);
+        REQUIRE(table.apply_sgr(bold_linked, "0") == linked);
+        REQUIRE(table.apply_hyperlink(bold_linked, ";") == table.apply_sgr(DEFAULT_ATTRIBUTES, "1"));
+        REQUIRE(transition(table, DEFAULT_ATTRIBUTES, bold_linked) == "\x1b[1m\x1b]8;;https://omux\x1b\\");
+        REQUIRE(transition(table, linked, DEFAULT_ATTRIBUTES) == "\x1b]8;;\x1b\\");
+    }
+    SECTION("Once every id is taken only attributes that already have one can be applied") {
+        auto last = DEFAULT_ATTRIBUTES;
+        for(int color = 0; table.size() <= std::numeric_limits<AttributeId>::max(); color++) {
+            last = *table.apply_sgr(DEFAULT_ATTRIBUTES, "38;2;" + std::to_string(color >> 16) + ";" +
+                                                      std::to_string(color >> 8 & 0xff) + ";" + std::to_string(color & 0xff));
+        }
+
+        REQUIRE_FALSE(table.apply_sgr(last, "1"));
+        REQUIRE_FALSE(table.apply_hyperlink(last, ";https://omux"));
+        REQUIRE_FALSE(table.intern(CellAttributes{.flags = CellAttributes::italic}));
+        REQUIRE(table.apply_sgr(last, "0") == DEFAULT_ATTRIBUTES);
+        REQUIRE(table.apply_sgr(DEFAULT_ATTRIBUTES, "38;2;0;0;5") != std::nullopt);
+    }
+}
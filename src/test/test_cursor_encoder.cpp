@@ -0,0 +1,177 @@
+#include "catch.hpp"
+#include "omux/cursor_encoder.hpp"
+#include "omux/terminal_model.hpp"
+#include <optional>
+#include <random>
+#include <string>
+
+using namespace omux;
+
+namespace {
+    auto cup(int column, int row) -> std::string {
+        return "\x1b[" + std::to_string(row) + ";" + std::to_string(column) + "H";
+    }
+
+    /**
+     * Puts a model's cursor at column and row, one based, and the encoder's as well with what it is told.
+     */
+    void place(TerminalModel& model, CursorEncoder& encoder, int column, int row) {
+        model.write(cup(column, row));
+        encoder.wrote(cup(column, row));
+    }
+} // namespace
+
+TEST_CASE("Cursor encoder") {
+    SECTION("Nothing is written to stay where the cursor is") {
+        CursorEncoder encoder;
+        encoder.set_screen_size(80, 24);
+        encoder.wrote("\x1b[5;10H");
+        REQUIRE(encoder.movement_to(10, 5).empty());
+        REQUIRE(encoder.movement_to(10, std::nullopt).empty());
+    }
+    SECTION("The cheapest movement is picked") {
+        CursorEncoder encoder;
+        encoder.set_screen_size(80, 24);
+        encoder.wrote("\x1b[5;10H");
+        REQUIRE(encoder.movement_to(1, std::nullopt) == "\r");
+        REQUIRE(encoder.movement_to(11, std::nullopt) == "\x1b[C");
+        REQUIRE(encoder.movement_to(3, std::nullopt) == "\x1b[7D");
+        REQUIRE(encoder.movement_to(10, 6) == "\n");
+        REQUIRE(encoder.movement_to(1, 6) == "\n\r");
+        REQUIRE(encoder.movement_to(10, 4) == "\x1b[A");
+        REQUIRE(encoder.movement_to(1, 1) == "\x1b[H");
+        REQUIRE(encoder.movement_to(40, 20) == "\x1b[20;40H");
+    }
+    SECTION("Only absolute movement is used for what isn't known") {
+        CursorEncoder encoder;
+        encoder.set_screen_size(80, 24);
+        REQUIRE(encoder.movement_to(1, std::nullopt) == "\r");
+        REQUIRE(encoder.movement_to(41, std::nullopt) == "\x1b[41G");
+        REQUIRE(encoder.movement_to(41, 3) == "\x1b[3;41H");
+        encoder.wrote("\x1b[7d");
+        REQUIRE(encoder.movement_to(41, 8) == "\n\x1b[41G");
+    }
+    SECTION("Text moves the cursor and wraps past the right edge") {
+        CursorEncoder encoder;
+        encoder.set_screen_size(10, 5);
+        encoder.wrote("\x1b[1;1Hhello");
+        REQUIRE(encoder.get_state().column == 6);
+        encoder.wrote("world");
+        REQUIRE(encoder.get_state().column == 10);
+        REQUIRE(encoder.get_state().pending_wrap);
+        // Moving to where the cursor is still clears the pending wrap
+        auto movement = encoder.movement_to(10, 1);
+        REQUIRE_FALSE(movement.empty());
+        encoder.wrote(movement);
+        encoder.wrote("!");
+        REQUIRE(encoder.get_state().row == 1);
+        encoder.wrote("!");
+        REQUIRE(encoder.get_state().column == 2);
+        REQUIRE(encoder.get_state().row == 2);
+    }
+    SECTION("Without auto wrap text stops in the last column") {
+        CursorEncoder encoder;
+        encoder.set_screen_size(10, 5);
+        encoder.set_auto_wrap(false);
+        encoder.wrote("\x1b[2;8Hhello");
+        REQUIRE(encoder.get_state().column == 10);
+        REQUIRE(encoder.get_state().row == 2);
+        REQUIRE_FALSE(encoder.get_state().pending_wrap);
+        REQUIRE(encoder.movement_to(10, 2).empty());
+        encoder.wrote("中");
+        REQUIRE(encoder.get_state().row == 2);
+        encoder.wrote("\x1b[?7h\x1b[2;10Hab");
+        REQUIRE(encoder.get_state().row == 3);
+    }
+    SECTION("Sequences split between writes are followed") {
+        CursorEncoder encoder;
+        encoder.set_screen_size(80, 24);
+        encoder.wrote("\x1b[1");
+        encoder.wrote("2;3");
+        REQUIRE_FALSE(encoder.get_state().row.has_value());
+        encoder.wrote("H\x1b]0;title\x07\x1b[31m");
+        REQUIRE(encoder.get_state().column == 3);
+        REQUIRE(encoder.get_state().row == 12);
+    }
+    SECTION("Output that can't be followed is forgotten") {
+        CursorEncoder encoder;
+        encoder.set_screen_size(80, 24);
+        encoder.wrote("\x1b[5;10H中");
+        REQUIRE_FALSE(encoder.get_state().column.has_value());
+        REQUIRE(encoder.get_state().row == 5);
+        encoder.wrote("\x1b[5;79H中");
+        REQUIRE_FALSE(encoder.get_state().row.has_value());
+        encoder.wrote("\x1b[5;10H\x1b" "8");
+        REQUIRE_FALSE(encoder.get_state().column.has_value());
+        encoder.wrote("\x1b[5;10H\x1b[?25l\x1b[?2026h");
+        REQUIRE(encoder.get_state().column == 10);
+        encoder.wrote("\x1b[>0q\x1b[?2026$p\x1b[>c\x1b[c");
+        REQUIRE(encoder.get_state().column == 10);
+        encoder.wrote("\x1b[?6h");
+        REQUIRE_FALSE(encoder.get_state().row.has_value());
+    }
+    SECTION("A reported column at the right edge isn't trusted") {
+        CursorEncoder encoder;
+        encoder.set_screen_size(80, 24);
+        encoder.reported(80, 3);
+        REQUIRE_FALSE(encoder.get_state().column.has_value());
+        REQUIRE(encoder.get_state().row == 3);
+        encoder.reported(12, 3);
+        REQUIRE(encoder.get_state().column == 12);
+    }
+    SECTION("Movements end where they were asked to on a reference terminal") {
+        std::mt19937 random{20261019};
+        for(int run = 0; run < 4000; run++) {
+            auto width = std::uniform_int_distribution<int>{1, 200}(random);
+            auto height = std::uniform_int_distribution<int>{1, 60}(random);
+            auto column = std::uniform_int_distribution<int>{1, width};
+            auto row = std::uniform_int_distribution<int>{1, height};
+            TerminalModel model{width, height};
+            CursorEncoder encoder;
+            encoder.set_screen_size(width, height);
+            auto from_column = column(random);
+            auto from_row = row(random);
+            place(model, encoder, from_column, from_row);
+            // Some of the time what the cursor has been through leaves part of it unknown or a wrap pending
+            switch(run % 5) {
+                case 1:
+                    model.write(std::string(static_cast<size_t>(width - from_column + 1), 'x'));
+                    encoder.wrote(std::string(static_cast<size_t>(width - from_column + 1), 'x'));
+                    break;
+                case 2:
+                    encoder.forget();
+                    break;
+                case 3:
+                    encoder.wrote("\x1b[" + std::to_string(from_row) + "d\x1b" "8");
+                    encoder.wrote("\x1b[" + std::to_string(from_row) + "d");
+                    break;
+                case 4:
+                    encoder.forget();
+                    encoder.wrote("\r");
+                    model.write("\r");
+                    break;
+                default:
+                    break;
+            }
+            auto to_column = column(random);
+            std::optional<int> to_row;
+            if(random() % 4 != 0) {
+                to_row = row(random);
+            }
+            auto movement = encoder.movement_to(to_column, to_row);
+            auto [model_column, model_row] = model.cursor();
+            auto expected_row = to_row.value_or(model_row + 1);
+            model.write(movement);
+            encoder.wrote(movement);
+            INFO("from " << from_column << "," << from_row << " to " << to_column << "," << expected_row << " on " << width << "x"
+                         << height << " in run " << run);
+            REQUIRE(model.cursor() == std::pair<int, int>{to_column - 1, expected_row - 1});
+            REQUIRE(movement.size() <= cup(to_column, expected_row).size());
+            // Writing the movement leaves the encoder knowing the cursor is there
+            REQUIRE(encoder.movement_to(to_column, to_row).empty());
+            // The text after it is drawn where it was meant to be
+            model.write("y");
+            REQUIRE(model.row_text(expected_row - 1)[static_cast<size_t>(to_column - 1)] == 'y');
+        }
+    }
+}
@@ -0,0 +1,133 @@
+#include "catch.hpp"
+#include "omux/host_profile.hpp"
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+
+using namespace omux;
+
+namespace {
+    // What Windows Terminal answers the probe with, it doesn't know XTVERSION
+    constexpr std::string_view WINDOWS_TERMINAL_REPLIES{"\x1b[?2026;2$y\x1b[?69;0$y\x1b[>0;10;1c\x1b[?61;4;6;7;14;21;22;23;24;28;32;42;52c"};
+} // namespace
+
+TEST_CASE("Host probe") {
+    SECTION("The replies say what the host supports") {
+        HostProbe probe;
+        REQUIRE(probe.feed(WINDOWS_TERMINAL_REPLIES).empty());
+        REQUIRE(probe.complete());
+        auto profile = probe.profile("");
+        REQUIRE(profile.scroll_regions);
+        REQUIRE_FALSE(profile.left_right_margins);
+        REQUIRE(profile.synchronized_output);
+        REQUIRE(profile.truecolor);
+        REQUIRE(profile.clipboard);
+        REQUIRE(profile.version == "DA2 0;10;1");
+    }
+    SECTION("XTVERSION names the host") {
+        HostProbe probe;
+        probe.feed("\x1bP>|WezTerm 20240203\x1b\\\x1b[?69;2$y\x1b[?1;2c");
+        REQUIRE(probe.complete());
+        auto profile = probe.profile("truecolor");
+        REQUIRE(profile.version == "WezTerm 20240203");
+        REQUIRE(profile.left_right_margins);
+        REQUIRE_FALSE(profile.synchronized_output);
+        REQUIRE(profile.truecolor);
+        REQUIRE_FALSE(profile.clipboard);
+    }
+    SECTION("Replies split between reads are put back together") {
+        HostProbe probe;
+        std::string forwarded;
+        for(auto character : WINDOWS_TERMINAL_REPLIES) {
+            forwarded += probe.feed(std::string_view{&character, 1});
+        }
+        REQUIRE(forwarded.empty());
+        REQUIRE(probe.complete());
+        REQUIRE(probe.profile("").synchronized_output);
+    }
+    SECTION("Keys pressed while waiting are handed back") {
+        HostProbe probe;
+        REQUIRE(probe.feed("ls\x1b[A\x1b") == "ls\x1b[A");
+        REQUIRE(probe.feed("x\x1b[?2026;1$y") == "\x1bx");
+        REQUIRE_FALSE(probe.complete());
+        REQUIRE(probe.feed("\x1b[?1;0cdir\r") == "dir\r");
+        REQUIRE(probe.complete());
+        REQUIRE(probe.feed("\x1b[?1;0c") == "\x1b[?1;0c");
+    }
+    SECTION("Replies that come after the profile was used at the timeout are still taken out") {
+        HostProbe probe;
+        REQUIRE(probe.feed("a") == "a");
+        REQUIRE(probe.profile("") == HostProfile{});
+
+        REQUIRE(probe.feed("b" + std::string{WINDOWS_TERMINAL_REPLIES} + "c") == "bc");
+        REQUIRE(probe.complete());
+        REQUIRE(probe.profile("").synchronized_output);
+    }
+    SECTION("A host that doesn't answer supports none of it") {
+        HostProbe probe;
+        REQUIRE(probe.feed("\x1b[").empty());
+        REQUIRE_FALSE(probe.complete());
+        REQUIRE(probe.finish() == "\x1b[");
+        REQUIRE(probe.profile("") == HostProfile{});
+    }
+}
+
+TEST_CASE("Host identity") {
+    std::map<std::string, std::string> environment;
+    auto identity = [&]() {
+        return host_identity([&](const char* variable) -> std::optional<std::string> {
+            auto value = environment.find(variable);
+            return value == environment.end() ? std::nullopt : std::optional{value->second};
+        });
+    };
+    REQUIRE(identity() == "console");
+    environment["WT_SESSION"] = "3c5b7c9e-0d1f-4a0b-8c1e-2f7a9b6d4e21";
+    auto windows_terminal = identity();
+    environment["WT_SESSION"] = "8d2f4e6a-1b3c-4d5e-9f0a-7b6c5d4e3f21";
+    REQUIRE(identity() == windows_terminal);
+    environment["TERM_PROGRAM"] = "WezTerm";
+    environment["TERM_PROGRAM_VERSION"] = "20240203";
+    REQUIRE(identity() != windows_terminal);
+}
+
+TEST_CASE("Host profile cache") {
+    auto path = std::filesystem::temp_directory_path() / "omux_test_host_profiles" / "host_profiles.txt";
+    std::filesystem::remove_all(path.parent_path());
+    HostProfile profile{.scroll_regions = true, .synchronized_output = true, .clipboard = true, .version = "WezTerm\t20240203"};
+    SECTION("Profiles are found by identity") {
+        HostProfileCache cache{path};
+        REQUIRE_FALSE(cache.find("console").has_value());
+        REQUIRE(cache.store("WindowsTerminal", profile));
+        REQUIRE(cache.store("console", HostProfile{}));
+
+        HostProfileCache reopened{path};
+        auto found = reopened.find("WindowsTerminal");
+        REQUIRE(found.has_value());
+        REQUIRE(found->synchronized_output);
+        REQUIRE(found->clipboard);
+        REQUIRE_FALSE(found->left_right_margins);
+        REQUIRE(found->version == "WezTerm 20240203");
+        REQUIRE(reopened.find("console") == HostProfile{});
+    }
+    SECTION("Storing a profile again replaces it") {
+        HostProfileCache cache{path};
+        cache.store("console", profile);
+        cache.store("console", HostProfile{.truecolor = true, .version = ""});
+        REQUIRE(cache.find("console") == HostProfile{.truecolor = true, .version = ""});
+    }
+    SECTION("Old profiles are probed again") {
+        HostProfileCache cache{path};
+        cache.store("console", profile);
+        REQUIRE_FALSE(cache.find("console", std::chrono::seconds(-1)).has_value());
+    }
+    SECTION("A file that isn't a cache is ignored") {
+        std::filesystem::create_directories(path.parent_path());
+        std::ofstream{path} << "something else\nconsole\t0\tscroll_regions\t\n";
+        HostProfileCache cache{path};
+        REQUIRE_FALSE(cache.find("console").has_value());
+        REQUIRE(cache.store("console", profile));
+        REQUIRE(cache.find("console").has_value());
+    }
+    std::filesystem::remove_all(path.parent_path());
+}
@@ -0,0 +1,73 @@
+#include "catch.hpp"
+#include "omux/io_executor.hpp"
+#include <chrono>
+#include <future>
+#include <thread>
+
+using namespace omux;
+
+namespace {
+    auto read_into(HANDLE pipe, std::stop_token stop, std::optional<std::chrono::milliseconds> timeout,
+                   std::promise<ReadResult>& result) -> DetachedTask {
+        result.set_value(co_await IoExecutor::read(pipe, std::move(stop), timeout));
+    }
+} // namespace
+
+TEST_CASE("I/O executor") {
+    IoExecutor executor{1};
+    HANDLE read_end = nullptr;
+    HANDLE write_end = nullptr;
+    Alias::CreateOverlappedPipe(&read_end, &write_end, 4096);
+    executor.associate(read_end);
+    std::promise<ReadResult> promise;
+    auto result = promise.get_future();
+
+    SECTION("Reads what is written") {
+        executor.spawn(read_into(read_end, {}, std::nullopt, promise));
+        std::string hello{"hello"};
+        WriteFile(write_end, hello.data(), static_cast<DWORD>(hello.size()), nullptr, nullptr);
+
+        REQUIRE(result.wait_for(std::chrono::seconds(1)) == std::future_status::ready);
+        auto output = result.get();
+        REQUIRE(output.bytes == hello);
+        REQUIRE_FALSE(output.closed);
+    }
+    SECTION("Stopping cancels a pending read") {
+        std::stop_source stop;
+        executor.spawn(read_into(read_end, stop.get_token(), std::nullopt, promise));
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        stop.request_stop();
+
+        REQUIRE(result.wait_for(std::chrono::milliseconds(100)) == std::future_status::ready);
+        auto output = result.get();
+        REQUIRE(output.bytes.empty());
+        REQUIRE_FALSE(output.closed);
+    }
+    SECTION("A read that is already stopped doesn't wait") {
+        std::stop_source stop;
+        stop.request_stop();
+        executor.spawn(read_into(read_end, stop.get_token(), std::nullopt, promise));
+
+        REQUIRE(result.wait_for(std::chrono::milliseconds(100)) == std::future_status::ready);
+        REQUIRE(result.get().bytes.empty());
+    }
+    SECTION("Reads time out") {
+        executor.spawn(read_into(read_end, {}, std::chrono::milliseconds(10), promise));
+
+        REQUIRE(result.wait_for(std::chrono::seconds(1)) == std::future_status::ready);
+        auto output = result.get();
+        REQUIRE(output.bytes.empty());
+        REQUIRE_FALSE(output.closed);
+    }
+    SECTION("Closing the other end ends reading") {
+        executor.spawn(read_into(read_end, {}, std::nullopt, promise));
+        CloseHandle(std::exchange(write_end, nullptr));
+
+        REQUIRE(result.wait_for(std::chrono::seconds(1)) == std::future_status::ready);
+        REQUIRE(result.get().closed);
+    }
+    if(write_end != nullptr) {
+        CloseHandle(write_end);
+    }
+    CloseHandle(read_end);
+}
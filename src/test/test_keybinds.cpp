@@ -22,14 +22,34 @@ TEST_CASE("Keybinds") {
         primary_console->set_active(console.get());
         // Ctrl-<key> is <key code>-64, or with the 6 bit turned off
         // A (0x41) becomes 0x1
-        primary_console->process_input("\x1\x23");
+        std::string input{"\x1\x23"};
+        action_factory->process_to_action(input);
         REQUIRE_FALSE(action_factory->get_action_stack()->empty());
         REQUIRE(action_factory->get_action_stack()->back()->get_enum() == Actions::split_vert);
+        action_factory->get_action_stack()->back()->act(primary_console.get());
+        // Done with once it has acted, and so is the prefix under it
+        action_factory->pop_finished();
+        REQUIRE(action_factory->get_action_stack()->empty());
         primary_console->remove_console(console.get());
         primary_console->remove_console(primary_console->get_active_console());
         primary_console->wait_for_attached_consoles();
 
     }
+    SECTION("Window and zoom keybinds follow the prefix") {
+        auto action_factory = std::make_shared<ActionFactory>();
+        std::string input{"\x1n"};
+        REQUIRE(action_factory->process_to_action(input) == Actions::select_window);
+        REQUIRE(input.empty());
+        input = "\x1p";
+        REQUIRE(action_factory->process_to_action(input) == Actions::select_window);
+        input = "\x1z";
+        REQUIRE(action_factory->process_to_action(input) == Actions::zoom);
+        REQUIRE(action_factory->get_action_stack()->back()->get_enum() == Actions::zoom);
+        // Without the prefix they are only keys
+        input = "npz";
+        REQUIRE(action_factory->process_to_action(input) == Actions::none);
+        REQUIRE(input == "npz");
+    }
     SECTION("Prefix followed by non-keybind removes the prefix") {
         auto action_factory = std::make_shared<ActionFactory>();
         auto primary_console = std::make_shared<PrimaryConsole>(action_factory);
@@ -41,6 +61,33 @@ TEST_CASE("Keybinds") {
         primary_console->process_input("a");
         REQUIRE(action_factory->get_action_stack()->empty());
     }
+    SECTION("Copy mode takes keys until it is exited") {
+        auto action_factory = std::make_shared<ActionFactory>();
+        auto primary_console = std::make_shared<PrimaryConsole>(action_factory);
+        auto input = primary_console->process_input("\x1[");
+        REQUIRE(input.empty());
+        REQUIRE(action_factory->get_action_stack()->back()->get_enum() == Actions::copy_mode);
+
+        // The search and steps don't reach the pane
+        input = primary_console->process_input("/exit\rnN");
+        REQUIRE(input.empty());
+        REQUIRE(action_factory->get_action_stack()->back()->get_enum() == Actions::copy_mode);
+
+        primary_console->process_input("q");
+        REQUIRE(action_factory->get_action_stack()->empty());
+        input = primary_console->process_input("a");
+        REQUIRE(input == "a");
+    }
+    SECTION("Window and zoom actions are taken off the stack once they have acted") {
+        auto action_factory = std::make_shared<ActionFactory>();
+        auto primary_console = std::make_shared<PrimaryConsole>(action_factory);
+        primary_console->process_input("\x1n");
+        primary_console->process_input("\x1z");
+        REQUIRE(action_factory->get_action_stack()->empty());
+        // A prefix waiting for its key stays
+        primary_console->process_input("\x1");
+        REQUIRE(action_factory->get_action_stack()->size() == 1);
+    }
     SECTION("Processed keys are removed") {
         auto action_factory = std::make_shared<ActionFactory>();
         auto primary_console = std::make_shared<PrimaryConsole>(action_factory);
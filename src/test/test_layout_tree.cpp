@@ -0,0 +1,58 @@
+#include "catch.hpp"
+#include "omux/layout_tree.hpp"
+#include <utility>
+#include <vector>
+
+using namespace omux;
+
+TEST_CASE("Layout tree") {
+    Layout screen{0, 0, 80, 24};
+    SECTION("A pane on its own gets the whole area") {
+        LayoutTree tree{1};
+        REQUIRE(tree.arrange(screen) == std::vector<std::pair<unsigned int, Layout>>{{1, screen}});
+    }
+    SECTION("Splits leave the halves the way splitting the active pane did") {
+        LayoutTree tree{1};
+        REQUIRE(tree.split(1, VERT, 2));
+        auto arranged = tree.arrange(screen);
+        REQUIRE(arranged.size() == 2);
+        REQUIRE(arranged[0] == std::pair{1U, Layout{0, 0, 39, 24}});
+        REQUIRE(arranged[1] == std::pair{2U, Layout{41, 0, 39, 24}});
+
+        REQUIRE(tree.split(2, HORI, 3));
+        arranged = tree.arrange(screen);
+        REQUIRE(arranged[1] == std::pair{2U, Layout{41, 0, 39, 11}});
+        REQUIRE(arranged[2] == std::pair{3U, Layout{41, 13, 39, 11}});
+        REQUIRE_FALSE(tree.split(4, VERT, 5));
+    }
+    SECTION("A removed pane's space goes to the other side of its split") {
+        LayoutTree tree{1};
+        tree.split(1, VERT, 2);
+        tree.split(2, HORI, 3);
+        REQUIRE(tree.remove(2));
+        REQUIRE_FALSE(tree.contains(2));
+        auto arranged = tree.arrange(screen);
+        REQUIRE(arranged[1] == std::pair{3U, Layout{41, 0, 39, 24}});
+        REQUIRE(tree.remove(1));
+        REQUIRE(tree.arrange(screen) == std::vector<std::pair<unsigned int, Layout>>{{3, screen}});
+        REQUIRE_FALSE(tree.remove(1));
+        REQUIRE(tree.remove(3));
+        REQUIRE(tree.empty());
+    }
+    SECTION("A pane still being made can be filled in") {
+        LayoutTree tree{1};
+        tree.split(1, VERT, NO_PANE);
+        REQUIRE(tree.replace(NO_PANE, 7));
+        REQUIRE(tree.panes() == std::vector<unsigned int>{1, 7});
+    }
+}
+
+TEST_CASE("Window") {
+    Window window{LayoutTree{1}, Layout{0, 0, 80, 24}, 1, std::nullopt};
+    window.panes.split(1, VERT, 2);
+    REQUIRE(window.arrange().size() == 2);
+    window.zoomed = 2;
+    REQUIRE(window.arrange() == std::vector<std::pair<unsigned int, Layout>>{{2, window.area}});
+    window.panes.remove(2);
+    REQUIRE(window.arrange() == std::vector<std::pair<unsigned int, Layout>>{{1, window.area}});
+}
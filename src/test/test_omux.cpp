@@ -1,7 +1,9 @@
 #include "catch.hpp"
 #include "omux/console.hpp"
+#include "omux/shell_pool.hpp"
 #include <memory>
 #include <exception>
+#include <thread>
 
 
 namespace CM = Catch::Matchers;
@@ -67,6 +69,27 @@ TEST_CASE("Console API"){
         
         primary_console->wait_for_attached_consoles();
     }
+
+    SECTION("Stops once every pane has finished") {
+        auto primary_console = std::make_shared<PrimaryConsole>();
+        REQUIRE_FALSE(primary_console->should_stop());
+
+        auto console_one = std::make_shared<Console>(primary_console, Layout{0, 0, 40, 20});
+        auto console_two = std::make_shared<Console>(primary_console, Layout{45, 0, 40, 20});
+        // Panes without a process yet are still waiting for one
+        REQUIRE_FALSE(primary_console->should_stop());
+
+        primary_console->remove_console(console_one.get());
+        REQUIRE_FALSE(primary_console->should_stop());
+        // Removing a pane twice doesn't count it twice
+        primary_console->remove_console(console_one.get());
+        REQUIRE_FALSE(primary_console->should_stop());
+
+        primary_console->remove_console(console_two.get());
+        REQUIRE(primary_console->should_stop());
+        // Nothing is attached, so this returns straight away
+        primary_console->wait_for_attached_consoles();
+    }
     
     Alias::ReverseSetupConsoleHost();
 }
@@ -92,22 +115,12 @@ TEST_CASE("Resizing consoles") {
         pwsh.wait_for_stop(1000);
 
         // Get the last height lines
-        std::vector<std::string> original_lines;
-        original_lines.insert(
-            original_lines.begin(),
-            console_one->get_scroll_buffer()->end()-original_height,
-            console_one->get_scroll_buffer()->end()
-        );
+        auto original_lines = console_one->snapshot()->screen;
 
         console_one->resize(Layout{0, 0, original_width - change_in_width, original_height});
         pwsh.wait_for_stop(1000);
 
-        std::vector<std::string> new_lines;
-        new_lines.insert(
-            new_lines.begin(),
-            console_one->get_scroll_buffer()->end() - original_height,
-            console_one->get_scroll_buffer()->end()
-        );
+        auto new_lines = console_one->snapshot()->screen;
 
         // Should now see the affect in the scroll buffer
         REQUIRE(new_lines != original_lines);
@@ -116,6 +129,26 @@ TEST_CASE("Resizing consoles") {
         primary_console->wait_for_attached_consoles();
         
     }
+    SECTION("Resize requests are coalesced into one applied resize") {
+        auto primary_console = std::make_shared<PrimaryConsole>();
+        auto console_one = std::make_shared<Console>(primary_console, Layout{0, 0, 40, 20});
+        primary_console->remove_console(console_one.get());
+
+        console_one->resize(Layout{0, 0, 38, 20});
+        console_one->resize(Layout{0, 0, 36, 20});
+        console_one->resize(Layout{0, 0, 30, 18});
+
+        // The requested layout is visible straight away but nothing is applied inside the debounce window
+        REQUIRE(console_one->get_layout().width == 30);
+        REQUIRE(console_one->get_layout().height == 18);
+        REQUIRE_FALSE(console_one->apply_pending_resize());
+        REQUIRE(console_one->get_resize_generation() == 0);
+
+        std::this_thread::sleep_for(RESIZE_DEBOUNCE_MS * 2);
+        REQUIRE(console_one->apply_pending_resize());
+        REQUIRE_FALSE(console_one->apply_pending_resize());
+        REQUIRE(console_one->get_resize_generation() == 1);
+    }
     SECTION("Resizing doesn't impact other consoles") {
     
     }
@@ -198,6 +231,79 @@ TEST_CASE("Layout management") {
         REQUIRE(console_two->get_layout().width == console_one->get_layout().width);
         REQUIRE(console_two->get_layout().height == (terminal_size.height / 2) - 1);
     }
+    SECTION("Splits take a shell from the pool when there is one") {
+        auto primary_console = std::make_shared<PrimaryConsole>();
+        auto terminal_size = primary_console->get_terminal_size();
+        auto console_one = std::make_shared<Console>(primary_console, terminal_size);
+        primary_console->set_active(console_one.get());
+        auto pool = std::make_shared<ShellPool>(primary_console, omux::PWSH_CONSOLE_PATH, L" -nop", Layout{0, 0, 80, 10}, 1);
+        REQUIRE(pool->wait_until_full(std::chrono::milliseconds(5000)));
+        primary_console->set_shell_pool(pool);
+
+        auto console_two = primary_console->split_active_console(VERT);
+        REQUIRE(console_two->is_running());
+        REQUIRE(console_two->is_visible());
+        REQUIRE(console_two->get_layout().x == (terminal_size.width/2)+1);
+        REQUIRE(console_two->get_layout().width == console_one->get_layout().width);
+        REQUIRE(console_two->get_layout().height == terminal_size.height);
+        // The pool starts another in its place
+        REQUIRE(pool->wait_until_full(std::chrono::milliseconds(5000)));
+
+        primary_console->set_active(console_two.get());
+        primary_console->write_input("exit\r");
+        console_two->wait_for_process_to_stop(2000);
+    }
+    SECTION("Only the current window's panes are shown") {
+        auto primary_console = std::make_shared<PrimaryConsole>();
+        auto terminal_size = primary_console->get_terminal_size();
+        auto console_one = std::make_shared<Console>(primary_console, terminal_size);
+        primary_console->set_active(console_one.get());
+        auto console_two = primary_console->split_active_console(VERT);
+        REQUIRE(primary_console->window_count() == 1);
+
+        auto console_three = primary_console->new_window();
+        REQUIRE(primary_console->window_count() == 2);
+        REQUIRE(primary_console->get_current_window() == 1);
+        REQUIRE(primary_console->get_active_console() == console_three.get());
+        REQUIRE(console_three->get_layout() == terminal_size);
+        REQUIRE(console_three->is_visible());
+        REQUIRE_FALSE(console_one->is_visible());
+        REQUIRE_FALSE(console_two->is_visible());
+
+        primary_console->select_window(1);
+        REQUIRE(primary_console->get_current_window() == 0);
+        REQUIRE(primary_console->get_active_console() == console_two.get());
+        REQUIRE(console_one->is_visible());
+        REQUIRE(console_two->is_visible());
+        REQUIRE_FALSE(console_three->is_visible());
+
+        primary_console->select_window(-1);
+        REQUIRE(primary_console->get_current_window() == 1);
+        console_three.reset();
+        REQUIRE(primary_console->window_count() == 1);
+        REQUIRE(primary_console->get_current_window() == 0);
+        REQUIRE(console_one->is_visible());
+        REQUIRE(console_two->is_visible());
+    }
+    SECTION("A zoomed pane fills its window until it is zoomed out") {
+        auto primary_console = std::make_shared<PrimaryConsole>();
+        auto terminal_size = primary_console->get_terminal_size();
+        auto console_one = std::make_shared<Console>(primary_console, terminal_size);
+        primary_console->set_active(console_one.get());
+        auto console_two = primary_console->split_active_console(HORI);
+        auto split_layout = console_one->get_layout();
+        primary_console->set_active(console_one.get());
+
+        primary_console->toggle_zoom();
+        REQUIRE(primary_console->get_zoomed_pane() == console_one->get_id());
+        REQUIRE(console_one->get_layout() == terminal_size);
+        REQUIRE_FALSE(console_two->is_visible());
+
+        primary_console->toggle_zoom();
+        REQUIRE_FALSE(primary_console->get_zoomed_pane().has_value());
+        REQUIRE(console_one->get_layout() == split_layout);
+        REQUIRE(console_two->is_visible());
+    }
 
     Alias::ReverseSetupConsoleHost();
 }
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "catch.hpp"
 #include "omux/console.hpp"
+#include "omux/session_recorder.hpp"
+#include <filesystem>
+#include <fstream>
 #include <string_view>
 #include <ranges>
 #include <gmock\gmock.h>
@@ -55,7 +58,7 @@ TEST_CASE("Process output with real stdout") {
         REQUIRE(console_one->get_scroll_buffer()->size() == 3);
         REQUIRE(console_one->get_scroll_buffer()->at(0).compare("T\n") == 0);
         REQUIRE(console_one->get_scroll_buffer()->at(1).compare("\n") == 0);
-        REQUIRE(console_one->get_scroll_buffer()->at(2).compare("\x1b[?25h\x1b[?25l.") == 0);
+        REQUIRE(console_one->get_scroll_buffer()->at(2).compare(".") == 0);
 
         primary_console->wait_for_attached_consoles();
     }
@@ -72,8 +75,7 @@ TEST_CASE("Process output with real stdout") {
         REQUIRE(console_one->get_scroll_buffer()->size() == 3);
         REQUIRE(console_one->get_scroll_buffer()->at(0).compare("\n") == 0);
         REQUIRE(console_one->get_scroll_buffer()->at(1).compare("\n") == 0);
-        REQUIRE(console_one->get_scroll_buffer()->at(2).compare(
-                "\x1b[?25h\x1b[?25l.") == 0);
+        REQUIRE(console_one->get_scroll_buffer()->at(2).compare(".") == 0);
 
         primary_console->wait_for_attached_consoles();
     }
@@ -88,7 +90,7 @@ TEST_CASE("Process output with real stdout") {
 
         // Two lines are in the scroll buffer
         REQUIRE(console_one->get_scroll_buffer()->size() == 1);
-        REQUIRE(console_one->get_scroll_buffer()->at(0).compare("A\x1b[?25h\x1b[?25l.") == 0);
+        REQUIRE(console_one->get_scroll_buffer()->at(0).compare("A.") == 0);
 
         primary_console->wait_for_attached_consoles();
     }
@@ -131,10 +133,119 @@ TEST_CASE("Process output with real stdout") {
         // Two lines are in the scroll buffer
         REQUIRE(console_one->get_scroll_buffer()->size() == 5);
 
-       REQUIRE(stdout_capture.str().find("2\n\x1b[0G3\n\x1b[0G4") != std::string::npos);
+       REQUIRE(stdout_capture.str().find("2\n\r3\n\r4") != std::string::npos);
 
     }
-    
+    SECTION("Hidden panes keep their output without writing it, and are drawn when shown") {
+        auto mock_primary_console = get_primary_console_mock_with_capture(&stdout_capture);
+        auto console_one = std::make_shared<Console>(mock_primary_console, Layout{0, 0, 40, 3});
+        mock_primary_console->remove_console(console_one.get());
+
+        Process pwsh{console_one};
+        console_one->set_visible(false);
+        pwsh.process_string_for_output("hidden\r\nline\r\n1\n2\n3");
+
+        REQUIRE(stdout_capture.str().empty());
+        REQUIRE_THAT(console_one->get_scroll_buffer()->at(0), CM::StartsWith("hidden"));
+        REQUIRE(console_one->get_scroll_buffer()->size() == 5);
+
+        console_one->set_visible(true);
+        // The rows on screen are drawn from the scroll buffer, what scrolled off while hidden isn't
+        REQUIRE(stdout_capture.str().find("\x1b[40X1") != std::string::npos);
+        REQUIRE(stdout_capture.str().find("\x1b[40X3") != std::string::npos);
+        REQUIRE(stdout_capture.str().find("hidden") == std::string::npos);
+    }
+    SECTION("Everything written to the host is recorded once, and hidden panes record nothing") {
+        auto mock_primary_console = get_primary_console_mock_with_capture(&stdout_capture);
+        auto console_one = std::make_shared<Console>(mock_primary_console, Layout{0, 0, 40, 3});
+        auto console_two = std::make_shared<Console>(mock_primary_console, Layout{0, 0, 40, 3});
+        mock_primary_console->remove_console(console_one.get());
+        mock_primary_console->remove_console(console_two.get());
+        auto path = std::filesystem::temp_directory_path() / "omux_test_process_host.rec";
+
+        Process shown{console_one};
+        Process hidden{console_two};
+        console_two->set_visible(false);
+        SessionRecorder::global().start(path);
+        shown.process_string_for_output("one\r\ntwo\rTW\x1b[1mbold\x1b[0m\r\n1\n2\n3");
+        hidden.process_string_for_output("hidden\r\nline");
+        SessionRecorder::global().stop();
+
+        std::ifstream recording{path, std::ios::binary};
+        std::string host_frames;
+        for(auto& frame : SessionRecorder::read_frames(recording)) {
+            if(frame.direction == RecordDirection::host) {
+                REQUIRE(frame.pane == console_one->get_id());
+                host_frames += frame.bytes;
+            }
+        }
+        REQUIRE(host_frames == stdout_capture.str());
+    }
+    SECTION("Published snapshots don't change with later output") {
+        auto primary_console = std::make_shared<PrimaryConsole>();
+        auto console_one = std::make_shared<Console>(primary_console, Layout{0, 0, 40, 30});
+        primary_console->remove_console(console_one.get());
+
+        Process pwsh{console_one};
+        pwsh.process_string_for_output("first\r\n");
+        console_one->publish_snapshot();
+        auto first = console_one->snapshot();
+        pwsh.process_string_for_output("second");
+        console_one->publish_snapshot();
+        auto second = console_one->snapshot();
+
+        REQUIRE(second->generation == first->generation + 1);
+        REQUIRE(first->screen.size() == 2);
+        REQUIRE(first->screen.back().empty());
+        REQUIRE(second->screen.size() == 2);
+        REQUIRE(second->screen.back() == "second");
+        REQUIRE(second->line_count == console_one->line_count());
+
+        primary_console->wait_for_attached_consoles();
+    }
+    SECTION("Alternate screen output stays out of the scroll buffer") {
+        auto mock_primary_console = get_primary_console_mock_with_capture(&stdout_capture);
+        auto console_one = std::make_shared<Console>(mock_primary_console, Layout{0, 0, 40, 5});
+        mock_primary_console->remove_console(console_one.get());
+
+        Process pwsh{console_one};
+        pwsh.process_string_for_output("prompt\r\n");
+        auto rows = console_one->get_scroll_buffer()->size();
+        pwsh.process_string_for_output("\x1b[?1049h\x1b[2;1Hfull\r\nscreen");
+        console_one->publish_snapshot();
+        auto alternate = console_one->snapshot();
+        pwsh.process_string_for_output("\x1b[?1049lback");
+
+        REQUIRE(alternate->alternate_screen);
+        REQUIRE(alternate->screen.size() == 5);
+        REQUIRE(alternate->screen[1] == "full");
+        REQUIRE(alternate->screen[2] == "screen");
+        REQUIRE(console_one->get_alternate_screen() == nullptr);
+        REQUIRE(console_one->get_scroll_buffer()->size() == rows);
+        REQUIRE(console_one->get_scroll_buffer()->at(rows - 1) == "back");
+        // The host never leaves omux's own screen
+        REQUIRE(stdout_capture.str().find("?1049") == std::string::npos);
+
+        mock_primary_console->wait_for_attached_consoles();
+    }
+    SECTION("Screen switches are found among other private modes") {
+        auto mock_primary_console = get_primary_console_mock_with_capture(&stdout_capture);
+        auto console_one = std::make_shared<Console>(mock_primary_console, Layout{0, 0, 40, 5});
+        mock_primary_console->remove_console(console_one.get());
+
+        Process pwsh{console_one};
+        pwsh.process_string_for_output("\x1b[?1049;1hfull");
+        REQUIRE(console_one->get_alternate_screen() != nullptr);
+        pwsh.process_string_for_output("\x1b[?1;1049lback");
+        REQUIRE(console_one->get_alternate_screen() == nullptr);
+        REQUIRE(console_one->get_scroll_buffer()->at(console_one->get_scroll_buffer()->size() - 1) == "back");
+        // The other modes still go to the screen the pane is on, without the switch
+        REQUIRE(stdout_capture.str().find("\x1b[?1l") != std::string::npos);
+        REQUIRE(stdout_capture.str().find("1049") == std::string::npos);
+
+        mock_primary_console->wait_for_attached_consoles();
+    }
+
     
     Alias::ReverseSetupConsoleHost();
 }
@@ -185,23 +296,5 @@ TEST_CASE("Process handles scrollbufer re-writes") {
         REQUIRE(console_one->get_scroll_buffer()->size() == 1);
         REQUIRE(console_one->get_scroll_buffer()->at(0).compare("Hello") == 0);
     }
-    SECTION("Deleting characters correctly position in the line") {
-        std::string line{
-        "\x1b[?25h\x1b[?25lPS F \\dev\\projects\\open_multiplexer\\build\\Clang x64-Debug> "
-        "\x1b[?25h\x1b[?25l\x1b[?25h\x1b[97m1\x1b[?25l\x1b[m\x1b[?25h\x1b[?25l\x1b[9712\x1b[?25h\x1b[?25l\x1b["
-        "m\x1b[?25h\x1b[?25l\x1b[97m"
-        "\x1b[10;60H"};
-        auto primary_console = std::make_shared<PrimaryConsole>();
-        auto console_one = std::make_shared<Console>(primary_console, Layout{0, 0, 40, 30});
-
-        Process pwsh{console_one};
-        line = pwsh.delete_n_renderable_characters_from_string(line, 6);
-        REQUIRE(line == "\x1b[?25h\x1b[?25lPS F ");
-
-        line = "\x1b[?25h\x1b[?25lPS\x1b[?25l\x1b[?25l";
-        line = pwsh.delete_n_renderable_characters_from_string(line, 4);
-        REQUIRE(line == "\x1b[?25h\x1b[?25lPS ");
-
-    }
     Alias::ReverseSetupConsoleHost();
 }
\ No newline at end of file
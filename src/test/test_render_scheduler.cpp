@@ -0,0 +1,262 @@
+#include "catch.hpp"
+#include "omux/render_scheduler.hpp"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace omux;
+
+namespace {
+    /**
+     * Renders a slice at a time and writes down which target each slice came from.
+     */
+    class CountingTarget : public RenderTarget {
+        public:
+        CountingTarget(char name, int slices, std::string& order) : name(name), left(slices), order(order) {
+        }
+        auto render_pending() -> bool override {
+            order.push_back(name);
+            return --left > 0;
+        }
+        [[nodiscard]] auto done() const -> bool {
+            return left <= 0;
+        }
+
+        private:
+        char name;
+        std::atomic<int> left;
+        std::string& order;
+    };
+
+    /**
+     * Keeps the scheduler busy until it is opened.
+     */
+    class GateTarget : public RenderTarget {
+        public:
+        GateTarget(std::atomic<bool>& open, std::string& order) : open(open), order(order) {
+        }
+        auto render_pending() -> bool override {
+            is_started = true;
+            while(!open) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            order.push_back('g');
+            return false;
+        }
+        [[nodiscard]] auto started() const -> bool {
+            return is_started;
+        }
+
+        private:
+        std::atomic<bool>& open;
+        std::atomic<bool> is_started{false};
+        std::string& order;
+    };
+
+    template <typename Condition> auto wait_until(Condition&& condition) -> bool {
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+        while(!condition()) {
+            if(std::chrono::steady_clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+} // namespace
+
+TEST_CASE("Render scheduler") {
+    std::mutex output_lock;
+    std::string order;
+
+    SECTION("Panes take turns a slice at a time") {
+        CountingTarget flood{'a', 4, order};
+        CountingTarget quiet{'b', 1, order};
+        {
+            // Holding the host back lets both queue up before anything renders
+            std::unique_lock hold(output_lock);
+            RenderScheduler scheduler{output_lock};
+            scheduler.schedule(&flood);
+            scheduler.schedule(&quiet);
+            hold.unlock();
+            REQUIRE(wait_until([&]() { return flood.done() && quiet.done(); }));
+            std::scoped_lock lock(output_lock);
+            REQUIRE(order == "abaaa");
+            REQUIRE(scheduler.rendered() == 5);
+        }
+    }
+    SECTION("Scheduling a queued pane again doesn't render it twice") {
+        CountingTarget target{'a', 1, order};
+        std::unique_lock hold(output_lock);
+        RenderScheduler scheduler{output_lock};
+        scheduler.schedule(&target);
+        scheduler.schedule(&target);
+        hold.unlock();
+        REQUIRE(wait_until([&]() { return target.done(); }));
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        std::scoped_lock lock(output_lock);
+        REQUIRE(order == "a");
+    }
+    SECTION("Removing a pane takes it out of the queue") {
+        std::atomic<bool> open{false};
+        GateTarget gate{open, order};
+        CountingTarget removed{'a', 1, order};
+        CountingTarget kept{'b', 1, order};
+        RenderScheduler scheduler{output_lock};
+        scheduler.schedule(&gate);
+        REQUIRE(wait_until([&]() { return gate.started(); }));
+        scheduler.schedule(&removed);
+        scheduler.schedule(&kept);
+        scheduler.remove(&removed);
+        open = true;
+        REQUIRE(wait_until([&]() { return kept.done(); }));
+        std::scoped_lock lock(output_lock);
+        REQUIRE(order == "gb");
+    }
+    SECTION("An echo of input goes ahead of bulk output waiting for its frame") {
+        CountingTarget bulk{'a', 1, order};
+        CountingTarget echo{'b', 1, order};
+        std::unique_lock hold(output_lock);
+        RenderScheduler scheduler{output_lock};
+        scheduler.schedule_output(&bulk, 4096, 4096);
+        scheduler.input_forwarded();
+        scheduler.schedule_output(&echo, 12, 12);
+        REQUIRE(scheduler.echoes() == 1);
+        REQUIRE(scheduler.batched() == 1);
+        // Past the frame both are due, the echo was queued first
+        std::this_thread::sleep_for(RENDER_FRAME_INTERVAL_MS * 2);
+        hold.unlock();
+        REQUIRE(wait_until([&]() { return bulk.done() && echo.done(); }));
+        std::scoped_lock lock(output_lock);
+        REQUIRE(order == "ba");
+    }
+    SECTION("Bulk output doesn't wait for the frame once a whole slice is waiting") {
+        CountingTarget trickle{'a', 1, order};
+        CountingTarget flood{'b', 1, order};
+        std::unique_lock hold(output_lock);
+        RenderScheduler scheduler{output_lock};
+        scheduler.schedule_output(&trickle, 4096, 4096);
+        scheduler.schedule_output(&flood, 4096, PANE_RENDER_SLICE);
+        std::this_thread::sleep_for(RENDER_FRAME_INTERVAL_MS * 2);
+        hold.unlock();
+        REQUIRE(wait_until([&]() { return trickle.done() && flood.done(); }));
+        std::scoped_lock lock(output_lock);
+        REQUIRE(order == "ba");
+        REQUIRE(scheduler.echoes() == 0);
+    }
+    SECTION("Output that comes in while a pane waits for its frame goes in the same frame") {
+        CountingTarget target{'a', 1, order};
+        RenderScheduler scheduler{output_lock};
+        scheduler.schedule_output(&target, 100, 100);
+        scheduler.schedule_output(&target, 100, 200);
+        REQUIRE(wait_until([&]() { return target.done(); }));
+        std::this_thread::sleep_for(RENDER_FRAME_INTERVAL_MS * 2);
+        std::scoped_lock lock(output_lock);
+        REQUIRE(order == "a");
+        REQUIRE(scheduler.batched() == 2);
+    }
+}
+
+TEST_CASE("Pending output") {
+    PendingOutput pending;
+    auto now = std::chrono::steady_clock::now();
+
+    SECTION("Ordinary output is taken a slice at a time") {
+        pending.append("abcdef");
+        auto slice = pending.take(4, now, false);
+
+        REQUIRE(slice.bytes == "abcd");
+        REQUIRE(slice.used == 4);
+        REQUIRE_FALSE(slice.frame);
+        REQUIRE(pending.take(4, now, false).bytes == "ef");
+    }
+    SECTION("A synchronized update is held until it ends and taken whole") {
+        pending.append("before\x1b[?2026hframe");
+        REQUIRE(pending.take(64, now, false).bytes == "before");
+
+        auto held = pending.take(2, now, false);
+        REQUIRE(held.bytes.empty());
+        REQUIRE(pending.held_until() == now + SYNCHRONIZED_UPDATE_TIMEOUT_MS);
+        REQUIRE(pending.take(2, now, false).used == 0);
+
+        pending.append(" done\x1b[?2026lafter");
+        auto frame = pending.take(2, now, false);
+        REQUIRE(frame.frame);
+        REQUIRE_FALSE(frame.timed_out);
+        REQUIRE(frame.bytes == "frame done");
+        REQUIRE(held.used + frame.used == std::string_view{"\x1b[?2026hframe done\x1b[?2026l"}.size());
+        REQUIRE_FALSE(pending.held_until());
+        REQUIRE(pending.take(64, now, false).bytes == "after");
+    }
+    SECTION("A frame marker split across chunks still starts a frame") {
+        pending.append("before\x1b[?20");
+        REQUIRE(pending.take(64, now, false).bytes == "before");
+        REQUIRE_FALSE(pending.ready());
+        REQUIRE(pending.take(64, now, false).used == 0);
+
+        pending.append("26hframe\x1b[?2026l");
+        auto frame = pending.take(64, now, false);
+        REQUIRE(frame.frame);
+        REQUIRE(frame.bytes == "frame");
+        REQUIRE(frame.used == std::string_view{"\x1b[?2026hframe\x1b[?2026l"}.size());
+        REQUIRE(pending.size() == 0);
+    }
+    SECTION("What only looked like the start of a marker is shown with the next chunk, or when flushing") {
+        pending.append("a\x1b[?");
+        REQUIRE(pending.take(64, now, false).bytes == "a");
+        pending.append("25h\x1b");
+        REQUIRE(pending.take(64, now, false).bytes == "\x1b[?25h");
+        REQUIRE(pending.take(64, now, true).bytes == "\x1b");
+        REQUIRE_FALSE(pending.ready());
+    }
+    SECTION("A private mode split across chunks or slices is held back until it is whole") {
+        pending.append("a\x1b[?1;10");
+        REQUIRE(pending.take(64, now, false).bytes == "a");
+        REQUIRE_FALSE(pending.ready());
+        pending.append("49hb");
+        REQUIRE(pending.take(64, now, false).bytes == "\x1b[?1;1049hb");
+
+        pending.append("abc\x1b[?1049hd");
+        REQUIRE(pending.take(6, now, false).bytes == "abc");
+        REQUIRE(pending.take(64, now, false).bytes == "\x1b[?1049hd");
+    }
+    SECTION("A frame that never ends is shown once it times out") {
+        pending.append("\x1b[?2026hpartial");
+        REQUIRE(pending.take(64, now, false).bytes.empty());
+
+        auto frame = pending.take(64, now + SYNCHRONIZED_UPDATE_TIMEOUT_MS, false);
+        REQUIRE(frame.timed_out);
+        REQUIRE(frame.bytes == "partial");
+        REQUIRE(pending.size() == 0);
+    }
+    SECTION("Flushing takes a held frame straight away") {
+        pending.append("\x1b[?2026hpartial");
+        auto frame = pending.take(64, now, true);
+
+        REQUIRE(frame.frame);
+        REQUIRE_FALSE(frame.timed_out);
+        REQUIRE(frame.bytes == "partial");
+    }
+    SECTION("Output keeps the resize generation it was read in") {
+        pending.append("old size", 0);
+        pending.append(" still old", 0);
+        pending.append("new size", 1);
+
+        auto before = pending.take(64, now, false);
+        REQUIRE(before.bytes == "old size still old");
+        REQUIRE(before.generation == 0);
+        auto after = pending.take(64, now, false);
+        REQUIRE(after.bytes == "new size");
+        REQUIRE(after.generation == 1);
+
+        pending.append("\x1b[?2026hold", 1);
+        pending.append(" new\x1b[?2026l", 2);
+        auto frame = pending.take(64, now, false);
+        REQUIRE(frame.bytes == "old new");
+        REQUIRE(frame.generation == 2);
+    }
+}
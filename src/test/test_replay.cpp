@@ -0,0 +1,120 @@
+#include "catch.hpp"
+#include "omux/replay.hpp"
+#include "omux/terminal_model.hpp"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+using namespace omux;
+
+TEST_CASE("Terminal model") {
+    SECTION("Text wraps at the edge and scrolls off the top") {
+        TerminalModel screen{4, 2};
+        screen.write("abcdefgh\r\nij");
+
+        REQUIRE(screen.row_text(0) == "efgh");
+        REQUIRE(screen.row_text(1) == "ij");
+        REQUIRE(screen.cursor() == std::pair{2, 1});
+    }
+    SECTION("Cursor movement and erasing") {
+        TerminalModel screen{10, 3};
+        screen.write("hello\x1b[2;3Hx\x1b[1;2H\x1b[K\x1b[3;1Hline\x1b[2D\x1b[1X");
+
+        REQUIRE(screen.row_text(0) == "h");
+        REQUIRE(screen.row_text(1) == "  x");
+        REQUIRE(screen.row_text(2) == "li e");
+    }
+    SECTION("Sequences and characters can be split between writes") {
+        TerminalModel screen{10, 2};
+        screen.write("\x1b[3");
+        screen.write("1mr\xc3");
+        screen.write("\xa9" "d\x1b]0;title\x07");
+
+        REQUIRE(screen.row_text(0) == "r\xc3\xa9" "d");
+        REQUIRE(screen.attribute_at(0, 0) == "\x1b[31m");
+    }
+    SECTION("Rows render with their attributes") {
+        TerminalModel screen{10, 2};
+        screen.write("a\x1b[31mbc\x1b[mde\x1b[44m \x1b[m");
+
+        REQUIRE(screen.render_row(0) == "a\x1b[31mbc\x1b[mde\x1b[44m \x1b[m");
+        REQUIRE(screen.render_row(1).empty());
+    }
+    SECTION("Rows render only what changes between cells") {
+        TerminalModel screen{20, 1};
+        screen.write("\x1b[1;31ma\x1b[22mb\x1b[44mc\x1b]8;;https://omux\x1b\\d\x1b]8;;\x07\x1b[0;1;32;44me");
+
+        REQUIRE(screen.render_row(0) == "\x1b[1;31ma\x1b[22mb\x1b[44mc\x1b]8;;https://omux\x1b\\d\x1b[1;32m\x1b]8;;\x1b\\e\x1b[m");
+    }
+    SECTION("Clearing blanks the screen and homes the cursor") {
+        TerminalModel screen{10, 2};
+        screen.write("\x1b[31mtext\r\nmore");
+        screen.clear();
+        screen.write("x");
+
+        REQUIRE(screen.row_text(0) == "x");
+        REQUIRE(screen.row_text(1).empty());
+        REQUIRE(screen.attribute_at(0, 0).empty());
+    }
+    SECTION("Screens that look the same hash the same") {
+        TerminalModel direct{10, 2};
+        TerminalModel redrawn{10, 2};
+        direct.write("\x1b[32mok\x1b[m");
+        redrawn.write("xx\x1b[?25l\r\x1b[32mok\x1b[0m");
+        REQUIRE(direct.screen_hash() == redrawn.screen_hash());
+
+        redrawn.write("!");
+        REQUIRE(direct.screen_hash() != redrawn.screen_hash());
+    }
+}
+
+TEST_CASE("Replaying recordings") {
+    SECTION("asciicast output and input events are read") {
+        std::stringstream cast{"{\"version\": 2, \"width\": 100, \"height\": 30}\n"
+                               "[0.5, \"o\", \"caf\\u00e9\\r\\n\"]\n"
+                               "[0.75, \"i\", \"ls\\r\"]\n"
+                               "[1.0, \"m\", \"marker\"]\n"
+                               "[1.25, \"o\", \"\\u001b[1m\\ud83d\\ude00\\\"\"]\n"};
+        auto recording = load_recording(cast);
+
+        REQUIRE(recording.width == 100);
+        REQUIRE(recording.height == 30);
+        REQUIRE(recording.frames.size() == 3);
+        REQUIRE(recording.frames[0].bytes == "caf\xc3\xa9\r\n");
+        REQUIRE(recording.frames[0].time == std::chrono::milliseconds{500});
+        REQUIRE(recording.frames[1].direction == RecordDirection::input);
+        REQUIRE(recording.frames[2].bytes == "\x1b[1m\xf0\x9f\x98\x80\"");
+    }
+    SECTION("omux recordings are read") {
+        auto path = std::filesystem::temp_directory_path() / "omux_test_replay.rec";
+        {
+            SessionRecorder recorder;
+            recorder.start(path);
+            recorder.record(3, RecordDirection::output, "hi");
+            recorder.stop();
+        }
+        std::ifstream file{path, std::ios::binary};
+        auto recording = load_recording(file);
+        file.close();
+        std::filesystem::remove(path);
+
+        REQUIRE(recording.frames.size() == 1);
+        REQUIRE(recording.frames[0].pane == 3);
+        REQUIRE(recording.frames[0].bytes == "hi");
+    }
+    SECTION("Only output is fed and counted") {
+        Recording recording;
+        recording.frames.push_back({std::chrono::microseconds{0}, 1, RecordDirection::output, "abc"});
+        recording.frames.push_back({std::chrono::microseconds{0}, 1, RecordDirection::input, "typed"});
+        recording.frames.push_back({std::chrono::microseconds{2000}, 1, RecordDirection::output, "de"});
+        TerminalModel screen{10, 1};
+
+        auto report = replay(recording, ReplayPacing::original, [&](const RecordedFrame& frame) { screen.write(frame.bytes); });
+
+        REQUIRE(report.frames == 2);
+        REQUIRE(report.bytes_in == 5);
+        REQUIRE(report.elapsed >= std::chrono::milliseconds{2});
+        REQUIRE(screen.row_text(0) == "abcde");
+    }
+}
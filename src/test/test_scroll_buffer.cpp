@@ -0,0 +1,550 @@
+#include "catch.hpp"
+#include "omux/lz_codec.hpp"
+#include "omux/memory_governor.hpp"
+#include "omux/scroll_buffer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+using namespace omux;
+
+namespace {
+    /**
+     * Keeps the spill in memory, with the same rule about not splitting data as the mapped file.
+     */
+    class MemorySpillFile : public SpillFile {
+        public:
+        static constexpr size_t SEGMENT_SIZE = 4096;
+        std::string data;
+
+        auto append(std::string_view bytes) -> size_t override {
+            auto segment_left = SEGMENT_SIZE - data.size() % SEGMENT_SIZE;
+            if(bytes.size() > segment_left && bytes.size() <= SEGMENT_SIZE) {
+                data.append(segment_left, '\0');
+            }
+            auto offset = data.size();
+            data.append(bytes);
+            return offset;
+        }
+        void write(size_t offset, std::string_view bytes) override {
+            data.replace(offset, bytes.size(), bytes);
+        }
+        auto read(size_t offset, size_t length) -> std::string_view override {
+            return std::string_view{data}.substr(offset, length);
+        }
+        [[nodiscard]] auto size() const -> size_t override {
+            return data.size();
+        }
+    };
+} // namespace
+
+TEST_CASE("Scroll buffer wrapping") {
+    SECTION("Lines are wrapped on renderable characters") {
+        ScrollBuffer buffer{10, 10};
+        buffer.append("\x1b[97mabcdef\x1b[m\n");
+
+        buffer.set_width(4);
+
+        REQUIRE(buffer.size() == 3);
+        REQUIRE(buffer.at(0) == "\x1b[97mabcd");
+        // Each row starts with the attributes it needs to be drawn on its own
+        REQUIRE(buffer.at(1) == "\x1b[97mef\x1b[m\n");
+    }
+    SECTION("Wide characters are wrapped by the columns they take") {
+        ScrollBuffer buffer{8, 10};
+        buffer.append("中文字符\n");
+        REQUIRE(buffer.size() == 2);
+
+        buffer.set_width(5);
+
+        REQUIRE(buffer.size() == 3);
+        REQUIRE(buffer.at(0) == "中文");
+        REQUIRE(buffer.at(1) == "字符\n");
+    }
+    SECTION("Attributes repeated by wrapping are dropped when rows are joined") {
+        ScrollBuffer buffer{4, 10};
+        buffer.append("\x1b[97mabcdef\x1b[m\n");
+
+        buffer.set_width(10);
+
+        REQUIRE(buffer.at(0) == "\x1b[97mabcdef\x1b[m\n");
+    }
+    SECTION("Carriage returns write over the row") {
+        ScrollBuffer buffer{4, 10};
+        buffer.append("abcdef\rxy\n");
+
+        REQUIRE(buffer.size() == 2);
+        REQUIRE(buffer.at(0) == "xycdef\n");
+    }
+    SECTION("Control sequences are measured to their final character") {
+        REQUIRE(control_sequence_length("\x1b[?25hA", 0) == 6);
+        REQUIRE(control_sequence_length("\x1b]0;title\x07" "A", 0) == 10);
+        REQUIRE(control_sequence_length("A", 0) == 0);
+    }
+}
+
+TEST_CASE("Scroll buffer rows") {
+    SECTION("Sequences that don't change the row are dropped") {
+        ScrollBuffer buffer{80, 10};
+        buffer.append("\x1b[?25h\x1b[?25lPS\x1b[?25l\x1b[?25h\x1b]0;title\x07\x1b[93m\x1b[93m>\x1b[m\x1b[90m ");
+
+        REQUIRE(buffer.at(0) == "PS\x1b[93m>\x1b[90m ");
+    }
+    SECTION("Truncating a row drops the runs after it") {
+        ScrollBuffer buffer{80, 10};
+        buffer.append("\x1b[97mabc\x1b[mdef");
+
+        buffer.truncate_back(2);
+        buffer.append_character("x");
+        REQUIRE(buffer.at(0) == "\x1b[97mabx");
+
+        buffer.truncate_back(5);
+        REQUIRE(buffer.at(0) == "\x1b[97mabx  ");
+    }
+    SECTION("Truncating counts the columns characters take") {
+        ScrollBuffer buffer{80, 10};
+        buffer.append("中文ab");
+
+        buffer.truncate_back(4);
+        buffer.append_character("x");
+        REQUIRE(buffer.at(0) == "中文x");
+
+        // Half of a wide character can't be kept
+        buffer.truncate_back(3);
+        REQUIRE(buffer.at(0) == "中 ");
+    }
+    SECTION("Writing over a row replaces whole characters by the cells they take") {
+        ScrollBuffer buffer{80, 10};
+        buffer.append("中文\rab");
+        REQUIRE(buffer.at(0) == "ab文");
+
+        // Half of a wide character written over is blanked, the attributes after it stay where they were
+        buffer.append("\r中\x1b[31m文\ra");
+        REQUIRE(buffer.at(0) == "a \x1b[31m文");
+
+        buffer.append("\rxyz");
+        REQUIRE(buffer.at(0) == "xy\x1b[31mz ");
+        buffer.append("\r中");
+        REQUIRE(buffer.at(0) == "中\x1b[31mz ");
+
+        // A mark joined onto the character written over goes with it
+        buffer.append("\re\xcc\x81" "f\rx");
+        REQUIRE(buffer.at(0) == "xf\x1b[31mz ");
+    }
+    SECTION("Attributes are stored as what they set") {
+        ScrollBuffer buffer{80, 10};
+        buffer.append("\x1b[1m\x1b[31mab\x1b[31;1mcd\x1b[39m\x1b[22mef\x1b[mgh");
+
+        // The same attributes set again are dropped, turning everything off is a reset
+        REQUIRE(buffer.at(0) == "\x1b[1;31mabcd\x1b[mefgh");
+    }
+    SECTION("Attributes the table has no room for are kept as their sequences") {
+        auto table = std::make_shared<AttributeTable>();
+        for(uint32_t color = 1; table->size() <= std::numeric_limits<AttributeId>::max(); color++) {
+            table->intern(CellAttributes{.foreground = CellAttributes::COLOR_RGB | color});
+        }
+        ScrollBuffer buffer{80, 10, table};
+        buffer.append("\x1b[38;2;255;0;0ma\x1b[1mb\x1b[0;38;2;0;0;5mc\x1b[mplain");
+
+        // After a sequence kept as it was the next attributes are set from a reset
+        REQUIRE(buffer.at(0) == "\x1b[38;2;255;0;0ma\x1b[1mb\x1b[m\x1b[38;2;0;0;5mc\x1b[mplain");
+    }
+    SECTION("Moving the cursor forward pads the row") {
+        ScrollBuffer buffer{80, 10};
+        buffer.append("ab");
+        buffer.cursor_forward(2);
+        buffer.append_character("c");
+
+        REQUIRE(buffer.at(0) == "ab  c");
+    }
+    SECTION("Sealed rows take less memory than their output") {
+        ScrollBuffer buffer{80, 10};
+        std::string line{"\x1b[?25h\x1b[?25l\x1b[93mGet-ChildItem\x1b[?25h\x1b[?25l\x1b[m \x1b[90m-Path\x1b[m C:\\\x1b[?25h\x1b[?25l\r\n"};
+        for(size_t i = 0; i < SCROLL_BUFFER_BLOCK_ROWS * 8; i++) {
+            buffer.append(line);
+        }
+
+        REQUIRE(buffer.memory_usage() < line.size() * SCROLL_BUFFER_BLOCK_ROWS * 8);
+        REQUIRE(buffer.at(0) == "\x1b[93mGet-ChildItem\x1b[m \x1b[90m-Path\x1b[m C:\\\n");
+    }
+}
+
+TEST_CASE("Scroll buffer reflow") {
+    SECTION("Soft wrapped rows are joined when the width grows") {
+        ScrollBuffer buffer{4, 10};
+        buffer.append("abcd");
+        buffer.wrap_back();
+        buffer.append("ef\n");
+
+        buffer.set_width(10);
+
+        REQUIRE(buffer.size() == 2);
+        REQUIRE(buffer.at(0) == "abcdef\n");
+    }
+    SECTION("Hard new lines are kept when the width shrinks") {
+        ScrollBuffer buffer{10, 10};
+        buffer.append("abcdef\ngh");
+
+        buffer.set_width(3);
+
+        REQUIRE(buffer.size() == 3);
+        REQUIRE(buffer.at(0) == "abc");
+        REQUIRE(buffer.at(1) == "def\n");
+        REQUIRE(buffer.at(2) == "gh");
+    }
+    SECTION("History is only reflowed when it is read") {
+        ScrollBuffer buffer{2, 2};
+        for(int i = 0; i < 1000; i++) {
+            buffer.append("abcd");
+            buffer.wrap_back();
+            buffer.append("ef\n");
+        }
+        buffer.append("end");
+        REQUIRE(buffer.stale_blocks() == 0);
+
+        buffer.set_width(6);
+        auto stale_after_resize = buffer.stale_blocks();
+        REQUIRE(stale_after_resize > 0);
+        REQUIRE(buffer.row_from_bottom(0) == "end");
+        REQUIRE(buffer.row_from_bottom(1) == "abcdef\n");
+
+        // Reading the top pulls every block up to date
+        for(size_t offset = 0; offset < buffer.size(); offset++) {
+            buffer.row_from_bottom(offset);
+        }
+        REQUIRE(buffer.stale_blocks() == 0);
+        REQUIRE(buffer.size() == 1001);
+        REQUIRE(buffer.at(0) == "abcdef\n");
+    }
+    SECTION("Reading from the top follows blocks that shrink as they are reflowed") {
+        ScrollBuffer buffer{2, 2};
+        for(int i = 0; i < 1000; i++) {
+            buffer.append("ab");
+            buffer.wrap_back();
+            buffer.append(std::to_string(i % 10) + "\n");
+        }
+        buffer.set_width(6);
+        // Each block halves, so the row asked for is in the block after the one it was in before reflowing
+        REQUIRE(buffer.at(200) == "ab0\n");
+
+        std::vector<std::string> rows;
+        for(size_t index = 0; index < buffer.size(); index++) {
+            rows.push_back(buffer.at(index));
+        }
+        REQUIRE(rows.size() == 1001);
+        for(size_t i = 0; i < 1000; i++) {
+            REQUIRE(rows[i] == "ab" + std::to_string(i % 10) + "\n");
+        }
+        REQUIRE_THROWS_AS(buffer.at(buffer.size()), std::out_of_range);
+    }
+    SECTION("Erasing past the hot rows pulls history back") {
+        ScrollBuffer buffer{80, 1};
+        for(size_t i = 0; i < SCROLL_BUFFER_BLOCK_ROWS * 2; i++) {
+            buffer.append(std::to_string(i) + "\n");
+        }
+        auto size = buffer.size();
+        buffer.erase_last(SCROLL_BUFFER_BLOCK_ROWS + 1);
+
+        REQUIRE(buffer.size() == size - SCROLL_BUFFER_BLOCK_ROWS - 1);
+        // The last row is being written again so it isn't ended any more
+        REQUIRE(buffer.row_from_bottom(0) == std::to_string(SCROLL_BUFFER_BLOCK_ROWS - 1));
+    }
+}
+
+TEST_CASE("Scroll buffer search") {
+    auto fill = [](ScrollBuffer& buffer, size_t lines) {
+        for(size_t i = 0; i < lines; i++) {
+            buffer.append("\x1b[97mline " + std::to_string(i) + "\x1b[m\r\n");
+        }
+    };
+    SECTION("Committed lines are indexed without their control sequences") {
+        ScrollBuffer buffer{80, 10};
+        fill(buffer, SCROLL_BUFFER_BLOCK_ROWS * 4);
+
+        REQUIRE(buffer.get_search_index().end_line() > 0);
+        REQUIRE(buffer.get_search_index().memory_usage() > 0);
+        REQUIRE(buffer.line_text(5) == "line 5");
+
+        SearchPattern pattern{"ne 12", false};
+        auto candidates = buffer.get_search_index().candidates(pattern);
+        REQUIRE(candidates);
+        REQUIRE(std::find(candidates->begin(), candidates->end(), 12) != candidates->end());
+        REQUIRE(std::find(candidates->begin(), candidates->end(), 13) == candidates->end());
+    }
+    SECTION("Finding steps through matches in both directions") {
+        ScrollBuffer buffer{80, 10};
+        fill(buffer, SCROLL_BUFFER_BLOCK_ROWS * 4);
+        SearchPattern pattern{"line 1[0-9]$", true};
+
+        auto match = buffer.find(pattern, buffer.line_count(), true);
+        REQUIRE(match == 19);
+        match = buffer.find(pattern, *match, true);
+        REQUIRE(match == 18);
+        match = buffer.find(pattern, *match, false);
+        REQUIRE(match == 19);
+        REQUIRE_FALSE(buffer.find(SearchPattern{"not there", false}, buffer.line_count(), true));
+        // Lines that haven't been committed yet are still found
+        REQUIRE(buffer.find(SearchPattern{"line 1023", false}, buffer.line_count(), true) == 1023);
+    }
+    SECTION("Matches can be scrolled to after a reflow") {
+        ScrollBuffer buffer{80, 10};
+        fill(buffer, SCROLL_BUFFER_BLOCK_ROWS * 4);
+        buffer.set_width(3);
+
+        auto offset = buffer.offset_of_line(100);
+        REQUIRE(strip_control_sequences(buffer.row_from_bottom(offset)) == "lin");
+        REQUIRE(strip_control_sequences(buffer.row_from_bottom(offset - 1)) == "e 1");
+        REQUIRE(strip_control_sequences(buffer.row_from_bottom(offset - 2)) == "00");
+    }
+    SECTION("The index drops the oldest lines to stay under its cap") {
+        SearchIndex index{4096};
+        for(size_t line = 0; line < 1000; line++) {
+            index.add_line(line, "some output on line " + std::to_string(line));
+        }
+
+        REQUIRE(index.memory_usage() <= 4096);
+        REQUIRE(index.first_indexed_line() > 0);
+        REQUIRE(index.end_line() == 1000);
+    }
+    SECTION("Regex patterns only narrow on the literals they require") {
+        REQUIRE(SearchPattern::required_literals("error: .* failed", true) == std::vector<std::string>{"error: ", " failed"});
+        REQUIRE(SearchPattern::required_literals("colou?r", true) == std::vector<std::string>{"colo", "r"});
+        REQUIRE(SearchPattern::required_literals("warn|error", true).empty());
+        REQUIRE(SearchPattern::required_literals("a\\.b[xyz]c", true) == std::vector<std::string>{"a.b", "c"});
+        REQUIRE(SearchPattern::required_literals("(foo)?bar", true) == std::vector<std::string>{"bar"});
+        REQUIRE(SearchPattern::required_literals("(foo)+bar", true) == std::vector<std::string>{"foo", "bar"});
+        REQUIRE(SearchPattern::required_literals("(?!foo)bar", true) == std::vector<std::string>{"bar"});
+        REQUIRE(SearchPattern::required_literals("\\x41bc", true) == std::vector<std::string>{"bc"});
+        REQUIRE(SearchPattern::required_literals("(foo", true).empty());
+    }
+    SECTION("The index never leaves out a line the regex matches") {
+        std::vector<std::string> lines{"xxbarxx", "foobar", "foo bar", "colour", "color", "a ab abc", "error: build failed", "fooo", "x"};
+        SearchIndex index{1024 * 1024};
+        for(size_t line = 0; line < lines.size(); line++) {
+            index.add_line(line, lines[line]);
+        }
+        for(const auto* expression : {"(foo)?bar", "(foo)*bar", "(foo){0,2}bar", "(?:fo(o)?)?bar", "((foo)?)bar", "(foo)?|bar", "(?!foo)bar",
+                                      "colou?r", "(ab)?c", "(a|ab)(c|bcd)", "error: .*(build )?failed", "fo{0}o", "\\x62ar"}) {
+            SearchPattern pattern{expression, true};
+            auto candidates = index.candidates(pattern);
+            for(size_t line = 0; line < lines.size(); line++) {
+                if(pattern.matches(lines[line]) && candidates) {
+                    INFO(expression << " matches " << lines[line]);
+                    REQUIRE(std::find(candidates->begin(), candidates->end(), line) != candidates->end());
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Scroll buffer compression") {
+    SECTION("The codec gets back what it was given") {
+        std::string repetitive;
+        for(int i = 0; i < 1000; i++) {
+            repetitive += "PS C:\\Users\\omux> dir " + std::to_string(i % 7) + "\n";
+        }
+        for(const auto& input : {std::string{}, std::string{"abc"}, std::string(300, 'a'), repetitive}) {
+            auto compressed = lz_compress(input);
+            REQUIRE(lz_decompress(compressed, input.size()) == input);
+        }
+        REQUIRE(lz_compress(repetitive).size() < repetitive.size() / 4);
+    }
+    SECTION("Corrupt blocks are rejected") {
+        auto compressed = lz_compress(std::string(300, 'a'));
+        REQUIRE_THROWS_AS(lz_decompress(compressed, 299), std::runtime_error);
+        REQUIRE_THROWS_AS(lz_decompress(compressed.substr(0, compressed.size() - 2), 300), std::runtime_error);
+    }
+    SECTION("Cold blocks are compressed and can still be read") {
+        ScrollBuffer buffer{80, 10};
+        for(size_t i = 0; i < SCROLL_BUFFER_BLOCK_ROWS * (SCROLL_BUFFER_WARM_BLOCKS + 4); i++) {
+            buffer.append("\x1b[97mline " + std::to_string(i) + "\x1b[m\r\n");
+        }
+        BlockCompressor::global().wait_until_idle();
+
+        REQUIRE(buffer.compressed_blocks() >= 3);
+        REQUIRE(buffer.at(0) == "\x1b[97mline 0\x1b[m\n");
+        REQUIRE(buffer.line_text(5) == "line 5");
+        REQUIRE(buffer.find(SearchPattern{"line 3$", true}, buffer.line_count(), true) == 3);
+    }
+    SECTION("Reflowed cold blocks are compressed again") {
+        ScrollBuffer buffer{80, 10};
+        for(size_t i = 0; i < SCROLL_BUFFER_BLOCK_ROWS * (SCROLL_BUFFER_WARM_BLOCKS + 4); i++) {
+            buffer.append("line " + std::to_string(i) + "\n");
+        }
+        BlockCompressor::global().wait_until_idle();
+        auto compressed = buffer.compressed_blocks();
+
+        buffer.set_width(3);
+        REQUIRE(buffer.at(0) == "lin");
+        BlockCompressor::global().wait_until_idle();
+        // Reflowing the hot rows can seal more blocks, but none of the old ones are left uncompressed
+        REQUIRE(buffer.compressed_blocks() >= compressed);
+    }
+}
+
+TEST_CASE("Scroll buffer spill") {
+    auto spilling_buffer = [](ScrollBuffer& buffer, size_t lines) {
+        buffer.set_spill([](std::string_view) { return std::make_unique<MemorySpillFile>(); }, 0);
+        for(size_t i = 0; i < lines; i++) {
+            buffer.append("\x1b[97mline " + std::to_string(i) + "\x1b[m\n");
+            // Give the compressor a chance to finish with each block before the next is sealed
+            if(i % SCROLL_BUFFER_BLOCK_ROWS == 0) {
+                BlockCompressor::global().wait_until_idle();
+            }
+        }
+    };
+    SECTION("Blocks over budget are spilled and read back") {
+        ScrollBuffer buffer{80, 10};
+        spilling_buffer(buffer, SCROLL_BUFFER_BLOCK_ROWS * (SCROLL_BUFFER_WARM_BLOCKS + 8));
+
+        REQUIRE(buffer.spilled_blocks() > 0);
+        REQUIRE(buffer.at(0) == "\x1b[97mline 0\x1b[m\n");
+        REQUIRE(buffer.line_text(300) == "line 300");
+        REQUIRE(buffer.find(SearchPattern{"line 7$", true}, buffer.line_count(), true) == 7);
+        auto offset = buffer.offset_of_line(5);
+        REQUIRE(buffer.row_from_bottom(offset) == "\x1b[97mline 5\x1b[m\n");
+    }
+    SECTION("Searches run on what the buffer held, only taking the writer's lock for spilled lines") {
+        ScrollBuffer buffer{80, 10};
+        auto lines = SCROLL_BUFFER_BLOCK_ROWS * (SCROLL_BUFFER_WARM_BLOCKS + 8);
+        spilling_buffer(buffer, lines);
+        std::mutex writer_lock;
+        SearchPattern spilled{"line 7$", true};
+        auto end = buffer.line_count();
+        std::unique_lock writing(writer_lock);
+        auto spilled_search = buffer.search(spilled, &writer_lock);
+        // The search keeps its own copy of the pattern
+        auto in_memory_search = buffer.search(SearchPattern{"line " + std::to_string(lines - 20) + "$", true}, &writer_lock);
+        // Goes on the empty line at the bottom, which the searches already took
+        buffer.append("line 7\n");
+
+        REQUIRE(in_memory_search.find(end, true) == lines - 20);
+        REQUIRE_FALSE(in_memory_search.find(lines - 20, false));
+        auto found = std::async(std::launch::async, [&] { return spilled_search.find(end, true); });
+        REQUIRE(found.wait_for(std::chrono::milliseconds(50)) == std::future_status::timeout);
+        writing.unlock();
+        REQUIRE(found.get() == 7);
+        REQUIRE(buffer.find(spilled, end - 2, false) == end - 1);
+    }
+    SECTION("Spilled blocks are reflowed in the spill") {
+        ScrollBuffer buffer{80, 10};
+        spilling_buffer(buffer, SCROLL_BUFFER_BLOCK_ROWS * (SCROLL_BUFFER_WARM_BLOCKS + 8));
+        auto rows = buffer.size();
+
+        buffer.set_width(3);
+        for(size_t offset = 0; offset < buffer.size(); offset++) {
+            buffer.row_from_bottom(offset);
+        }
+
+        REQUIRE(buffer.stale_blocks() == 0);
+        REQUIRE(buffer.size() > rows * 2);
+        REQUIRE(buffer.at(0) == "\x1b[97mlin");
+        REQUIRE(buffer.at(1) == "\x1b[97me 0\x1b[m\n");
+    }
+    SECTION("Reflowing spilled blocks again and again reuses their space") {
+        ScrollBuffer buffer{80, 10};
+        MemorySpillFile* data = nullptr;
+        buffer.set_spill([&](std::string_view name) {
+            auto file = std::make_unique<MemorySpillFile>();
+            if(name == "data") {
+                data = file.get();
+            }
+            return file;
+        }, 0);
+        for(size_t i = 0; i < SCROLL_BUFFER_BLOCK_ROWS * (SCROLL_BUFFER_WARM_BLOCKS + 8); i++) {
+            buffer.append("\x1b[97mline " + std::to_string(i) + "\x1b[m\n");
+            if(i % SCROLL_BUFFER_BLOCK_ROWS == 0) {
+                BlockCompressor::global().wait_until_idle();
+            }
+        }
+        REQUIRE(data != nullptr);
+        auto read_everything = [&]() {
+            for(size_t offset = 0; offset < buffer.size(); offset++) {
+                buffer.row_from_bottom(offset);
+            }
+        };
+        std::vector<size_t> sizes;
+        for(int resize = 0; resize < 10; resize++) {
+            buffer.set_width(resize % 2 == 0 ? 3 : 80);
+            read_everything();
+            sizes.push_back(data->size());
+        }
+        // Once the narrow and wide copies have both been written the file stops growing
+        REQUIRE(sizes.back() == sizes[2]);
+        REQUIRE(buffer.at(0) == "\x1b[97mline 0\x1b[m\n");
+    }
+    SECTION("Erasing pulls blocks back out of the spill") {
+        ScrollBuffer buffer{80, 10};
+        spilling_buffer(buffer, SCROLL_BUFFER_BLOCK_ROWS * (SCROLL_BUFFER_WARM_BLOCKS + 4));
+        auto spilled = buffer.spilled_blocks();
+        REQUIRE(spilled > 0);
+
+        buffer.erase_last(buffer.size() - SCROLL_BUFFER_BLOCK_ROWS / 2);
+
+        REQUIRE(buffer.spilled_blocks() < spilled);
+        REQUIRE(buffer.line_count() == SCROLL_BUFFER_BLOCK_ROWS / 2);
+        REQUIRE(buffer.row_from_bottom(0) == "\x1b[97mline " + std::to_string(SCROLL_BUFFER_BLOCK_ROWS / 2 - 1) + "\x1b[m");
+    }
+}
+
+TEST_CASE("Memory governor") {
+    auto usage = [](size_t bytes) { return std::make_shared<std::atomic<size_t>>(bytes); };
+    SECTION("The least recently viewed pane is trimmed first") {
+        MemoryGovernor governor{1000};
+        auto older_bytes = usage(600);
+        auto newer_bytes = usage(600);
+        auto older = governor.add_pane(older_bytes);
+        auto newer = governor.add_pane(newer_bytes);
+        older->viewed();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        newer->viewed();
+
+        governor.rebalance();
+
+        REQUIRE(governor.total_bytes() == 1200);
+        REQUIRE(newer->get_budget() == 1000);
+        REQUIRE_FALSE(newer->take_trim_request());
+        REQUIRE(older->get_budget() == 400);
+        REQUIRE(older->take_trim_request());
+        REQUIRE_FALSE(older->take_trim_request());
+
+        older->viewed();
+        governor.rebalance();
+
+        REQUIRE(older->get_budget() == 1000);
+        REQUIRE(newer->get_budget() == 400);
+        REQUIRE(newer->take_trim_request());
+    }
+    SECTION("Dropped panes stop counting against the budget") {
+        MemoryGovernor governor{1000};
+        auto kept_bytes = usage(600);
+        auto kept = governor.add_pane(kept_bytes);
+        governor.add_pane(usage(5000)).reset();
+
+        governor.rebalance();
+
+        REQUIRE(governor.total_bytes() == 600);
+        REQUIRE_FALSE(kept->take_trim_request());
+    }
+    SECTION("Shrinking a buffer's budget spills its history") {
+        ScrollBuffer buffer{80, 10};
+        buffer.set_spill([](std::string_view) { return std::make_unique<MemorySpillFile>(); }, SCROLL_BUFFER_MEMORY_BUDGET);
+        for(size_t i = 0; i < SCROLL_BUFFER_BLOCK_ROWS * (SCROLL_BUFFER_WARM_BLOCKS + 4); i++) {
+            buffer.append("line " + std::to_string(i) + "\n");
+        }
+        BlockCompressor::global().wait_until_idle();
+        REQUIRE(buffer.spilled_blocks() == 0);
+        auto bytes = buffer.get_block_bytes()->load();
+
+        buffer.set_memory_budget(0);
+
+        REQUIRE(buffer.spilled_blocks() > 0);
+        REQUIRE(buffer.get_block_bytes()->load() < bytes);
+        REQUIRE(buffer.line_text(0) == "line 0");
+    }
+}
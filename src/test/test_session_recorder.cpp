@@ -0,0 +1,114 @@
+#include "catch.hpp"
+#include "omux/session_recorder.hpp"
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace omux;
+
+namespace {
+    auto read_recording(const std::filesystem::path& path) -> std::vector<RecordedFrame> {
+        std::ifstream recording{path, std::ios::binary};
+        return SessionRecorder::read_frames(recording);
+    }
+} // namespace
+
+TEST_CASE("Session recorder") {
+    auto path = std::filesystem::temp_directory_path() / "omux_test_session.rec";
+    SECTION("Nothing is recorded until it is started") {
+        SessionRecorder recorder;
+        REQUIRE_FALSE(recorder.enabled());
+        recorder.record(1, RecordDirection::output, "ignored");
+        recorder.stop();
+    }
+    SECTION("Frames are read back in the order they were recorded") {
+        SessionRecorder recorder;
+        recorder.start(path);
+        recorder.record(1, RecordDirection::output, "hello\r\n");
+        recorder.record(2, RecordDirection::input, "ls\r");
+        recorder.record(1, RecordDirection::host, std::string{"\0\x1b[1G", 5});
+        recorder.stop();
+
+        auto frames = read_recording(path);
+        REQUIRE(frames.size() == 3);
+        REQUIRE(frames[0].pane == 1);
+        REQUIRE(frames[0].direction == RecordDirection::output);
+        REQUIRE(frames[0].bytes == "hello\r\n");
+        REQUIRE(frames[1].pane == 2);
+        REQUIRE(frames[1].direction == RecordDirection::input);
+        REQUIRE(frames[2].bytes == std::string{"\0\x1b[1G", 5});
+        REQUIRE(frames[0].time <= frames[1].time);
+        REQUIRE(frames[1].time <= frames[2].time);
+        REQUIRE_FALSE(recorder.write_error());
+    }
+    SECTION("Starting again begins an empty recording") {
+        SessionRecorder recorder;
+        recorder.start(path);
+        recorder.record(1, RecordDirection::output, "first");
+        recorder.start(path);
+        recorder.record(1, RecordDirection::output, "second");
+        recorder.stop();
+
+        auto frames = read_recording(path);
+        REQUIRE(frames.size() == 1);
+        REQUIRE(frames[0].bytes == "second");
+    }
+    SECTION("Every thread's frames are kept") {
+        SessionRecorder recorder;
+        recorder.start(path);
+        std::vector<std::thread> panes;
+        for(unsigned int pane = 0; pane < 4; pane++) {
+            panes.emplace_back([&recorder, pane]() {
+                for(int i = 0; i < 1000; i++) {
+                    recorder.record(pane, RecordDirection::output, std::to_string(i));
+                }
+            });
+        }
+        for(auto& pane : panes) {
+            pane.join();
+        }
+        recorder.stop();
+
+        auto frames = read_recording(path);
+        REQUIRE(frames.size() == 4000);
+        std::vector<int> next(4, 0);
+        for(const auto& frame : frames) {
+            REQUIRE(frame.bytes == std::to_string(next[frame.pane]++));
+        }
+    }
+    SECTION("Recordings are rotated by size") {
+        SessionRecorder recorder;
+        recorder.start(path, 1024);
+        for(int i = 0; i < 100; i++) {
+            recorder.record(1, RecordDirection::output, std::string(100, 'x'));
+        }
+        recorder.stop();
+
+        auto rotated = path;
+        rotated += ".1";
+        REQUIRE(std::filesystem::exists(rotated));
+        REQUIRE(std::filesystem::file_size(path) <= 1024);
+        REQUIRE_FALSE(read_recording(path).empty());
+        REQUIRE_FALSE(read_recording(rotated).empty());
+    }
+    SECTION("A truncated recording stops at the last whole frame") {
+        SessionRecorder recorder;
+        recorder.start(path);
+        recorder.record(1, RecordDirection::output, "first");
+        recorder.record(1, RecordDirection::output, "second");
+        recorder.stop();
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) - 2);
+
+        auto frames = read_recording(path);
+        REQUIRE(frames.size() == 1);
+        REQUIRE(frames[0].bytes == "first");
+    }
+    std::filesystem::remove(path);
+    for(size_t number = 1; number <= SESSION_RECORDER_KEPT_FILES; number++) {
+        auto rotated = path;
+        rotated += "." + std::to_string(number);
+        std::filesystem::remove(rotated);
+    }
+}
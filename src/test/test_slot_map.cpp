@@ -0,0 +1,50 @@
+#include "catch.hpp"
+#include "omux/slot_map.hpp"
+#include <string>
+
+using namespace omux;
+
+TEST_CASE("Slot map") {
+    SlotMap<std::string> values;
+    auto first = values.insert("first");
+    auto second = values.insert("second");
+    auto third = values.insert("third");
+
+    SECTION("Values are found by their handles") {
+        REQUIRE(values.size() == 3);
+        REQUIRE(*values.get(first) == "first");
+        REQUIRE(*values.get(second) == "second");
+        REQUIRE(*values.get(third) == "third");
+        REQUIRE(values.get(SlotHandle{}) == nullptr);
+    }
+    SECTION("Erasing keeps the other handles working") {
+        REQUIRE(values.erase(first));
+
+        REQUIRE(values.size() == 2);
+        REQUIRE(values.get(first) == nullptr);
+        REQUIRE(*values.get(second) == "second");
+        REQUIRE(*values.get(third) == "third");
+        REQUIRE_FALSE(values.erase(first));
+    }
+    SECTION("Stale handles don't match a reused slot") {
+        values.erase(second);
+        auto reused = values.insert("reused");
+
+        REQUIRE(reused.index == second.index);
+        REQUIRE(values.get(second) == nullptr);
+        REQUIRE_FALSE(values.contains(second));
+        REQUIRE(*values.get(reused) == "reused");
+    }
+    SECTION("Iterating visits every value and handle_at gives back its handle") {
+        values.erase(second);
+        size_t visited = 0;
+        for(size_t position = 0; position < values.size(); position++) {
+            auto handle = values.handle_at(position);
+            REQUIRE(values.get(handle) == &*(values.begin() + static_cast<std::ptrdiff_t>(position)));
+            REQUIRE(values.position_of(handle) == position);
+            visited++;
+        }
+        REQUIRE(visited == 2);
+        REQUIRE_FALSE(values.position_of(second));
+    }
+}
@@ -0,0 +1,56 @@
+#include "catch.hpp"
+#include "omux/unicode_width.hpp"
+#include <string>
+
+using namespace omux;
+
+TEST_CASE("Unicode width") {
+    SECTION("Characters take the columns the terminal gives them") {
+        REQUIRE(codepoint_width(U'a') == 1);
+        REQUIRE(codepoint_width(U'\t') == 0);
+        REQUIRE(codepoint_width(U'─') == 1);
+        REQUIRE(codepoint_width(U'中') == 2);
+        REQUIRE(codepoint_width(U'ｱ') == 1);
+        REQUIRE(codepoint_width(U'Ａ') == 2);
+        REQUIRE(codepoint_width(U'\U0001f600') == 2);
+        REQUIRE(codepoint_width(U'́') == 0);
+        REQUIRE(codepoint_width(U'​') == 0);
+        REQUIRE(codepoint_width(U'\U00020000') == 2);
+    }
+    SECTION("Text is measured in columns") {
+        REQUIRE(text_columns("plain") == 5);
+        REQUIRE(text_columns("中文ab") == 6);
+        REQUIRE(text_columns("e\xcc\x81") == 1);
+        REQUIRE(text_columns("\xff") == 1);
+    }
+    SECTION("Columns are found in text") {
+        REQUIRE(column_offset("中文ab", 2) == std::pair<size_t, size_t>{3, 0});
+        REQUIRE(column_offset("中文ab", 3) == std::pair<size_t, size_t>{3, 1});
+        REQUIRE(column_offset("中文ab", 5) == std::pair<size_t, size_t>{7, 0});
+        REQUIRE(column_offset("ab", 4) == std::pair<size_t, size_t>{2, 2});
+        // A combining mark stays with the character before it
+        REQUIRE(column_offset("e\xcc\x81x", 1) == std::pair<size_t, size_t>{3, 0});
+    }
+    SECTION("Characters split between reads are decoded whole") {
+        Utf8Decoder decoder;
+        std::string text{"a中\xf0\x9f\x98\x80"};
+        std::u32string decoded;
+        for(auto byte : text) {
+            if(auto character = decoder.feed(byte)) {
+                decoded.push_back(*character);
+            }
+        }
+
+        REQUIRE(decoded == U"a中\U0001f600");
+        REQUIRE(decoder.bytes() == "\xf0\x9f\x98\x80");
+        REQUIRE_FALSE(decoder.in_sequence());
+    }
+    SECTION("Broken characters don't hold up what comes after") {
+        Utf8Decoder decoder;
+        REQUIRE_FALSE(decoder.feed('\xe4'));
+        REQUIRE(decoder.in_sequence());
+        REQUIRE(decoder.feed('a') == U'a');
+        REQUIRE(decoder.feed('\x80') == U'�');
+        REQUIRE(decoder.bytes() == "\xef\xbf\xbd");
+    }
+}
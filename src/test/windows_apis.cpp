@@ -35,7 +35,7 @@ TEST_CASE("Windows API"){
         REQUIRE(win_process->process_info.dwProcessId > 0);
 
         win_process->wait_for_stop(1000);
-        pseudo_console->read_output().wait();
+        pseudo_console->next_output({}, std::chrono::milliseconds(1000));
         auto output = pseudo_console->latest_output();
         REQUIRE(output.size() > 0);
         REQUIRE(output.find("127.0.0.1") != std::string::npos);
@@ -47,7 +47,7 @@ TEST_CASE("Windows API"){
         auto win_process = Alias::NewProcess(pseudo_console.get(), L"ping -4 -n 1 google.com");
 
         win_process->wait_for_stop(1000);
-        pseudo_console->read_output();
+        pseudo_console->next_output({}, std::chrono::milliseconds(1000));
         auto output = pseudo_console->latest_output();
         REQUIRE(output.find("\x1b[20;15H") != std::string::npos);
         //std::wcout << output.data() << std::endl;
@@ -73,7 +73,7 @@ TEST_CASE("Win Input"){
         std::string input{ "echo Hello\n" };
 
         win_process->wait_for_stop(1000); // Use this to ensure the process actually starts
-        auto output = pseudo_console->read_output().get();
+        auto output = pseudo_console->next_output({}, std::chrono::milliseconds(1000)).value_or("");
         //auto buffer = pseudo_console->get_scroll_buffer();
         REQUIRE(output.find("PS") != std::string::npos);
 
@@ -81,8 +81,7 @@ TEST_CASE("Win Input"){
         pseudo_console->write_input(input);
         win_process->wait_for_stop(500); // Use this to ensure the input goes through
 
-        REQUIRE(pseudo_console->bytes_in_read_pipe() > 0); // Use this to abort the test if the read is going to hang
-        pseudo_console->read_output();
+        REQUIRE(pseudo_console->next_output({}, std::chrono::milliseconds(1000)));
 
         REQUIRE(pseudo_console->latest_output().find("Hello") != std::string::npos);
 
@@ -104,17 +103,17 @@ TEST_CASE("Primary console"){
         WriteFile(write_pipe, input.data(), input.size()*sizeof(char), nullptr, nullptr);
 
         Alias::MainConsole console;
-        auto read_input = console.read_input_from_console();
-        read_input.wait();
-        REQUIRE_THAT(read_input.get(), CM::Contains("he\n"));
+        auto read_input = console.next_input({}, std::chrono::milliseconds(1000));
+        REQUIRE(read_input);
+        REQUIRE_THAT(*read_input, CM::Contains("he\n"));
     }
     SECTION("Read input can be destroyed and not block exit"){
         
         auto now = std::chrono::steady_clock::now();
         Alias::MainConsole console;
-        auto read_input = console.read_input_from_console();
-        read_input.wait_for(std::chrono::milliseconds(100));
+        console.next_input({}, std::chrono::milliseconds(100));
         console.cancel_io();
+        REQUIRE(console.input_finished());
 
         auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - now);
         REQUIRE(duration.count() < 500);
@@ -215,9 +214,25 @@ TEST_CASE("Re-binding stdin to fstreams"){
 TEST_CASE("Interrupting read file calls") {
     auto pseudo_console = Alias::CreatePseudoConsole(0, 0, 130, 20);
     
-    auto read_future = pseudo_console->read_output();
-    read_future.wait_for(std::chrono::microseconds(10));
+    // Starts the reader, which is then left blocked in ReadFile
+    pseudo_console->next_output({}, std::chrono::milliseconds(0));
+    auto now = std::chrono::steady_clock::now();
     pseudo_console->close_pipes();
-    auto wait_result = read_future.wait_for(std::chrono::milliseconds(5000));
-    REQUIRE(wait_result != std::future_status::timeout);
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - now);
+    REQUIRE(pseudo_console->output_finished());
+    REQUIRE(duration.count() < 50);
+}
+TEST_CASE("Waiting for output stops when asked") {
+    auto pseudo_console = Alias::CreatePseudoConsole(0, 0, 130, 20);
+    // The pseudo console can write a few setup sequences of its own
+    while(pseudo_console->next_output({}, std::chrono::milliseconds(100))) {
+    }
+
+    std::stop_source stop;
+    auto now = std::chrono::steady_clock::now();
+    std::jthread stopper([&]() { stop.request_stop(); });
+    // Nothing is written, so only the stop ends the wait
+    REQUIRE_FALSE(pseudo_console->next_output(stop.get_token(), std::chrono::milliseconds(5000)));
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - now);
+    REQUIRE(duration.count() < 1000);
 }
\ No newline at end of file